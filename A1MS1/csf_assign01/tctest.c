@@ -22,10 +22,49 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 #include "tctest.h"
 
+#ifdef TCTEST_WRAP_ALLOC
+/*
+ * The program is linked with --wrap for the allocator functions, so
+ * its calls to malloc go to __wrap_malloc, and __real_malloc is the C
+ * library's. The harness uses the real ones, so it isn't counted.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void __real_free(void *p);
+
+#define tctest_malloc __real_malloc
+#define tctest_calloc __real_calloc
+#define tctest_realloc __real_realloc
+#define tctest_free __real_free
+#else
+#define tctest_malloc malloc
+#define tctest_calloc calloc
+#define tctest_realloc realloc
+#define tctest_free free
+#endif
+
 typedef struct {
 	int signum;
 	const char *msg;
@@ -48,6 +87,16 @@ int tctest_num_executed;
 const char *tctest_testname_to_execute;
 void (*tctest_on_test_executed)(const char *testname, int passed);
 void (*tctest_on_complete)(int num_passed, int num_executed);
+int tctest_bench_mode;
+const char *tctest_json_file;
+unsigned tctest_bench_samples = 30;
+double tctest_bench_time = 0.3;
+const char *tctest_baseline_file;
+double tctest_threshold = 10.0;
+unsigned tctest_jobs;
+double tctest_timeout = 60.0;
+int tctest_show_allocs;
+int tctest_bench_counters;
 
 /*
  * Special version of write to work around the fact that
@@ -138,3 +187,1059 @@ void tctest_register_signal_handlers(void) {
 		sigaction(tctest_signal_list[i].signum, &sa, NULL);
 	}
 }
+
+/*
+ * Allocation counting
+ */
+
+static atomic_uint_fast64_t tctest_num_allocs;
+static atomic_uint_fast64_t tctest_num_alloc_bytes;
+static atomic_uint_fast64_t tctest_num_frees;
+
+/* counts when the current test function started */
+static uint64_t tctest_mark_allocs, tctest_mark_bytes, tctest_mark_frees;
+
+#ifdef TCTEST_WRAP_ALLOC
+static void tctest_count_alloc(size_t size) {
+	atomic_fetch_add_explicit(&tctest_num_allocs, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&tctest_num_alloc_bytes, size, memory_order_relaxed);
+}
+
+void *__wrap_malloc(size_t size) {
+	void *p = __real_malloc(size);
+	if (p) {
+		tctest_count_alloc(size);
+	}
+	return p;
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+	void *p = __real_calloc(n, size);
+	if (p) {
+		tctest_count_alloc(n * size);
+	}
+	return p;
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+	void *q = __real_realloc(p, size);
+	if (q && size > 0) {
+		tctest_count_alloc(size);
+	}
+	return q;
+}
+
+void __wrap_free(void *p) {
+	if (p) {
+		atomic_fetch_add_explicit(&tctest_num_frees, 1, memory_order_relaxed);
+	}
+	__real_free(p);
+}
+
+int tctest_alloc_tracking(void) {
+	return 1;
+}
+#else
+int tctest_alloc_tracking(void) {
+	return 0;
+}
+#endif
+
+uint64_t tctest_alloc_count(void) {
+	return atomic_load_explicit(&tctest_num_allocs, memory_order_relaxed);
+}
+
+uint64_t tctest_alloc_bytes(void) {
+	return atomic_load_explicit(&tctest_num_alloc_bytes, memory_order_relaxed);
+}
+
+static uint64_t tctest_free_count(void) {
+	return atomic_load_explicit(&tctest_num_frees, memory_order_relaxed);
+}
+
+void tctest_alloc_mark(void) {
+	tctest_mark_allocs = tctest_alloc_count();
+	tctest_mark_bytes = tctest_alloc_bytes();
+	tctest_mark_frees = tctest_free_count();
+}
+
+void tctest_print_passed(void) {
+	if (tctest_show_allocs && tctest_alloc_tracking()) {
+		printf("passed! (%llu allocation(s), %llu bytes, %llu free(s))\n",
+		       (unsigned long long) (tctest_alloc_count() - tctest_mark_allocs),
+		       (unsigned long long) (tctest_alloc_bytes() - tctest_mark_bytes),
+		       (unsigned long long) (tctest_free_count() - tctest_mark_frees));
+	} else if (tctest_show_allocs) {
+		printf("passed! (allocations aren't counted)\n");
+	} else {
+		printf("passed!\n");
+	}
+}
+
+static int tctest_read_baseline(const char *filename);
+
+int tctest_should_run(const char *name) {
+	return !tctest_testname_to_execute || strcmp(tctest_testname_to_execute, name) == 0;
+}
+
+int tctest_parse_args(int argc, char **argv) {
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (strcmp(arg, "--bench") == 0) {
+			tctest_bench_mode = 1;
+		} else if (strcmp(arg, "--json") == 0 && i + 1 < argc) {
+			tctest_json_file = argv[++i];
+		} else if (strcmp(arg, "--samples") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+			tctest_bench_samples = (unsigned) atoi(argv[++i]);
+		} else if (strcmp(arg, "--bench-time") == 0 && i + 1 < argc && strtod(argv[i + 1], NULL) > 0) {
+			tctest_bench_time = strtod(argv[++i], NULL);
+		} else if (strcmp(arg, "--baseline") == 0 && i + 1 < argc) {
+			tctest_baseline_file = argv[++i];
+		} else if (strcmp(arg, "--threshold") == 0 && i + 1 < argc && strtod(argv[i + 1], NULL) >= 0) {
+			tctest_threshold = strtod(argv[++i], NULL);
+		} else if (strcmp(arg, "--counters") == 0) {
+			tctest_bench_counters = 1;
+		} else if (strcmp(arg, "--allocs") == 0) {
+			tctest_show_allocs = 1;
+		} else if (strcmp(arg, "-j") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+			tctest_jobs = (unsigned) atoi(argv[++i]);
+		} else if (strcmp(arg, "--timeout") == 0 && i + 1 < argc && strtod(argv[i + 1], NULL) >= 0) {
+			tctest_timeout = strtod(argv[++i], NULL);
+		} else if (arg[0] != '-' && !tctest_testname_to_execute) {
+			tctest_testname_to_execute = arg;
+		} else {
+			fprintf(stderr, "Usage: %s [--bench] [--json file] [--samples N] "
+			        "[--bench-time seconds] [--counters]\n       [--baseline file] [--threshold percent] "
+			        "[--allocs] [-j N] [--timeout seconds] [test]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (tctest_baseline_file && tctest_read_baseline(tctest_baseline_file) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Benchmark timing
+ */
+
+/* hardware counters, counted per benchmark iteration */
+enum {
+	TCTEST_CYCLES, TCTEST_INSTRUCTIONS, TCTEST_L1D_MISSES, TCTEST_LLC_MISSES,
+	TCTEST_BRANCH_MISSES, TCTEST_DTLB_MISSES, TCTEST_NUM_COUNTERS
+};
+
+static const char *const tctest_counter_names[TCTEST_NUM_COUNTERS] = {
+	"cycles", "instructions", "L1d misses", "LLC misses", "branch misses", "dTLB misses"
+};
+static const char *const tctest_counter_keys[TCTEST_NUM_COUNTERS] = {
+	"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses"
+};
+
+typedef struct {
+	char name[128];
+	uint64_t iters;           /* iterations per sample */
+	unsigned num_samples;
+	double *samples;          /* ns per iteration, sorted when done */
+	double median, p99, min, mean;
+	uint64_t allocs, alloc_bytes;  /* made while sampling */
+	double counters[TCTEST_NUM_COUNTERS];  /* per iteration, or -1 if not counted */
+} tctest_bench_result;
+
+enum { TCTEST_CALIBRATING, TCTEST_WARMUP, TCTEST_SAMPLING };
+
+static struct {
+	tctest_bench_result cur;
+	int phase;
+	uint64_t start;
+	uint64_t paused;          /* when the timer was paused, or 0 */
+	uint64_t mark_allocs, mark_bytes;  /* counts when the timer was (re)started */
+} tctest_bench;
+
+static tctest_bench_result *tctest_results;
+static unsigned tctest_num_results;
+static unsigned tctest_results_capacity;
+
+/* results read from the baseline file (only names and samples) */
+static tctest_bench_result *tctest_baseline;
+static unsigned tctest_num_baseline;
+
+/* nanoseconds per tick of tctest_ticks (0 until calibrated) */
+static double tctest_ns_per_tick;
+
+static uint64_t tctest_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+ * The time stamp counter, read with rdtscp so that it isn't read
+ * before the code being timed has finished.
+ */
+static uint64_t tctest_ticks(void) {
+	unsigned aux;
+	return __rdtscp(&aux);
+}
+
+/* Measure the counter's rate against the monotonic clock. */
+static void tctest_calibrate_ticks(void) {
+	uint64_t t0 = tctest_now_ns(), c0 = tctest_ticks();
+	uint64_t t1, c1;
+	do {
+		t1 = tctest_now_ns();
+		c1 = tctest_ticks();
+	} while (t1 - t0 < 20000000U);
+	tctest_ns_per_tick = c1 > c0 ? (double) (t1 - t0) / (double) (c1 - c0) : 1.0;
+}
+#else
+static uint64_t tctest_ticks(void) {
+	return tctest_now_ns();
+}
+
+static void tctest_calibrate_ticks(void) {
+	tctest_ns_per_tick = 1.0;
+}
+#endif
+
+/*
+ * The counters are opened for the benchmarking thread when the first
+ * benchmark starts, and only run while a benchmark is sampling (and
+ * not paused). Each one that can't be opened (the CPU or a container
+ * may not provide it, or perf_event_paranoid may forbid it) is left
+ * out. The kernel may multiplex them if there are more than the CPU
+ * can count at once, so their counts are scaled by the time each was
+ * actually counting.
+ */
+static int tctest_counter_fds[TCTEST_NUM_COUNTERS];
+static int tctest_num_counter_fds = -1;   /* -1 until opened */
+
+#ifdef __linux__
+static void tctest_counters_open(void) {
+	static const struct {
+		uint32_t type;
+		uint64_t config;
+	} events[TCTEST_NUM_COUNTERS] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		                      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		                      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	};
+	int i, first_errno = 0;
+
+	tctest_num_counter_fds = 0;
+	for (i = 0; i < TCTEST_NUM_COUNTERS; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		tctest_counter_fds[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (tctest_counter_fds[i] >= 0) {
+			tctest_num_counter_fds++;
+		} else if (!first_errno) {
+			first_errno = errno;
+		}
+	}
+	if (tctest_num_counter_fds == 0) {
+		printf("(hardware counters unavailable: %s)\n", strerror(first_errno));
+	}
+}
+
+static void tctest_counters_ioctl(unsigned long request) {
+	int i;
+	for (i = 0; i < TCTEST_NUM_COUNTERS; i++) {
+		if (tctest_counter_fds[i] >= 0) {
+			ioctl(tctest_counter_fds[i], request, 0);
+		}
+	}
+}
+
+static void tctest_counters_enable(void) {
+	tctest_counters_ioctl(PERF_EVENT_IOC_ENABLE);
+}
+
+static void tctest_counters_disable(void) {
+	tctest_counters_ioctl(PERF_EVENT_IOC_DISABLE);
+}
+
+static void tctest_counters_reset(void) {
+	tctest_counters_ioctl(PERF_EVENT_IOC_RESET);
+}
+
+/* Read the counts per iteration, over ops iterations. */
+static void tctest_counters_read(double *per_op, double ops) {
+	int i;
+	for (i = 0; i < TCTEST_NUM_COUNTERS; i++) {
+		uint64_t v[3];   /* value, time enabled, time running */
+		per_op[i] = -1.0;
+		if (tctest_counter_fds[i] >= 0
+		    && read(tctest_counter_fds[i], v, sizeof(v)) == (ssize_t) sizeof(v) && v[2] > 0) {
+			per_op[i] = (double) v[0] * ((double) v[1] / (double) v[2]) / ops;
+		}
+	}
+}
+
+static void tctest_counters_close(void) {
+	int i;
+	for (i = 0; i < TCTEST_NUM_COUNTERS && tctest_num_counter_fds >= 0; i++) {
+		if (tctest_counter_fds[i] >= 0) {
+			close(tctest_counter_fds[i]);
+		}
+	}
+	tctest_num_counter_fds = -1;
+}
+#else
+static void tctest_counters_open(void) {
+	tctest_num_counter_fds = 0;
+	printf("(hardware counters unavailable on this system)\n");
+}
+
+static void tctest_counters_enable(void) {
+}
+
+static void tctest_counters_disable(void) {
+}
+
+static void tctest_counters_reset(void) {
+}
+
+static void tctest_counters_read(double *per_op, double ops) {
+	int i;
+	(void) ops;
+	for (i = 0; i < TCTEST_NUM_COUNTERS; i++) {
+		per_op[i] = -1.0;
+	}
+}
+
+static void tctest_counters_close(void) {
+	tctest_num_counter_fds = -1;
+}
+#endif
+
+/* 1 if counters are being collected */
+static int tctest_counting(void) {
+	return tctest_bench_counters && tctest_num_counter_fds > 0;
+}
+
+/* Add the allocations since the timer was (re)started to the benchmark's. */
+static void tctest_bench_count_allocs(void) {
+	tctest_bench.cur.allocs += tctest_alloc_count() - tctest_bench.mark_allocs;
+	tctest_bench.cur.alloc_bytes += tctest_alloc_bytes() - tctest_bench.mark_bytes;
+}
+
+static void tctest_bench_mark_allocs(void) {
+	tctest_bench.mark_allocs = tctest_alloc_count();
+	tctest_bench.mark_bytes = tctest_alloc_bytes();
+}
+
+static int tctest_compare_doubles(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+	return x < y ? -1 : x > y;
+}
+
+uint64_t tctest_bench_begin(const char *name, long arg, int has_arg) {
+	tctest_bench_result *r = &tctest_bench.cur;
+
+	if (tctest_ns_per_tick == 0.0) {
+		tctest_calibrate_ticks();
+	}
+	if (tctest_bench_counters && tctest_num_counter_fds < 0) {
+		tctest_counters_open();
+	}
+	if (has_arg) {
+		snprintf(r->name, sizeof(r->name), "%s/%ld", name, arg);
+	} else {
+		snprintf(r->name, sizeof(r->name), "%s", name);
+	}
+	r->iters = 1;
+	r->num_samples = 0;
+	r->allocs = r->alloc_bytes = 0;
+	r->samples = (double *) tctest_malloc(tctest_bench_samples * sizeof(double));
+	if (!r->samples) {
+		FAIL("out of memory");
+	}
+	printf("%s...", r->name);
+	fflush(stdout);
+
+	tctest_bench.phase = TCTEST_CALIBRATING;
+	tctest_bench.paused = 0;
+	tctest_bench_mark_allocs();
+	tctest_bench.start = tctest_ticks();
+	return r->iters;
+}
+
+typedef struct {
+	double value;
+	int current;              /* 1 if from the current run, 0 if from the baseline */
+} tctest_ranked;
+
+static int tctest_compare_ranked(const void *a, const void *b) {
+	return tctest_compare_doubles(&((const tctest_ranked *) a)->value,
+	                              &((const tctest_ranked *) b)->value);
+}
+
+/*
+ * The z score of the Mann-Whitney U statistic of the current samples
+ * against the baseline's (large when the current ones tend to be
+ * larger), using the normal approximation with the correction for
+ * ties.
+ */
+static double tctest_mann_whitney_z(const double *base, unsigned n1, const double *cur, unsigned n2) {
+	unsigned n = n1 + n2, i, j;
+	tctest_ranked *all = (tctest_ranked *) tctest_malloc(n * sizeof(tctest_ranked));
+	double rank_sum = 0.0, ties = 0.0, u, mean, var;
+
+	if (!all) {
+		return 0.0;
+	}
+	for (i = 0; i < n1; i++) {
+		all[i].value = base[i];
+		all[i].current = 0;
+	}
+	for (i = 0; i < n2; i++) {
+		all[n1 + i].value = cur[i];
+		all[n1 + i].current = 1;
+	}
+	qsort(all, n, sizeof(tctest_ranked), tctest_compare_ranked);
+
+	/* ranks are 1-based, and tied values share their average rank */
+	for (i = 0; i < n; i = j) {
+		double t, rank;
+		for (j = i + 1; j < n && all[j].value == all[i].value; j++) {
+		}
+		t = j - i;
+		rank = (i + 1 + j) / 2.0;
+		for (; i < j; i++) {
+			if (all[i].current) {
+				rank_sum += rank;
+			}
+		}
+		ties += t * t * t - t;
+	}
+	tctest_free(all);
+
+	u = rank_sum - n2 * (n2 + 1) / 2.0;
+	mean = n1 * (double) n2 / 2.0;
+	var = n1 * (double) n2 / 12.0 * ((n + 1) - ties / ((double) n * (n - 1)));
+	if (var <= 0.0) {
+		return 0.0;
+	}
+	/* with the continuity correction */
+	return (u - mean - 0.5) / sqrt(var);
+}
+
+/*
+ * Compare a finished benchmark with its baseline, printing the
+ * change; a significant slowdown past the threshold counts as a
+ * failure.
+ */
+static void tctest_compare_baseline(const tctest_bench_result *r) {
+	const tctest_bench_result *base = NULL;
+	unsigned i;
+	double change, z;
+
+	for (i = 0; i < tctest_num_baseline; i++) {
+		if (strcmp(tctest_baseline[i].name, r->name) == 0) {
+			base = &tctest_baseline[i];
+		}
+	}
+	if (!base) {
+		printf(", not in baseline");
+		return;
+	}
+	change = 100.0 * (r->median / base->median - 1.0);
+	z = tctest_mann_whitney_z(base->samples, base->num_samples, r->samples, r->num_samples);
+	printf(", %+.1f%% vs baseline (z = %.2f)", change, z);
+	/* one-sided, at the 1% level */
+	if (change > tctest_threshold && z > 2.326) {
+		printf(" REGRESSION");
+		tctest_failures++;
+	}
+}
+
+/* Compute the statistics of a finished benchmark, and print them. */
+static void tctest_bench_report(tctest_bench_result *r) {
+	unsigned n = r->num_samples, i;
+	double sum = 0.0;
+
+	qsort(r->samples, n, sizeof(double), tctest_compare_doubles);
+	r->min = r->samples[0];
+	r->median = n % 2 ? r->samples[n / 2] : (r->samples[n / 2 - 1] + r->samples[n / 2]) / 2;
+	/* nearest rank */
+	r->p99 = r->samples[(99 * n + 99) / 100 - 1];
+	for (i = 0; i < n; i++) {
+		sum += r->samples[i];
+	}
+	r->mean = sum / n;
+
+	printf("median %.3f ns/op, p99 %.3f ns/op, min %.3f ns/op (%u x %llu iterations)",
+	       r->median, r->p99, r->min, n, (unsigned long long) r->iters);
+	if (tctest_alloc_tracking()) {
+		double ops = (double) n * (double) r->iters;
+		printf(", %.2f allocs/op, %.1f B/op", r->allocs / ops, r->alloc_bytes / ops);
+	}
+	if (tctest_baseline_file) {
+		tctest_compare_baseline(r);
+	}
+	printf("\n");
+
+	if (tctest_counting()) {
+		const char *sep = "  ";
+		for (i = 0; i < TCTEST_NUM_COUNTERS; i++) {
+			if (r->counters[i] < 0) {
+				printf("%s%s n/a", sep, tctest_counter_names[i]);
+			} else {
+				printf("%s%s %.2f/op", sep, tctest_counter_names[i], r->counters[i]);
+			}
+			if (i == TCTEST_INSTRUCTIONS && r->counters[TCTEST_CYCLES] > 0
+			    && r->counters[TCTEST_INSTRUCTIONS] >= 0) {
+				printf(" (IPC %.2f)", r->counters[TCTEST_INSTRUCTIONS] / r->counters[TCTEST_CYCLES]);
+			}
+			sep = ", ";
+		}
+		printf("\n");
+	}
+}
+
+void tctest_bench_pause(void) {
+	if (!tctest_bench.paused) {
+		tctest_bench.paused = tctest_ticks();
+		if (tctest_counting()) {
+			tctest_counters_disable();
+		}
+		tctest_bench_count_allocs();
+	}
+}
+
+void tctest_bench_resume(void) {
+	if (tctest_bench.paused) {
+		tctest_bench_mark_allocs();
+		if (tctest_counting() && tctest_bench.phase == TCTEST_SAMPLING) {
+			tctest_counters_enable();
+		}
+		tctest_bench.start += tctest_ticks() - tctest_bench.paused;
+		tctest_bench.paused = 0;
+	}
+}
+
+uint64_t tctest_bench_next(void) {
+	uint64_t end = tctest_bench.paused ? tctest_bench.paused : tctest_ticks();
+	tctest_bench_result *r = &tctest_bench.cur;
+	double ns = (double) (end - tctest_bench.start) * tctest_ns_per_tick;
+	double target = tctest_bench_time * 1e9 / (tctest_bench_samples + 1);
+
+	if (!tctest_bench.paused) {
+		if (tctest_counting()) {
+			tctest_counters_disable();
+		}
+		tctest_bench_count_allocs();
+	}
+	switch (tctest_bench.phase) {
+	case TCTEST_CALIBRATING:
+		if (ns < target / 2) {
+			/* grow quickly while the call is too short to time */
+			double factor = ns > 0 ? target / ns : 100.0;
+			if (factor > 100.0) {
+				factor = 100.0;
+			}
+			r->iters = (uint64_t) (r->iters * factor) + 1;
+		} else {
+			r->iters = (uint64_t) (r->iters * (target / ns));
+			if (r->iters < 1) {
+				r->iters = 1;
+			}
+			tctest_bench.phase = TCTEST_WARMUP;
+		}
+		break;
+	case TCTEST_WARMUP:
+		tctest_bench.phase = TCTEST_SAMPLING;
+		r->allocs = r->alloc_bytes = 0;
+		if (tctest_counting()) {
+			tctest_counters_reset();
+		}
+		break;
+	default:
+		r->samples[r->num_samples++] = ns / (double) r->iters;
+		if (r->num_samples == tctest_bench_samples) {
+			if (tctest_counting()) {
+				tctest_counters_read(r->counters, (double) r->num_samples * (double) r->iters);
+			}
+			tctest_bench_report(r);
+			if (tctest_num_results == tctest_results_capacity) {
+				unsigned capacity = tctest_results_capacity ? 2 * tctest_results_capacity : 16;
+				tctest_bench_result *results = (tctest_bench_result *)
+					tctest_realloc(tctest_results, capacity * sizeof(tctest_bench_result));
+				if (!results) {
+					tctest_free(r->samples);
+					return 0;
+				}
+				tctest_results = results;
+				tctest_results_capacity = capacity;
+			}
+			tctest_results[tctest_num_results++] = *r;
+			r->samples = NULL;
+			return 0;
+		}
+		break;
+	}
+
+	tctest_bench.paused = 0;
+	tctest_bench_mark_allocs();
+	if (tctest_counting() && tctest_bench.phase == TCTEST_SAMPLING) {
+		tctest_counters_enable();
+	}
+	tctest_bench.start = tctest_ticks();
+	return r->iters;
+}
+
+void tctest_bench_abort(void) {
+	if (tctest_counting()) {
+		tctest_counters_disable();
+	}
+	tctest_free(tctest_bench.cur.samples);
+	tctest_bench.cur.samples = NULL;
+}
+
+/* Write a string as a JSON string literal. */
+static void tctest_json_string(FILE *out, const char *s) {
+	putc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			putc('\\', out);
+		}
+		putc(*s, out);
+	}
+	putc('"', out);
+}
+
+/* Write the benchmark results to the JSON file. */
+static int tctest_write_json(const char *filename) {
+	FILE *out = fopen(filename, "w");
+	unsigned i, j;
+
+	if (!out) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return -1;
+	}
+	fprintf(out, "{\n  \"benchmarks\": [");
+	for (i = 0; i < tctest_num_results; i++) {
+		const tctest_bench_result *r = &tctest_results[i];
+		fprintf(out, "%s\n    {\"name\": ", i > 0 ? "," : "");
+		tctest_json_string(out, r->name);
+		fprintf(out, ", \"iterations\": %llu, \"median_ns\": %.4f, \"p99_ns\": %.4f, "
+		        "\"min_ns\": %.4f, \"mean_ns\": %.4f,\n     ",
+		        (unsigned long long) r->iters, r->median, r->p99, r->min, r->mean);
+		if (tctest_alloc_tracking()) {
+			double ops = (double) r->num_samples * (double) r->iters;
+			fprintf(out, "\"allocs_per_op\": %.4f, \"bytes_per_op\": %.4f, ",
+			        r->allocs / ops, r->alloc_bytes / ops);
+		}
+		if (tctest_counting()) {
+			for (j = 0; j < TCTEST_NUM_COUNTERS; j++) {
+				if (r->counters[j] < 0) {
+					fprintf(out, "\"%s_per_op\": null, ", tctest_counter_keys[j]);
+				} else {
+					fprintf(out, "\"%s_per_op\": %.4f, ", tctest_counter_keys[j], r->counters[j]);
+				}
+			}
+			fprintf(out, "\n     ");
+		}
+		fprintf(out, "\"samples_ns\": [");
+		for (j = 0; j < r->num_samples; j++) {
+			fprintf(out, "%s%.4f", j > 0 ? ", " : "", r->samples[j]);
+		}
+		fprintf(out, "]}");
+	}
+	fprintf(out, "\n  ]\n}\n");
+	if (fclose(out) != 0) {
+		fprintf(stderr, "Cannot write %s\n", filename);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Forked tests
+ */
+
+typedef struct {
+	pid_t pid;                /* 0 if the slot is free */
+	const char *name;
+	int out;                  /* read end of the child's output pipe, or -1 at EOF */
+	char *output;
+	size_t output_len, output_capacity;
+	int result;               /* 1 passed, 0 failed, -1 not reported */
+	uint64_t deadline;        /* in ns of tctest_now_ns, or 0 */
+	int timed_out;
+} tctest_child;
+
+/* the result record a child writes to the result pipe */
+typedef struct {
+	pid_t pid;
+	int passed;
+} tctest_child_result;
+
+static tctest_child *tctest_children;
+static unsigned tctest_num_running;
+static int tctest_result_pipe[2] = { -1, -1 };
+
+/* in a child: its result, or -1 if none yet */
+static int tctest_child_passed = -1;
+static int tctest_is_child;
+
+static void tctest_read_output(tctest_child *c) {
+	char buf[4096];
+	ssize_t n;
+
+	while ((n = read(c->out, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)) {
+		if (n < 0) {
+			continue;
+		}
+		if (c->output_len + (size_t) n > c->output_capacity) {
+			size_t capacity = c->output_capacity ? 2 * c->output_capacity : sizeof(buf);
+			char *output;
+			while (capacity < c->output_len + (size_t) n) {
+				capacity *= 2;
+			}
+			output = (char *) tctest_realloc(c->output, capacity);
+			if (!output) {
+				/* drop what doesn't fit */
+				continue;
+			}
+			c->output = output;
+			c->output_capacity = capacity;
+		}
+		memcpy(c->output + c->output_len, buf, (size_t) n);
+		c->output_len += (size_t) n;
+	}
+	if (n == 0) {
+		close(c->out);
+		c->out = -1;
+	}
+}
+
+static void tctest_read_results(void) {
+	tctest_child_result r;
+	unsigned i;
+
+	while (read(tctest_result_pipe[0], &r, sizeof(r)) == (ssize_t) sizeof(r)) {
+		for (i = 0; i < tctest_jobs; i++) {
+			if (tctest_children[i].pid == r.pid) {
+				tctest_children[i].result = r.passed;
+			}
+		}
+	}
+}
+
+/* Report a child whose output is complete (or which was killed), and free its slot. */
+static void tctest_finish_child(tctest_child *c) {
+	int status = 0, passed;
+
+	while (waitpid(c->pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	if (c->out >= 0) {
+		tctest_read_output(c);
+		if (c->out >= 0) {
+			close(c->out);
+		}
+	}
+	tctest_read_results();
+
+	passed = c->result == 1 && !c->timed_out;
+	if (c->output_len > 0) {
+		fwrite(c->output, 1, c->output_len, stdout);
+	}
+	if (c->result < 0 || c->timed_out) {
+		if (c->output_len == 0) {
+			printf("%s...", c->name);
+		}
+		if (c->timed_out) {
+			printf("timed out after %g seconds\n", tctest_timeout);
+		} else if (WIFSIGNALED(status)) {
+			printf("killed by signal %d\n", WTERMSIG(status));
+		} else {
+			printf("exited with status %d without a result\n", WEXITSTATUS(status));
+		}
+	}
+	fflush(stdout);
+
+	if (!passed) {
+		tctest_failures++;
+	}
+	if (tctest_on_test_executed) {
+		tctest_on_test_executed(c->name, passed);
+	}
+	tctest_free(c->output);
+	memset(c, 0, sizeof(*c));
+	tctest_num_running--;
+}
+
+/* Collect output and results until at most max_running children are left. */
+static void tctest_wait_children(unsigned max_running) {
+	while (tctest_num_running > max_running) {
+		struct pollfd fds[tctest_jobs];
+		unsigned slot[tctest_jobs];
+		unsigned i, n = 0;
+		uint64_t now = tctest_now_ns(), first_deadline = 0;
+		int timeout_ms = -1;
+
+		for (i = 0; i < tctest_jobs; i++) {
+			tctest_child *c = &tctest_children[i];
+			if (!c->pid) {
+				continue;
+			}
+			if (c->out < 0) {
+				/* its output is complete, so it has exited (or closed stdout) */
+				tctest_finish_child(c);
+				continue;
+			}
+			if (c->deadline && now >= c->deadline) {
+				kill(c->pid, SIGKILL);
+				c->timed_out = 1;
+				tctest_finish_child(c);
+				continue;
+			}
+			if (c->deadline && (!first_deadline || c->deadline < first_deadline)) {
+				first_deadline = c->deadline;
+			}
+			fds[n].fd = c->out;
+			fds[n].events = POLLIN;
+			slot[n++] = i;
+		}
+		if (tctest_num_running <= max_running || n == 0) {
+			continue;
+		}
+		if (first_deadline) {
+			timeout_ms = (int) ((first_deadline - now + 999999) / 1000000);
+		}
+		if (poll(fds, n, timeout_ms) > 0) {
+			for (i = 0; i < n; i++) {
+				if (fds[i].revents) {
+					tctest_read_output(&tctest_children[slot[i]]);
+				}
+			}
+		}
+	}
+}
+
+int tctest_fork_test(const char *name) {
+	int out[2];
+	unsigned i;
+	pid_t pid;
+
+	if (tctest_jobs == 0) {
+		return TCTEST_SERIAL;
+	}
+	if (!tctest_children) {
+		tctest_children = (tctest_child *) tctest_calloc(tctest_jobs, sizeof(tctest_child));
+		if (!tctest_children || pipe(tctest_result_pipe) != 0) {
+			tctest_free(tctest_children);
+			tctest_children = NULL;
+			tctest_jobs = 0;
+			return TCTEST_SERIAL;
+		}
+		fcntl(tctest_result_pipe[0], F_SETFL, O_NONBLOCK);
+	}
+	tctest_wait_children(tctest_jobs - 1);
+
+	/* don't let the child inherit (and print again) buffered output */
+	fflush(stdout);
+	if (pipe(out) != 0) {
+		return TCTEST_SERIAL;
+	}
+	pid = fork();
+	if (pid < 0) {
+		close(out[0]);
+		close(out[1]);
+		return TCTEST_SERIAL;
+	}
+	if (pid == 0) {
+		for (i = 0; i < tctest_jobs; i++) {
+			if (tctest_children[i].pid) {
+				close(tctest_children[i].out);
+			}
+		}
+		close(tctest_result_pipe[0]);
+		close(out[0]);
+		dup2(out[1], 1);
+		dup2(out[1], 2);
+		close(out[1]);
+		tctest_is_child = 1;
+		return TCTEST_CHILD;
+	}
+
+	close(out[1]);
+	fcntl(out[0], F_SETFL, O_NONBLOCK);
+	for (i = 0; tctest_children[i].pid; i++) {
+	}
+	tctest_children[i].pid = pid;
+	tctest_children[i].name = name;
+	tctest_children[i].out = out[0];
+	tctest_children[i].result = -1;
+	tctest_children[i].deadline = tctest_timeout > 0
+		? tctest_now_ns() + (uint64_t) (tctest_timeout * 1e9) : 0;
+	tctest_num_running++;
+	tctest_num_executed++;
+	return TCTEST_PARENT;
+}
+
+void tctest_test_executed(const char *name, int passed) {
+	if (tctest_is_child) {
+		tctest_child_passed = passed;
+	} else if (tctest_on_test_executed) {
+		tctest_on_test_executed(name, passed);
+	}
+}
+
+void tctest_child_finish(void) {
+	tctest_child_result r;
+
+	fflush(stdout);
+	r.pid = getpid();
+	r.passed = tctest_child_passed;
+	tctest_write(tctest_result_pipe[1], &r, sizeof(r));
+	_exit(0);
+}
+
+/*
+ * Read the names and samples of the benchmarks in a file written by
+ * tctest_write_json.
+ */
+static int tctest_read_baseline(const char *filename) {
+	FILE *in = fopen(filename, "r");
+	char *text = NULL, *p;
+	size_t len = 0, capacity = 0, n;
+	unsigned capacity_results = 0, sample_capacity;
+
+	if (!in) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return -1;
+	}
+	do {
+		if (len + 4096 > capacity) {
+			capacity = capacity ? 2 * capacity : 65536;
+			p = (char *) tctest_realloc(text, capacity + 1);
+			if (!p) {
+				break;
+			}
+			text = p;
+		}
+		n = fread(text + len, 1, capacity - len, in);
+		len += n;
+	} while (n > 0);
+	fclose(in);
+	if (!text) {
+		return -1;
+	}
+	text[len] = '\0';
+
+	for (p = text; (p = strstr(p, "{\"name\": \"")) != NULL; ) {
+		tctest_bench_result *b;
+		char *end;
+		size_t i = 0;
+
+		if (tctest_num_baseline == capacity_results) {
+			unsigned new_capacity = capacity_results ? 2 * capacity_results : 16;
+			b = (tctest_bench_result *) tctest_realloc(tctest_baseline, new_capacity * sizeof(*b));
+			if (!b) {
+				break;
+			}
+			tctest_baseline = b;
+			capacity_results = new_capacity;
+		}
+		b = &tctest_baseline[tctest_num_baseline];
+		memset(b, 0, sizeof(*b));
+
+		/* the name, undoing tctest_json_string's escapes */
+		for (p += 10; *p && *p != '"'; p++) {
+			if (*p == '\\' && p[1]) {
+				p++;
+			}
+			if (i + 1 < sizeof(b->name)) {
+				b->name[i++] = *p;
+			}
+		}
+		b->name[i] = '\0';
+
+		p = strstr(p, "\"samples_ns\": [");
+		if (!p) {
+			break;
+		}
+		p += 15;
+		sample_capacity = 16;
+		b->samples = (double *) tctest_malloc(sample_capacity * sizeof(double));
+		if (!b->samples) {
+			break;
+		}
+		for (;;) {
+			double x = strtod(p, &end);
+			if (end == p) {
+				break;
+			}
+			if (b->num_samples == sample_capacity) {
+				double *samples = (double *) tctest_realloc(b->samples, 2 * sample_capacity * sizeof(double));
+				if (!samples) {
+					break;
+				}
+				b->samples = samples;
+				sample_capacity *= 2;
+			}
+			b->samples[b->num_samples++] = x;
+			for (p = end; *p == ',' || *p == ' ' || *p == '\n'; p++) {
+			}
+		}
+		if (b->num_samples > 0) {
+			qsort(b->samples, b->num_samples, sizeof(double), tctest_compare_doubles);
+			n = b->num_samples;
+			b->median = n % 2 ? b->samples[n / 2] : (b->samples[n / 2 - 1] + b->samples[n / 2]) / 2;
+			tctest_num_baseline++;
+		} else {
+			tctest_free(b->samples);
+		}
+	}
+	tctest_free(text);
+	return 0;
+}
+
+int tctest_finish(void) {
+	int rc = 0;
+	unsigned i;
+
+	if (tctest_children) {
+		tctest_wait_children(0);
+		tctest_free(tctest_children);
+		tctest_children = NULL;
+		close(tctest_result_pipe[0]);
+		close(tctest_result_pipe[1]);
+	}
+	if (tctest_bench_mode && tctest_json_file) {
+		rc = tctest_write_json(tctest_json_file);
+	}
+	for (i = 0; i < tctest_num_results; i++) {
+		tctest_free(tctest_results[i].samples);
+	}
+	tctest_free(tctest_results);
+	tctest_results = NULL;
+	tctest_num_results = tctest_results_capacity = 0;
+	tctest_counters_close();
+	for (i = 0; i < tctest_num_baseline; i++) {
+		tctest_free(tctest_baseline[i].samples);
+	}
+	tctest_free(tctest_baseline);
+	tctest_baseline = NULL;
+	tctest_num_baseline = 0;
+	return rc;
+}
@@ -26,6 +26,7 @@
 #define TCTEST_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <setjmp.h>
 #include <signal.h>
@@ -65,12 +66,166 @@ extern void (*tctest_on_test_executed)(const char *testname, int passed);
  */
 extern void (*tctest_on_complete)(int num_passed, int num_executed);
 
+/*
+ * Benchmarks.
+ *
+ * A benchmark is a function taking the test fixture and an
+ * iteration count, which runs the code being measured that many
+ * times, passing each result to TCTEST_KEEP so that the compiler
+ * can't optimize the computation away:
+ *
+ *   void bench_add(TestObjs *objs, uint64_t iters) {
+ *     for (uint64_t i = 0; i < iters; i++) {
+ *       UInt256 sum = uint256_add(objs->one, objs->max);
+ *       TCTEST_KEEP(sum);
+ *     }
+ *   }
+ *
+ * BENCH(bench_add) runs it when the program was started with
+ * --bench (and TEST does nothing then). The iteration count is
+ * calibrated first, doubling it until one call takes long enough to
+ * time accurately, and after a warmup call the benchmark is called
+ * for a number of samples, each timed with the time stamp counter
+ * (rdtscp) on x86 or clock_gettime elsewhere. The median, 99th
+ * percentile and minimum time per iteration are printed, and with
+ * --json file, every benchmark's samples are written to the file.
+ *
+ * With --counters, each benchmark also reports hardware performance
+ * counts per iteration, from perf_event_open(2): cycles, instructions
+ * (and IPC), L1 data cache and last-level cache misses, branch
+ * misses and data TLB misses. Counters the system doesn't provide
+ * (in a VM or container, or with a restrictive
+ * /proc/sys/kernel/perf_event_paranoid) are reported as n/a.
+ *
+ * BENCH_ARGS(func, a, b, ...) runs a benchmark taking a third
+ * parameter, func(objs, iters, arg), once for each argument,
+ * reporting it as func/a, func/b and so on.
+ *
+ * Work a benchmark does to set up before its loop (or to clean up
+ * after it) can be left out of the timing by calling
+ * tctest_bench_pause() before it and tctest_bench_resume() after.
+ *
+ * The JSON file of one run can be given to a later one as a baseline
+ * (--baseline file). Each benchmark's samples are then compared with
+ * the baseline's using a one-sided Mann-Whitney U test, and a
+ * benchmark whose median is more than the threshold (--threshold,
+ * 10% by default) slower, with the difference significant at the 1%
+ * level, counts as failed, so TEST_FINI returns a failing exit code.
+ */
+extern int tctest_bench_mode;
+extern const char *tctest_json_file;
+extern unsigned tctest_bench_samples;
+extern double tctest_bench_time;
+extern int tctest_bench_counters;
+extern const char *tctest_baseline_file;
+extern double tctest_threshold;
+
+/*
+ * Running tests in separate processes.
+ *
+ * With -j N, each test is forked into a process of its own and up to
+ * N of them run at once. A test that crashes badly or corrupts the
+ * heap then can't affect the others, and one that runs for longer
+ * than the timeout (--timeout, 60 seconds by default) is killed and
+ * fails. A test's output is collected through a pipe and printed when
+ * it finishes (so tests are reported in the order they finish), and
+ * its result comes back through another pipe to the parent, which
+ * counts it and calls tctest_on_test_executed as usual.
+ *
+ * Benchmarks always run one at a time in the test program's own
+ * process.
+ */
+extern unsigned tctest_jobs;
+extern double tctest_timeout;
+
+/*
+ * Counting heap allocations.
+ *
+ * When tctest.c is compiled with TCTEST_WRAP_ALLOC and the test
+ * program is linked with
+ *
+ *   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+ *
+ * the calls to the allocator from the program's own code (not from
+ * inside the C library, such as strdup or fopen) go through tctest,
+ * which counts them in every thread. The harness's own allocations
+ * are left out. With --allocs, each passed test reports the
+ * allocations (and bytes) made by the test function, and benchmarks
+ * always report their allocations and bytes per iteration.
+ *
+ * ASSERT_NO_ALLOC(block) runs the block and fails if it allocated
+ * (a successful realloc counts as an allocation). Without
+ * TCTEST_WRAP_ALLOC it always fails, since nothing can be checked.
+ */
+extern int tctest_show_allocs;
+
+/* 1 if allocations are being counted */
+int tctest_alloc_tracking(void);
+/* the number of allocations, and bytes allocated, so far */
+uint64_t tctest_alloc_count(void);
+uint64_t tctest_alloc_bytes(void);
+
+void tctest_alloc_mark(void);
+void tctest_print_passed(void);
+
+/*
+ * Handle the command line of a test program: a test (or benchmark)
+ * name to run only that one, and the options
+ *
+ *   --bench           run the benchmarks instead of the tests
+ *   --json FILE       write benchmark results to FILE as JSON
+ *   --samples N       samples per benchmark (default 30)
+ *   --bench-time SEC  target time per benchmark (default 0.3)
+ *   --counters        report hardware performance counters
+ *   --baseline FILE   compare benchmarks with the results in FILE (as
+ *                     written by --json)
+ *   --threshold PCT   slowdown counted as a regression (default 10)
+ *   --allocs          report each test's heap allocations
+ *   -j N              run up to N tests at a time, each in its own process
+ *   --timeout SEC     with -j, fail a test running longer than this (0 for
+ *                     no limit)
+ *
+ * Returns 0 on success, or prints a usage message and returns -1.
+ */
+int tctest_parse_args(int argc, char **argv);
+
+/* Return 1 if the test or benchmark with this name should run. */
+int tctest_should_run(const char *name);
+
+uint64_t tctest_bench_begin(const char *name, long arg, int has_arg);
+uint64_t tctest_bench_next(void);
+void tctest_bench_pause(void);
+void tctest_bench_resume(void);
+void tctest_bench_abort(void);
+int tctest_finish(void);
+
+/* Where a TEST runs: here, in a forked child, or (in the parent) elsewhere */
+#define TCTEST_SERIAL 0
+#define TCTEST_CHILD  1
+#define TCTEST_PARENT 2
+
+int tctest_fork_test(const char *name);
+void tctest_test_executed(const char *name, int passed);
+void tctest_child_finish(void);
+
+/*
+ * Make the compiler assume the value of var is used (it must be an
+ * lvalue), so the computation producing it can't be eliminated.
+ */
+#define TCTEST_KEEP(var) tctest_keep(&(var))
+
+static inline void tctest_keep(const void *p) {
+	__asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
 #define TEST_INIT() do { \
 	tctest_register_signal_handlers(); \
 } while (0)
 
 #define TEST(func) do { \
-	if (!tctest_testname_to_execute || strcmp(tctest_testname_to_execute, #func) == 0) { \
+	int tctest_where; \
+	if (!tctest_bench_mode && tctest_should_run(#func) && \
+	    (tctest_where = tctest_fork_test(#func)) != TCTEST_PARENT) { \
 		TestObjs *t = 0; \
 		tctest_num_executed++; \
 		tctest_assertion_line = -1; \
@@ -78,20 +233,58 @@ extern void (*tctest_on_complete)(int num_passed, int num_executed);
 			t = setup(); \
 			printf("%s...", #func); \
 			fflush(stdout); \
+			tctest_alloc_mark(); \
 			func(t); \
-			printf("passed!\n"); \
-			if (tctest_on_test_executed) { \
-				tctest_on_test_executed(#func, 1); \
-			} \
+			tctest_print_passed(); \
+			tctest_test_executed(#func, 1); \
 		} else { \
 			tctest_failures++; \
-			if (tctest_on_test_executed) { \
-				tctest_on_test_executed(#func, 0); \
-			} \
+			tctest_test_executed(#func, 0); \
 		} \
 		if (t) { \
 			cleanup(t); \
 		} \
+		if (tctest_where == TCTEST_CHILD) { \
+			tctest_child_finish(); \
+		} \
+	} \
+} while (0)
+
+/* Run one benchmark, with tctest_iters iterations per call. */
+#define TCTEST_BENCH_RUN(name, arg, has_arg, call) do { \
+	TestObjs *t = 0; \
+	uint64_t tctest_iters; \
+	tctest_num_executed++; \
+	tctest_assertion_line = -1; \
+	if (sigsetjmp(tctest_env, 1) == 0) { \
+		t = setup(); \
+		for (tctest_iters = tctest_bench_begin(name, arg, has_arg); tctest_iters != 0; \
+		     tctest_iters = tctest_bench_next()) { \
+			call; \
+		} \
+	} else { \
+		tctest_bench_abort(); \
+		tctest_failures++; \
+	} \
+	if (t) { \
+		cleanup(t); \
+	} \
+} while (0)
+
+#define BENCH(func) do { \
+	if (tctest_bench_mode && tctest_should_run(#func)) { \
+		TCTEST_BENCH_RUN(#func, 0, 0, func(t, tctest_iters)); \
+	} \
+} while (0)
+
+#define BENCH_ARGS(func, ...) do { \
+	if (tctest_bench_mode && tctest_should_run(#func)) { \
+		static const long tctest_args[] = { __VA_ARGS__ }; \
+		size_t tctest_i; \
+		for (tctest_i = 0; tctest_i < sizeof(tctest_args) / sizeof(tctest_args[0]); tctest_i++) { \
+			TCTEST_BENCH_RUN(#func, tctest_args[tctest_i], 1, \
+			                 func(t, tctest_iters, tctest_args[tctest_i])); \
+		} \
 	} \
 } while (0)
 
@@ -103,6 +296,21 @@ extern void (*tctest_on_complete)(int num_passed, int num_executed);
 	} \
 } while (0)
 
+#define ASSERT_NO_ALLOC(block) do { \
+	uint64_t tctest_allocs_before = tctest_alloc_count(); \
+	block; \
+	tctest_assertion_line = __LINE__; \
+	if (!tctest_alloc_tracking()) { \
+		printf("failed ASSERT_NO_ALLOC at line %d (allocations aren't counted)\n", __LINE__); \
+		siglongjmp(tctest_env, 1); \
+	} \
+	if (tctest_alloc_count() != tctest_allocs_before) { \
+		printf("failed ASSERT_NO_ALLOC at line %d (%llu allocation(s))\n", __LINE__, \
+		       (unsigned long long) (tctest_alloc_count() - tctest_allocs_before)); \
+		siglongjmp(tctest_env, 1); \
+	} \
+} while (0)
+
 /*
  * Use this macro to unconditionally fail the current test with
  * specified error message.  This is somewhat nicer than doing
@@ -114,7 +322,14 @@ extern void (*tctest_on_complete)(int num_passed, int num_executed);
 } while (0)
 
 #define TEST_FINI() do { \
-	if (tctest_failures == 0) { \
+	if (tctest_finish() != 0) { \
+		tctest_failures++; \
+	} \
+	if (tctest_bench_mode && tctest_failures == 0) { \
+		printf("%d benchmark(s) run\n", tctest_num_executed); \
+	} else if (tctest_bench_mode) { \
+		printf("%d benchmark(s) failed\n", tctest_failures); \
+	} else if (tctest_failures == 0) { \
 		printf("All tests passed!\n"); \
 	} else { \
 		printf("%d test(s) failed\n", tctest_failures); \
@@ -63,42 +63,100 @@ UInt256 uint256_create_from_hex(const char *hex) {
   return result;
 }
 
+// Parse exactly eight hex digits, most significant first, a word at
+// a time: returns -1 if any of them isn't a hex digit.
+static int64_t parse_hex8(const char *hex) {
+  uint64_t x;
+  memcpy(&x, hex, 8);
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+  x = __builtin_bswap64(x);
+#endif
+  const uint64_t ones = 0x0101010101010101ULL, high = 0x8080808080808080ULL;
+  if (x & high) {
+    return -1;
+  }
+  // for bytes below 0x80, the high bit of x + (0x80 - lo) is set if a
+  // byte is >= lo, and of x + (0x7F - hi) if it is > hi
+  uint64_t digit = (x + (0x80 - '0') * ones) & ~(x + (0x7F - '9') * ones);
+  uint64_t lower = x | 0x20 * ones;
+  uint64_t letter = (lower + (0x80 - 'a') * ones) & ~(lower + (0x7F - 'f') * ones);
+  if (((digit | letter) & high) != high) {
+    return -1;
+  }
+  // each byte's value, then pairs of nibbles into bytes, bytes into
+  // 16 bits and those into 32 (the first character is in the low
+  // byte)
+  x = (x & 0x0F * ones) + 9 * ((letter & high) >> 7);
+  x = ((x << 4) & 0x00F000F000F000F0ULL) | ((x >> 8) & 0x000F000F000F000FULL);
+  x = ((x << 8) & 0x0000FF000000FF00ULL) | ((x >> 16) & 0x000000FF000000FFULL);
+  x = ((x << 16) & 0x00000000FFFF0000ULL) | ((x >> 32) & 0x000000000000FFFFULL);
+  return (int64_t) x;
+}
+
+int uint256_parse_hex(const char *hex, size_t len, UInt256 *result) {
+  if (len == 0 || len > 64) {
+    return -1;
+  }
+  // whole words from the end, then the leading digits padded with
+  // zeros to eight
+  unsigned i = 0;
+  for (; len >= 8; i++, len -= 8) {
+    int64_t word = parse_hex8(hex + len - 8);
+    if (word < 0) {
+      return -1;
+    }
+    result->data[i] = (uint32_t) word;
+  }
+  if (len > 0) {
+    char padded[8] = { '0', '0', '0', '0', '0', '0', '0', '0' };
+    memcpy(padded + 8 - len, hex, len);
+    int64_t word = parse_hex8(padded);
+    if (word < 0) {
+      return -1;
+    }
+    result->data[i++] = (uint32_t) word;
+  }
+  for (; i < 8; i++) {
+    result->data[i] = 0;
+  }
+  return 0;
+}
+
 // Return a dynamically-allocated string of hex digits representing the
 // given UInt256 value.
 char *uint256_format_as_hex(UInt256 val) {
   char *hex = (char *)malloc(65);
-  char *hex_chunk = hex;
-  uint32_t current;
-  int curr_hex = 0;
-  int zero_flag = 1;
-  
-  for (int i = 7; i >= 0; i--) {
-    if (val.data[i]) {
-      current = val.data[i];
-      if (zero_flag) {
-	curr_hex = sprintf(hex_chunk, "%x", current);
-	zero_flag = 0;
-      }
-      else {
-	curr_hex = sprintf(hex_chunk, "%08x", current);
-      }
-      hex_chunk += curr_hex;
-    }
-    else {
-      if (!(hex_chunk == hex)) {
-	current = val.data[i];
-	curr_hex = sprintf(hex_chunk, "%08x", current);
-	hex_chunk += curr_hex;
-      }
-    }
+  if (hex != NULL) {
+    uint256_format_hex(val, hex);
   }
+  return hex;
+}
 
-  if (hex_chunk == hex) {
-    *hex_chunk++ = '0';
+unsigned uint256_format_hex(UInt256 val, char *buf) {
+  static const char digits[] = "0123456789abcdef";
+  int top = 7;
+  while (top > 0 && val.data[top] == 0) {
+    top--;
   }
 
-  *hex_chunk = '\0';
-  return hex;
+  // the top word without leading zeros, the rest as eight digits
+  unsigned n = 0;
+  uint32_t word = val.data[top];
+  int shift = 28;
+  while (shift > 0 && (word >> shift) == 0) {
+    shift -= 4;
+  }
+  for (; shift >= 0; shift -= 4) {
+    buf[n++] = digits[(word >> shift) & 0xF];
+  }
+  for (int i = top - 1; i >= 0; i--) {
+    word = val.data[i];
+    for (shift = 28; shift >= 0; shift -= 4) {
+      buf[n++] = digits[(word >> shift) & 0xF];
+    }
+  }
+  buf[n] = '\0';
+  return n;
 }
 
 // Get 32 bits of data from a UInt256 value.
@@ -113,16 +171,15 @@ uint32_t uint256_get_bits(UInt256 val, unsigned index) {
 // Compute the sum of two UInt256 values.
 UInt256 uint256_add(UInt256 left, UInt256 right) {
   UInt256 sum;
-  int overflow = 0;
+  uint64_t carry = 0;
 
+  // add each pair of words in 64 bits, so the carry out is simply
+  // bit 32 (comparing the 32-bit sum with the operands misses the
+  // carry when right + carry wraps to 0)
   for (int i = 0; i < 8; i++) {
-    sum.data[i] = left.data[i] + right.data[i] + overflow;
-    if (sum.data[i] < left.data[i] || sum.data[i] < right.data[i]) {
-      overflow = 1;
-    }
-    else {
-      overflow = 0;
-    }
+    uint64_t word = (uint64_t) left.data[i] + right.data[i] + carry;
+    sum.data[i] = (uint32_t) word;
+    carry = word >> 32;
   }
   return sum;
 }
@@ -155,51 +212,38 @@ UInt256 uint256_negate(UInt256 val) {
   return result;
 }
 
+// Compute the product of two UInt256 values (modulo 2^256).
+UInt256 uint256_mul(UInt256 left, UInt256 right) {
+  UInt256 product = uint256_create_from_u32(0);
+
+  // schoolbook, keeping only the partial products below 2^256; each
+  // step fits in 64 bits, since (2^32-1)^2 + 2(2^32-1) = 2^64-1
+  for (int i = 0; i < 8; i++) {
+    uint64_t carry = 0;
+    for (int j = 0; i + j < 8; j++) {
+      uint64_t t = (uint64_t) left.data[i] * right.data[j] + product.data[i + j] + carry;
+      product.data[i + j] = (uint32_t) t;
+      carry = t >> 32;
+    }
+  }
+  return product;
+}
+
 // Return the result of rotating every bit in val nbits to
 // the left.  Any bits shifted past the most significant bit
 // should be shifted back into the least significant bits.
 UInt256 uint256_rotate_left(UInt256 val, unsigned nbits) {
   UInt256 result;
-
-  char *bin = (char *)malloc(257);
-  char *val_chunk = bin;
-
-  int curr_val = 0;
-  for (int i = 7; i >= 0; i--) {
-    uint32_t current = val.data[i];
-    curr_val = sprintf(val_chunk, "%032b", current);
-    val_chunk += curr_val;
+  unsigned words = (nbits % 256) / 32;
+  unsigned bits = nbits % 32;
+
+  // word i gets the bits of word i - words, topped up from the
+  // word below it
+  for (unsigned i = 0; i < 8; i++) {
+    uint32_t hi = val.data[(i + 8 - words) % 8];
+    uint32_t lo = val.data[(i + 7 - words) % 8];
+    result.data[i] = bits == 0 ? hi : (hi << bits) | (lo >> (32 - bits));
   }
-  if (val_chunk == bin) {
-    *val_chunk++ = '0';
-  }
-  *val_chunk = '\0';
-
-  int bin_len = strlen(bin);
-  unsigned final_nbits = nbits % 256; 
-  char sub_bin[final_nbits + 1];
-
-  strncpy(sub_bin, bin, final_nbits);
-  sub_bin[final_nbits] = '\0';
-
-  memmove(bin, bin + final_nbits, bin_len - final_nbits + 1);
-  strcat(bin, sub_bin);
-
-  int curr_index = 0;
-  
-  uint32_t chunk = 0;
-  for (int i = 7; i >= 0; i--) {
-    char bin_32[32];
-    strncpy(bin_32, bin + curr_index, 32);
-
-    bin_32[32] = '\0';
-    chunk = strtoul(bin_32, NULL, 2);
-    result.data[i] = chunk;
-    curr_index += 32;
-    
-  }
-
-  free(bin);
   return result;
 }
 
@@ -207,47 +251,5 @@ UInt256 uint256_rotate_left(UInt256 val, unsigned nbits) {
 // the right. Any bits shifted past the least significant bit
 // should be shifted back into the most significant bits.
 UInt256 uint256_rotate_right(UInt256 val, unsigned nbits) {
-  UInt256 result;
-
-  char *bin = (char *)malloc(257);
-  char *val_chunk = bin;
-
-  int curr_val = 0;
-  for (int i = 7; i >= 0; i--) {
-    uint32_t current = val.data[i];
-    curr_val = sprintf(val_chunk, "%032b", current);
-    val_chunk += curr_val;
-  }
-  if (val_chunk == bin) {
-    *val_chunk++ = '0';
-  }
-  *val_chunk = '\0';
-
-  int bin_len = strlen(bin);
-  unsigned final_nbits = nbits % 256;
-  unsigned sub_end = 256 - final_nbits;
-  char sub_bin[sub_end + 1];
-
-  strncpy(sub_bin, bin, sub_end);
-  sub_bin[sub_end] = '\0';
-
-  memmove(bin, bin + sub_end, bin_len - sub_end + 1);
-  strcat(bin, sub_bin);
-
-  int curr_index = 0;
-
-  uint32_t chunk = 0;
-  for (int i = 7; i >= 0; i--) {
-    char bin_32[32];
-    strncpy(bin_32, bin + curr_index, 32);
-
-    bin_32[32] = '\0';
-    chunk = strtoul(bin_32, NULL, 2);
-    result.data[i] = chunk;
-    curr_index += 32;
-
-  }
-
-  free(bin);
-  return result;
+  return uint256_rotate_left(val, 256 - nbits % 256);
 }
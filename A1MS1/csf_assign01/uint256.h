@@ -1,6 +1,7 @@
 #ifndef UINT256_H
 #define UINT256_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 // Data type representing a 256-bit unsigned integer, represented
@@ -27,10 +28,21 @@ UInt256 uint256_create(const uint32_t data[8]);
 // Create a UInt256 value from a string of hexadecimal digits.
 UInt256 uint256_create_from_hex(const char *hex);
 
+// Parse the len hexadecimal digits at hex (which needn't be
+// NUL-terminated) into *result, eight digits at a time. Returns 0 on
+// success, or -1 if len is 0 or more than 64, or a character isn't a
+// hex digit.
+int uint256_parse_hex(const char *hex, size_t len, UInt256 *result);
+
 // Return a dynamically-allocated string of hex digits representing the
 // given UInt256 value.
 char *uint256_format_as_hex(UInt256 val);
 
+// Write the hex digits of val (lowercase, without leading zeros) and
+// a NUL terminator to buf, which must have room for 65 characters.
+// Returns the number of digits.
+unsigned uint256_format_hex(UInt256 val, char *buf);
+
 // Get 32 bits of data from a UInt256 value.
 // Index 0 is the least significant 32 bits, index 7 is the most
 // significant 32 bits.
@@ -44,12 +56,9 @@ UInt256 uint256_sub(UInt256 left, UInt256 right);
 
 // Return the two's-complement negation of the given UInt256 value.
 UInt256 uint256_negate(UInt256 val);
-#if 0
 
-// Not assigning this for Fall 2023
-// Compute the product of two UInt256 values.
+// Compute the product of two UInt256 values (modulo 2^256).
 UInt256 uint256_mul(UInt256 left, UInt256 right);
-#endif
 
 // Return the result of rotating every bit in val nbits to
 // the left.  Any bits shifted past the most significant bit
@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "uint256.h"
+
+// Bulk evaluator for files of UInt256 operations, as written by
+// genfact.rb: one "a op b = c" per line, in hex, where op is one of
+// + - * (see ops below).
+//
+// Usage: uint256_calc [-t threads] [-w] [-o output] file
+//
+// By default every line is evaluated and checked against its "= c"
+// column. With -w the result column is computed instead (it may be
+// missing from the input), and each line is written out as
+// "a op b = result" to the output file (standard output by default),
+// in the input's order. Every input line has exactly one output line:
+// a blank line stays blank, and a malformed one is written as
+// "error: malformed line".
+//
+// The file is mapped into memory and cut into chunks of about a
+// megabyte at line boundaries, which the threads take in turn. Hex
+// numbers are parsed eight digits at a time (uint256_parse_hex). The
+// number of lines, mismatches and malformed lines and the throughput
+// are reported on standard error, along with the first few problem
+// lines; the exit status is 1 if there were any.
+
+#define CHUNK_SIZE (1 << 20)
+
+// chunks a writing thread may get ahead of the output
+#define WINDOW 64
+
+// problems remembered per chunk, and reported in all
+#define MAX_PROBLEMS 10
+
+typedef UInt256 (*BinaryOp)(UInt256 left, UInt256 right);
+
+static const struct {
+  char symbol;
+  BinaryOp fn;
+} ops[] = {
+  { '+', uint256_add },
+  { '-', uint256_sub },
+  { '*', uint256_mul },
+};
+
+#define NUM_OPS (sizeof(ops) / sizeof(ops[0]))
+
+enum { PROBLEM_MISMATCH, PROBLEM_MALFORMED };
+
+typedef struct {
+  uint64_t line;          // within the chunk, from 0
+  int kind;
+  UInt256 computed;       // for a mismatch
+} Problem;
+
+typedef struct {
+  const char *begin, *end;
+  uint64_t num_newlines;
+  uint64_t lines, mismatches, malformed;
+  Problem problems[MAX_PROBLEMS];
+  unsigned num_problems;
+  char *out;              // output (-w)
+  size_t out_len, out_capacity;
+  int done;
+} Chunk;
+
+static struct {
+  Chunk *chunks;
+  size_t num_chunks;
+  int write;
+  atomic_size_t next_chunk;
+
+  // for -w: chunks are written in order by the main thread
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t num_written;
+  int out_of_memory;
+} calc;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline int is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && is_blank(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// Parse the hex number at *p (after any blanks), advancing *p past it.
+static int parse_number(const char **p, const char *end, UInt256 *v) {
+  const char *start = skip_blanks(*p, end), *q = start;
+  while (q < end && !is_blank(*q)) {
+    q++;
+  }
+  *p = q;
+  return uint256_parse_hex(start, (size_t) (q - start), v);
+}
+
+static void add_problem(Chunk *c, uint64_t line, int kind, UInt256 computed) {
+  if (c->num_problems < MAX_PROBLEMS) {
+    c->problems[c->num_problems].line = line;
+    c->problems[c->num_problems].kind = kind;
+    c->problems[c->num_problems].computed = computed;
+    c->num_problems++;
+  }
+}
+
+// Make room for len more bytes of output. Returns 0, or -1 if memory
+// ran out.
+static int reserve_output(Chunk *c, size_t len) {
+  if (c->out_len + len > c->out_capacity) {
+    size_t capacity = c->out_capacity ? 2 * c->out_capacity : 2 * CHUNK_SIZE;
+    while (capacity < c->out_len + len) {
+      capacity *= 2;
+    }
+    char *out = realloc(c->out, capacity);
+    if (out == NULL) {
+      calc.out_of_memory = 1;
+      return -1;
+    }
+    c->out = out;
+    c->out_capacity = capacity;
+  }
+  return 0;
+}
+
+// Append a line of output: the operands as they were written, and
+// the result.
+static void append_output(Chunk *c, const char *text, size_t len, UInt256 result) {
+  if (reserve_output(c, len + 70) != 0) {
+    return;
+  }
+  memcpy(c->out + c->out_len, text, len);
+  c->out_len += len;
+  memcpy(c->out + c->out_len, " = ", 3);
+  c->out_len += 3;
+  c->out_len += uint256_format_hex(result, c->out + c->out_len);
+  c->out[c->out_len++] = '\n';
+}
+
+// Append a line of output with the given text, so that every input
+// line has its output line.
+static void append_line(Chunk *c, const char *text) {
+  size_t len = strlen(text);
+  if (reserve_output(c, len + 1) != 0) {
+    return;
+  }
+  memcpy(c->out + c->out_len, text, len);
+  c->out_len += len;
+  c->out[c->out_len++] = '\n';
+}
+
+// Evaluate the line [p, end) of a chunk.
+static void process_line(Chunk *c, uint64_t line, const char *p, const char *end) {
+  UInt256 left, right, result, expected;
+  const char *start = skip_blanks(p, end);
+  if (start == end) {
+    // blank
+    if (calc.write) {
+      append_line(c, "");
+    }
+    return;
+  }
+  c->lines++;
+
+  p = start;
+  if (parse_number(&p, end, &left) != 0) {
+    goto malformed;
+  }
+  p = skip_blanks(p, end);
+  if (p + 1 >= end || !is_blank(p[1])) {
+    goto malformed;
+  }
+  BinaryOp fn = NULL;
+  for (unsigned i = 0; i < NUM_OPS; i++) {
+    if (*p == ops[i].symbol) {
+      fn = ops[i].fn;
+    }
+  }
+  if (fn == NULL) {
+    goto malformed;
+  }
+  p++;
+  if (parse_number(&p, end, &right) != 0) {
+    goto malformed;
+  }
+  const char *operands_end = p;
+  result = fn(left, right);
+
+  p = skip_blanks(p, end);
+  if (calc.write) {
+    if (p < end && *p != '=') {
+      goto malformed;
+    }
+    append_output(c, start, (size_t) (operands_end - start), result);
+    return;
+  }
+
+  if (p == end || *p != '=') {
+    goto malformed;
+  }
+  p++;
+  if (parse_number(&p, end, &expected) != 0 || skip_blanks(p, end) != end) {
+    goto malformed;
+  }
+  if (memcmp(&result, &expected, sizeof(result)) != 0) {
+    c->mismatches++;
+    add_problem(c, line, PROBLEM_MISMATCH, result);
+  }
+  return;
+
+malformed:
+  c->malformed++;
+  add_problem(c, line, PROBLEM_MALFORMED, uint256_create_from_u32(0));
+  if (calc.write) {
+    append_line(c, "error: malformed line");
+  }
+}
+
+static void process_chunk(Chunk *c) {
+  const char *p = c->begin;
+  uint64_t line = 0;
+  while (p < c->end) {
+    const char *nl = memchr(p, '\n', (size_t) (c->end - p));
+    const char *line_end = nl != NULL ? nl : c->end;
+    process_line(c, line, p, line_end);
+    line++;
+    p = line_end + 1;
+  }
+  c->num_newlines = line;
+}
+
+static void *worker_main(void *arg) {
+  (void) arg;
+  for (;;) {
+    size_t i = atomic_fetch_add(&calc.next_chunk, 1);
+    if (i >= calc.num_chunks) {
+      return NULL;
+    }
+    if (calc.write) {
+      // don't get too far ahead of the output
+      pthread_mutex_lock(&calc.lock);
+      while (i >= calc.num_written + WINDOW) {
+        pthread_cond_wait(&calc.cond, &calc.lock);
+      }
+      pthread_mutex_unlock(&calc.lock);
+    }
+    process_chunk(&calc.chunks[i]);
+    pthread_mutex_lock(&calc.lock);
+    calc.chunks[i].done = 1;
+    pthread_cond_broadcast(&calc.cond);
+    pthread_mutex_unlock(&calc.lock);
+  }
+}
+
+// Cut [data, data + size) into chunks ending at newlines.
+static int make_chunks(const char *data, size_t size) {
+  size_t max_chunks = size / CHUNK_SIZE + 1;
+  calc.chunks = calloc(max_chunks, sizeof(Chunk));
+  if (calc.chunks == NULL) {
+    return -1;
+  }
+  const char *p = data, *end = data + size;
+  while (p < end) {
+    const char *chunk_end = end;
+    if ((size_t) (end - p) > CHUNK_SIZE) {
+      const char *nl = memchr(p + CHUNK_SIZE, '\n', (size_t) (end - p - CHUNK_SIZE));
+      chunk_end = nl != NULL ? nl + 1 : end;
+    }
+    Chunk *c = &calc.chunks[calc.num_chunks++];
+    c->begin = p;
+    c->end = chunk_end;
+    p = chunk_end;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *output = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:wo:")) != -1) {
+    switch (opt) {
+    case 't':
+      num_threads = atol(optarg);
+      break;
+    case 'w':
+      calc.write = 1;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: uint256_calc [-t threads] [-w] [-o output] file\n");
+      return 1;
+    }
+  }
+  if (optind + 1 != argc) {
+    fprintf(stderr, "Usage: uint256_calc [-t threads] [-w] [-o output] file\n");
+    return 1;
+  }
+  if (num_threads < 1) {
+    fprintf(stderr, "Error: invalid number of threads\n");
+    return 1;
+  }
+  if (output != NULL && !calc.write) {
+    fprintf(stderr, "Error: -o is only used with -w\n");
+    return 1;
+  }
+
+  int fd = open(argv[optind], O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Error: couldn't open %s\n", argv[optind]);
+    return 1;
+  }
+  size_t size = (size_t) st.st_size;
+  const char *data = "";
+  if (size > 0) {
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "Error: couldn't map %s\n", argv[optind]);
+      return 1;
+    }
+    madvise((void *) data, size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  FILE *out = stdout;
+  if (output != NULL) {
+    out = fopen(output, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Error: couldn't open %s\n", output);
+      return 1;
+    }
+  }
+
+  if (make_chunks(data, size) != 0) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+  pthread_mutex_init(&calc.lock, NULL);
+  pthread_cond_init(&calc.cond, NULL);
+
+  double start = now_seconds();
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  long started = 0;
+  for (; threads != NULL && started < num_threads; started++) {
+    if (pthread_create(&threads[started], NULL, worker_main, NULL) != 0) {
+      break;
+    }
+  }
+  if (started == 0) {
+    fprintf(stderr, "Error: couldn't start threads\n");
+    return 1;
+  }
+
+  int rc = 0;
+  if (calc.write) {
+    // write the chunks' output in order as they finish
+    for (size_t i = 0; i < calc.num_chunks; i++) {
+      Chunk *c = &calc.chunks[i];
+      pthread_mutex_lock(&calc.lock);
+      while (!c->done) {
+        pthread_cond_wait(&calc.cond, &calc.lock);
+      }
+      pthread_mutex_unlock(&calc.lock);
+      if (c->out_len > 0 && fwrite(c->out, 1, c->out_len, out) != c->out_len) {
+        rc = 1;
+      }
+      free(c->out);
+      c->out = NULL;
+      pthread_mutex_lock(&calc.lock);
+      calc.num_written = i + 1;
+      pthread_cond_broadcast(&calc.cond);
+      pthread_mutex_unlock(&calc.lock);
+    }
+  }
+  for (long i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  if (calc.write && fflush(out) != 0) {
+    rc = 1;
+  }
+  if (out != stdout && fclose(out) != 0) {
+    rc = 1;
+  }
+  if (rc != 0) {
+    fprintf(stderr, "Error: couldn't write the output\n");
+  }
+  if (calc.out_of_memory) {
+    fprintf(stderr, "Error: out of memory\n");
+    rc = 1;
+  }
+  double elapsed = now_seconds() - start;
+
+  // totals, and the first problems with their line numbers in the file
+  uint64_t lines = 0, mismatches = 0, malformed = 0, first_line = 1;
+  unsigned reported = 0;
+  for (size_t i = 0; i < calc.num_chunks; i++) {
+    Chunk *c = &calc.chunks[i];
+    lines += c->lines;
+    mismatches += c->mismatches;
+    malformed += c->malformed;
+    for (unsigned j = 0; j < c->num_problems && reported < MAX_PROBLEMS; j++, reported++) {
+      const Problem *p = &c->problems[j];
+      if (p->kind == PROBLEM_MISMATCH) {
+        char hex[65];
+        uint256_format_hex(p->computed, hex);
+        fprintf(stderr, "line %llu: result differs (computed %s)\n",
+                (unsigned long long) (first_line + p->line), hex);
+      } else {
+        fprintf(stderr, "line %llu: malformed\n", (unsigned long long) (first_line + p->line));
+      }
+    }
+    first_line += c->num_newlines;
+  }
+  fprintf(stderr, "%llu lines", (unsigned long long) lines);
+  if (!calc.write) {
+    fprintf(stderr, ", %llu mismatch(es)", (unsigned long long) mismatches);
+  }
+  fprintf(stderr, ", %llu malformed, in %.2f s (%.2f million lines/s, %.0f MB/s)\n",
+          (unsigned long long) malformed, elapsed, lines / elapsed / 1e6, size / elapsed / 1e6);
+
+  free(calc.chunks);
+  if (size > 0) {
+    munmap((void *) data, size);
+  }
+  return rc != 0 || mismatches > 0 || malformed > 0;
+}
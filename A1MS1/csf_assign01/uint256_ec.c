@@ -0,0 +1,521 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "uint256_mod.h"
+#include "uint256_ec.h"
+
+__extension__ typedef unsigned __int128 u128;
+
+typedef FieldSecp256k1 Fe;
+
+// The curve's constants, least significant word first
+static const UInt256 ORDER = { {
+  0xD0364141U, 0xBFD25E8CU, 0xAF48A03BU, 0xBAAEDCE6U, 0xFFFFFFFEU, 0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU
+} };
+static const UInt256 PRIME = { {
+  0xFFFFFC2FU, 0xFFFFFFFEU, 0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU
+} };
+static const UInt256 GX = { {
+  0x16F81798U, 0x59F2815BU, 0x2DCE28D9U, 0x029BFCDBU, 0xCE870B07U, 0x55A06295U, 0xF9DCBBACU, 0x79BE667EU
+} };
+static const UInt256 GY = { {
+  0xFB10D4B8U, 0x9C47D08FU, 0xA6855419U, 0xFD17B448U, 0x0E1108A8U, 0x5DA4FBFCU, 0x26A3C465U, 0x483ADA77U
+} };
+
+// Points whose multiples are taken with a NAF of this width use a
+// table of the odd multiples 1, 3, ..., 2^(W-1) - 1
+#define WNAF_WIDTH 5
+#define WNAF_TABLE (1 << (WNAF_WIDTH - 2))
+
+// Signatures are checked by secp256k1_verify_batch this many at a time
+#define VERIFY_CHUNK 64
+
+// Built on first use: j * 16^i * G at base_table[i][j - 1], and
+// Montgomery multiplication modulo the order, for the scalars
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static Secp256k1Affine base_table[64][15];
+static UInt256Mont order_mont;
+
+// Shorter names for the field operations
+static inline Fe fe_add(Fe a, Fe b) {
+  return field_secp256k1_add(a, b);
+}
+
+static inline Fe fe_sub(Fe a, Fe b) {
+  return field_secp256k1_sub(a, b);
+}
+
+static inline Fe fe_mul(Fe a, Fe b) {
+  return field_secp256k1_mul(a, b);
+}
+
+static inline Fe fe_sqr(Fe a) {
+  return field_secp256k1_sqr(a);
+}
+
+static inline int fe_is_zero(Fe a) {
+  return field_secp256k1_is_zero(a);
+}
+
+// a < b
+static int less(UInt256 a, UInt256 b) {
+  for (int i = 7; i >= 0; i--) {
+    if (a.data[i] != b.data[i]) {
+      return a.data[i] < b.data[i];
+    }
+  }
+  return 0;
+}
+
+static int is_zero(UInt256 a) {
+  uint32_t bits = 0;
+  for (int i = 0; i < 8; i++) {
+    bits |= a.data[i];
+  }
+  return bits == 0;
+}
+
+// a mod n, for any a (which is below 2n)
+static UInt256 reduce_order(UInt256 a) {
+  return less(a, ORDER) ? a : uint256_sub(a, ORDER);
+}
+
+// a * b mod n, for a and b below n: the Montgomery product of a * R
+// and b is a * b.
+static UInt256 mul_order(UInt256 a, UInt256 b) {
+  return uint256_mont_mul(&order_mont, uint256_mont_to(&order_mont, a), b);
+}
+
+static void set_infinity(Secp256k1Point *result) {
+  result->x = result->y = field_secp256k1_from_u32(1);
+  result->z = field_secp256k1_from_u32(0);
+}
+
+UInt256 secp256k1_order(void) {
+  return ORDER;
+}
+
+Secp256k1Affine secp256k1_generator(void) {
+  Secp256k1Affine g = { field_secp256k1_from_uint256(GX), field_secp256k1_from_uint256(GY), 0 };
+  return g;
+}
+
+// Whether y^2 = x^3 + 7 for the point's coordinates
+static int on_curve(Fe x, Fe y) {
+  Fe rhs = fe_add(fe_mul(fe_sqr(x), x), field_secp256k1_from_u32(7));
+  return field_secp256k1_equal(fe_sqr(y), rhs);
+}
+
+int secp256k1_affine_create(Secp256k1Affine *result, UInt256 x, UInt256 y) {
+  if (!less(x, PRIME) || !less(y, PRIME)) {
+    return -1;
+  }
+  Fe fx = field_secp256k1_from_uint256(x), fy = field_secp256k1_from_uint256(y);
+  if (!on_curve(fx, fy)) {
+    return -1;
+  }
+  result->x = fx;
+  result->y = fy;
+  result->infinity = 0;
+  return 0;
+}
+
+int secp256k1_affine_get(const Secp256k1Affine *point, UInt256 *x, UInt256 *y) {
+  if (point->infinity) {
+    return -1;
+  }
+  *x = field_secp256k1_to_uint256(point->x);
+  *y = field_secp256k1_to_uint256(point->y);
+  return 0;
+}
+
+void secp256k1_from_affine(Secp256k1Point *result, const Secp256k1Affine *point) {
+  if (point->infinity) {
+    set_infinity(result);
+    return;
+  }
+  result->x = point->x;
+  result->y = point->y;
+  result->z = field_secp256k1_from_u32(1);
+}
+
+void secp256k1_to_affine(Secp256k1Affine *result, const Secp256k1Point *point) {
+  if (secp256k1_is_infinity(point)) {
+    result->infinity = 1;
+    return;
+  }
+  Fe zi = field_secp256k1_inv(point->z), zi2 = fe_sqr(zi);
+  result->x = fe_mul(point->x, zi2);
+  result->y = fe_mul(point->y, fe_mul(zi2, zi));
+  result->infinity = 0;
+}
+
+// secp256k1_to_affine_batch with caller-provided room for n field
+// elements at z and zinv.
+static void to_affine_batch(Secp256k1Affine *out, const Secp256k1Point *in, size_t n, Fe *z, Fe *zinv) {
+  // the point at infinity has no inverse; stand in 1 for its Z
+  for (size_t i = 0; i < n; i++) {
+    z[i] = fe_is_zero(in[i].z) ? field_secp256k1_from_u32(1) : in[i].z;
+  }
+  field_secp256k1_inv_batch(zinv, z, n);
+  for (size_t i = 0; i < n; i++) {
+    if (fe_is_zero(in[i].z)) {
+      out[i].infinity = 1;
+      continue;
+    }
+    Fe zi2 = fe_sqr(zinv[i]);
+    out[i].x = fe_mul(in[i].x, zi2);
+    out[i].y = fe_mul(in[i].y, fe_mul(zi2, zinv[i]));
+    out[i].infinity = 0;
+  }
+}
+
+void secp256k1_to_affine_batch(Secp256k1Affine *out, const Secp256k1Point *in, size_t n) {
+  Fe *z = malloc(2 * n * sizeof(Fe));
+  if (z == NULL) {
+    for (size_t i = 0; i < n; i++) {
+      secp256k1_to_affine(&out[i], &in[i]);
+    }
+    return;
+  }
+  to_affine_batch(out, in, n, z, z + n);
+  free(z);
+}
+
+int secp256k1_is_infinity(const Secp256k1Point *point) {
+  return fe_is_zero(point->z);
+}
+
+// X1 / Z1^2 = X2 / Z2^2 and Y1 / Z1^3 = Y2 / Z2^3, multiplied out
+int secp256k1_equal(const Secp256k1Point *p, const Secp256k1Point *q) {
+  int p_inf = secp256k1_is_infinity(p), q_inf = secp256k1_is_infinity(q);
+  if (p_inf || q_inf) {
+    return p_inf && q_inf;
+  }
+  Fe z1z1 = fe_sqr(p->z), z2z2 = fe_sqr(q->z);
+  return field_secp256k1_equal(fe_mul(p->x, z2z2), fe_mul(q->x, z1z1))
+    && field_secp256k1_equal(fe_mul(p->y, fe_mul(z2z2, q->z)), fe_mul(q->y, fe_mul(z1z1, p->z)));
+}
+
+void secp256k1_neg(Secp256k1Point *result, const Secp256k1Point *point) {
+  result->x = point->x;
+  result->y = field_secp256k1_neg(point->y);
+  result->z = point->z;
+}
+
+// dbl-2009-l from the Explicit-Formulas Database (for a = 0): 2
+// multiplications and 5 squarings. The point at infinity doubles to
+// Z3 = 0 by itself, and there are no points with Y = 0.
+void secp256k1_double(Secp256k1Point *result, const Secp256k1Point *point) {
+  Fe a = fe_sqr(point->x), b = fe_sqr(point->y), c = fe_sqr(b);
+  Fe d = fe_sub(fe_sub(fe_sqr(fe_add(point->x, b)), a), c);
+  d = fe_add(d, d);
+  Fe e = field_secp256k1_mul_u32(a, 3), f = fe_sqr(e);
+  Fe z3 = fe_mul(point->y, point->z);
+  Fe x3 = fe_sub(f, fe_add(d, d));
+  result->y = fe_sub(fe_mul(e, fe_sub(d, x3)), field_secp256k1_mul_u32(c, 8));
+  result->x = x3;
+  result->z = fe_add(z3, z3);
+}
+
+// add-2007-bl: 11 multiplications and 5 squarings. When the x
+// coordinates match, the points are equal (and it's a doubling) or
+// each other's negation (and the sum is infinity).
+void secp256k1_add(Secp256k1Point *result, const Secp256k1Point *p, const Secp256k1Point *q) {
+  if (secp256k1_is_infinity(p)) {
+    *result = *q;
+    return;
+  }
+  if (secp256k1_is_infinity(q)) {
+    *result = *p;
+    return;
+  }
+  Fe z1z1 = fe_sqr(p->z), z2z2 = fe_sqr(q->z);
+  Fe u1 = fe_mul(p->x, z2z2), u2 = fe_mul(q->x, z1z1);
+  Fe s1 = fe_mul(fe_mul(p->y, q->z), z2z2), s2 = fe_mul(fe_mul(q->y, p->z), z1z1);
+  Fe h = fe_sub(u2, u1), r = fe_sub(s2, s1);
+  if (fe_is_zero(h)) {
+    if (fe_is_zero(r)) {
+      secp256k1_double(result, p);
+    } else {
+      set_infinity(result);
+    }
+    return;
+  }
+  r = fe_add(r, r);
+  Fe i = fe_sqr(fe_add(h, h)), j = fe_mul(h, i), v = fe_mul(u1, i);
+  Fe x3 = fe_sub(fe_sub(fe_sqr(r), j), fe_add(v, v));
+  Fe s1j = fe_mul(s1, j);
+  Fe y3 = fe_sub(fe_mul(r, fe_sub(v, x3)), fe_add(s1j, s1j));
+  result->z = fe_mul(fe_sub(fe_sub(fe_sqr(fe_add(p->z, q->z)), z1z1), z2z2), h);
+  result->x = x3;
+  result->y = y3;
+}
+
+// madd-2007-bl, add-2007-bl with Z2 = 1: 7 multiplications and 4
+// squarings.
+void secp256k1_add_affine(Secp256k1Point *result, const Secp256k1Point *p, const Secp256k1Affine *q) {
+  if (q->infinity) {
+    *result = *p;
+    return;
+  }
+  if (secp256k1_is_infinity(p)) {
+    secp256k1_from_affine(result, q);
+    return;
+  }
+  Fe z1z1 = fe_sqr(p->z);
+  Fe u2 = fe_mul(q->x, z1z1), s2 = fe_mul(fe_mul(q->y, p->z), z1z1);
+  Fe h = fe_sub(u2, p->x), r = fe_sub(s2, p->y);
+  if (fe_is_zero(h)) {
+    if (fe_is_zero(r)) {
+      secp256k1_double(result, p);
+    } else {
+      set_infinity(result);
+    }
+    return;
+  }
+  r = fe_add(r, r);
+  Fe hh = fe_sqr(h), i = fe_add(hh, hh);
+  i = fe_add(i, i);
+  Fe j = fe_mul(h, i), v = fe_mul(p->x, i);
+  Fe x3 = fe_sub(fe_sub(fe_sqr(r), j), fe_add(v, v));
+  Fe y1j = fe_mul(p->y, j);
+  Fe y3 = fe_sub(fe_mul(r, fe_sub(v, x3)), fe_add(y1j, y1j));
+  result->z = fe_sub(fe_sub(fe_sqr(fe_add(p->z, h)), z1z1), hh);
+  result->x = x3;
+  result->y = y3;
+}
+
+// Row i of the table is 1 to 15 times 16^i * G, built in Jacobian
+// coordinates and converted a row (one inversion) at a time.
+static void init(void) {
+  Secp256k1Affine g = secp256k1_generator();
+  Secp256k1Point base, row[15];
+  Fe z[15], zinv[15];
+  secp256k1_from_affine(&base, &g);
+  for (int i = 0; i < 64; i++) {
+    row[0] = base;
+    for (int j = 1; j < 15; j++) {
+      secp256k1_add(&row[j], &row[j - 1], &base);
+    }
+    secp256k1_add(&base, &row[14], &base);
+    to_affine_batch(base_table[i], row, 15, z, zinv);
+  }
+  uint256_mont_init(&order_mont, ORDER);
+}
+
+void secp256k1_mul_base(Secp256k1Point *result, UInt256 k) {
+  pthread_once(&init_once, init);
+  Secp256k1Point acc;
+  set_infinity(&acc);
+  for (int i = 0; i < 64; i++) {
+    unsigned digit = (k.data[i / 8] >> (i % 8 * 4)) & 15;
+    if (digit != 0) {
+      secp256k1_add_affine(&acc, &acc, &base_table[i][digit - 1]);
+    }
+  }
+  *result = acc;
+}
+
+// The width-5 NAF of k mod n, least significant digit first: odd
+// digits in (-16, 16), with at least four zeros after each nonzero
+// one. Returns the number of digits (at most 257).
+static int wnaf(int8_t naf[257], UInt256 k) {
+  k = reduce_order(k);
+  uint64_t w[4];
+  for (int i = 0; i < 4; i++) {
+    w[i] = k.data[2 * i] | (uint64_t) k.data[2 * i + 1] << 32;
+  }
+  int len = 0;
+  while (w[0] | w[1] | w[2] | w[3]) {
+    int digit = 0;
+    if (w[0] & 1) {
+      digit = (int) (w[0] & ((1 << WNAF_WIDTH) - 1));
+      if (digit >= 1 << (WNAF_WIDTH - 1)) {
+        digit -= 1 << WNAF_WIDTH;
+      }
+      // k -= digit, which clears the low WNAF_WIDTH bits, by adding
+      // -digit sign-extended to 256 bits (k < n keeps k + 15 from
+      // overflowing)
+      int64_t delta = -digit;
+      uint64_t fill = delta < 0 ? UINT64_MAX : 0;
+      u128 t = 0;
+      for (int i = 0; i < 4; i++) {
+        t += (u128) w[i] + (i == 0 ? (uint64_t) delta : fill);
+        w[i] = (uint64_t) t;
+        t >>= 64;
+      }
+    }
+    naf[len++] = (int8_t) digit;
+    for (int i = 0; i < 3; i++) {
+      w[i] = w[i] >> 1 | w[i + 1] << 63;
+    }
+    w[3] >>= 1;
+  }
+  return len;
+}
+
+// The odd multiples 1, 3, ..., 15 times point.
+static void odd_multiples(Secp256k1Point table[WNAF_TABLE], const Secp256k1Point *point) {
+  Secp256k1Point twice;
+  secp256k1_double(&twice, point);
+  table[0] = *point;
+  for (int i = 1; i < WNAF_TABLE; i++) {
+    secp256k1_add(&table[i], &table[i - 1], &twice);
+  }
+}
+
+// Double-and-add over the NAF digits from the top. The top digit is
+// nonzero, so the sum starts as its multiple rather than as the point
+// at infinity, doubled for nothing.
+static void mul_wnaf(Secp256k1Point *result, const Secp256k1Point table[WNAF_TABLE],
+                     const int8_t *naf, int len) {
+  Secp256k1Point acc, neg;
+  set_infinity(&acc);
+  for (int i = len - 1; i >= 0; i--) {
+    if (i != len - 1) {
+      secp256k1_double(&acc, &acc);
+    }
+    if (naf[i] > 0) {
+      secp256k1_add(&acc, &acc, &table[(naf[i] - 1) / 2]);
+    } else if (naf[i] < 0) {
+      secp256k1_neg(&neg, &table[(-naf[i] - 1) / 2]);
+      secp256k1_add(&acc, &acc, &neg);
+    }
+  }
+  *result = acc;
+}
+
+// The same, with the multiples in affine coordinates.
+static void mul_wnaf_affine(Secp256k1Point *result, const Secp256k1Affine table[WNAF_TABLE],
+                            const int8_t *naf, int len) {
+  Secp256k1Point acc;
+  Secp256k1Affine neg;
+  set_infinity(&acc);
+  for (int i = len - 1; i >= 0; i--) {
+    if (i != len - 1) {
+      secp256k1_double(&acc, &acc);
+    }
+    if (naf[i] > 0) {
+      secp256k1_add_affine(&acc, &acc, &table[(naf[i] - 1) / 2]);
+    } else if (naf[i] < 0) {
+      neg = table[(-naf[i] - 1) / 2];
+      neg.y = field_secp256k1_neg(neg.y);
+      secp256k1_add_affine(&acc, &acc, &neg);
+    }
+  }
+  *result = acc;
+}
+
+void secp256k1_mul(Secp256k1Point *result, const Secp256k1Point *point, UInt256 k) {
+  Secp256k1Point table[WNAF_TABLE];
+  int8_t naf[257];
+  int len = wnaf(naf, k);
+  odd_multiples(table, point);
+  mul_wnaf(result, table, naf, len);
+}
+
+// Whether the x coordinate of the point, mod n, is r, without
+// inverting Z: x = X / Z^2 is below p, so x mod n = r means x is r
+// or r + n (if that's below p), and X = x * Z^2.
+static int check_x(const Secp256k1Point *point, UInt256 r) {
+  if (secp256k1_is_infinity(point)) {
+    return 0;
+  }
+  Fe z2 = fe_sqr(point->z);
+  if (field_secp256k1_equal(point->x, fe_mul(field_secp256k1_from_uint256(r), z2))) {
+    return 1;
+  }
+  UInt256 r_plus_n = uint256_add(r, ORDER);
+  return less(r_plus_n, PRIME) && !less(r_plus_n, r)
+    && field_secp256k1_equal(point->x, fe_mul(field_secp256k1_from_uint256(r_plus_n), z2));
+}
+
+// Whether r and s are in [1, n) and the key is a point on the curve
+// (a point off it would put the multiplications on another curve)
+static int sig_in_range(const Secp256k1Signature *sig, const Secp256k1Affine *pub) {
+  return !pub->infinity && !is_zero(sig->r) && !is_zero(sig->s)
+    && less(sig->r, ORDER) && less(sig->s, ORDER) && on_curve(pub->x, pub->y);
+}
+
+// R = (z / s) * G + (r / s) * pub, and x(R) mod n must be r.
+int secp256k1_verify(UInt256 z, const Secp256k1Signature *sig, const Secp256k1Affine *pub) {
+  pthread_once(&init_once, init);
+  if (!sig_in_range(sig, pub)) {
+    return 0;
+  }
+  UInt256 w;
+  if (uint256_modinv(sig->s, ORDER, &w) != 0) {
+    return 0;
+  }
+  UInt256 u1 = mul_order(reduce_order(z), w), u2 = mul_order(sig->r, w);
+  Secp256k1Point q, r1, r2;
+  secp256k1_mul_base(&r1, u1);
+  secp256k1_from_affine(&q, pub);
+  secp256k1_mul(&r2, &q, u2);
+  secp256k1_add(&r1, &r1, &r2);
+  return check_x(&r1, sig->r);
+}
+
+// Room for one chunk of secp256k1_verify_batch
+typedef struct {
+  UInt256 s[VERIFY_CHUNK], s_inv[VERIFY_CHUNK];
+  Secp256k1Point multiples[VERIFY_CHUNK * WNAF_TABLE];
+  Secp256k1Affine affine[VERIFY_CHUNK * WNAF_TABLE];
+  Fe z[VERIFY_CHUNK * WNAF_TABLE], zinv[VERIFY_CHUNK * WNAF_TABLE];
+} VerifyScratch;
+
+// As secp256k1_verify, but each chunk of signatures shares one
+// inversion modulo n (for the s values) and one in the field (for
+// the keys' multiples, which then take mixed additions).
+long secp256k1_verify_batch(const UInt256 *z, const Secp256k1Signature *sig,
+                            const Secp256k1Affine *pub, size_t n, int *valid) {
+  pthread_once(&init_once, init);
+  VerifyScratch *scratch = malloc(sizeof(VerifyScratch));
+  if (scratch == NULL) {
+    return -1;
+  }
+  Secp256k1Affine g = secp256k1_generator();
+  long count = 0;
+  for (size_t start = 0; start < n; start += VERIFY_CHUNK) {
+    size_t m = n - start < VERIFY_CHUNK ? n - start : VERIFY_CHUNK;
+    // the signatures that are out of range stand in s = 1 and key G
+    // (and are marked invalid), so the batches stay invertible
+    for (size_t i = 0; i < m; i++) {
+      valid[start + i] = sig_in_range(&sig[start + i], &pub[start + i]);
+      scratch->s[i] = valid[start + i] ? sig[start + i].s : uint256_create_from_u32(1);
+      Secp256k1Point q;
+      secp256k1_from_affine(&q, valid[start + i] ? &pub[start + i] : &g);
+      odd_multiples(&scratch->multiples[i * WNAF_TABLE], &q);
+    }
+    // every s is in [1, n) for the prime n, so the batch inverts; but
+    // should it not, the chunk is checked one signature at a time
+    if (uint256_modinv_batch(scratch->s_inv, scratch->s, m, ORDER) != 0) {
+      for (size_t i = 0; i < m; i++) {
+        valid[start + i] = valid[start + i] && secp256k1_verify(z[start + i], &sig[start + i], &pub[start + i]);
+        count += valid[start + i];
+      }
+      continue;
+    }
+    to_affine_batch(scratch->affine, scratch->multiples, m * WNAF_TABLE, scratch->z, scratch->zinv);
+
+    for (size_t i = 0; i < m; i++) {
+      if (!valid[start + i]) {
+        continue;
+      }
+      const Secp256k1Signature *si = &sig[start + i];
+      UInt256 w = scratch->s_inv[i];
+      UInt256 u1 = mul_order(reduce_order(z[start + i]), w), u2 = mul_order(si->r, w);
+      Secp256k1Point acc, r1;
+      int8_t naf[257];
+      int len = wnaf(naf, u2);
+      mul_wnaf_affine(&acc, &scratch->affine[i * WNAF_TABLE], naf, len);
+      secp256k1_mul_base(&r1, u1);
+      secp256k1_add(&acc, &acc, &r1);
+      valid[start + i] = check_x(&acc, si->r);
+      count += valid[start + i];
+    }
+  }
+  free(scratch);
+  return count;
+}
@@ -0,0 +1,91 @@
+#ifndef UINT256_EC_H
+#define UINT256_EC_H
+
+#include <stddef.h>
+#include "uint256.h"
+#include "uint256_field.h"
+
+// Point arithmetic on the secp256k1 curve, y^2 = x^3 + 7 over the
+// field of uint256_field.h, and ECDSA signature verification.
+//
+// Points are mostly kept in Jacobian coordinates (X, Y, Z), standing
+// for the affine point (X / Z^2, Y / Z^3), so adding and doubling need
+// no field inversions; Z = 0 is the point at infinity. Points are
+// passed by pointer, and a result may be one of the arguments.
+//
+// None of this is constant time: it is meant for verification, where
+// the scalars and points are public, not for signing.
+
+// A point in Jacobian coordinates.
+typedef struct {
+  FieldSecp256k1 x, y, z;
+} Secp256k1Point;
+
+// A point in affine coordinates.
+typedef struct {
+  FieldSecp256k1 x, y;
+  int infinity;         // 1 for the point at infinity (x and y unused)
+} Secp256k1Affine;
+
+// An ECDSA signature.
+typedef struct {
+  UInt256 r, s;
+} Secp256k1Signature;
+
+// The group order n.
+UInt256 secp256k1_order(void);
+
+// The generator G.
+Secp256k1Affine secp256k1_generator(void);
+
+// Make an affine point from its coordinates. Returns 0, or -1 if
+// either is not below p or the point isn't on the curve.
+int secp256k1_affine_create(Secp256k1Affine *result, UInt256 x, UInt256 y);
+
+// Get an affine point's coordinates (in [0, p)). Returns 0, or -1 for
+// the point at infinity.
+int secp256k1_affine_get(const Secp256k1Affine *point, UInt256 *x, UInt256 *y);
+
+void secp256k1_from_affine(Secp256k1Point *result, const Secp256k1Affine *point);
+
+// Convert to affine coordinates, with one field inversion.
+void secp256k1_to_affine(Secp256k1Affine *result, const Secp256k1Point *point);
+
+// Convert n points with a single inversion between them. out must not
+// overlap in.
+void secp256k1_to_affine_batch(Secp256k1Affine *out, const Secp256k1Point *in, size_t n);
+
+// 1 if the points are the same (in whatever coordinates), otherwise 0.
+int secp256k1_equal(const Secp256k1Point *p, const Secp256k1Point *q);
+int secp256k1_is_infinity(const Secp256k1Point *point);
+
+void secp256k1_neg(Secp256k1Point *result, const Secp256k1Point *point);
+void secp256k1_double(Secp256k1Point *result, const Secp256k1Point *point);
+void secp256k1_add(Secp256k1Point *result, const Secp256k1Point *p, const Secp256k1Point *q);
+
+// p + q for an affine q (a mixed addition, which is cheaper).
+void secp256k1_add_affine(Secp256k1Point *result, const Secp256k1Point *p, const Secp256k1Affine *q);
+
+// k * G, from a table of the multiples j * 16^i * G (for j from 1 to
+// 15), built on first use: one mixed addition per nonzero 4-bit digit
+// of k, and no doublings.
+void secp256k1_mul_base(Secp256k1Point *result, UInt256 k);
+
+// k * point, for any point, with a width-5 NAF of k (a signed digit
+// every 5 bits or more, taken from 8 precomputed odd multiples).
+void secp256k1_mul(Secp256k1Point *result, const Secp256k1Point *point, UInt256 k);
+
+// Check an ECDSA signature of the message hash z by the public key
+// pub. Returns 1 if it's valid, otherwise 0 (also if pub is the point
+// at infinity or not on the curve).
+int secp256k1_verify(UInt256 z, const Secp256k1Signature *sig, const Secp256k1Affine *pub);
+
+// Check n signatures at once, setting valid[i] to what
+// secp256k1_verify would return for each. The inverses of the s
+// values, and the conversion of each key's multiples to affine
+// coordinates, are done as batches with one inversion each. Returns
+// the number of valid signatures, or -1 if memory runs out.
+long secp256k1_verify_batch(const UInt256 *z, const Secp256k1Signature *sig,
+                            const Secp256k1Affine *pub, size_t n, int *valid);
+
+#endif // UINT256_EC_H
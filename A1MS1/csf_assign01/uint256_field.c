@@ -0,0 +1,322 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "uint256_field.h"
+
+__extension__ typedef unsigned __int128 u128;
+
+// The generic code below takes the field's constants as arguments;
+// each field's functions pass their own, and the compiler inlines the
+// helpers into them and specializes them.
+//
+//   c: 2^256 mod p
+//   p: the prime, for the final reduction
+//   passes: how many times p may have to be subtracted from a value
+//     below 2^256 to bring it below p
+
+static const uint64_t SECP256K1_C = 0x1000003D1ULL;
+static const uint64_t SECP256K1_P[4] = {
+  0xFFFFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL
+};
+// p - 2, the inversion exponent
+static const uint64_t SECP256K1_P_2[4] = {
+  0xFFFFFFFEFFFFFC2DULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL
+};
+
+static const uint64_t P25519_C = 38;
+static const uint64_t P25519_P[4] = {
+  0xFFFFFFFFFFFFFFEDULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0x7FFFFFFFFFFFFFFFULL
+};
+static const uint64_t P25519_P_2[4] = {
+  0xFFFFFFFFFFFFFFEBULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0x7FFFFFFFFFFFFFFFULL
+};
+
+static inline void from_uint256(uint64_t r[4], UInt256 val) {
+  for (int i = 0; i < 4; i++) {
+    r[i] = val.data[2 * i] | (uint64_t) val.data[2 * i + 1] << 32;
+  }
+}
+
+static inline UInt256 to_uint256(const uint64_t a[4]) {
+  UInt256 val;
+  for (int i = 0; i < 4; i++) {
+    val.data[2 * i] = (uint32_t) a[i];
+    val.data[2 * i + 1] = (uint32_t) (a[i] >> 32);
+  }
+  return val;
+}
+
+// r = top * 2^256 + r, reduced below 2^256: add top * c, and if that
+// overflows, c once more (which can't overflow again, as what's left
+// is below top * c).
+static inline void fold(uint64_t r[4], uint64_t top, uint64_t c) {
+  u128 t = (u128) top * c + r[0];
+  r[0] = (uint64_t) t;
+  t >>= 64;
+  for (int i = 1; i < 4; i++) {
+    t += r[i];
+    r[i] = (uint64_t) t;
+    t >>= 64;
+  }
+  t = (u128) r[0] + (c & -(uint64_t) t);
+  r[0] = (uint64_t) t;
+  t >>= 64;
+  for (int i = 1; i < 4; i++) {
+    t += r[i];
+    r[i] = (uint64_t) t;
+    t >>= 64;
+  }
+}
+
+static inline void fe_add(uint64_t r[4], const uint64_t a[4], const uint64_t b[4], uint64_t c) {
+  u128 t = 0;
+  for (int i = 0; i < 4; i++) {
+    t += (u128) a[i] + b[i];
+    r[i] = (uint64_t) t;
+    t >>= 64;
+  }
+  fold(r, (uint64_t) t, c);
+}
+
+// r - c if borrow, twice: a - b wraps to a - b + 2^256, which is c too
+// much, and if taking c off borrows again, that wraps by another
+// 2^256 (and leaves plenty of room).
+static inline void fe_sub(uint64_t r[4], const uint64_t a[4], const uint64_t b[4], uint64_t c) {
+  uint64_t borrow = 0;
+  for (int i = 0; i < 4; i++) {
+    u128 t = (u128) a[i] - b[i] - borrow;
+    r[i] = (uint64_t) t;
+    borrow = (uint64_t) (t >> 64) & 1;
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    uint64_t sub = c & -borrow;
+    borrow = 0;
+    for (int i = 0; i < 4; i++) {
+      u128 t = (u128) r[i] - (i == 0 ? sub : 0) - borrow;
+      r[i] = (uint64_t) t;
+      borrow = (uint64_t) (t >> 64) & 1;
+    }
+  }
+}
+
+// Fold the high half of the 512-bit t into the low half: c is below
+// 2^64, so hi * c + lo fits in five limbs, and the fifth goes through
+// fold.
+static inline void reduce512(uint64_t r[4], const uint64_t t[8], uint64_t c) {
+  u128 acc = 0;
+  for (int i = 0; i < 4; i++) {
+    acc += (u128) t[i + 4] * c + t[i];
+    r[i] = (uint64_t) acc;
+    acc >>= 64;
+  }
+  fold(r, (uint64_t) acc, c);
+}
+
+static inline void fe_mul(uint64_t r[4], const uint64_t a[4], const uint64_t b[4], uint64_t c) {
+  uint64_t t[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  for (int i = 0; i < 4; i++) {
+    u128 acc = 0;
+    for (int j = 0; j < 4; j++) {
+      acc += (u128) a[i] * b[j] + t[i + j];
+      t[i + j] = (uint64_t) acc;
+      acc >>= 64;
+    }
+    t[i + 4] = (uint64_t) acc;
+  }
+  reduce512(r, t, c);
+}
+
+// Squaring needs only the 6 distinct cross products, doubled, plus the
+// 4 squares, instead of 16 products.
+static inline void fe_sqr(uint64_t r[4], const uint64_t a[4], uint64_t c) {
+  uint64_t t[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  for (int i = 0; i < 3; i++) {
+    u128 acc = 0;
+    for (int j = i + 1; j < 4; j++) {
+      acc += (u128) a[i] * a[j] + t[i + j];
+      t[i + j] = (uint64_t) acc;
+      acc >>= 64;
+    }
+    t[i + 4] = (uint64_t) acc;
+  }
+  for (int i = 7; i > 0; i--) {
+    t[i] = t[i] << 1 | t[i - 1] >> 63;
+  }
+  t[0] <<= 1;
+  u128 acc = 0;
+  for (int i = 0; i < 4; i++) {
+    u128 sq = (u128) a[i] * a[i];
+    acc += (u128) t[2 * i] + (uint64_t) sq;
+    t[2 * i] = (uint64_t) acc;
+    acc >>= 64;
+    acc += (u128) t[2 * i + 1] + (uint64_t) (sq >> 64);
+    t[2 * i + 1] = (uint64_t) acc;
+    acc >>= 64;
+  }
+  reduce512(r, t, c);
+}
+
+static inline void fe_mul_u32(uint64_t r[4], const uint64_t a[4], uint32_t k, uint64_t c) {
+  u128 acc = 0;
+  for (int i = 0; i < 4; i++) {
+    acc += (u128) a[i] * k;
+    r[i] = (uint64_t) acc;
+    acc >>= 64;
+  }
+  fold(r, (uint64_t) acc, c);
+}
+
+// Subtract p while the value isn't below it, at most passes times.
+static inline void canonical(uint64_t r[4], const uint64_t a[4], const uint64_t p[4], int passes) {
+  for (int i = 0; i < 4; i++) {
+    r[i] = a[i];
+  }
+  for (int pass = 0; pass < passes; pass++) {
+    uint64_t d[4], borrow = 0;
+    for (int i = 0; i < 4; i++) {
+      u128 t = (u128) r[i] - p[i] - borrow;
+      d[i] = (uint64_t) t;
+      borrow = (uint64_t) (t >> 64) & 1;
+    }
+    uint64_t keep = -borrow;
+    for (int i = 0; i < 4; i++) {
+      r[i] = (r[i] & keep) | (d[i] & ~keep);
+    }
+  }
+}
+
+static inline int fe_is_zero(const uint64_t a[4], const uint64_t p[4], int passes) {
+  uint64_t r[4];
+  canonical(r, a, p, passes);
+  return (r[0] | r[1] | r[2] | r[3]) == 0;
+}
+
+// a^e, a 4-bit window at a time from the top. The exponent is public
+// (p - 2), so the table lookups by its digits give nothing away.
+static inline void fe_pow(uint64_t r[4], const uint64_t a[4], const uint64_t e[4], uint64_t c) {
+  uint64_t table[16][4] = { { 1, 0, 0, 0 } };
+  for (int i = 0; i < 4; i++) {
+    table[1][i] = a[i];
+  }
+  for (int i = 2; i < 16; i++) {
+    fe_mul(table[i], table[i - 1], a, c);
+  }
+  uint64_t x[4] = { 1, 0, 0, 0 };
+  for (int i = 63; i >= 0; i--) {
+    if (i != 63) {
+      for (int k = 0; k < 4; k++) {
+        fe_sqr(x, x, c);
+      }
+    }
+    unsigned digit = (unsigned) (e[i / 16] >> (i % 16 * 4)) & 15;
+    fe_mul(x, x, table[digit], c);
+  }
+  for (int i = 0; i < 4; i++) {
+    r[i] = x[i];
+  }
+}
+
+// Each field's functions, on its own type and constants.
+#define FIELD_FUNCTIONS(name, Type, C, P, P_2, PASSES) \
+  Type field_##name##_from_uint256(UInt256 val) { \
+    Type r; \
+    from_uint256(r.w, val); \
+    return r; \
+  } \
+  \
+  UInt256 field_##name##_to_uint256(Type a) { \
+    uint64_t r[4]; \
+    canonical(r, a.w, P, PASSES); \
+    return to_uint256(r); \
+  } \
+  \
+  Type field_##name##_from_u32(uint32_t val) { \
+    Type r = { { val, 0, 0, 0 } }; \
+    return r; \
+  } \
+  \
+  Type field_##name##_add(Type a, Type b) { \
+    Type r; \
+    fe_add(r.w, a.w, b.w, C); \
+    return r; \
+  } \
+  \
+  Type field_##name##_sub(Type a, Type b) { \
+    Type r; \
+    fe_sub(r.w, a.w, b.w, C); \
+    return r; \
+  } \
+  \
+  Type field_##name##_neg(Type a) { \
+    Type r; \
+    const uint64_t zero[4] = { 0, 0, 0, 0 }; \
+    fe_sub(r.w, zero, a.w, C); \
+    return r; \
+  } \
+  \
+  Type field_##name##_mul(Type a, Type b) { \
+    Type r; \
+    fe_mul(r.w, a.w, b.w, C); \
+    return r; \
+  } \
+  \
+  Type field_##name##_mul_u32(Type a, uint32_t k) { \
+    Type r; \
+    fe_mul_u32(r.w, a.w, k, C); \
+    return r; \
+  } \
+  \
+  Type field_##name##_sqr(Type a) { \
+    Type r; \
+    fe_sqr(r.w, a.w, C); \
+    return r; \
+  } \
+  \
+  Type field_##name##_inv(Type a) { \
+    Type r; \
+    fe_pow(r.w, a.w, P_2, C); \
+    return r; \
+  } \
+  \
+  int field_##name##_equal(Type a, Type b) { \
+    uint64_t d[4]; \
+    fe_sub(d, a.w, b.w, C); \
+    return fe_is_zero(d, P, PASSES); \
+  } \
+  \
+  int field_##name##_is_zero(Type a) { \
+    return fe_is_zero(a.w, P, PASSES); \
+  } \
+  \
+  void field_##name##_mul_batch(Type *out, const Type *a, const Type *b, size_t n) { \
+    for (size_t i = 0; i < n; i++) { \
+      fe_mul(out[i].w, a[i].w, b[i].w, C); \
+    } \
+  } \
+  \
+  int field_##name##_inv_batch(Type *out, const Type *in, size_t n) { \
+    if (n == 0) { \
+      return 0; \
+    } \
+    /* out[i] holds the product of in[0..i], then its inverse walks */ \
+    /* back down, giving up one factor at a time */ \
+    out[0] = in[0]; \
+    for (size_t i = 1; i < n; i++) { \
+      fe_mul(out[i].w, out[i - 1].w, in[i].w, C); \
+    } \
+    if (fe_is_zero(out[n - 1].w, P, PASSES)) { \
+      return -1; \
+    } \
+    uint64_t t[4]; \
+    fe_pow(t, out[n - 1].w, P_2, C); \
+    for (size_t i = n - 1; i > 0; i--) { \
+      fe_mul(out[i].w, t, out[i - 1].w, C); \
+      fe_mul(t, t, in[i].w, C); \
+    } \
+    for (int i = 0; i < 4; i++) { \
+      out[0].w[i] = t[i]; \
+    } \
+    return 0; \
+  }
+
+FIELD_FUNCTIONS(secp256k1, FieldSecp256k1, SECP256K1_C, SECP256K1_P, SECP256K1_P_2, 1)
+FIELD_FUNCTIONS(25519, Field25519, P25519_C, P25519_P, P25519_P_2, 2)
@@ -0,0 +1,87 @@
+#ifndef UINT256_FIELD_H
+#define UINT256_FIELD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "uint256.h"
+
+// Arithmetic modulo two fixed pseudo-Mersenne primes,
+//
+//   secp256k1: p = 2^256 - 2^32 - 977
+//   25519:     p = 2^255 - 19
+//
+// For both, 2^256 is a small constant modulo p (2^32 + 977 and 38),
+// so the high half of a 512-bit product is folded into the low half
+// with a multiplication by that constant instead of a division. Each
+// field has its own type, and its functions are the same code
+// compiled with its own constants.
+//
+// Reduction is lazy: an element is any value below 2^256 congruent to
+// it, not necessarily less than p, and only the conversion back to a
+// UInt256 and the comparisons reduce it fully. Every function takes
+// any such value and runs in constant time.
+
+// An element of the secp256k1 field, as four 64-bit limbs, least
+// significant first.
+typedef struct {
+  uint64_t w[4];
+} FieldSecp256k1;
+
+// An element of the field modulo 2^255 - 19.
+typedef struct {
+  uint64_t w[4];
+} Field25519;
+
+// Convert a UInt256 (any value) to an element, and an element to its
+// value in [0, p).
+FieldSecp256k1 field_secp256k1_from_uint256(UInt256 val);
+UInt256 field_secp256k1_to_uint256(FieldSecp256k1 a);
+
+// The element with the given small value.
+FieldSecp256k1 field_secp256k1_from_u32(uint32_t val);
+
+FieldSecp256k1 field_secp256k1_add(FieldSecp256k1 a, FieldSecp256k1 b);
+FieldSecp256k1 field_secp256k1_sub(FieldSecp256k1 a, FieldSecp256k1 b);
+FieldSecp256k1 field_secp256k1_neg(FieldSecp256k1 a);
+FieldSecp256k1 field_secp256k1_mul(FieldSecp256k1 a, FieldSecp256k1 b);
+FieldSecp256k1 field_secp256k1_mul_u32(FieldSecp256k1 a, uint32_t k);
+FieldSecp256k1 field_secp256k1_sqr(FieldSecp256k1 a);
+
+// a^(p - 2), the inverse of a nonzero a (and 0 for 0). Computed by
+// Fermat's little theorem so that, like the rest of the field, it
+// runs in constant time; uint256_modinv is faster when the input
+// isn't secret.
+FieldSecp256k1 field_secp256k1_inv(FieldSecp256k1 a);
+
+// 1 if a and b are congruent mod p, otherwise 0.
+int field_secp256k1_equal(FieldSecp256k1 a, FieldSecp256k1 b);
+
+// 1 if a is congruent to 0 mod p, otherwise 0.
+int field_secp256k1_is_zero(FieldSecp256k1 a);
+
+// out[i] = a[i] * b[i] for n elements. out may be a or b.
+void field_secp256k1_mul_batch(FieldSecp256k1 *out, const FieldSecp256k1 *a,
+                               const FieldSecp256k1 *b, size_t n);
+
+// Invert n elements with one inversion and 3(n - 1) multiplications
+// (Montgomery's trick). out must not overlap in. Returns 0, or -1 if
+// any element is 0 (and out is left unspecified).
+int field_secp256k1_inv_batch(FieldSecp256k1 *out, const FieldSecp256k1 *in, size_t n);
+
+// The same for 2^255 - 19.
+Field25519 field_25519_from_uint256(UInt256 val);
+UInt256 field_25519_to_uint256(Field25519 a);
+Field25519 field_25519_from_u32(uint32_t val);
+Field25519 field_25519_add(Field25519 a, Field25519 b);
+Field25519 field_25519_sub(Field25519 a, Field25519 b);
+Field25519 field_25519_neg(Field25519 a);
+Field25519 field_25519_mul(Field25519 a, Field25519 b);
+Field25519 field_25519_mul_u32(Field25519 a, uint32_t k);
+Field25519 field_25519_sqr(Field25519 a);
+Field25519 field_25519_inv(Field25519 a);
+int field_25519_equal(Field25519 a, Field25519 b);
+int field_25519_is_zero(Field25519 a);
+void field_25519_mul_batch(Field25519 *out, const Field25519 *a, const Field25519 *b, size_t n);
+int field_25519_inv_batch(Field25519 *out, const Field25519 *in, size_t n);
+
+#endif // UINT256_FIELD_H
@@ -0,0 +1,551 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "uint256_mod.h"
+
+// The arithmetic here is done on four 64-bit limbs, least significant
+// first, with carries through a 128-bit type.
+__extension__ typedef unsigned __int128 u128;
+
+typedef struct {
+  uint64_t w[4];
+} Limbs;
+
+static Limbs to_limbs(UInt256 val) {
+  Limbs x;
+  for (int i = 0; i < 4; i++) {
+    x.w[i] = val.data[2 * i] | (uint64_t) val.data[2 * i + 1] << 32;
+  }
+  return x;
+}
+
+static UInt256 from_limbs(const uint64_t w[4]) {
+  UInt256 val;
+  for (int i = 0; i < 4; i++) {
+    val.data[2 * i] = (uint32_t) w[i];
+    val.data[2 * i + 1] = (uint32_t) (w[i] >> 32);
+  }
+  return val;
+}
+
+static int is_zero(const uint64_t a[4]) {
+  return (a[0] | a[1] | a[2] | a[3]) == 0;
+}
+
+static int is_one(const uint64_t a[4]) {
+  return ((a[0] ^ 1) | a[1] | a[2] | a[3]) == 0;
+}
+
+// Compare a and b (not in constant time): -1, 0 or 1.
+static int cmp(const uint64_t a[4], const uint64_t b[4]) {
+  for (int i = 3; i >= 0; i--) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+// a + b into r, returning the carry out.
+static uint64_t add(uint64_t r[4], const uint64_t a[4], const uint64_t b[4]) {
+  u128 t = 0;
+  for (int i = 0; i < 4; i++) {
+    t += (u128) a[i] + b[i];
+    r[i] = (uint64_t) t;
+    t >>= 64;
+  }
+  return (uint64_t) t;
+}
+
+// a - b into r, returning the borrow out.
+static uint64_t sub(uint64_t r[4], const uint64_t a[4], const uint64_t b[4]) {
+  uint64_t borrow = 0;
+  for (int i = 0; i < 4; i++) {
+    u128 t = (u128) a[i] - b[i] - borrow;
+    r[i] = (uint64_t) t;
+    borrow = (uint64_t) (t >> 64) & 1;
+  }
+  return borrow;
+}
+
+// The constant-time helpers take a mask of all ones or all zeros for
+// the condition.
+
+// r += b if mask; returns the carry out.
+static uint64_t cnd_add(uint64_t mask, uint64_t r[4], const uint64_t b[4]) {
+  u128 t = 0;
+  for (int i = 0; i < 4; i++) {
+    t += (u128) r[i] + (b[i] & mask);
+    r[i] = (uint64_t) t;
+    t >>= 64;
+  }
+  return (uint64_t) t;
+}
+
+// r -= b if mask; returns the borrow out.
+static uint64_t cnd_sub(uint64_t mask, uint64_t r[4], const uint64_t b[4]) {
+  uint64_t borrow = 0;
+  for (int i = 0; i < 4; i++) {
+    u128 t = (u128) r[i] - (b[i] & mask) - borrow;
+    r[i] = (uint64_t) t;
+    borrow = (uint64_t) (t >> 64) & 1;
+  }
+  return borrow;
+}
+
+// r = -r if mask.
+static void cnd_neg(uint64_t mask, uint64_t r[4]) {
+  u128 t = mask & 1;
+  for (int i = 0; i < 4; i++) {
+    t += r[i] ^ mask;
+    r[i] = (uint64_t) t;
+    t >>= 64;
+  }
+}
+
+static void cnd_swap(uint64_t mask, uint64_t a[4], uint64_t b[4]) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t t = (a[i] ^ b[i]) & mask;
+    a[i] ^= t;
+    b[i] ^= t;
+  }
+}
+
+// r = (top:r) >> 1, where top is the bit shifted in at the top.
+static void shr1(uint64_t r[4], uint64_t top) {
+  for (int i = 0; i < 3; i++) {
+    r[i] = r[i] >> 1 | r[i + 1] << 63;
+  }
+  r[3] = r[3] >> 1 | top << 63;
+}
+
+// r >>= n, for n < 256.
+static void shr(uint64_t r[4], unsigned n) {
+  unsigned words = n / 64, bits = n % 64;
+  for (unsigned i = 0; i < 4; i++) {
+    uint64_t lo = i + words < 4 ? r[i + words] : 0;
+    uint64_t hi = i + words + 1 < 4 ? r[i + words + 1] : 0;
+    r[i] = bits ? lo >> bits | hi << (64 - bits) : lo;
+  }
+}
+
+// The number of trailing zero bits of a nonzero a.
+static unsigned ctz(const uint64_t a[4]) {
+  unsigned i = 0;
+  while (a[i] == 0) {
+    i++;
+  }
+  return i * 64 + (unsigned) __builtin_ctzll(a[i]);
+}
+
+// Shift-and-subtract long division, one quotient bit per step, in
+// constant time. b must be nonzero.
+static void divmod(const uint64_t a[4], const uint64_t b[4], uint64_t q[4], uint64_t r[4]) {
+  for (int i = 0; i < 4; i++) {
+    q[i] = r[i] = 0;
+  }
+  for (int i = 255; i >= 0; i--) {
+    uint64_t top = r[3] >> 63;
+    for (int j = 3; j > 0; j--) {
+      r[j] = r[j] << 1 | r[j - 1] >> 63;
+    }
+    r[0] = r[0] << 1 | (a[i / 64] >> (i % 64) & 1);
+    // subtract b if top:r >= b, i.e. if there's a top bit or no borrow
+    uint64_t t[4];
+    uint64_t borrow = sub(t, r, b);
+    uint64_t mask = -((top | (borrow ^ 1)) & 1);
+    for (int j = 0; j < 4; j++) {
+      r[j] = (t[j] & mask) | (r[j] & ~mask);
+    }
+    q[i / 64] |= (mask & 1) << (i % 64);
+  }
+}
+
+// a mod m, for a nonzero m.
+static void reduce(uint64_t a[4], const uint64_t m[4]) {
+  uint64_t q[4], r[4];
+  divmod(a, m, q, r);
+  for (int i = 0; i < 4; i++) {
+    a[i] = r[i];
+  }
+}
+
+int uint256_divmod(UInt256 a, UInt256 b, UInt256 *quotient, UInt256 *remainder) {
+  Limbs x = to_limbs(a), y = to_limbs(b);
+  if (is_zero(y.w)) {
+    return -1;
+  }
+  uint64_t q[4], r[4];
+  divmod(x.w, y.w, q, r);
+  if (quotient) {
+    *quotient = from_limbs(q);
+  }
+  if (remainder) {
+    *remainder = from_limbs(r);
+  }
+  return 0;
+}
+
+// Stein's algorithm: take out the common factors of two, then keep
+// subtracting the smaller value from the larger and dropping the
+// factors of two from the difference, which leaves both odd.
+UInt256 uint256_gcd(UInt256 a, UInt256 b) {
+  Limbs x = to_limbs(a), y = to_limbs(b);
+  if (is_zero(x.w)) {
+    return b;
+  }
+  if (is_zero(y.w)) {
+    return a;
+  }
+  unsigned zx = ctz(x.w), zy = ctz(y.w);
+  unsigned shift = zx < zy ? zx : zy;
+  shr(x.w, zx);
+  do {
+    shr(y.w, ctz(y.w));
+    if (cmp(x.w, y.w) > 0) {
+      Limbs t = x;
+      x = y;
+      y = t;
+    }
+    sub(y.w, y.w, x.w);
+  } while (!is_zero(y.w));
+  // shift the common power of two back in
+  Limbs g = { { 0, 0, 0, 0 } };
+  for (int i = 0; i < 4; i++) {
+    unsigned j = i + shift / 64;
+    if (j < 4) {
+      g.w[j] |= x.w[i] << (shift % 64);
+    }
+    if (shift % 64 && j + 1 < 4) {
+      g.w[j + 1] |= x.w[i] >> (64 - shift % 64);
+    }
+  }
+  return from_limbs(g.w);
+}
+
+// x / 2 mod an odd m, for x < m.
+static void half_mod(uint64_t x[4], const uint64_t m[4]) {
+  uint64_t carry = 0;
+  if (x[0] & 1) {
+    carry = add(x, x, m);
+  }
+  shr1(x, carry);
+}
+
+// Binary extended Euclid for an odd modulus, keeping
+//
+//   u = x1 * a (mod m), v = x2 * a (mod m)
+//
+// while u and v are reduced as in the binary GCD. a must be less than m.
+static int modinv_odd(uint64_t r[4], const uint64_t a[4], const uint64_t m[4]) {
+  uint64_t u[4], v[4], x1[4] = { 1, 0, 0, 0 }, x2[4] = { 0, 0, 0, 0 };
+  for (int i = 0; i < 4; i++) {
+    u[i] = a[i];
+    v[i] = m[i];
+  }
+  if (is_zero(u)) {
+    return -1;
+  }
+  while (!is_one(u) && !is_one(v)) {
+    while ((u[0] & 1) == 0) {
+      shr1(u, 0);
+      half_mod(x1, m);
+    }
+    while ((v[0] & 1) == 0) {
+      shr1(v, 0);
+      half_mod(x2, m);
+    }
+    if (cmp(u, v) >= 0) {
+      sub(u, u, v);
+      if (sub(x1, x1, x2)) {
+        add(x1, x1, m);
+      }
+      if (is_zero(u)) {
+        return -1;          // u = v = gcd(a, m) > 1
+      }
+    } else {
+      sub(v, v, u);
+      if (sub(x2, x2, x1)) {
+        add(x2, x2, m);
+      }
+    }
+  }
+  const uint64_t *x = is_one(u) ? x1 : x2;
+  for (int i = 0; i < 4; i++) {
+    r[i] = x[i];
+  }
+  return 0;
+}
+
+// The extended Euclidean algorithm, for an even modulus. The Bezout
+// coefficients of a alternate in sign, so only their magnitudes are
+// kept, and they never exceed m.
+static int modinv_euclid(uint64_t r[4], const uint64_t a[4], const uint64_t m[4]) {
+  uint64_t r0[4], r1[4], t0[4] = { 0, 0, 0, 0 }, t1[4] = { 1, 0, 0, 0 };
+  int t0_negative = 0, t1_negative = 0;
+  for (int i = 0; i < 4; i++) {
+    r0[i] = m[i];
+    r1[i] = a[i];
+  }
+  while (!is_zero(r1)) {
+    uint64_t q[4], rem[4];
+    divmod(r0, r1, q, rem);
+    UInt256 qt = uint256_mul(from_limbs(q), from_limbs(t1));
+    Limbs next = to_limbs(qt);
+    add(next.w, next.w, t0);
+    for (int i = 0; i < 4; i++) {
+      r0[i] = r1[i];
+      r1[i] = rem[i];
+      t0[i] = t1[i];
+      t1[i] = next.w[i];
+    }
+    t0_negative = t1_negative;
+    t1_negative = !t1_negative;
+  }
+  if (!is_one(r0)) {
+    return -1;
+  }
+  if (t0_negative) {
+    sub(t0, m, t0);
+  }
+  for (int i = 0; i < 4; i++) {
+    r[i] = t0[i];
+  }
+  return 0;
+}
+
+int uint256_modinv(UInt256 a, UInt256 m, UInt256 *result) {
+  Limbs x = to_limbs(a), n = to_limbs(m);
+  if (is_zero(n.w) || is_one(n.w)) {
+    return -1;
+  }
+  if (cmp(x.w, n.w) >= 0) {
+    reduce(x.w, n.w);
+  }
+  uint64_t r[4];
+  int rc = n.w[0] & 1 ? modinv_odd(r, x.w, n.w) : modinv_euclid(r, x.w, n.w);
+  if (rc == 0) {
+    *result = from_limbs(r);
+  }
+  return rc;
+}
+
+// Möller's constant-time inversion (as in Nettle), for an odd m and
+// a < m. It keeps
+//
+//   a = u * a0 (mod m), b = v * a0 (mod m)
+//
+// with b odd, and at every step subtracts b from a if a is odd
+// (swapping them first if a < b), then halves a, which is now even.
+// 512 steps, the total bit length of a and m, always take a to 0 and
+// leave b = gcd(a0, m).
+static int modinv_ct(uint64_t r[4], const uint64_t a0[4], const uint64_t m[4]) {
+  uint64_t a[4], b[4], u[4] = { 1, 0, 0, 0 }, v[4] = { 0, 0, 0, 0 }, m1h[4];
+  for (int i = 0; i < 4; i++) {
+    a[i] = a0[i];
+    b[i] = m[i];
+    m1h[i] = m[i];
+  }
+  // (m + 1) / 2, added when halving an odd u
+  shr1(m1h, 0);
+  add(m1h, m1h, (const uint64_t[4]) { 1, 0, 0, 0 });
+
+  for (int i = 0; i < 512; i++) {
+    uint64_t odd = -(a[0] & 1);
+    uint64_t swap = -cnd_sub(odd, a, b);
+    cnd_add(swap, b, a);
+    cnd_neg(swap, a);
+    cnd_swap(swap, u, v);
+    uint64_t borrow = cnd_sub(odd, u, v);
+    cnd_add(-borrow, u, m);
+    shr1(a, 0);
+    uint64_t lsb = -(u[0] & 1);
+    shr1(u, 0);
+    cnd_add(lsb, u, m1h);
+  }
+  if (!is_one(b)) {
+    return -1;
+  }
+  for (int i = 0; i < 4; i++) {
+    r[i] = v[i];
+  }
+  return 0;
+}
+
+int uint256_modinv_ct(UInt256 a, UInt256 m, UInt256 *result) {
+  Limbs x = to_limbs(a), n = to_limbs(m);
+  if ((n.w[0] & 1) == 0 || is_one(n.w)) {
+    return -1;
+  }
+  reduce(x.w, n.w);
+  uint64_t r[4];
+  if (modinv_ct(r, x.w, n.w) != 0) {
+    return -1;
+  }
+  *result = from_limbs(r);
+  return 0;
+}
+
+// Montgomery multiplication, a * b / 2^256 mod m, interleaving the
+// product and the reduction a limb of b at a time (CIOS). The running
+// value stays below 2m, so it needs one extra limb and one final
+// conditional subtraction.
+static void mont_mul(uint64_t r[4], const uint64_t a[4], const uint64_t b[4],
+                     const uint64_t m[4], uint64_t m_inv) {
+  uint64_t t[6] = { 0, 0, 0, 0, 0, 0 };
+  for (int i = 0; i < 4; i++) {
+    u128 c = 0;
+    for (int j = 0; j < 4; j++) {
+      c += (u128) a[j] * b[i] + t[j];
+      t[j] = (uint64_t) c;
+      c >>= 64;
+    }
+    c += t[4];
+    t[4] = (uint64_t) c;
+    t[5] = (uint64_t) (c >> 64);
+
+    // add a multiple of m that clears the low limb, and drop it
+    uint64_t q = t[0] * m_inv;
+    c = (u128) q * m[0] + t[0];
+    c >>= 64;
+    for (int j = 1; j < 4; j++) {
+      c += (u128) q * m[j] + t[j];
+      t[j - 1] = (uint64_t) c;
+      c >>= 64;
+    }
+    c += t[4];
+    t[3] = (uint64_t) c;
+    t[4] = t[5] + (uint64_t) (c >> 64);
+  }
+  uint64_t d[4];
+  uint64_t borrow = sub(d, t, m);
+  // keep t if it was below m: no top limb and a borrow
+  uint64_t keep = -(borrow & (t[4] ^ 1) & 1);
+  for (int i = 0; i < 4; i++) {
+    r[i] = (t[i] & keep) | (d[i] & ~keep);
+  }
+}
+
+// -1/m mod 2^64, for the low limb of an odd m, by Newton's iteration:
+// m is its own inverse mod 8, and each step doubles the number of
+// correct bits.
+static uint64_t mont_m_inv(uint64_t m0) {
+  uint64_t inv = m0;
+  for (int i = 0; i < 5; i++) {
+    inv *= 2 - m0 * inv;
+  }
+  return -inv;
+}
+
+int uint256_mont_init(UInt256Mont *ctx, UInt256 m) {
+  Limbs n = to_limbs(m);
+  if ((n.w[0] & 1) == 0 || is_one(n.w)) {
+    return -1;
+  }
+  ctx->m_inv = mont_m_inv(n.w[0]);
+
+  // 2^256 mod m is (2^256 - m) mod m, which needs no division if m
+  // has its top bit set. Doubling it 8 times gives 2^264 mod m, and
+  // each Montgomery squaring of 2^(256 + k) gives 2^(256 + 2k), so 5
+  // of them reach 2^512 mod m.
+  uint64_t x[4];
+  sub(x, (const uint64_t[4]) { 0, 0, 0, 0 }, n.w);
+  if ((n.w[3] >> 63) == 0) {
+    reduce(x, n.w);
+  }
+  for (int i = 0; i < 8; i++) {
+    uint64_t carry = add(x, x, x);
+    uint64_t d[4];
+    uint64_t borrow = sub(d, x, n.w);
+    uint64_t keep = -(borrow & (carry ^ 1) & 1);
+    for (int j = 0; j < 4; j++) {
+      x[j] = (x[j] & keep) | (d[j] & ~keep);
+    }
+  }
+  for (int i = 0; i < 5; i++) {
+    mont_mul(x, x, x, n.w, ctx->m_inv);
+  }
+  for (int i = 0; i < 4; i++) {
+    ctx->m[i] = n.w[i];
+    ctx->r2[i] = x[i];
+  }
+  return 0;
+}
+
+UInt256 uint256_mont_mul(const UInt256Mont *ctx, UInt256 a, UInt256 b) {
+  Limbs x = to_limbs(a), y = to_limbs(b);
+  uint64_t r[4];
+  mont_mul(r, x.w, y.w, ctx->m, ctx->m_inv);
+  return from_limbs(r);
+}
+
+UInt256 uint256_mont_to(const UInt256Mont *ctx, UInt256 a) {
+  Limbs x = to_limbs(a);
+  uint64_t r[4];
+  mont_mul(r, x.w, ctx->r2, ctx->m, ctx->m_inv);
+  return from_limbs(r);
+}
+
+UInt256 uint256_mont_from(const UInt256Mont *ctx, UInt256 a) {
+  Limbs x = to_limbs(a);
+  const uint64_t one[4] = { 1, 0, 0, 0 };
+  uint64_t r[4];
+  mont_mul(r, x.w, one, ctx->m, ctx->m_inv);
+  return from_limbs(r);
+}
+
+// Montgomery's trick, done with Montgomery products of the values as
+// they are, so nothing has to be converted. Each product carries a
+// factor of 1/R: the prefix products are
+//
+//   c[i] = a[0] * ... * a[i] / R^i
+//
+// and inverting c[n-1] gives 1/(a[0] * ... * a[n-1]) * R^(n-1). Going
+// back down, the product of that with c[i-1] is 1/a[i] exactly, and
+// with a[i] it's the inverse of c[i-1], in the same form.
+static int modinv_batch(UInt256 *out, const UInt256 *in, size_t n, UInt256 m,
+                        int (*inv)(uint64_t *, const uint64_t *, const uint64_t *)) {
+  Limbs mod = to_limbs(m);
+  if ((mod.w[0] & 1) == 0 || is_one(mod.w)) {
+    return -1;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  uint64_t m_inv = mont_m_inv(mod.w[0]);
+  uint64_t too_large = 0;
+  uint64_t c[4];
+  for (size_t i = 0; i < n; i++) {
+    Limbs a = to_limbs(in[i]);
+    uint64_t d[4];
+    too_large |= sub(d, a.w, mod.w) ^ 1;
+    if (i == 0) {
+      for (int j = 0; j < 4; j++) {
+        c[j] = a.w[j];
+      }
+    } else {
+      mont_mul(c, c, a.w, mod.w, m_inv);
+    }
+    out[i] = from_limbs(c);
+  }
+  uint64_t t[4];
+  if (too_large || inv(t, c, mod.w) != 0) {
+    return -1;
+  }
+  for (size_t i = n - 1; i > 0; i--) {
+    Limbs prev = to_limbs(out[i - 1]), a = to_limbs(in[i]);
+    uint64_t r[4];
+    mont_mul(r, t, prev.w, mod.w, m_inv);
+    out[i] = from_limbs(r);
+    mont_mul(t, t, a.w, mod.w, m_inv);
+  }
+  out[0] = from_limbs(t);
+  return 0;
+}
+
+int uint256_modinv_batch(UInt256 *out, const UInt256 *in, size_t n, UInt256 m) {
+  return modinv_batch(out, in, n, m, modinv_odd);
+}
+
+int uint256_modinv_batch_ct(UInt256 *out, const UInt256 *in, size_t n, UInt256 m) {
+  return modinv_batch(out, in, n, m, modinv_ct);
+}
@@ -0,0 +1,63 @@
+#ifndef UINT256_MOD_H
+#define UINT256_MOD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "uint256.h"
+
+// Division, GCD and modular inverses of UInt256 values.
+//
+// The functions work on the values as four 64-bit limbs. Those whose
+// names end in _ct take the same time and access the same memory
+// whatever the (secret) values are, apart from the modulus and a
+// final success check; the others branch on the values and are
+// faster.
+
+// Divide a by b, storing the quotient and the remainder (either
+// pointer may be NULL). Returns 0, or -1 if b is 0.
+int uint256_divmod(UInt256 a, UInt256 b, UInt256 *quotient, UInt256 *remainder);
+
+// Greatest common divisor of a and b (binary GCD), with gcd(a, 0) = a.
+UInt256 uint256_gcd(UInt256 a, UInt256 b);
+
+// Store the inverse of a modulo m (the x in [0, m) with a * x = 1
+// mod m) in *result. Returns 0, or -1 if there is none (gcd(a, m) is
+// not 1, or m < 2). a needn't be less than m.
+int uint256_modinv(UInt256 a, UInt256 m, UInt256 *result);
+
+// The inverse of a modulo m in constant time, for an odd m (it
+// returns -1 for an even one).
+int uint256_modinv_ct(UInt256 a, UInt256 m, UInt256 *result);
+
+// Montgomery multiplication modulo an odd m: with R = 2^256, values
+// are kept as a * R mod m, and the product of two is a single pass of
+// multiply-and-reduce with no division. All of these are constant
+// time.
+typedef struct {
+  uint64_t m[4];        // the modulus, least significant limb first
+  uint64_t r2[4];       // R^2 mod m
+  uint64_t m_inv;       // -1/m mod 2^64
+} UInt256Mont;
+
+// Set up ctx for the modulus m. Returns 0, or -1 if m is even or 1.
+int uint256_mont_init(UInt256Mont *ctx, UInt256 m);
+
+// a * b / R mod m, for a and b less than m.
+UInt256 uint256_mont_mul(const UInt256Mont *ctx, UInt256 a, UInt256 b);
+
+// Convert a (less than m) to Montgomery form, a * R mod m, and back.
+UInt256 uint256_mont_to(const UInt256Mont *ctx, UInt256 a);
+UInt256 uint256_mont_from(const UInt256Mont *ctx, UInt256 a);
+
+// Invert n values modulo an odd m at once, with Montgomery's trick:
+// one inversion of their product and 3(n - 1) Montgomery
+// multiplications. out[i] is the inverse of in[i]; the arrays must
+// not overlap, and each value must be less than m. Returns 0, or -1
+// if m isn't odd (or is 1), a value is too large, or any of them has
+// no inverse (in which case out is left unspecified).
+int uint256_modinv_batch(UInt256 *out, const UInt256 *in, size_t n, UInt256 m);
+
+// The same, with the constant-time inversion.
+int uint256_modinv_batch_ct(UInt256 *out, const UInt256 *in, size_t n, UInt256 m);
+
+#endif // UINT256_MOD_H
@@ -0,0 +1,593 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "uint256.h"
+
+// Property-based differential tester for the UInt256 functions.
+//
+// Usage: uint256_proptest [-n cases] [-T seconds] [-t threads]
+//                         [-s seed] [-p property]
+//
+// Each case is a pair of random values and a rotation count. The
+// generator is biased toward the inputs arithmetic code gets wrong:
+// limbs of all ones, zero, one and the top bit, runs of all-ones
+// limbs that make a carry or borrow ripple through the whole value,
+// single bits, and pairs of operands that are equal, complementary or
+// each other's negation.
+//
+// Every property is checked on every case (or just the one named with
+// -p). The results of uint256_add, _sub, _mul, _negate and the
+// rotations are compared with a reference implementation that works
+// on four 64-bit limbs with unsigned __int128 carries, sharing no
+// code with uint256.c; two round-trip laws are checked as well.
+//
+// The cases are split across threads, each with its own generator
+// seeded from -s, until -n cases have run or -T seconds have passed.
+// The first failing case is shrunk, by clearing limbs and bits and
+// reducing the rotation count for as long as it still fails, and is
+// printed with the expected and actual results. The exit status is 1
+// if any property failed.
+
+#define BATCH 4096
+
+__extension__ typedef unsigned __int128 u128;
+
+// A value as four 64-bit limbs, least significant first
+typedef struct {
+  uint64_t w[4];
+} Ref;
+
+typedef struct {
+  UInt256 a, b;
+  unsigned n;
+  Ref ra, rb;       // a and b for the reference (see case_update)
+} Case;
+
+typedef struct {
+  const char *name;
+  // Compute the actual and expected results for a case.
+  void (*run)(const Case *c, Ref *actual, Ref *expected);
+  int binary;       // whether b is used
+  int rotates;      // whether n is used
+} Property;
+
+//
+// Reference implementation
+//
+
+static Ref ref_from(UInt256 v) {
+  Ref r;
+  for (int i = 0; i < 4; i++) {
+    r.w[i] = (uint64_t) v.data[2 * i] | (uint64_t) v.data[2 * i + 1] << 32;
+  }
+  return r;
+}
+
+static Ref ref_add(Ref a, Ref b) {
+  Ref r;
+  u128 carry = 0;
+  for (int i = 0; i < 4; i++) {
+    u128 s = (u128) a.w[i] + b.w[i] + carry;
+    r.w[i] = (uint64_t) s;
+    carry = s >> 64;
+  }
+  return r;
+}
+
+static Ref ref_sub(Ref a, Ref b) {
+  Ref r;
+  u128 borrow = 0;
+  for (int i = 0; i < 4; i++) {
+    u128 d = (u128) a.w[i] - b.w[i] - borrow;
+    r.w[i] = (uint64_t) d;
+    borrow = (d >> 64) != 0;
+  }
+  return r;
+}
+
+static Ref ref_negate(Ref a) {
+  Ref zero = { { 0, 0, 0, 0 } };
+  return ref_sub(zero, a);
+}
+
+// the product modulo 2^256
+static Ref ref_mul(Ref a, Ref b) {
+  Ref r = { { 0, 0, 0, 0 } };
+  for (int i = 0; i < 4; i++) {
+    u128 carry = 0;
+    for (int j = 0; i + j < 4; j++) {
+      u128 t = (u128) a.w[i] * b.w[j] + r.w[i + j] + carry;
+      r.w[i + j] = (uint64_t) t;
+      carry = t >> 64;
+    }
+  }
+  return r;
+}
+
+static Ref ref_rotate_left(Ref a, unsigned n) {
+  Ref r;
+  unsigned limbs = (n % 256) / 64, bits = n % 64;
+  for (unsigned i = 0; i < 4; i++) {
+    uint64_t hi = a.w[(i + 4 - limbs) % 4], lo = a.w[(i + 3 - limbs) % 4];
+    r.w[i] = bits == 0 ? hi : (hi << bits) | (lo >> (64 - bits));
+  }
+  return r;
+}
+
+static Ref ref_rotate_right(Ref a, unsigned n) {
+  return ref_rotate_left(a, (256 - n % 256) % 256);
+}
+
+static int ref_equal(const Ref *x, const Ref *y) {
+  return memcmp(x->w, y->w, sizeof(x->w)) == 0;
+}
+
+static void ref_print(const char *label, Ref v) {
+  printf("  %-9s 0x%016llx%016llx%016llx%016llx\n", label,
+         (unsigned long long) v.w[3], (unsigned long long) v.w[2],
+         (unsigned long long) v.w[1], (unsigned long long) v.w[0]);
+}
+
+//
+// Properties
+//
+
+static void prop_add(const Case *c, Ref *actual, Ref *expected) {
+  *actual = ref_from(uint256_add(c->a, c->b));
+  *expected = ref_add(c->ra, c->rb);
+}
+
+static void prop_sub(const Case *c, Ref *actual, Ref *expected) {
+  *actual = ref_from(uint256_sub(c->a, c->b));
+  *expected = ref_sub(c->ra, c->rb);
+}
+
+static void prop_mul(const Case *c, Ref *actual, Ref *expected) {
+  *actual = ref_from(uint256_mul(c->a, c->b));
+  *expected = ref_mul(c->ra, c->rb);
+}
+
+static void prop_negate(const Case *c, Ref *actual, Ref *expected) {
+  *actual = ref_from(uint256_negate(c->a));
+  *expected = ref_negate(c->ra);
+}
+
+static void prop_rotate_left(const Case *c, Ref *actual, Ref *expected) {
+  *actual = ref_from(uint256_rotate_left(c->a, c->n));
+  *expected = ref_rotate_left(c->ra, c->n);
+}
+
+static void prop_rotate_right(const Case *c, Ref *actual, Ref *expected) {
+  *actual = ref_from(uint256_rotate_right(c->a, c->n));
+  *expected = ref_rotate_right(c->ra, c->n);
+}
+
+// (a - b) + b == a
+static void prop_sub_add(const Case *c, Ref *actual, Ref *expected) {
+  *actual = ref_from(uint256_add(uint256_sub(c->a, c->b), c->b));
+  *expected = c->ra;
+}
+
+// rotating right undoes rotating left
+static void prop_rotate_inverse(const Case *c, Ref *actual, Ref *expected) {
+  *actual = ref_from(uint256_rotate_right(uint256_rotate_left(c->a, c->n), c->n));
+  *expected = c->ra;
+}
+
+static const Property properties[] = {
+  { "add", prop_add, 1, 0 },
+  { "sub", prop_sub, 1, 0 },
+  { "mul", prop_mul, 1, 0 },
+  { "negate", prop_negate, 0, 0 },
+  { "rotate_left", prop_rotate_left, 0, 1 },
+  { "rotate_right", prop_rotate_right, 0, 1 },
+  { "sub_add", prop_sub_add, 1, 0 },
+  { "rotate_inverse", prop_rotate_inverse, 0, 1 },
+};
+
+#define NUM_PROPERTIES (sizeof(properties) / sizeof(properties[0]))
+
+// Set the reference copies of a case's operands.
+static void case_update(Case *c) {
+  c->ra = ref_from(c->a);
+  c->rb = ref_from(c->b);
+}
+
+static int fails(const Property *p, const Case *c) {
+  Ref actual, expected;
+  p->run(c, &actual, &expected);
+  return !ref_equal(&actual, &expected);
+}
+
+//
+// Generators
+//
+
+// xoshiro256** (Blackman and Vigna), seeded with splitmix64
+typedef struct {
+  uint64_t s[4];
+} Rng;
+
+static uint64_t splitmix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static void rng_seed(Rng *r, uint64_t seed) {
+  for (int i = 0; i < 4; i++) {
+    r->s[i] = splitmix64(&seed);
+  }
+}
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(Rng *r) {
+  uint64_t result = rotl64(r->s[1] * 5, 7) * 9;
+  uint64_t t = r->s[1] << 17;
+  r->s[2] ^= r->s[0];
+  r->s[3] ^= r->s[1];
+  r->s[1] ^= r->s[2];
+  r->s[0] ^= r->s[3];
+  r->s[2] ^= t;
+  r->s[3] = rotl64(r->s[3], 45);
+  return result;
+}
+
+static uint32_t gen_limb(Rng *r) {
+  uint64_t x = rng_next(r);
+  switch (x & 15) {
+  case 0: return 0;
+  case 1: return 0xFFFFFFFFU;
+  case 2: return 1;
+  case 3: return 0x80000000U;
+  case 4: return 0x7FFFFFFFU;
+  case 5: return (uint32_t) (x >> 56);                  // small
+  case 6: return 0xFFFFFFFFU - (uint32_t) (x >> 56);    // nearly all ones
+  default: return (uint32_t) (x >> 32);
+  }
+}
+
+static UInt256 gen_value(Rng *r) {
+  UInt256 v;
+  uint64_t x = rng_next(r);
+  switch (x & 7) {
+  case 0: {
+    // every limb the same edge value
+    uint32_t limb = gen_limb(r);
+    for (int i = 0; i < 8; i++) {
+      v.data[i] = limb;
+    }
+    break;
+  }
+  case 1: {
+    // a run of all-ones limbs at the bottom, for long carries
+    unsigned run = (unsigned) (x >> 8) % 9;
+    for (unsigned i = 0; i < 8; i++) {
+      v.data[i] = i < run ? 0xFFFFFFFFU : gen_limb(r);
+    }
+    break;
+  }
+  case 2: {
+    // a single bit
+    unsigned bit = (unsigned) (x >> 8) % 256;
+    memset(&v, 0, sizeof(v));
+    v.data[bit / 32] = 1U << (bit % 32);
+    break;
+  }
+  case 3: {
+    // fully random
+    for (int i = 0; i < 8; i += 2) {
+      uint64_t y = rng_next(r);
+      v.data[i] = (uint32_t) y;
+      v.data[i + 1] = (uint32_t) (y >> 32);
+    }
+    break;
+  }
+  default:
+    for (int i = 0; i < 8; i++) {
+      v.data[i] = gen_limb(r);
+    }
+    break;
+  }
+  return v;
+}
+
+static unsigned gen_rotation(Rng *r) {
+  uint64_t x = rng_next(r);
+  switch (x & 7) {
+  case 0: return 0;
+  case 1: return 32 * (unsigned) ((x >> 8) % 9);      // whole limbs
+  case 2: return 255 + (unsigned) ((x >> 8) % 3);     // 255, 256, 257
+  case 3: return (unsigned) (x >> 32);                // any unsigned
+  default: return (unsigned) (x >> 8) % 256;
+  }
+}
+
+static void gen_case(Rng *r, Case *c) {
+  c->a = gen_value(r);
+  uint64_t x = rng_next(r);
+  switch (x & 7) {
+  case 0:
+    c->b = c->a;
+    break;
+  case 1:
+    // the complement, so a + b is all ones (and + 1 carries through)
+    for (int i = 0; i < 8; i++) {
+      c->b.data[i] = ~c->a.data[i];
+    }
+    break;
+  case 2: {
+    // the negation, so a + b wraps to zero
+    Ref neg = ref_negate(ref_from(c->a));
+    for (int i = 0; i < 4; i++) {
+      c->b.data[2 * i] = (uint32_t) neg.w[i];
+      c->b.data[2 * i + 1] = (uint32_t) (neg.w[i] >> 32);
+    }
+    break;
+  }
+  default:
+    c->b = gen_value(r);
+    break;
+  }
+  c->n = gen_rotation(r);
+  case_update(c);
+}
+
+//
+// Shrinking
+//
+
+// Replace *field with candidate if the case still fails with it.
+static int try_value(const Property *p, Case *c, UInt256 *field, UInt256 candidate) {
+  UInt256 saved = *field;
+  if (memcmp(&saved, &candidate, sizeof(saved)) == 0) {
+    return 0;
+  }
+  *field = candidate;
+  case_update(c);
+  if (fails(p, c)) {
+    return 1;
+  }
+  *field = saved;
+  case_update(c);
+  return 0;
+}
+
+static int shrink_value(const Property *p, Case *c, UInt256 *field) {
+  int progress = 0;
+  // whole limbs to zero first, then single bits, most significant
+  // first
+  for (int i = 7; i >= 0; i--) {
+    UInt256 v = *field;
+    v.data[i] = 0;
+    progress |= try_value(p, c, field, v);
+  }
+  for (int bit = 255; bit >= 0; bit--) {
+    UInt256 v = *field;
+    if (v.data[bit / 32] & (1U << (bit % 32))) {
+      v.data[bit / 32] &= ~(1U << (bit % 32));
+      progress |= try_value(p, c, field, v);
+    }
+  }
+  return progress;
+}
+
+static int shrink_rotation(const Property *p, Case *c) {
+  unsigned candidates[4] = { 0, c->n % 256, c->n / 2, c->n - 1 };
+  int progress = 0;
+  for (int i = 0; i < 4 && c->n > 0; i++) {
+    unsigned saved = c->n;
+    if (candidates[i] >= saved) {
+      continue;
+    }
+    c->n = candidates[i];
+    if (fails(p, c)) {
+      progress = 1;
+    } else {
+      c->n = saved;
+    }
+  }
+  return progress;
+}
+
+// Shrink a failing case as far as it goes; returns the number of
+// rounds.
+static unsigned shrink(const Property *p, Case *c) {
+  unsigned rounds = 0;
+  int progress;
+  do {
+    progress = shrink_value(p, c, &c->a);
+    if (p->binary) {
+      progress |= shrink_value(p, c, &c->b);
+    }
+    if (p->rotates) {
+      progress |= shrink_rotation(p, c);
+    }
+    rounds++;
+  } while (progress);
+  return rounds;
+}
+
+//
+// Running
+//
+
+static struct {
+  uint64_t seed;
+  uint64_t max_cases;
+  double max_seconds;
+  const Property *only;           // the one property to check, or NULL
+  double start;
+
+  atomic_uint_fast64_t num_cases;
+  atomic_int stop;
+
+  pthread_mutex_t lock;
+  int failed;                     // the first failure, under the lock:
+  const Property *failed_prop;
+  Case failed_case;
+  unsigned failed_thread;
+  uint64_t failed_index;
+} run;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report_failure(const Property *p, const Case *c, unsigned thread, uint64_t index) {
+  pthread_mutex_lock(&run.lock);
+  if (!run.failed) {
+    run.failed = 1;
+    run.failed_prop = p;
+    run.failed_case = *c;
+    run.failed_thread = thread;
+    run.failed_index = index;
+  }
+  pthread_mutex_unlock(&run.lock);
+  atomic_store(&run.stop, 1);
+}
+
+static void *worker_main(void *arg) {
+  unsigned thread = (unsigned) (uintptr_t) arg;
+  Rng rng;
+  Case c;
+  uint64_t index = 0;
+
+  rng_seed(&rng, run.seed + thread);
+  while (!atomic_load_explicit(&run.stop, memory_order_relaxed)) {
+    for (unsigned i = 0; i < BATCH; i++, index++) {
+      gen_case(&rng, &c);
+      if (run.only != NULL) {
+        if (fails(run.only, &c)) {
+          report_failure(run.only, &c, thread, index);
+          return NULL;
+        }
+        continue;
+      }
+      for (unsigned j = 0; j < NUM_PROPERTIES; j++) {
+        if (fails(&properties[j], &c)) {
+          report_failure(&properties[j], &c, thread, index);
+          return NULL;
+        }
+      }
+    }
+    uint64_t total = atomic_fetch_add(&run.num_cases, BATCH) + BATCH;
+    if ((run.max_cases > 0 && total >= run.max_cases)
+        || (run.max_seconds > 0 && now_seconds() - run.start >= run.max_seconds)) {
+      atomic_store(&run.stop, 1);
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  run.seed = (uint64_t) time(NULL);
+  run.max_cases = 10000000;
+  while ((opt = getopt(argc, argv, "n:T:t:s:p:")) != -1) {
+    switch (opt) {
+    case 'n':
+      run.max_cases = strtoull(optarg, NULL, 10);
+      break;
+    case 'T':
+      run.max_seconds = atof(optarg);
+      break;
+    case 't':
+      num_threads = atol(optarg);
+      break;
+    case 's':
+      run.seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'p':
+      for (unsigned j = 0; j < NUM_PROPERTIES; j++) {
+        if (strcmp(optarg, properties[j].name) == 0) {
+          run.only = &properties[j];
+        }
+      }
+      if (run.only == NULL) {
+        fprintf(stderr, "Error: unknown property %s\n", optarg);
+        return 1;
+      }
+      break;
+    default:
+      fprintf(stderr, "Usage: uint256_proptest [-n cases] [-T seconds] [-t threads] "
+              "[-s seed] [-p property]\n");
+      return 1;
+    }
+  }
+  if (num_threads < 1) {
+    fprintf(stderr, "Error: invalid number of threads\n");
+    return 1;
+  }
+  if (run.max_seconds > 0 && run.max_cases == 10000000) {
+    // a time limit alone runs for that long
+    run.max_cases = 0;
+  }
+
+  pthread_mutex_init(&run.lock, NULL);
+  printf("seed %llu, %ld thread(s)\n", (unsigned long long) run.seed, num_threads);
+  fflush(stdout);
+
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  if (threads == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+  run.start = now_seconds();
+  long started = 0;
+  for (; started < num_threads; started++) {
+    if (pthread_create(&threads[started], NULL, worker_main, (void *) (uintptr_t) started) != 0) {
+      break;
+    }
+  }
+  if (started == 0) {
+    fprintf(stderr, "Error: couldn't start threads\n");
+    return 1;
+  }
+  for (long i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double elapsed = now_seconds() - run.start;
+  free(threads);
+
+  uint64_t num_cases = atomic_load(&run.num_cases);
+  printf("%llu cases in %.2f s (%.1f million/s), %u properties each\n",
+         (unsigned long long) num_cases, elapsed, num_cases / elapsed / 1e6,
+         run.only != NULL ? 1 : (unsigned) NUM_PROPERTIES);
+
+  if (!run.failed) {
+    printf("all properties held\n");
+    return 0;
+  }
+
+  const Property *p = run.failed_prop;
+  Case c = run.failed_case;
+  unsigned rounds = shrink(p, &c);
+  Ref actual, expected;
+  p->run(&c, &actual, &expected);
+  printf("FAILED %s (thread %u, case %llu), shrunk in %u round(s):\n", p->name,
+         run.failed_thread, (unsigned long long) run.failed_index, rounds);
+  ref_print("a", ref_from(c.a));
+  if (p->binary) {
+    ref_print("b", ref_from(c.b));
+  }
+  if (p->rotates) {
+    printf("  %-9s %u\n", "n", c.n);
+  }
+  ref_print("expected", expected);
+  ref_print("actual", actual);
+  return 1;
+}
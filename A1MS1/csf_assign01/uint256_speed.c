@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "uint256.h"
+#include "uint256_mod.h"
+#include "uint256_field.h"
+#include "uint256_ec.h"
+
+// Throughput of the modular and elliptic curve arithmetic, in
+// operations per second.
+//
+// Usage: uint256_speed [-t seconds]
+//
+// Each operation is run in a dependent chain (every result feeds the
+// next call) for about -t seconds (default 0.2), so the numbers are
+// of latency-bound work, as in a scalar multiplication. The generic
+// Montgomery multiplication from uint256_mod.h is timed for both
+// primes next to the special-form field types from uint256_field.h,
+// followed by the secp256k1 point operations and ECDSA verification
+// from uint256_ec.h.
+
+#define BATCH 4096
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double seconds = 0.2;
+static uint64_t sink;
+
+// Run body in rounds (of 1, 2, 4, ... up to 1024 runs) until seconds
+// have passed, then print the rate; ops is the number of operations
+// one run of body does.
+#define TIME(label, ops, body) \
+  do { \
+    uint64_t runs = 0, round = 1; \
+    double start = now_seconds(), elapsed; \
+    do { \
+      for (uint64_t rep = 0; rep < round; rep++) { \
+        body; \
+      } \
+      runs += round; \
+      if (round < 1024) { \
+        round *= 2; \
+      } \
+      elapsed = now_seconds() - start; \
+    } while (elapsed < seconds); \
+    printf("%-34s %12.0f ops/s %10.1f ns/op\n", label, runs * (double) (ops) / elapsed, \
+           elapsed * 1e9 / (runs * (double) (ops))); \
+  } while (0)
+
+static FieldSecp256k1 secp_in[BATCH], secp_out[BATCH];
+static Field25519 f25519_in[BATCH], f25519_out[BATCH];
+
+// Signatures for the verification timings: VERIFY_KEYS keys, each
+// signing the same message (with different nonces)
+#define VERIFY_KEYS 256
+static UInt256 verify_z[VERIFY_KEYS];
+static Secp256k1Signature verify_sig[VERIFY_KEYS];
+static Secp256k1Affine verify_pub[VERIFY_KEYS];
+static int verify_valid[VERIFY_KEYS];
+
+static int less(UInt256 a, UInt256 b) {
+  for (int i = 7; i >= 0; i--) {
+    if (a.data[i] != b.data[i]) {
+      return a.data[i] < b.data[i];
+    }
+  }
+  return 0;
+}
+
+// Make signature i with private key d and nonce k: r = x(k * G) mod n,
+// s = (z + r * d) / k mod n, for d, k and z below n. It's only for the
+// timings, so it leans on the library itself.
+static void make_signature(int i, UInt256 d, UInt256 k, UInt256 z) {
+  UInt256 n = secp256k1_order(), x, y, k_inv, r, s, t, sum;
+  UInt256Mont mont;
+  Secp256k1Point point;
+  Secp256k1Affine affine;
+  uint256_mont_init(&mont, n);
+  secp256k1_mul_base(&point, k);
+  secp256k1_to_affine(&affine, &point);
+  secp256k1_affine_get(&affine, &x, &y);
+  uint256_divmod(x, n, NULL, &r);
+  uint256_modinv(k, n, &k_inv);
+  // the Montgomery product of a value in Montgomery form and one not
+  // is the plain product
+  t = uint256_mont_mul(&mont, uint256_mont_to(&mont, r), d);
+  sum = uint256_add(t, z);
+  if (less(sum, t) || !less(sum, n)) {
+    sum = uint256_sub(sum, n);
+  }
+  s = uint256_mont_mul(&mont, uint256_mont_to(&mont, sum), k_inv);
+  secp256k1_mul_base(&point, d);
+  secp256k1_to_affine(&verify_pub[i], &point);
+  verify_z[i] = z;
+  verify_sig[i].r = r;
+  verify_sig[i].s = s;
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "t:")) != -1) {
+    switch (opt) {
+    case 't':
+      seconds = atof(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: uint256_speed [-t seconds]\n");
+      return 1;
+    }
+  }
+  if (!(seconds > 0)) {
+    fprintf(stderr, "Error: invalid time\n");
+    return 1;
+  }
+
+  UInt256 secp_p = uint256_create_from_hex("fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f");
+  UInt256 p25519 = uint256_create_from_hex("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffed");
+  UInt256 a = uint256_create_from_hex("5d5d3f0bd8578708ca055e64b071fb39cc89c6441a42c0bea958cda76bb7353");
+  UInt256 b = uint256_create_from_hex("8369869fe4435cf6247854aee4241c2713d511017771764284aba8f2a38961b");
+
+  printf("generic (Montgomery):\n");
+  UInt256Mont secp_mont, mont25519;
+  uint256_mont_init(&secp_mont, secp_p);
+  uint256_mont_init(&mont25519, p25519);
+  {
+    UInt256 x = uint256_mont_to(&secp_mont, a), y = uint256_mont_to(&secp_mont, b);
+    TIME("  secp256k1 mul", 1, x = uint256_mont_mul(&secp_mont, x, y));
+    sink += x.data[0];
+    TIME("  secp256k1 inv", 1, uint256_modinv(x, secp_p, &x));
+    sink += x.data[0];
+    TIME("  secp256k1 inv (constant time)", 1, uint256_modinv_ct(x, secp_p, &x));
+    sink += x.data[0];
+  }
+  {
+    UInt256 x = uint256_mont_to(&mont25519, a), y = uint256_mont_to(&mont25519, b);
+    TIME("  2^255-19 mul", 1, x = uint256_mont_mul(&mont25519, x, y));
+    sink += x.data[0];
+  }
+
+  printf("special form:\n");
+  {
+    FieldSecp256k1 x = field_secp256k1_from_uint256(a), y = field_secp256k1_from_uint256(b);
+    TIME("  secp256k1 mul", 1, x = field_secp256k1_mul(x, y));
+    TIME("  secp256k1 sqr", 1, x = field_secp256k1_sqr(x));
+    TIME("  secp256k1 add", 1, x = field_secp256k1_add(x, y));
+    TIME("  secp256k1 inv", 1, x = field_secp256k1_inv(x));
+    for (int i = 0; i < BATCH; i++) {
+      secp_in[i] = x = field_secp256k1_mul(x, y);
+    }
+    TIME("  secp256k1 inv, batch of 4096", BATCH, field_secp256k1_inv_batch(secp_out, secp_in, BATCH));
+    sink += x.w[0] + secp_out[0].w[0];
+  }
+  {
+    Field25519 x = field_25519_from_uint256(a), y = field_25519_from_uint256(b);
+    TIME("  2^255-19 mul", 1, x = field_25519_mul(x, y));
+    TIME("  2^255-19 sqr", 1, x = field_25519_sqr(x));
+    TIME("  2^255-19 add", 1, x = field_25519_add(x, y));
+    TIME("  2^255-19 inv", 1, x = field_25519_inv(x));
+    for (int i = 0; i < BATCH; i++) {
+      f25519_in[i] = x = field_25519_mul(x, y);
+    }
+    TIME("  2^255-19 inv, batch of 4096", BATCH, field_25519_inv_batch(f25519_out, f25519_in, BATCH));
+    sink += x.w[0] + f25519_out[0].w[0];
+  }
+
+  printf("secp256k1:\n");
+  {
+    Secp256k1Affine g = secp256k1_generator();
+    Secp256k1Point p, q;
+    secp256k1_from_affine(&p, &g);
+    secp256k1_double(&q, &p);
+    TIME("  point double", 1, secp256k1_double(&p, &p));
+    TIME("  point add", 1, secp256k1_add(&p, &p, &q));
+    TIME("  point add (affine)", 1, secp256k1_add_affine(&p, &p, &g));
+    UInt256 k = a;
+    TIME("  fixed-base mul (table)", 1, (secp256k1_mul_base(&p, k), k.data[0] ^= p.x.w[0]));
+    TIME("  variable-base mul (wNAF)", 1, (secp256k1_mul(&p, &q, k), k.data[0] ^= p.x.w[0]));
+    sink += p.x.w[0];
+
+    for (int i = 0; i < VERIFY_KEYS; i++) {
+      make_signature(i, uint256_add(a, uint256_create_from_u32(i)), uint256_add(b, uint256_create_from_u32(i)), a);
+    }
+    if (secp256k1_verify_batch(verify_z, verify_sig, verify_pub, VERIFY_KEYS, verify_valid) != VERIFY_KEYS) {
+      fprintf(stderr, "Error: a test signature didn't verify\n");
+      return 1;
+    }
+    int i = 0;
+    TIME("  ECDSA verify", 1, (sink += secp256k1_verify(verify_z[i], &verify_sig[i], &verify_pub[i]),
+                                i = (i + 1) % VERIFY_KEYS));
+    TIME("  ECDSA verify, batch of 256", VERIFY_KEYS,
+         sink += secp256k1_verify_batch(verify_z, verify_sig, verify_pub, VERIFY_KEYS, verify_valid));
+  }
+
+  // keep the calls from being optimized away
+  if (sink == 42) {
+    printf("\n");
+  }
+  return 0;
+}
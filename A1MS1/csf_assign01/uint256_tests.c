@@ -1,8 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "tctest.h"
 
 #include "uint256.h"
+#include "uint256_mod.h"
+#include "uint256_field.h"
+#include "uint256_ec.h"
 
 typedef struct {
   UInt256 zero; // the value equal to 0
@@ -10,10 +16,12 @@ typedef struct {
   UInt256 max;  // the value equal to (2^256)-1
   UInt256 msb_set; // the value equal to 2^255
   UInt256 rot; // value used to test rotations
+  UInt256 prime; // the secp256k1 field prime, 2^256 - 2^32 - 977
 } TestObjs;
 
 // Helper functions for implementing tests
 void set_all(UInt256 *val, uint32_t wordval);
+int point_is(const Secp256k1Point *point, const char *x, const char *y);
 
 #define ASSERT_SAME(expected, actual) \
 do { \
@@ -48,10 +56,36 @@ void test_sub(TestObjs *objs);
 void test_negate(TestObjs *objs);
 void test_rotate_left(TestObjs *objs);
 void test_rotate_right(TestObjs *objs);
+void test_rotate_words(TestObjs *objs);
+void test_no_alloc(TestObjs *objs);
+void test_mul(TestObjs *objs);
+void test_parse_hex(TestObjs *objs);
+void test_divmod(TestObjs *objs);
+void test_gcd(TestObjs *objs);
+void test_modinv(TestObjs *objs);
+void test_mont(TestObjs *objs);
+void test_modinv_batch(TestObjs *objs);
+void test_field_secp256k1(TestObjs *objs);
+void test_field_25519(TestObjs *objs);
+void test_ec_add(TestObjs *objs);
+void test_ec_mul(TestObjs *objs);
+void test_ec_verify(TestObjs *objs);
+void test_ec_verify_batch(TestObjs *objs);
+void test_calc_write(TestObjs *objs);
+
+// Declarations of benchmark functions
+void bench_add(TestObjs *objs, uint64_t iters);
+void bench_rotate_left(TestObjs *objs, uint64_t iters, long nbits);
+void bench_format_as_hex(TestObjs *objs, uint64_t iters);
+void bench_mul(TestObjs *objs, uint64_t iters);
+void bench_modinv(TestObjs *objs, uint64_t iters);
+void bench_modinv_ct(TestObjs *objs, uint64_t iters);
+void bench_modinv_batch(TestObjs *objs, uint64_t iters, long n);
+void bench_modinv_batch_ct(TestObjs *objs, uint64_t iters, long n);
 
 int main(int argc, char **argv) {
-  if (argc > 1) {
-    tctest_testname_to_execute = argv[1];
+  if (tctest_parse_args(argc, argv) != 0) {
+    return 1;
   }
 
   TEST_INIT();
@@ -66,6 +100,31 @@ int main(int argc, char **argv) {
   TEST(test_negate);
   TEST(test_rotate_left);
   TEST(test_rotate_right);
+  TEST(test_rotate_words);
+  TEST(test_no_alloc);
+  TEST(test_mul);
+  TEST(test_parse_hex);
+  TEST(test_divmod);
+  TEST(test_gcd);
+  TEST(test_modinv);
+  TEST(test_mont);
+  TEST(test_modinv_batch);
+  TEST(test_field_secp256k1);
+  TEST(test_field_25519);
+  TEST(test_ec_add);
+  TEST(test_ec_mul);
+  TEST(test_ec_verify);
+  TEST(test_ec_verify_batch);
+  TEST(test_calc_write);
+
+  BENCH(bench_add);
+  BENCH_ARGS(bench_rotate_left, 1, 37, 128);
+  BENCH(bench_format_as_hex);
+  BENCH(bench_mul);
+  BENCH(bench_modinv);
+  BENCH(bench_modinv_ct);
+  BENCH_ARGS(bench_modinv_batch, 1, 64, 4096);
+  BENCH_ARGS(bench_modinv_batch_ct, 1, 64, 4096);
 
   TEST_FINI();
 }
@@ -77,6 +136,23 @@ void set_all(UInt256 *val, uint32_t wordval) {
   }
 }
 
+// Whether point is the affine point (x, y), given in hex
+int point_is(const Secp256k1Point *point, const char *x, const char *y) {
+  Secp256k1Affine affine;
+  UInt256 px, py;
+  secp256k1_to_affine(&affine, point);
+  if (secp256k1_affine_get(&affine, &px, &py) != 0) {
+    return 0;
+  }
+  UInt256 ex = uint256_create_from_hex(x), ey = uint256_create_from_hex(y);
+  for (int i = 0; i < 8; i++) {
+    if (px.data[i] != ex.data[i] || py.data[i] != ey.data[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 TestObjs *setup(void) {
   TestObjs *objs = (TestObjs *) malloc(sizeof(TestObjs));
 
@@ -96,6 +172,8 @@ TestObjs *setup(void) {
   uint32_t rot_data[8] = { 0x000000ABU, 0U, 0U, 0U, 0U, 0U, 0U, 0xCD000000U };
   INIT_FROM_ARR(objs->rot, rot_data);
 
+  objs->prime = uint256_create_from_hex("fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f");
+
   return objs;
 }
 
@@ -449,6 +527,12 @@ void test_add(TestObjs *objs) {
 
   result = uint256_add(objs->max, objs->one);
   ASSERT_SAME(objs->zero, result);
+
+  // word 1 sums to 0xffffffff + 0xffffffff + 1, whose low 32 bits
+  // equal both operands, so comparing the 32-bit sum with the
+  // operands misses its carry (the case uint256_proptest shrank)
+  result = uint256_add(uint256_create_from_hex("ffffffff1e66a197"), uint256_create_from_hex("ffffffffe1995e69"));
+  ASSERT_SAME(uint256_create_from_hex("1ffffffff00000000"), result);
 }
 
 void test_sub(TestObjs *objs) {
@@ -646,3 +730,707 @@ void test_rotate_right(TestObjs *objs) {
   ASSERT(0U == result.data[2]);
   ASSERT(0U == result.data[7]);
 }
+
+static unsigned bit_at(UInt256 val, unsigned index) {
+  return (val.data[index / 32] >> (index % 32)) & 1U;
+}
+
+void test_rotate_words(TestObjs *objs) {
+  // every word different, so a word moved to the wrong place shows
+  uint32_t mixed_data[8] = { 0x01234567U, 0x89ABCDEFU, 0xF0E1D2C3U, 0xB4A59687U,
+                             0x78695A4BU, 0x3C2D1E0FU, 0xDEADBEEFU, 0x80000001U };
+  UInt256 mixed, left, right;
+  INIT_FROM_ARR(mixed, mixed_data);
+
+  // counts within a word, at word boundaries, across several words
+  // and past a full turn, checked bit by bit
+  const unsigned counts[] = { 0, 1, 31, 32, 33, 63, 64, 100, 224, 255, 256, 257, 1000 };
+  for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    unsigned n = counts[c];
+    left = uint256_rotate_left(mixed, n);
+    right = uint256_rotate_right(mixed, n);
+    for (unsigned i = 0; i < 256; i++) {
+      ASSERT(bit_at(mixed, i) == bit_at(left, (i + n) % 256));
+      ASSERT(bit_at(mixed, (i + n) % 256) == bit_at(right, i));
+    }
+    ASSERT_SAME(mixed, uint256_rotate_right(left, n));
+    ASSERT_SAME(mixed, uint256_rotate_left(right, n));
+  }
+
+  // the words are moved in place, without the heap
+  ASSERT_NO_ALLOC(left = uint256_rotate_left(objs->msb_set, 1));
+  ASSERT_SAME(objs->one, left);
+  ASSERT_NO_ALLOC(right = uint256_rotate_right(objs->one, 1));
+  ASSERT_SAME(objs->msb_set, right);
+}
+
+void test_no_alloc(TestObjs *objs) {
+  UInt256 result;
+
+  // arithmetic works in place, without the heap
+  ASSERT_NO_ALLOC(result = uint256_add(objs->max, objs->one));
+  ASSERT_SAME(objs->zero, result);
+  ASSERT_NO_ALLOC(result = uint256_sub(objs->zero, objs->one));
+  ASSERT_SAME(objs->max, result);
+  ASSERT_NO_ALLOC(result = uint256_negate(objs->one));
+  ASSERT_SAME(objs->max, result);
+}
+
+void test_mul(TestObjs *objs) {
+  UInt256 result;
+
+  result = uint256_mul(objs->max, objs->zero);
+  ASSERT_SAME(objs->zero, result);
+
+  result = uint256_mul(objs->max, objs->one);
+  ASSERT_SAME(objs->max, result);
+
+  // (2^256 - 1)^2 = 2^512 - 2^257 + 1, which is 1 modulo 2^256
+  result = uint256_mul(objs->max, objs->max);
+  ASSERT_SAME(objs->one, result);
+
+  // 2^255 * 2 overflows to 0
+  result = uint256_mul(objs->msb_set, uint256_create_from_u32(2));
+  ASSERT_SAME(objs->zero, result);
+
+  // from genfact.rb
+  UInt256 left = uint256_create_from_hex("428b440878973400fb2e00e96b9525d");
+  UInt256 right = uint256_create_from_hex("3500ed754a0d172fb82ad191ec55c41");
+  UInt256 expected = uint256_create_from_hex("dc712cf2bd8e60b1e17827f3d26abcf3e3841e96ae95f5ccfba372638559d");
+  result = uint256_mul(left, right);
+  ASSERT_SAME(expected, result);
+
+  // a product that wraps
+  left = uint256_create_from_hex("5d5d3f0bd8578708ca055e64b071fb39cc89c6441a42c0bea958cda76bb7353");
+  right = uint256_create_from_hex("8369869fe4435cf6247854aee4241c2713d511017771764284aba8f2a38961b");
+  expected = uint256_create_from_hex("cb84fcda57661aee10c6cb061313cefa4d931f3289f60074d8104fe6337fcbc1");
+  result = uint256_mul(left, right);
+  ASSERT_SAME(expected, result);
+}
+
+void test_parse_hex(TestObjs *objs) {
+  UInt256 result;
+
+  ASSERT(uint256_parse_hex("0", 1, &result) == 0);
+  ASSERT_SAME(objs->zero, result);
+
+  ASSERT(uint256_parse_hex("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff", 64, &result) == 0);
+  ASSERT_SAME(objs->max, result);
+
+  // mixed case, a partial word, and only the first len characters
+  ASSERT(uint256_parse_hex("CD000000000000000000000000000000000000000000000000000000000000ab = x", 64, &result) == 0);
+  ASSERT(result.data[0] == 0x000000abU);
+  ASSERT(result.data[7] == 0xCD000000U);
+  ASSERT(uint256_parse_hex("1aBcDeF23456789", 15, &result) == 0);
+  ASSERT(result.data[0] == 0x23456789U);
+  ASSERT(result.data[1] == 0x1abcdefU);
+  ASSERT(result.data[2] == 0U);
+
+  char *hex = uint256_format_as_hex(objs->rot);
+  ASSERT(uint256_parse_hex(hex, strlen(hex), &result) == 0);
+  ASSERT_SAME(objs->rot, result);
+  free(hex);
+
+  // not hex digits, empty, or too long
+  ASSERT(uint256_parse_hex("12g4", 4, &result) == -1);
+  ASSERT(uint256_parse_hex("123456789abcdef:", 16, &result) == -1);
+  ASSERT(uint256_parse_hex("12 4", 4, &result) == -1);
+  ASSERT(uint256_parse_hex("\xb1", 1, &result) == -1);
+  ASSERT(uint256_parse_hex("", 0, &result) == -1);
+  ASSERT(uint256_parse_hex("10000000000000000000000000000000000000000000000000000000000000000", 65, &result) == -1);
+}
+
+void test_divmod(TestObjs *objs) {
+  UInt256 quotient, remainder;
+
+  ASSERT(uint256_divmod(objs->max, objs->zero, &quotient, &remainder) == -1);
+
+  ASSERT(uint256_divmod(objs->max, objs->one, &quotient, &remainder) == 0);
+  ASSERT_SAME(objs->max, quotient);
+  ASSERT_SAME(objs->zero, remainder);
+
+  ASSERT(uint256_divmod(objs->one, objs->max, &quotient, &remainder) == 0);
+  ASSERT_SAME(objs->zero, quotient);
+  ASSERT_SAME(objs->one, remainder);
+
+  // 2^256 - 1 = 2^255 + (2^255 - 1)
+  ASSERT(uint256_divmod(objs->max, objs->msb_set, &quotient, NULL) == 0);
+  ASSERT_SAME(objs->one, quotient);
+  ASSERT(uint256_divmod(objs->max, objs->msb_set, NULL, &remainder) == 0);
+  ASSERT_SAME(uint256_sub(objs->msb_set, objs->one), remainder);
+
+  UInt256 left = uint256_create_from_hex("8369869fe4435cf6247854aee4241c2713d511017771764284aba8f2a38961b");
+  UInt256 right = uint256_create_from_hex("428b440878973400fb2e00e96b9525d");
+  ASSERT(uint256_divmod(left, right, &quotient, &remainder) == 0);
+  ASSERT_SAME(uint256_create_from_hex("1f98d94ef46a61d1877301ac668be3b0c"), quotient);
+  ASSERT_SAME(uint256_create_from_hex("1d5192d6fa02aa4e81290347a874abf"), remainder);
+}
+
+void test_gcd(TestObjs *objs) {
+  UInt256 result;
+
+  result = uint256_gcd(objs->zero, objs->zero);
+  ASSERT_SAME(objs->zero, result);
+  result = uint256_gcd(objs->max, objs->zero);
+  ASSERT_SAME(objs->max, result);
+  result = uint256_gcd(objs->zero, objs->rot);
+  ASSERT_SAME(objs->rot, result);
+  result = uint256_gcd(objs->max, objs->msb_set);
+  ASSERT_SAME(objs->one, result);
+  result = uint256_gcd(objs->msb_set, objs->msb_set);
+  ASSERT_SAME(objs->msb_set, result);
+
+  // powers of two
+  UInt256 pow200 = uint256_rotate_left(objs->one, 200);
+  result = uint256_gcd(objs->msb_set, pow200);
+  ASSERT_SAME(pow200, result);
+
+  // a common factor of 42, including a power of two
+  UInt256 left = uint256_create_from_hex("18f439832d38b3805e3140578857ee2e");
+  UInt256 right = uint256_create_from_hex("d403b5d528345cbee0ab4647b157104");
+  result = uint256_gcd(left, right);
+  ASSERT_SAME(uint256_create_from_u32(42), result);
+  result = uint256_gcd(right, left);
+  ASSERT_SAME(uint256_create_from_u32(42), result);
+}
+
+void test_modinv(TestObjs *objs) {
+  UInt256 result;
+  UInt256 val = uint256_create_from_hex("5d5d3f0bd8578708ca055e64b071fb39cc89c6441a42c0bea958cda76bb7353");
+  UInt256 expected = uint256_create_from_hex("e9fb9139c628ff9bf5fd3b6a49040a60dc760b0d563c59e9fd355c6286d2272e");
+
+  // an odd (prime) modulus, both ways
+  ASSERT(uint256_modinv(val, objs->prime, &result) == 0);
+  ASSERT_SAME(expected, result);
+  ASSERT(uint256_modinv_ct(val, objs->prime, &result) == 0);
+  ASSERT_SAME(expected, result);
+  ASSERT(uint256_modinv(objs->one, objs->prime, &result) == 0);
+  ASSERT_SAME(objs->one, result);
+  ASSERT(uint256_modinv_ct(objs->one, objs->prime, &result) == 0);
+  ASSERT_SAME(objs->one, result);
+
+  // -1 is its own inverse, and a value above the modulus is reduced
+  UInt256 minus_one = uint256_sub(objs->prime, objs->one);
+  ASSERT(uint256_modinv(minus_one, objs->prime, &result) == 0);
+  ASSERT_SAME(minus_one, result);
+  ASSERT(uint256_modinv_ct(minus_one, objs->prime, &result) == 0);
+  ASSERT_SAME(minus_one, result);
+  UInt256 max_inv = uint256_create_from_hex("be4316dba038daad273e4bda627ecf687c8941a534b5ba270b2a4b24b07e6798");
+  ASSERT(uint256_modinv(objs->max, objs->prime, &result) == 0);
+  ASSERT_SAME(max_inv, result);
+  ASSERT(uint256_modinv_ct(objs->max, objs->prime, &result) == 0);
+  ASSERT_SAME(max_inv, result);
+
+  // even moduli
+  ASSERT(uint256_modinv(val, objs->msb_set, &result) == 0);
+  ASSERT_SAME(uint256_create_from_hex("690eaa14fb9144839134a6be747876ba607041359feb01c0a92a8e21ec5748db"), result);
+  ASSERT(uint256_modinv(val, uint256_sub(objs->max, objs->one), &result) == 0);
+  ASSERT_SAME(uint256_create_from_hex("3f54d2168cf5f3c3e69d58bb31533ac58397441953fba03ab9fbfad6e40e0b19"), result);
+  ASSERT(uint256_modinv_ct(val, objs->msb_set, &result) == -1);
+
+  // no inverse: zero, a shared factor, and moduli 0 and 1
+  ASSERT(uint256_modinv(objs->zero, objs->prime, &result) == -1);
+  ASSERT(uint256_modinv_ct(objs->zero, objs->prime, &result) == -1);
+  ASSERT(uint256_modinv(objs->prime, objs->prime, &result) == -1);
+  ASSERT(uint256_modinv_ct(objs->prime, objs->prime, &result) == -1);
+  ASSERT(uint256_modinv(uint256_create_from_u32(6), uint256_create_from_u32(9), &result) == -1);
+  ASSERT(uint256_modinv_ct(uint256_create_from_u32(6), uint256_create_from_u32(9), &result) == -1);
+  ASSERT(uint256_modinv(uint256_create_from_u32(2), objs->msb_set, &result) == -1);
+  ASSERT(uint256_modinv(val, objs->zero, &result) == -1);
+  ASSERT(uint256_modinv(val, objs->one, &result) == -1);
+  ASSERT(uint256_modinv_ct(val, objs->one, &result) == -1);
+}
+
+void test_mont(TestObjs *objs) {
+  UInt256Mont ctx;
+
+  ASSERT(uint256_mont_init(&ctx, objs->msb_set) == -1);
+  ASSERT(uint256_mont_init(&ctx, objs->one) == -1);
+  ASSERT(uint256_mont_init(&ctx, objs->prime) == 0);
+
+  // 2^256 mod p = 2^32 + 977
+  UInt256 r = uint256_create_from_hex("1000003d1");
+  ASSERT_SAME(r, uint256_mont_to(&ctx, objs->one));
+  ASSERT_SAME(objs->one, uint256_mont_from(&ctx, r));
+  ASSERT_SAME(uint256_create_from_hex("300000b73"), uint256_mont_to(&ctx, uint256_create_from_u32(3)));
+
+  // a * (1/a) = 1, in Montgomery form
+  UInt256 val = uint256_create_from_hex("5d5d3f0bd8578708ca055e64b071fb39cc89c6441a42c0bea958cda76bb7353");
+  UInt256 inv = uint256_create_from_hex("e9fb9139c628ff9bf5fd3b6a49040a60dc760b0d563c59e9fd355c6286d2272e");
+  UInt256 product = uint256_mont_mul(&ctx, uint256_mont_to(&ctx, val), uint256_mont_to(&ctx, inv));
+  ASSERT_SAME(r, product);
+  ASSERT_SAME(objs->one, uint256_mont_from(&ctx, product));
+
+  // (p - 1)^2 = 1, with the largest inputs
+  UInt256 minus_one = uint256_mont_to(&ctx, uint256_sub(objs->prime, objs->one));
+  ASSERT_SAME(r, uint256_mont_mul(&ctx, minus_one, minus_one));
+
+  // a modulus just below 2^256, where the running value needs its extra limb
+  ASSERT(uint256_mont_init(&ctx, objs->max) == 0);
+  UInt256 big = uint256_sub(objs->max, objs->one);
+  ASSERT_SAME(big, uint256_mont_from(&ctx, uint256_mont_to(&ctx, big)));
+  ASSERT_SAME(objs->one, uint256_mont_from(&ctx, uint256_mont_mul(&ctx, uint256_mont_to(&ctx, big), uint256_mont_to(&ctx, big))));
+}
+
+void test_modinv_batch(TestObjs *objs) {
+  UInt256 in[5], out[5], expected;
+
+  in[0] = uint256_create_from_hex("5d5d3f0bd8578708ca055e64b071fb39cc89c6441a42c0bea958cda76bb7353");
+  in[1] = objs->one;
+  in[2] = uint256_sub(objs->prime, objs->one);
+  in[3] = objs->rot;
+  in[4] = in[0];
+  ASSERT(uint256_modinv_batch(out, in, 5, objs->prime) == 0);
+  for (int i = 0; i < 5; i++) {
+    ASSERT(uint256_modinv(in[i], objs->prime, &expected) == 0);
+    ASSERT_SAME(expected, out[i]);
+  }
+  set_all(&out[0], 0);
+  ASSERT(uint256_modinv_batch_ct(out, in, 5, objs->prime) == 0);
+  for (int i = 0; i < 5; i++) {
+    ASSERT(uint256_modinv(in[i], objs->prime, &expected) == 0);
+    ASSERT_SAME(expected, out[i]);
+  }
+
+  // a single value, and none
+  ASSERT(uint256_modinv_batch(out, in, 1, objs->prime) == 0);
+  ASSERT_SAME(uint256_create_from_hex("e9fb9139c628ff9bf5fd3b6a49040a60dc760b0d563c59e9fd355c6286d2272e"), out[0]);
+  ASSERT(uint256_modinv_batch(out, in, 0, objs->prime) == 0);
+
+  // a zero anywhere, a value not below m, or an even modulus
+  in[3] = objs->zero;
+  ASSERT(uint256_modinv_batch(out, in, 5, objs->prime) == -1);
+  ASSERT(uint256_modinv_batch_ct(out, in, 5, objs->prime) == -1);
+  in[3] = objs->prime;
+  ASSERT(uint256_modinv_batch(out, in, 5, objs->prime) == -1);
+  ASSERT(uint256_modinv_batch_ct(out, in, 5, objs->prime) == -1);
+  ASSERT(uint256_modinv_batch(out, in, 3, objs->msb_set) == -1);
+}
+
+void test_field_secp256k1(TestObjs *objs) {
+  UInt256 left = uint256_create_from_hex("5d5d3f0bd8578708ca055e64b071fb39cc89c6441a42c0bea958cda76bb7353");
+  UInt256 right = uint256_create_from_hex("8369869fe4435cf6247854aee4241c2713d511017771764284aba8f2a38961b");
+  FieldSecp256k1 a = field_secp256k1_from_uint256(left), b = field_secp256k1_from_uint256(right);
+  FieldSecp256k1 max = field_secp256k1_from_uint256(objs->max);
+
+  ASSERT_SAME(left, field_secp256k1_to_uint256(a));
+  ASSERT_SAME(uint256_create_from_hex("e0c6c5abbc9ae3feee7db31394961760e05ed74591b437012e04769a0f4096e"), field_secp256k1_to_uint256(field_secp256k1_add(a, b)));
+  ASSERT_SAME(uint256_create_from_hex("fd9f3b86bf4142a12a58d09b5cc4ddf12b8b4b542a2d14a7c24ad24a4c82d967"), field_secp256k1_to_uint256(field_secp256k1_sub(a, b)));
+  ASSERT_SAME(uint256_create_from_hex("260c47940bebd5ed5a72f64a33b220ed474b4abd5d2eb583db52db4b37d22c8"), field_secp256k1_to_uint256(field_secp256k1_sub(b, a)));
+  ASSERT_SAME(uint256_create_from_hex("1d77f94c19bd38517a47d825ca4c8c99d64a0b8b7c462148e144367b0dde1c8c"), field_secp256k1_to_uint256(field_secp256k1_mul(a, b)));
+  ASSERT_SAME(uint256_create_from_hex("46f7b471802b3b7064634567ca4dd27053c933d43e82c73ed849dd03e22b9f4"), field_secp256k1_to_uint256(field_secp256k1_sqr(a)));
+  ASSERT_SAME(uint256_create_from_hex("e9fb9139c628ff9bf5fd3b6a49040a60dc760b0d563c59e9fd355c6286d2272e"), field_secp256k1_to_uint256(field_secp256k1_inv(a)));
+  ASSERT(field_secp256k1_is_zero(field_secp256k1_inv(field_secp256k1_from_u32(0))));
+
+  // 2^256 - 1 isn't reduced, and the results of carries and borrows
+  // past 2^256 are folded back in
+  ASSERT_SAME(uint256_create_from_hex("1000003d0"), field_secp256k1_to_uint256(max));
+  ASSERT_SAME(uint256_create_from_hex("1000007a0000e8900"), field_secp256k1_to_uint256(field_secp256k1_mul(max, max)));
+  ASSERT_SAME(uint256_create_from_hex("1000007a0000e8900"), field_secp256k1_to_uint256(field_secp256k1_sqr(max)));
+  ASSERT_SAME(uint256_create_from_hex("2000007a0"), field_secp256k1_to_uint256(field_secp256k1_add(max, max)));
+  ASSERT_SAME(uint256_create_from_hex("fffffffffffffffffffffffffffffffffffffffffffffffffffffffdfffff85f"), field_secp256k1_to_uint256(field_secp256k1_neg(max)));
+  ASSERT_SAME(uint256_create_from_hex("3b9acaea3e223ab0"), field_secp256k1_to_uint256(field_secp256k1_mul_u32(max, 1000000007U)));
+
+  // lazily reduced values compare by their value mod p
+  ASSERT(field_secp256k1_equal(field_secp256k1_from_uint256(uint256_add(objs->prime, objs->one)), field_secp256k1_from_u32(1)));
+  ASSERT(field_secp256k1_is_zero(field_secp256k1_from_uint256(objs->prime)));
+  ASSERT(!field_secp256k1_equal(a, b));
+  ASSERT(field_secp256k1_equal(field_secp256k1_mul(a, field_secp256k1_inv(a)), field_secp256k1_from_u32(1)));
+  ASSERT(field_secp256k1_is_zero(field_secp256k1_add(max, field_secp256k1_neg(max))));
+
+  // batches
+  FieldSecp256k1 in[4] = { a, b, max, field_secp256k1_from_u32(1) }, out[4];
+  ASSERT(field_secp256k1_inv_batch(out, in, 4) == 0);
+  for (int i = 0; i < 4; i++) {
+    ASSERT(field_secp256k1_equal(out[i], field_secp256k1_inv(in[i])));
+  }
+  field_secp256k1_mul_batch(out, out, in, 4);
+  for (int i = 0; i < 4; i++) {
+    ASSERT(field_secp256k1_equal(out[i], field_secp256k1_from_u32(1)));
+  }
+  in[2] = field_secp256k1_from_uint256(objs->prime);
+  ASSERT(field_secp256k1_inv_batch(out, in, 4) == -1);
+}
+
+void test_field_25519(TestObjs *objs) {
+  UInt256 left = uint256_create_from_hex("5d5d3f0bd8578708ca055e64b071fb39cc89c6441a42c0bea958cda76bb7353");
+  UInt256 right = uint256_create_from_hex("8369869fe4435cf6247854aee4241c2713d511017771764284aba8f2a38961b");
+  UInt256 p25519 = uint256_create_from_hex("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffed");
+  Field25519 a = field_25519_from_uint256(left), b = field_25519_from_uint256(right);
+  Field25519 max = field_25519_from_uint256(objs->max);
+
+  ASSERT_SAME(left, field_25519_to_uint256(a));
+  ASSERT_SAME(uint256_create_from_hex("e0c6c5abbc9ae3feee7db31394961760e05ed74591b437012e04769a0f4096e"), field_25519_to_uint256(field_25519_add(a, b)));
+  ASSERT_SAME(uint256_create_from_hex("7d9f3b86bf4142a12a58d09b5cc4ddf12b8b4b542a2d14a7c24ad24b4c82dd25"), field_25519_to_uint256(field_25519_sub(a, b)));
+  ASSERT_SAME(uint256_create_from_hex("260c47940bebd5ed5a72f64a33b220ed474b4abd5d2eb583db52db4b37d22c8"), field_25519_to_uint256(field_25519_sub(b, a)));
+  ASSERT_SAME(uint256_create_from_hex("52a232835afdc9ca33d2d1a5fb56796a1992d0374a4a8286cd70c8d614e94478"), field_25519_to_uint256(field_25519_mul(a, b)));
+  ASSERT_SAME(uint256_create_from_hex("4210e98b08225f6368c23dd2853cfd9122708664bfbde76e5278ead9195b2b4c"), field_25519_to_uint256(field_25519_sqr(a)));
+  ASSERT_SAME(uint256_create_from_hex("76ba5e3a0723c978c339180e32484fb3d01601f51d92dd5cd916bb6ded39d02b"), field_25519_to_uint256(field_25519_inv(a)));
+  ASSERT(field_25519_is_zero(field_25519_inv(field_25519_from_u32(0))));
+
+  // 2^256 - 1 isn't reduced, and the results of carries and borrows
+  // past 2^256 are folded back in
+  ASSERT_SAME(uint256_create_from_hex("25"), field_25519_to_uint256(max));
+  ASSERT_SAME(uint256_create_from_hex("559"), field_25519_to_uint256(field_25519_mul(max, max)));
+  ASSERT_SAME(uint256_create_from_hex("559"), field_25519_to_uint256(field_25519_sqr(max)));
+  ASSERT_SAME(uint256_create_from_hex("4a"), field_25519_to_uint256(field_25519_add(max, max)));
+  ASSERT_SAME(uint256_create_from_hex("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffc8"), field_25519_to_uint256(field_25519_neg(max)));
+  ASSERT_SAME(uint256_create_from_hex("89d5f3303"), field_25519_to_uint256(field_25519_mul_u32(max, 1000000007U)));
+
+  // lazily reduced values compare by their value mod p
+  ASSERT(field_25519_equal(field_25519_from_uint256(uint256_add(p25519, objs->one)), field_25519_from_u32(1)));
+  ASSERT(field_25519_is_zero(field_25519_from_uint256(p25519)));
+  ASSERT(!field_25519_equal(a, b));
+  ASSERT(field_25519_equal(field_25519_mul(a, field_25519_inv(a)), field_25519_from_u32(1)));
+  ASSERT(field_25519_is_zero(field_25519_add(max, field_25519_neg(max))));
+
+  // batches
+  Field25519 in[4] = { a, b, max, field_25519_from_u32(1) }, out[4];
+  ASSERT(field_25519_inv_batch(out, in, 4) == 0);
+  for (int i = 0; i < 4; i++) {
+    ASSERT(field_25519_equal(out[i], field_25519_inv(in[i])));
+  }
+  field_25519_mul_batch(out, out, in, 4);
+  for (int i = 0; i < 4; i++) {
+    ASSERT(field_25519_equal(out[i], field_25519_from_u32(1)));
+  }
+  in[2] = field_25519_from_uint256(p25519);
+  ASSERT(field_25519_inv_batch(out, in, 4) == -1);
+}
+
+// The multiples of G are from the published secp256k1 test vectors
+// (and checked in Python), as are the first signature (private key 1,
+// the SHA-256 of "Satoshi Nakamoto") and its other valid s; the other
+// signatures were made in Python.
+#define G_X "79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798"
+#define G_Y "483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8"
+#define G2_X "c6047f9441ed7d6d3045406e95c07cd85c778e4b8cef3ca7abac09b95c709ee5"
+#define G2_Y "1ae168fea63dc339a3c58419466ceaeef7f632653266d0e1236431a950cfe52a"
+#define G3_X "f9308a019258c31049344f85f89d5229b531c845836f99b08601f113bce036f9"
+#define G3_Y "388f7b0f632de8140fe337e62a37f3566500a99934c2231b6cb9fd7584b8e672"
+
+void test_ec_add(TestObjs *objs) {
+  Secp256k1Affine g = secp256k1_generator(), affine;
+  Secp256k1Point p, q, r, inf;
+  (void) objs;
+
+  UInt256 x, y;
+  ASSERT(secp256k1_affine_get(&g, &x, &y) == 0);
+  ASSERT_SAME(uint256_create_from_hex(G_X), x);
+  ASSERT_SAME(uint256_create_from_hex(G_Y), y);
+  ASSERT(secp256k1_affine_create(&affine, x, y) == 0);
+  ASSERT(secp256k1_affine_create(&affine, x, uint256_add(y, objs->one)) == -1);
+  ASSERT(secp256k1_affine_create(&affine, objs->max, y) == -1);
+
+  // 2G three ways, and 3G
+  secp256k1_from_affine(&p, &g);
+  secp256k1_double(&q, &p);
+  ASSERT(point_is(&q, G2_X, G2_Y));
+  secp256k1_add(&r, &p, &p);
+  ASSERT(point_is(&r, G2_X, G2_Y));
+  secp256k1_add_affine(&r, &p, &g);
+  ASSERT(point_is(&r, G2_X, G2_Y));
+  ASSERT(secp256k1_equal(&q, &r));
+  secp256k1_add(&r, &q, &p);
+  ASSERT(point_is(&r, G3_X, G3_Y));
+  secp256k1_add_affine(&r, &q, &g);
+  ASSERT(point_is(&r, G3_X, G3_Y));
+  ASSERT(!secp256k1_equal(&q, &r));
+
+  // in place
+  r = p;
+  secp256k1_double(&r, &r);
+  secp256k1_add(&r, &r, &p);
+  ASSERT(point_is(&r, G3_X, G3_Y));
+
+  // the point at infinity
+  secp256k1_neg(&q, &p);
+  secp256k1_add(&inf, &p, &q);
+  ASSERT(secp256k1_is_infinity(&inf));
+  secp256k1_add_affine(&r, &q, &g);
+  ASSERT(secp256k1_is_infinity(&r));
+  secp256k1_double(&r, &inf);
+  ASSERT(secp256k1_is_infinity(&r));
+  secp256k1_add(&r, &inf, &p);
+  ASSERT(secp256k1_equal(&r, &p));
+  secp256k1_add(&r, &p, &inf);
+  ASSERT(secp256k1_equal(&r, &p));
+  secp256k1_add_affine(&r, &inf, &g);
+  ASSERT(secp256k1_equal(&r, &p));
+  ASSERT(secp256k1_equal(&inf, &inf));
+  ASSERT(!secp256k1_equal(&inf, &p));
+  secp256k1_to_affine(&affine, &inf);
+  ASSERT(affine.infinity);
+
+  // to affine coordinates in a batch
+  Secp256k1Point points[3];
+  Secp256k1Affine out[3];
+  secp256k1_double(&points[0], &p);
+  points[1] = inf;
+  secp256k1_add(&points[2], &points[0], &p);
+  secp256k1_to_affine_batch(out, points, 3);
+  ASSERT(secp256k1_affine_get(&out[0], &x, &y) == 0);
+  ASSERT_SAME(uint256_create_from_hex(G2_X), x);
+  ASSERT(out[1].infinity);
+  ASSERT(secp256k1_affine_get(&out[2], &x, &y) == 0);
+  ASSERT_SAME(uint256_create_from_hex(G3_Y), y);
+}
+
+void test_ec_mul(TestObjs *objs) {
+  static const char *const vectors[][3] = {
+    { "1", G_X, G_Y },
+    { "2", G2_X, G2_Y },
+    { "3", G3_X, G3_Y },
+    { "18ebbb95eed0e13",
+      "a90cc3d3f3e146daadfc74ca1372207cb4b725ae708cef713a98edd73d99ef29",
+      "5a79d6b289610c68bc3b47f3d72f9788a26a06868b4d8e433e1e2ad76fb7dc76" },
+    // n - 1, which gives -G
+    { "fffffffffffffffffffffffffffffffebaaedce6af48a03bbfd25e8cd0364140",
+      G_X, "b7c52588d95c3b9aa25b0403f1eef75702e84bb7597aabe663b82f6f04ef2777" },
+    { "b14a81b53e13272ee40c58c9a32d60b15d357ffe4423f60ddb0eda407f5e8e61",
+      "c9b432a47da8bee1c3b108d0b63091ad0ee2b3de9be9f3ccfa430a3a920425d0",
+      "edbbb9fed733584409600df2d60bab5ca624ed31885cec25c29d050d270232dc" },
+    // above n
+    { "ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff",
+      "9166c289b9f905e55f9e3df9f69d7f356b4a22095f894f4715714aa4b56606af",
+      "f181eb966be4acb5cff9e16b66d809be94e214f06c93fd091099af98499255e7" },
+  };
+  Secp256k1Affine g = secp256k1_generator();
+  Secp256k1Point p, r;
+  secp256k1_from_affine(&p, &g);
+
+  for (unsigned i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+    UInt256 k = uint256_create_from_hex(vectors[i][0]);
+    secp256k1_mul_base(&r, k);
+    ASSERT(point_is(&r, vectors[i][1], vectors[i][2]));
+    secp256k1_mul(&r, &p, k);
+    ASSERT(point_is(&r, vectors[i][1], vectors[i][2]));
+  }
+
+  // 0 and n give the point at infinity
+  secp256k1_mul_base(&r, objs->zero);
+  ASSERT(secp256k1_is_infinity(&r));
+  secp256k1_mul(&r, &p, objs->zero);
+  ASSERT(secp256k1_is_infinity(&r));
+  secp256k1_mul_base(&r, secp256k1_order());
+  ASSERT(secp256k1_is_infinity(&r));
+  secp256k1_mul(&r, &p, secp256k1_order());
+  ASSERT(secp256k1_is_infinity(&r));
+
+  // a * (b * G) = (a * b) * G, for an a * b that doesn't overflow
+  Secp256k1Point q, expected;
+  UInt256 a = uint256_create_from_hex("5d5d3f0bd8578708ca055e64b071fb39cc89c6441a42c0bea958cda");
+  UInt256 b = uint256_create_from_u32(1000000007U);
+  secp256k1_mul_base(&q, b);
+  secp256k1_mul(&r, &q, a);
+  secp256k1_mul_base(&expected, uint256_mul(a, b));
+  ASSERT(secp256k1_equal(&r, &expected));
+}
+
+void test_ec_verify(TestObjs *objs) {
+  Secp256k1Affine pub = secp256k1_generator(), pub2;
+  UInt256 z = uint256_create_from_hex("a0dc65ffca799873cbea0ac274015b9526505daaaed385155425f7337704883e");
+  Secp256k1Signature sig = {
+    uint256_create_from_hex("934b1ea10a4b3c1757e2b0c017d0b6143ce3c9a7e6a4a49860d7a6ab210ee3d8"),
+    uint256_create_from_hex("2442ce9d2b916064108014783e923ec36b49743e2ffa1c4496f01a512aafd9e5")
+  };
+  ASSERT(secp256k1_verify(z, &sig, &pub) == 1);
+
+  // n - s is valid too
+  Secp256k1Signature low_s = sig;
+  low_s.s = uint256_create_from_hex("dbbd3162d46e9f9bef7feb87c16dc13b4f6568a87f4e83f728e2443ba586675c");
+  ASSERT(secp256k1_verify(z, &low_s, &pub) == 1);
+
+  // another key and message
+  ASSERT(secp256k1_affine_create(&pub2,
+    uint256_create_from_hex("7b118019ba844eed4bacc58ead26fd9221a331ca86236a04dce2e1d0f8c27896"),
+    uint256_create_from_hex("e6611baec59a8b1b669936401011205d8007f8654be119c757f360ab661b3ebe")) == 0);
+  UInt256 z2 = uint256_create_from_hex("1937f9a9d34525ba58e0aff5273fd14bee272ba515d25ff68e83a364ad2b6e44");
+  Secp256k1Signature sig2 = {
+    uint256_create_from_hex("e4eacb8f58eb164ae912b7f7113bde5554b20b062cef5b289e7a452e75771fa5"),
+    uint256_create_from_hex("0f446bdf122fe7f27b55885ccc0d56dfae61d8682e58aa1dff2c4c237851c88d")
+  };
+  ASSERT(secp256k1_verify(z2, &sig2, &pub2) == 1);
+
+  // the wrong message, key, or signature
+  ASSERT(secp256k1_verify(uint256_add(z, objs->one), &sig, &pub) == 0);
+  ASSERT(secp256k1_verify(z, &sig, &pub2) == 0);
+  ASSERT(secp256k1_verify(z2, &sig, &pub2) == 0);
+  Secp256k1Signature bad = sig;
+  bad.r = uint256_add(bad.r, objs->one);
+  ASSERT(secp256k1_verify(z, &bad, &pub) == 0);
+
+  // r and s out of range
+  bad = sig;
+  bad.r = objs->zero;
+  ASSERT(secp256k1_verify(z, &bad, &pub) == 0);
+  bad = sig;
+  bad.s = secp256k1_order();
+  ASSERT(secp256k1_verify(z, &bad, &pub) == 0);
+  bad.s = objs->zero;
+  ASSERT(secp256k1_verify(z, &bad, &pub) == 0);
+  pub.infinity = 1;
+  ASSERT(secp256k1_verify(z, &sig, &pub) == 0);
+
+  // a key off the curve is rejected by both checks
+  Secp256k1Affine off = secp256k1_generator();
+  off.y = field_secp256k1_add(off.y, field_secp256k1_from_u32(1));
+  ASSERT(secp256k1_verify(z, &sig, &off) == 0);
+  int valid;
+  ASSERT(secp256k1_verify_batch(&z, &sig, &off, 1, &valid) == 0);
+  ASSERT(valid == 0);
+}
+
+void test_ec_verify_batch(TestObjs *objs) {
+  Secp256k1Affine g = secp256k1_generator(), pub2;
+  ASSERT(secp256k1_affine_create(&pub2,
+    uint256_create_from_hex("7b118019ba844eed4bacc58ead26fd9221a331ca86236a04dce2e1d0f8c27896"),
+    uint256_create_from_hex("e6611baec59a8b1b669936401011205d8007f8654be119c757f360ab661b3ebe")) == 0);
+  UInt256 z1 = uint256_create_from_hex("a0dc65ffca799873cbea0ac274015b9526505daaaed385155425f7337704883e");
+  UInt256 z2 = uint256_create_from_hex("1937f9a9d34525ba58e0aff5273fd14bee272ba515d25ff68e83a364ad2b6e44");
+  UInt256 z3 = uint256_create_from_hex("16c5deada28e9f8b6dca3d159b84bd80e4a78cf19a919f4efcf5f11454340c5e");
+  Secp256k1Signature sig1 = {
+    uint256_create_from_hex("934b1ea10a4b3c1757e2b0c017d0b6143ce3c9a7e6a4a49860d7a6ab210ee3d8"),
+    uint256_create_from_hex("2442ce9d2b916064108014783e923ec36b49743e2ffa1c4496f01a512aafd9e5")
+  };
+  Secp256k1Signature sig2 = {
+    uint256_create_from_hex("e4eacb8f58eb164ae912b7f7113bde5554b20b062cef5b289e7a452e75771fa5"),
+    uint256_create_from_hex("0f446bdf122fe7f27b55885ccc0d56dfae61d8682e58aa1dff2c4c237851c88d")
+  };
+  Secp256k1Signature sig3 = {
+    uint256_create_from_hex("d029847c84a06199994f041c57a74ab4e06e09edb8071b18115a229992b0f035"),
+    uint256_create_from_hex("a41508ac0c84ce4a4de3f5a520599edd48326d66ba12a94a01148aab3f6ba6d2")
+  };
+  Secp256k1Signature zero_s = { sig1.r, objs->zero };
+
+  // more than one chunk of good and bad signatures
+  enum { N = 150 };
+  static UInt256 z[N];
+  static Secp256k1Signature sig[N];
+  static Secp256k1Affine pub[N];
+  static int valid[N];
+  long expected = 0;
+  for (int i = 0; i < N; i++) {
+    switch (i % 5) {
+    case 0: z[i] = z1; sig[i] = sig1; pub[i] = g; break;
+    case 1: z[i] = z2; sig[i] = sig2; pub[i] = pub2; break;
+    case 2: z[i] = z3; sig[i] = sig3; pub[i] = pub2; break;
+    case 3: z[i] = z2; sig[i] = sig1; pub[i] = g; break;
+    default: z[i] = z1; sig[i] = zero_s; pub[i] = g; break;
+    }
+    expected += i % 5 < 3;
+  }
+  ASSERT(secp256k1_verify_batch(z, sig, pub, N, valid) == expected);
+  for (int i = 0; i < N; i++) {
+    ASSERT(valid[i] == (i % 5 < 3));
+    ASSERT(valid[i] == secp256k1_verify(z[i], &sig[i], &pub[i]));
+  }
+  ASSERT(secp256k1_verify_batch(z, sig, pub, 0, valid) == 0);
+}
+
+void test_calc_write(TestObjs *objs) {
+  (void) objs;
+
+  // uint256_calc -w writes one line per input line, blank and
+  // malformed lines included, so the output lines up with the input
+  char name[] = "/tmp/uint256_calcXXXXXX";
+  int fd = mkstemp(name);
+  ASSERT(fd >= 0);
+  FILE *in = fdopen(fd, "w");
+  fputs("1 + 2\n\nzz + 1\n3 * 4 = 5\nff ^ 1\nff - 1", in);
+  fclose(in);
+
+  char cmd[64];
+  sprintf(cmd, "./uint256_calc -w %s 2>/dev/null", name);
+  FILE *out = popen(cmd, "r");
+  ASSERT(out != NULL);
+  const char *expected[] = { "1 + 2 = 3\n", "\n", "error: malformed line\n", "3 * 4 = c\n",
+                             "error: malformed line\n", "ff - 1 = fe\n" };
+  char line[128];
+  for (unsigned i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+    ASSERT(fgets(line, sizeof(line), out) != NULL);
+    ASSERT(0 == strcmp(expected[i], line));
+  }
+  ASSERT(fgets(line, sizeof(line), out) == NULL);
+  // malformed lines still make the exit status 1
+  int status = pclose(out);
+  ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+  unlink(name);
+}
+
+void bench_add(TestObjs *objs, uint64_t iters) {
+  UInt256 sum = objs->rot;
+  for (uint64_t i = 0; i < iters; i++) {
+    sum = uint256_add(sum, objs->max);
+  }
+  TCTEST_KEEP(sum);
+}
+
+void bench_rotate_left(TestObjs *objs, uint64_t iters, long nbits) {
+  UInt256 val = objs->rot;
+  for (uint64_t i = 0; i < iters; i++) {
+    val = uint256_rotate_left(val, (unsigned) nbits);
+  }
+  TCTEST_KEEP(val);
+}
+
+void bench_format_as_hex(TestObjs *objs, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    char *s = uint256_format_as_hex(objs->rot);
+    TCTEST_KEEP(s);
+    free(s);
+  }
+}
+
+void bench_mul(TestObjs *objs, uint64_t iters) {
+  UInt256 product = objs->rot;
+  for (uint64_t i = 0; i < iters; i++) {
+    product = uint256_mul(product, objs->max);
+  }
+  TCTEST_KEEP(product);
+}
+
+void bench_modinv(TestObjs *objs, uint64_t iters) {
+  UInt256 val = objs->rot;
+  for (uint64_t i = 0; i < iters; i++) {
+    uint256_modinv(val, objs->prime, &val);
+  }
+  TCTEST_KEEP(val);
+}
+
+void bench_modinv_ct(TestObjs *objs, uint64_t iters) {
+  UInt256 val = objs->rot;
+  for (uint64_t i = 0; i < iters; i++) {
+    uint256_modinv_ct(val, objs->prime, &val);
+  }
+  TCTEST_KEEP(val);
+}
+
+// Batches of n values, below the prime
+#define MAX_BATCH 4096
+static UInt256 batch_in[MAX_BATCH], batch_out[MAX_BATCH];
+
+static void fill_batch(TestObjs *objs, long n) {
+  batch_in[0] = objs->rot;
+  for (long i = 1; i < n; i++) {
+    // odd times odd stays odd, so none of them is 0
+    batch_in[i] = uint256_mul(batch_in[i - 1], objs->rot);
+    batch_in[i].data[7] &= 0x7FFFFFFFU;
+  }
+}
+
+void bench_modinv_batch(TestObjs *objs, uint64_t iters, long n) {
+  fill_batch(objs, n);
+  for (uint64_t i = 0; i < iters; i++) {
+    uint256_modinv_batch(batch_out, batch_in, (size_t) n, objs->prime);
+  }
+  TCTEST_KEEP(batch_out[0]);
+}
+
+void bench_modinv_batch_ct(TestObjs *objs, uint64_t iters, long n) {
+  fill_batch(objs, n);
+  for (uint64_t i = 0; i < iters; i++) {
+    uint256_modinv_batch_ct(batch_out, batch_in, (size_t) n, objs->prime);
+  }
+  TCTEST_KEEP(batch_out[0]);
+}
@@ -2,10 +2,676 @@
 #include <stdint.h>
 #include "wcfuncs.h"
 #include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include "wctable.h"
+#include "wcspill.h"
+#include "wcngram.h"
+#include "wcpipe.h"
+#include "wcexport.h"
+#include "wcart.h"
+#include "wcstop.h"
+#include "wcutf8.h"
+#include "wcwindow.h"
+#include "wcfiles.h"
+#include "wctfidf.h"
+#include "wcmem.h"
+#include "wcutil.h"
 
 // Suggested number of buckets for the hash table
 #define HASHTABLE_SIZE 13249
 
+// Options (from the command line) for a run of c_wordcount
+struct Options {
+  size_t memory_budget;   // -m: count within this many bytes, spilling to disk
+  unsigned ngram_len;     // -n: count n-grams of this many words
+  unsigned top_k;         // -k: number of n-grams, prefix matches or window words to report
+  int verbose;            // -v: print timing and statistics to stderr
+  int use_stdio;          // -F: read a character at a time with fgetc
+  const char *export_file;  // -e: write every word and its count here
+  int export_binary;      // -b: export in binary rather than CSV
+  int export_by_word;     // -a: export in alphabetical order
+  const char *prefix;     // -p: report the most frequent words with this prefix
+  const struct WcStopSet *stop_words;  // -x or -S: words not counted, or NULL
+  int utf8;               // -u: UTF-8 aware normalization
+  unsigned window;        // -w: report the words of the last this many seconds
+  unsigned interval;      // -i: seconds between window reports
+  int follow;             // -f: keep reading at end of file, like tail -f
+  int recursive;          // -R: count the files below directories
+  int per_file;           // -P: print each file's summary too
+  unsigned num_threads;   // -t: threads for counting several files
+  const char *tfidf_file; // -T: write the files' TF-IDF vectors here
+  int pages;              // -H: page size for the tables (WC_PAGES_*)
+  int numa;               // -N: NUMA node of the tables, or WC_NUMA_*
+};
+
+// Number of entries reported when -k isn't given
+#define DEFAULT_TOP_K 10
+
+// Bytes read at a time, and milliseconds between checks for more
+// input at end of file, when counting over a time window
+#define WINDOW_READ_SIZE (64 << 10)
+#define WINDOW_FOLLOW_MS 200
+
+static void usage(void) {
+  fprintf(stderr, "Usage: c_wordcount [-m budget[K|M|G]] [-n N [-k K]] [-F] [-e out [-b] [-a]] [-p prefix [-k K]] [-x | -S stopfile] [-u] [-w window[s|m|h] [-i interval] [-f] [-k K]] [-R] [-P] [-t threads] [-T out] [-H thp|huge] [-N local|spread|node] [-v] [file...]\n");
+  exit(1);
+}
+
+// Parse a byte count with an optional K, M or G suffix.
+// Returns 0 if the string isn't a valid size.
+static size_t parse_size(const char *s) {
+  char *end;
+  unsigned long long val = strtoull(s, &end, 10);
+  switch (*end) {
+  case 'G': case 'g': val <<= 10; // fall through
+  case 'M': case 'm': val <<= 10; // fall through
+  case 'K': case 'k': val <<= 10; end++; break;
+  default: break;
+  }
+  return *end == '\0' ? (size_t) val : 0;
+}
+
+// Parse a duration in seconds with an optional s, m or h suffix.
+// Returns 0 if the string isn't a valid duration.
+static unsigned parse_duration(const char *s) {
+  char *end;
+  unsigned long val = strtoul(s, &end, 10);
+  switch (*end) {
+  case 'h': val *= 60; // fall through
+  case 'm': val *= 60; // fall through
+  case 's': end++; break;
+  default: break;
+  }
+  return *end == '\0' && val <= 0xFFFFFFFFUL ? (unsigned) val : 0;
+}
+
+// Print the elapsed time and word throughput since start to stderr.
+static void report_throughput(double start, uint64_t num_words) {
+  double elapsed = wc_now_seconds() - start;
+  fprintf(stderr, "elapsed: %.3f s, %llu words (%.0f words/s)\n",
+          elapsed, (unsigned long long) num_words, elapsed > 0 ? num_words / elapsed : 0.0);
+}
+
+// Return the placement policy for tables (filled in p), or NULL if
+// none was asked for.
+static const struct WcMemPolicy *table_placement(const struct Options *opts,
+                                                 struct WcMemPolicy *p) {
+  if (opts->pages == WC_PAGES_DEFAULT && opts->numa == WC_NUMA_DEFAULT) {
+    return NULL;
+  }
+  p->pages = opts->pages;
+  p->numa = opts->numa;
+  return p;
+}
+
+// Print to stderr how the tables' memory was placed and the data-TLB
+// misses counted since dtlb_counter was started.
+static void report_placement(int dtlb_counter) {
+  int64_t misses = wc_dtlb_counter_stop(dtlb_counter);
+  struct WcMemStats s;
+  wc_mem_get_stats(&s);
+  if (s.bytes > 0) {
+    fprintf(stderr, "placed: %llu bytes, huge: %llu requested, %llu backed, hugetlb fallbacks: %llu, bind failures: %llu\n",
+            (unsigned long long) s.bytes, (unsigned long long) s.huge_bytes,
+            (unsigned long long) wc_mem_anon_huge_bytes(),
+            (unsigned long long) s.hugetlb_fallbacks, (unsigned long long) s.bind_failures);
+  }
+  if (misses >= 0) {
+    fprintf(stderr, "dTLB load misses: %lld\n", (long long) misses);
+  } else {
+    fprintf(stderr, "dTLB load misses: unavailable\n");
+  }
+}
+
+// Count the input within a memory budget, spilling partitions of
+// the vocabulary to disk when it doesn't fit.
+static int count_with_budget(FILE *in_file, const struct Options *opts, double start) {
+  struct WcSpillOptions spill_opts = { opts->memory_budget, 0, NULL, opts->stop_words };
+  struct WcSummary summary;
+  struct WcSpillStats stats;
+
+  if (wc_spill_count(in_file, &spill_opts, &summary, &stats) != 0) {
+    fprintf(stderr, "Error: could not use spill files\n");
+    return 1;
+  }
+  wc_summary_print(stdout, &summary);
+  if (stats.num_clamped > 0) {
+    fprintf(stderr, "Warning: some word counts exceeded %lu and were clamped\n",
+            (unsigned long) UINT32_MAX);
+  }
+  if (opts->verbose) {
+    fprintf(stderr, "spills: %u, bytes spilled: %llu, partition depth: %u\n",
+            stats.num_spills, (unsigned long long) stats.bytes_spilled, stats.max_depth);
+    report_throughput(start, summary.total_words);
+  }
+  return 0;
+}
+
+// Write every word of t and its count to the export file.
+static int export_table(const struct WcTable *t, const struct Options *opts) {
+  double start = wc_now_seconds();
+  FILE *out = fopen(opts->export_file, "wb");
+  if (!out) {
+    fprintf(stderr, "Error: Cannot open export file\n");
+    return 1;
+  }
+  int rc = wc_export_table(out, t, opts->export_binary ? WC_EXPORT_BINARY : WC_EXPORT_CSV,
+                           opts->export_by_word ? WC_EXPORT_BY_WORD : WC_EXPORT_BY_COUNT, 0);
+  if (fclose(out) != 0 || rc != 0) {
+    fprintf(stderr, "Error: could not write export file\n");
+    return 1;
+  }
+  if (opts->verbose) {
+    fprintf(stderr, "export: %u words in %.3f s\n", (unsigned int) t->unique_words,
+            wc_now_seconds() - start);
+  }
+  return 0;
+}
+
+// Print the most frequent words starting with the -p prefix, using
+// an ART index over the table. The prefix is normalized the way the
+// words were, so -p The finds the words counted as "the...".
+static int report_prefix(const struct WcTable *t, const struct Options *opts) {
+  double start = wc_now_seconds();
+  struct WcArt *a = wc_art_build(t, 0);
+  const struct WordEntry **top = (const struct WordEntry **)
+    malloc(opts->top_k * sizeof(struct WordEntry *));
+  // wc_utf8_normalize writes up to MAX_WORDLEN + 1 bytes
+  size_t prefix_size = strlen(opts->prefix) + 1;
+  if (prefix_size < MAX_WORDLEN + 1) {
+    prefix_size = MAX_WORDLEN + 1;
+  }
+  unsigned char *prefix = (unsigned char *) malloc(prefix_size);
+  if (a == NULL || top == NULL || prefix == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    wc_art_destroy(a);
+    free(top);
+    free(prefix);
+    return 1;
+  }
+  double build_time = wc_now_seconds() - start;
+
+  if (opts->utf8) {
+    wc_utf8_normalize((const unsigned char *) opts->prefix, strlen(opts->prefix), prefix);
+  } else {
+    strcpy((char *) prefix, opts->prefix);
+    wc_tolower(prefix);
+  }
+  unsigned n = wc_art_top_k_prefix(a, prefix, top, opts->top_k);
+  printf("Words starting with \"%s\": %u\n", opts->prefix,
+         (unsigned int) wc_art_count_prefix(a, prefix));
+  printf("Most frequent words starting with \"%s\":\n", opts->prefix);
+  for (unsigned i = 0; i < n; i++) {
+    printf("%s (%u)\n", (const char *) top[i]->word, (unsigned int) top[i]->count);
+  }
+  if (opts->verbose) {
+    fprintf(stderr, "index: %zu bytes (table: %zu bytes), built in %.3f s\n",
+            a->memory, wc_table_memory_usage(t), build_time);
+  }
+  wc_art_destroy(a);
+  free(top);
+  free(prefix);
+  return 0;
+}
+
+// Print the summary of a finished table, then export it and report
+// the -p prefix if asked to.
+static int report_table(const struct WcTable *t, const struct Options *opts) {
+  struct WcSummary summary;
+  wc_summary_from_table(&summary, t);
+  wc_summary_print(stdout, &summary);
+  if ((opts->export_file != NULL && export_table(t, opts) != 0)
+      || (opts->prefix != NULL && report_prefix(t, opts) != 0)) {
+    return 1;
+  }
+  return 0;
+}
+
+// Count the input with a reader thread filling buffers in the
+// background while this thread counts.
+static int count_pipelined(FILE *in_file, const struct Options *opts, double start) {
+  int dtlb_counter = opts->verbose ? wc_dtlb_counter_start() : -1;
+  struct WcMemPolicy placement;
+  struct WcTable *t = wc_table_create_placed(0, table_placement(opts, &placement));
+  struct WcPipe *p = t != NULL ? wc_pipe_open(fileno(in_file), 0, 0) : NULL;
+  if (p == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    wc_table_destroy(t);
+    return 1;
+  }
+  t->stop_words = opts->stop_words;
+
+  int rc = opts->utf8 ? wc_utf8_count_pipe(p, t) : wc_pipe_count_table(p, t);
+  uint64_t bytes_read = p->bytes_read;
+  uint64_t reader_waits = p->reader_waits;
+  uint64_t consumer_waits = p->consumer_waits;
+  if (wc_pipe_close(p) != 0 || rc != 0) {
+    fprintf(stderr, "Error: Cannot read input\n");
+    wc_table_destroy(t);
+    return 1;
+  }
+
+  if (report_table(t, opts) != 0) {
+    wc_table_destroy(t);
+    return 1;
+  }
+  if (opts->verbose) {
+    // reader waits mean counting is the bottleneck, counter waits
+    // mean input is
+    fprintf(stderr, "bytes read: %llu, reader waits: %llu, counter waits: %llu\n",
+            (unsigned long long) bytes_read, (unsigned long long) reader_waits,
+            (unsigned long long) consumer_waits);
+    report_throughput(start, t->total_words);
+    report_placement(dtlb_counter);
+  }
+  wc_table_destroy(t);
+  return 0;
+}
+
+// Read the next word a character at a time with fgetc, for -F,
+// splitting long runs like every other mode does.
+static int read_word_fgetc(FILE *in, struct WcSplitter *s, unsigned char *w) {
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    if (wc_splitter_add_char(s, (unsigned char) c, w)) {
+      return 1;
+    }
+  }
+  return wc_splitter_finish(s, w);
+}
+
+// Count sliding-window n-grams and print the most frequent ones.
+static int count_ngrams(FILE *in_file, const struct Options *opts, double start) {
+  struct WcNgramCounter *c = wc_ngram_create(opts->ngram_len);
+  uint32_t *top = (uint32_t *) malloc(opts->top_k * sizeof(uint32_t));
+  struct WcWordReader reader;
+  unsigned char word[MAX_WORDLEN + 1];
+  uint64_t num_words = 0;
+  int rc = 0, more;
+
+  if (wc_reader_init(&reader, in_file) != 0 || c == NULL || top == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    rc = 1;
+    goto done;
+  }
+  while ((more = wc_reader_next(&reader, word)) != 0) {
+    if (more < 0) {
+      fprintf(stderr, "Error: Cannot read input\n");
+      rc = 1;
+      goto done;
+    }
+    if (opts->stop_words != NULL) {
+      // stop words are dropped before the n-gram window sees them
+      wc_tolower(word);
+      wc_trim_non_alpha(word);
+      if (wc_stop_contains(opts->stop_words, word)) {
+        continue;
+      }
+    }
+    num_words++;
+    if (wc_ngram_add_word(c, word) != 0) {
+      fprintf(stderr, "Error: out of memory\n");
+      rc = 1;
+      goto done;
+    }
+  }
+
+  unsigned n = wc_ngram_top_k(c, top, opts->top_k);
+  printf("Total %u-grams read: %llu\n", opts->ngram_len, (unsigned long long) c->total_ngrams);
+  printf("Unique %u-grams read: %u\n", opts->ngram_len, (unsigned int) c->num_ngrams);
+  printf("Most frequent %u-grams:\n", opts->ngram_len);
+  for (unsigned i = 0; i < n; i++) {
+    wc_ngram_print(stdout, c, top[i]);
+    printf(" (%u)\n", (unsigned int) c->counts[top[i]]);
+  }
+  if (opts->verbose) {
+    fprintf(stderr, "distinct words: %u, key bytes: %zu\n", (unsigned int) c->num_words,
+            (size_t) c->num_ngrams * opts->ngram_len * sizeof(uint32_t));
+    report_throughput(start, num_words);
+  }
+
+done:
+  free(top);
+  wc_ngram_destroy(c);
+  wc_reader_free(&reader);
+  return rc;
+}
+
+// Print the counts of the window's complete intervals.
+static void report_window(struct WcWindow *w, const struct Options *opts,
+                          struct WordEntry **top, double start) {
+  double report_start = wc_now_seconds();
+  unsigned n = wc_window_top_k(w, top, opts->top_k);
+  printf("Window: last %u s at %.0f s\n", w->num_closed * opts->interval, report_start - start);
+  printf("Total words read: %u\n", (unsigned int) w->total->total_words);
+  printf("Unique words read: %u\n", (unsigned int) w->total->unique_words);
+  printf("Most frequent words:\n");
+  for (unsigned i = 0; i < n; i++) {
+    printf("%s (%u)\n", (const char *) top[i]->word, (unsigned int) top[i]->count);
+  }
+  printf("\n");
+  fflush(stdout);
+  if (opts->verbose) {
+    fprintf(stderr, "report: %.3f ms, total entries: %u, expired entries: %llu\n",
+            (wc_now_seconds() - report_start) * 1e3, (unsigned int) w->total->num_entries,
+            (unsigned long long) w->num_expired);
+  }
+}
+
+// Count the input as it arrives, reporting the most frequent words
+// of the last opts->window seconds every opts->interval seconds.
+// Words are timed by when they are read, not by anything in the
+// input. With opts->follow, reading continues at end of file (and
+// starts over if the file is truncated) until the program is killed.
+static int count_window(FILE *in_file, const struct Options *opts, double start) {
+  struct WcWindow *w = wc_window_create(opts->window / opts->interval, opts->stop_words);
+  struct WordEntry **top = (struct WordEntry **) malloc(opts->top_k * sizeof(struct WordEntry *));
+  unsigned char *buf = (unsigned char *) malloc(WINDOW_READ_SIZE);
+  if (w == NULL || top == NULL || buf == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    wc_window_destroy(w);
+    free(top);
+    free(buf);
+    return 1;
+  }
+
+  int fd = fileno(in_file);
+  struct stat st;
+  int is_file = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+  off_t offset = 0;
+  struct WcSplitter splitter;
+  unsigned char word[MAX_WORDLEN + 1];
+  double interval_end = start + opts->interval;
+  int rc = 0;
+  int eof = 0;
+  wc_splitter_init(&splitter);
+
+  while (!eof || opts->follow) {
+    double now = wc_now_seconds();
+    if (now >= interval_end) {
+      // after a long pause, closing one interval more than the window
+      // holds is enough to expire everything
+      unsigned closes = 0;
+      while (now >= interval_end) {
+        if (closes++ <= w->num_intervals && wc_window_close_interval(w) != 0) {
+          fprintf(stderr, "Error: could not update the window counts\n");
+          rc = 1;
+          goto done;
+        }
+        interval_end += opts->interval;
+      }
+      report_window(w, opts, top, start);
+    }
+
+    // wait for input, but not past the end of the interval
+    int timeout_ms = (int) ((interval_end - now) * 1000) + 1;
+    if (eof) {
+      // a file at its end always polls as readable, so sleep a little
+      // before looking for more
+      poll(NULL, 0, timeout_ms < WINDOW_FOLLOW_MS ? timeout_ms : WINDOW_FOLLOW_MS);
+      if (is_file && fstat(fd, &st) == 0 && st.st_size < offset) {
+        lseek(fd, 0, SEEK_SET);   // truncated: start over
+        offset = 0;
+      }
+    } else {
+      struct pollfd pfd = { fd, POLLIN, 0 };
+      if (poll(&pfd, 1, timeout_ms) == 0) {
+        continue;
+      }
+    }
+
+    ssize_t len = read(fd, buf, WINDOW_READ_SIZE);
+    if (len < 0) {
+      fprintf(stderr, "Error: Cannot read input\n");
+      rc = 1;
+      goto done;
+    }
+    eof = len == 0;
+    if (eof && !is_file) {
+      break;   // a closed pipe won't get more input
+    }
+    offset += len;
+    size_t pos = 0;
+    while (wc_splitter_next(&splitter, buf, (size_t) len, &pos, word)) {
+      if (opts->utf8) {
+        wc_utf8_count_word(wc_window_current(w), word);
+      } else {
+        wc_table_count_word(wc_window_current(w), word);
+      }
+    }
+  }
+
+  // count the last word and the partial interval
+  if (wc_splitter_finish(&splitter, word)) {
+    if (opts->utf8) {
+      wc_utf8_count_word(wc_window_current(w), word);
+    } else {
+      wc_table_count_word(wc_window_current(w), word);
+    }
+  }
+  if (wc_window_close_interval(w) != 0) {
+    fprintf(stderr, "Error: could not update the window counts\n");
+    rc = 1;
+    goto done;
+  }
+  report_window(w, opts, top, start);
+
+done:
+  wc_window_destroy(w);
+  free(top);
+  free(buf);
+  return rc;
+}
+
+// Return 1 if path is a directory, or doesn't exist but looks like a
+// glob pattern.
+static int is_pattern_or_dir(const char *path) {
+  struct stat st;
+  if (stat(path, &st) == 0) {
+    return S_ISDIR(st.st_mode);
+  }
+  return strpbrk(path, "*?[") != NULL;
+}
+
+// List the files named on the command line, expanding directories
+// and glob patterns. Returns 0 on success, or prints an error and
+// returns -1.
+static int list_files(char **paths, unsigned num_paths, const struct Options *opts,
+                      struct WcFileList *list) {
+  wc_files_init(list);
+  for (unsigned i = 0; i < num_paths; i++) {
+    if (wc_files_add(list, paths[i], opts->recursive) != 0) {
+      struct stat st;
+      if (!opts->recursive && stat(paths[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Error: %s is a directory (use -R)\n", paths[i]);
+      } else {
+        fprintf(stderr, "Error: Cannot open %s\n", paths[i]);
+      }
+      wc_files_free(list);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Count the files named on the command line (expanding directories
+// and glob patterns) with a pool of threads, printing each file's
+// summary first if asked to.
+static int count_files(char **paths, unsigned num_paths, const struct Options *opts, double start) {
+  struct WcFileList list;
+  if (list_files(paths, num_paths, opts, &list) != 0) {
+    return 1;
+  }
+
+  int dtlb_counter = opts->verbose ? wc_dtlb_counter_start() : -1;
+  struct WcMemPolicy placement;
+  const struct WcMemPolicy *mem = table_placement(opts, &placement);
+  struct WcTable *t = wc_table_create_placed(0, mem);
+  if (t == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    wc_files_free(&list);
+    return 1;
+  }
+  struct WcFilesOptions files_opts = { opts->num_threads, 0, opts->per_file, opts->utf8,
+                                       opts->stop_words, mem };
+  struct WcFilesStats stats;
+  int rc = wc_files_count(&list, &files_opts, t, &stats) != 0;
+  for (unsigned i = 0; i < list.num_files; i++) {
+    if (list.files[i].error) {
+      fprintf(stderr, "Error: Cannot read %s\n", list.files[i].path);
+    } else if (opts->per_file) {
+      printf("%s:\n", list.files[i].path);
+      wc_summary_print(stdout, &list.files[i].summary);
+      printf("\n");
+    }
+  }
+
+  if (report_table(t, opts) != 0) {
+    rc = 1;
+  }
+  if (opts->verbose) {
+    fprintf(stderr, "files: %u, bytes: %llu, threads: %u, tasks: %u, steals: %u\n",
+            list.num_files, (unsigned long long) stats.bytes, stats.num_threads,
+            stats.num_tasks, stats.num_steals);
+    report_throughput(start, t->total_words);
+    report_placement(dtlb_counter);
+  }
+  wc_table_destroy(t);
+  wc_files_free(&list);
+  return rc;
+}
+
+// Write the TF-IDF vectors of the files named on the command line,
+// each file being one document.
+static int write_tfidf(char **paths, unsigned num_paths, const struct Options *opts, double start) {
+  struct WcFileList list;
+  if (list_files(paths, num_paths, opts, &list) != 0) {
+    return 1;
+  }
+  FILE *out = fopen(opts->tfidf_file, "wb");
+  if (out == NULL) {
+    fprintf(stderr, "Error: Cannot open %s\n", opts->tfidf_file);
+    wc_files_free(&list);
+    return 1;
+  }
+
+  struct WcTfidfOptions tfidf_opts = { opts->num_threads, opts->stop_words, NULL };
+  struct WcTfidfStats stats = { 0, 0, 0, 0, 0 };
+  int rc = 0;
+  if (wc_tfidf_run(&list, &tfidf_opts, out, &stats) != 0) {
+    rc = 1;
+    int unreadable = 0;
+    for (unsigned i = 0; i < list.num_files; i++) {
+      if (list.files[i].error) {
+        fprintf(stderr, "Error: Cannot read %s\n", list.files[i].path);
+        unreadable = 1;
+      }
+    }
+    if (!unreadable) {
+      fprintf(stderr, "Error: Cannot write %s\n", opts->tfidf_file);
+    }
+  }
+  if (fclose(out) != 0) {
+    rc = 1;
+  }
+
+  printf("Documents: %u\n", stats.num_docs);
+  printf("Terms: %u\n", stats.num_terms);
+  printf("Nonzero weights: %llu\n", (unsigned long long) stats.num_weights);
+  if (opts->verbose) {
+    fprintf(stderr, "temporary bytes: %llu\n", (unsigned long long) stats.tmp_bytes);
+    report_throughput(start, stats.num_tokens);
+  }
+  wc_files_free(&list);
+  return rc;
+}
+
+// Checks that the options fit together, one per mode. Each returns
+// a description of the first conflict it finds, or NULL.
+
+// Several files (or a directory or pattern) are counted in parallel.
+static const char *check_files_mode(const struct Options *opts, int many_files, unsigned num_paths) {
+  if (!many_files) {
+    return NULL;
+  }
+  if (num_paths == 0) {
+    return "-R, -P, -t and -T need files to count";
+  }
+  if (opts->use_stdio || opts->memory_budget > 0 || opts->ngram_len > 1 || opts->window > 0) {
+    return "-F, -m, -n and -w count a single input";
+  }
+  return NULL;
+}
+
+// N-grams are counted in memory.
+static const char *check_ngram_mode(const struct Options *opts) {
+  if (opts->ngram_len > 1 && opts->memory_budget > 0) {
+    return "-n can't be used with -m";
+  }
+  return NULL;
+}
+
+// Exporting, prefix queries and UTF-8 words need the counting table.
+static const char *check_table_options(const struct Options *opts) {
+  if ((opts->export_file != NULL || opts->prefix != NULL || opts->utf8)
+      && (opts->use_stdio || opts->memory_budget > 0 || opts->ngram_len > 1)) {
+    return "-e, -p and -u can't be used with -F, -m or -n";
+  }
+  if ((opts->export_binary || opts->export_by_word) && opts->export_file == NULL) {
+    return "-b and -a need -e";
+  }
+  return NULL;
+}
+
+// The last stretch of time is counted as it is read.
+static const char *check_window_mode(const struct Options *opts) {
+  if ((opts->interval > 0 || opts->follow) && opts->window == 0) {
+    return "-i and -f need -w";
+  }
+  if (opts->window > 0 && (opts->use_stdio || opts->memory_budget > 0 || opts->ngram_len > 1
+                           || opts->export_file != NULL || opts->prefix != NULL)) {
+    return "-w can't be used with -F, -m, -n, -e or -p";
+  }
+  return NULL;
+}
+
+// Page size and NUMA placement apply to the counting tables.
+static const char *check_placement(const struct Options *opts) {
+  if ((opts->pages != WC_PAGES_DEFAULT || opts->numa != WC_NUMA_DEFAULT)
+      && (opts->use_stdio || opts->memory_budget > 0 || opts->ngram_len > 1 || opts->window > 0
+          || opts->tfidf_file != NULL)) {
+    return "-H and -N can't be used with -F, -m, -n, -w or -T";
+  }
+  return NULL;
+}
+
+// TF-IDF vectors are written instead of the usual summary.
+static const char *check_tfidf_mode(const struct Options *opts) {
+  if (opts->tfidf_file != NULL
+      && (opts->per_file || opts->utf8 || opts->export_file != NULL || opts->prefix != NULL)) {
+    return "-T can't be used with -P, -u, -e or -p";
+  }
+  return NULL;
+}
+
+// Return a description of the first conflict between the options,
+// or NULL if they fit together.
+static const char *check_options(const struct Options *opts, int many_files, unsigned num_paths) {
+  const char *conflict;
+  if ((conflict = check_files_mode(opts, many_files, num_paths)) != NULL
+      || (conflict = check_ngram_mode(opts)) != NULL
+      || (conflict = check_table_options(opts)) != NULL
+      || (conflict = check_window_mode(opts)) != NULL
+      || (conflict = check_placement(opts)) != NULL
+      || (conflict = check_tfidf_mode(opts)) != NULL) {
+    return conflict;
+  }
+  return NULL;
+}
 
 int main(int argc, char **argv) {
   // stats (to be printed at end)
@@ -14,10 +680,171 @@ int main(int argc, char **argv) {
   const unsigned char *best_word = (const unsigned char *) "";
   uint32_t best_word_count = 0;
 
+  struct Options opts = {
+    .ngram_len = 1,
+    .top_k = DEFAULT_TOP_K,
+    .pages = WC_PAGES_DEFAULT,
+    .numa = WC_NUMA_DEFAULT,
+  };
+  struct WcStopSet *loaded_stop_words = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "m:n:k:Fe:bap:xS:uw:i:fRPt:T:H:N:v")) != -1) {
+    switch (opt) {
+    case 'm':
+      opts.memory_budget = parse_size(optarg);
+      if (opts.memory_budget == 0) {
+        fprintf(stderr, "Error: invalid memory budget\n");
+        return 1;
+      }
+      break;
+    case 'n':
+      opts.ngram_len = (unsigned) atoi(optarg);
+      if (opts.ngram_len < 1 || opts.ngram_len > WC_NGRAM_MAX) {
+        fprintf(stderr, "Error: n-gram length must be between 1 and %d\n", WC_NGRAM_MAX);
+        return 1;
+      }
+      break;
+    case 'k':
+      opts.top_k = (unsigned) atoi(optarg);
+      if (opts.top_k < 1) {
+        fprintf(stderr, "Error: invalid count for -k\n");
+        return 1;
+      }
+      break;
+    case 'F':
+      opts.use_stdio = 1;
+      break;
+    case 'e':
+      opts.export_file = optarg;
+      break;
+    case 'b':
+      opts.export_binary = 1;
+      break;
+    case 'a':
+      opts.export_by_word = 1;
+      break;
+    case 'p':
+      opts.prefix = optarg;
+      break;
+    case 'x':
+      if (opts.stop_words != NULL) {
+        usage();
+      }
+      opts.stop_words = &wc_stop_builtin;
+      break;
+    case 'S':
+      if (opts.stop_words != NULL) {
+        usage();
+      }
+      loaded_stop_words = wc_stop_load(optarg);
+      if (loaded_stop_words == NULL) {
+        fprintf(stderr, "Error: Cannot read stop word file\n");
+        return 1;
+      }
+      opts.stop_words = loaded_stop_words;
+      break;
+    case 'u':
+      opts.utf8 = 1;
+      break;
+    case 'w':
+      opts.window = parse_duration(optarg);
+      if (opts.window == 0) {
+        fprintf(stderr, "Error: invalid window length\n");
+        return 1;
+      }
+      break;
+    case 'i':
+      opts.interval = parse_duration(optarg);
+      if (opts.interval == 0) {
+        fprintf(stderr, "Error: invalid report interval\n");
+        return 1;
+      }
+      break;
+    case 'f':
+      opts.follow = 1;
+      break;
+    case 'R':
+      opts.recursive = 1;
+      break;
+    case 'P':
+      opts.per_file = 1;
+      break;
+    case 't':
+      opts.num_threads = (unsigned) atoi(optarg);
+      if (opts.num_threads < 1) {
+        fprintf(stderr, "Error: invalid number of threads\n");
+        return 1;
+      }
+      break;
+    case 'T':
+      opts.tfidf_file = optarg;
+      break;
+    case 'H':
+      if (strcmp(optarg, "thp") == 0) {
+        opts.pages = WC_PAGES_THP;
+      } else if (strcmp(optarg, "huge") == 0) {
+        opts.pages = WC_PAGES_HUGETLB;
+      } else {
+        usage();
+      }
+      break;
+    case 'N':
+      if (strcmp(optarg, "local") == 0) {
+        opts.numa = WC_NUMA_LOCAL;
+      } else if (strcmp(optarg, "spread") == 0) {
+        opts.numa = WC_NUMA_SPREAD;
+      } else if (isdigit((unsigned char) optarg[0])) {
+        opts.numa = atoi(optarg);
+        if ((unsigned) opts.numa >= wc_mem_num_nodes()) {
+          fprintf(stderr, "Error: no NUMA node %d\n", opts.numa);
+          return 1;
+        }
+      } else {
+        usage();
+      }
+      break;
+    case 'v':
+      opts.verbose = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+  // several inputs (or a pattern for some) are counted in parallel
+  unsigned num_paths = (unsigned) (argc - optind);
+  int many_files = num_paths > 1 || opts.recursive || opts.per_file || opts.num_threads > 0
+    || opts.tfidf_file != NULL || (num_paths == 1 && is_pattern_or_dir(argv[optind]));
+  const char *conflict = check_options(&opts, many_files, num_paths);
+  if (conflict != NULL) {
+    fprintf(stderr, "Error: %s\n", conflict);
+    usage();
+  }
+  if (opts.window > 0) {
+    // by default the window is reported ten times over
+    if (opts.interval == 0) {
+      opts.interval = opts.window >= 10 ? opts.window / 10 : 1;
+    }
+    if (opts.interval > opts.window || opts.window % opts.interval != 0) {
+      fprintf(stderr, "Error: the window must be a multiple of the report interval\n");
+      return 1;
+    }
+  }
+
+  if (opts.tfidf_file != NULL) {
+    int rc = write_tfidf(argv + optind, num_paths, &opts, wc_now_seconds());
+    wc_stop_free(loaded_stop_words);
+    return rc;
+  }
+  if (many_files) {
+    int rc = count_files(argv + optind, num_paths, &opts, wc_now_seconds());
+    wc_stop_free(loaded_stop_words);
+    return rc;
+  }
+
   // read input file or retrieve input from standard input
   FILE *in_file;
-  if (argc >= 2) {
-    in_file = fopen(argv[1], "r");
+  if (optind < argc) {
+    in_file = fopen(argv[optind], "r");
     if (!in_file) {
       fprintf(stderr, "Error: Cannot open file\n");
       return 1;
@@ -27,6 +854,26 @@ int main(int argc, char **argv) {
     in_file = stdin;
   }
 
+  double start = wc_now_seconds();
+
+  if (opts.memory_budget > 0 || opts.ngram_len > 1 || opts.window > 0 || !opts.use_stdio) {
+    int rc;
+    if (opts.window > 0) {
+      rc = count_window(in_file, &opts, start);
+    } else if (opts.ngram_len > 1) {
+      rc = count_ngrams(in_file, &opts, start);
+    } else if (opts.memory_budget > 0) {
+      rc = count_with_budget(in_file, &opts, start);
+    } else {
+      rc = count_pipelined(in_file, &opts, start);
+    }
+    if (in_file != stdin) {
+      fclose(in_file);
+    }
+    wc_stop_free(loaded_stop_words);
+    return rc;
+  }
+
   // create hashtable
   struct WordEntry *words[HASHTABLE_SIZE] = { NULL };
 
@@ -34,10 +881,16 @@ int main(int argc, char **argv) {
   unsigned char best_word_temp[MAX_WORDLEN + 1] = "";
 
   // read through all the words in the input and save the best word with the highest count
-  while (wc_readnext(in_file, curr_word)) {
-    total_words++;
+  struct WcSplitter splitter;
+  wc_splitter_init(&splitter);
+  while (read_word_fgetc(in_file, &splitter, curr_word)) {
     wc_tolower(curr_word);
     wc_trim_non_alpha(curr_word);
+    // stop words are skipped entirely, as if removed from the input
+    if (opts.stop_words != NULL && wc_stop_contains(opts.stop_words, curr_word)) {
+      continue;
+    }
+    total_words++;
     struct WordEntry *current = wc_dict_find_or_insert(words, HASHTABLE_SIZE, curr_word);
     current->count++;
     if (current->count == 1) {
@@ -66,9 +919,14 @@ int main(int argc, char **argv) {
   printf("Unique words read: %u\n", (unsigned int) unique_words);
   printf("Most frequent word: %s (%u)\n", (const char *) best_word, best_word_count);
 
+  if (opts.verbose) {
+    report_throughput(start, total_words);
+  }
+
   if (in_file != stdin) {
     fclose(in_file);
   }
+  wc_stop_free(loaded_stop_words);
 
   return 0;
 }
@@ -0,0 +1,470 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "wcart.h"
+#include "wcexport.h"
+
+// Size of each arena chunk the nodes are carved from
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct WcArtNode4 {
+  struct WcArtNode n;
+  unsigned char keys[4];
+  void *children[4];
+};
+
+struct WcArtNode16 {
+  struct WcArtNode n;
+  unsigned char keys[16];
+  void *children[16];
+};
+
+struct WcArtNode48 {
+  struct WcArtNode n;
+  unsigned char index[256];   // 0 for no child, else 1 + slot in children
+  void *children[48];
+};
+
+struct WcArtNode256 {
+  struct WcArtNode n;
+  void *children[256];
+};
+
+struct WcArtChunk {
+  struct WcArtChunk *next;
+  size_t used;
+  size_t size;
+  max_align_t data[];
+};
+
+static const size_t node_sizes[WC_ART_NUM_NODE_TYPES] = {
+  sizeof(struct WcArtNode4),
+  sizeof(struct WcArtNode16),
+  sizeof(struct WcArtNode48),
+  sizeof(struct WcArtNode256),
+};
+
+static int is_leaf(const void *ref) {
+  return ((uintptr_t) ref & 1) != 0;
+}
+
+static const struct WordEntry *leaf_entry(const void *ref) {
+  return (const struct WordEntry *) ((uintptr_t) ref & ~(uintptr_t) 1);
+}
+
+static void *make_leaf(const struct WordEntry *e) {
+  return (void *) ((uintptr_t) e | 1);
+}
+
+static uint32_t ref_max_count(const void *ref) {
+  return is_leaf(ref) ? leaf_entry(ref)->count : ((const struct WcArtNode *) ref)->max_count;
+}
+
+static uint32_t ref_num_words(const void *ref) {
+  return is_leaf(ref) ? 1 : ((const struct WcArtNode *) ref)->num_words;
+}
+
+// Allocate a zeroed node of the given type from the arena.
+static struct WcArtNode *alloc_node(struct WcArt *a, unsigned type) {
+  size_t size = (node_sizes[type] + 15) & ~(size_t) 15;
+  struct WcArtChunk *c = a->chunks;
+  if (c == NULL || c->used + size > c->size) {
+    size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+    c = (struct WcArtChunk *) malloc(sizeof(struct WcArtChunk) + chunk_size);
+    if (c == NULL) {
+      return NULL;
+    }
+    c->next = a->chunks;
+    c->used = 0;
+    c->size = chunk_size;
+    a->chunks = c;
+    a->memory += sizeof(struct WcArtChunk) + chunk_size;
+  }
+  struct WcArtNode *n = (struct WcArtNode *) ((unsigned char *) c->data + c->used);
+  c->used += size;
+  memset(n, 0, node_sizes[type]);
+  n->type = (uint8_t) type;
+  a->num_nodes[type]++;
+  return n;
+}
+
+// Add a child for key byte c. Children must be added in increasing
+// key order.
+static void add_child(struct WcArtNode *n, unsigned char c, void *child) {
+  switch (n->type) {
+  case WC_ART_NODE4: {
+    struct WcArtNode4 *n4 = (struct WcArtNode4 *) n;
+    n4->keys[n->num_children] = c;
+    n4->children[n->num_children] = child;
+    break;
+  }
+  case WC_ART_NODE16: {
+    struct WcArtNode16 *n16 = (struct WcArtNode16 *) n;
+    n16->keys[n->num_children] = c;
+    n16->children[n->num_children] = child;
+    break;
+  }
+  case WC_ART_NODE48: {
+    struct WcArtNode48 *n48 = (struct WcArtNode48 *) n;
+    n48->index[c] = (unsigned char) (n->num_children + 1);
+    n48->children[n->num_children] = child;
+    break;
+  }
+  default: {
+    struct WcArtNode256 *n256 = (struct WcArtNode256 *) n;
+    n256->children[c] = child;
+    break;
+  }
+  }
+  n->num_children++;
+}
+
+// Return the child of n for key byte c, or NULL.
+static void *find_child(const struct WcArtNode *n, unsigned char c) {
+  switch (n->type) {
+  case WC_ART_NODE4: {
+    const struct WcArtNode4 *n4 = (const struct WcArtNode4 *) n;
+    for (unsigned i = 0; i < n->num_children; i++) {
+      if (n4->keys[i] == c) {
+        return n4->children[i];
+      }
+    }
+    return NULL;
+  }
+  case WC_ART_NODE16: {
+    const struct WcArtNode16 *n16 = (const struct WcArtNode16 *) n;
+#ifdef __SSE2__
+    __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char) c),
+                                 _mm_loadu_si128((const __m128i *) n16->keys));
+    unsigned mask = (unsigned) _mm_movemask_epi8(cmp) & ((1U << n->num_children) - 1);
+    return mask != 0 ? n16->children[__builtin_ctz(mask)] : NULL;
+#else
+    for (unsigned i = 0; i < n->num_children; i++) {
+      if (n16->keys[i] == c) {
+        return n16->children[i];
+      }
+    }
+    return NULL;
+#endif
+  }
+  case WC_ART_NODE48: {
+    const struct WcArtNode48 *n48 = (const struct WcArtNode48 *) n;
+    return n48->index[c] != 0 ? n48->children[n48->index[c] - 1] : NULL;
+  }
+  default:
+    return ((const struct WcArtNode256 *) n)->children[c];
+  }
+}
+
+// Build the subtree for items[lo..hi), which are sorted, distinct,
+// and all share their first depth characters.
+static void *build(struct WcArt *a, const struct WcExportItem *items,
+                   uint32_t lo, uint32_t hi, unsigned depth) {
+  const struct WordEntry *first = (const struct WordEntry *)
+    (items[lo].word - offsetof(struct WordEntry, word));
+  if (hi - lo == 1) {
+    return make_leaf(first);
+  }
+
+  // the common prefix of a sorted range is that of its ends
+  const unsigned char *w = items[lo].word;
+  const unsigned char *last = items[hi - 1].word;
+  unsigned d = depth;
+  while (w[d] != '\0' && w[d] == last[d]) {
+    d++;
+  }
+
+  uint32_t i = lo;
+  if (w[d] == '\0') {
+    // the shortest word ends here, and sorts first
+    i++;
+  }
+  unsigned num_children = 0;
+  for (uint32_t j = i; j < hi; ) {
+    unsigned char c = items[j].word[d];
+    while (j < hi && items[j].word[d] == c) {
+      j++;
+    }
+    num_children++;
+  }
+
+  unsigned type = num_children <= 4 ? WC_ART_NODE4
+    : num_children <= 16 ? WC_ART_NODE16
+    : num_children <= 48 ? WC_ART_NODE48 : WC_ART_NODE256;
+  struct WcArtNode *n = alloc_node(a, type);
+  if (n == NULL) {
+    return NULL;
+  }
+  n->prefix_start = (uint8_t) depth;
+  n->depth = (uint8_t) d;
+  n->path = w;
+  if (i > lo) {
+    n->terminal = make_leaf(first);
+    n->max_count = first->count;
+    n->num_words = 1;
+  }
+
+  while (i < hi) {
+    unsigned char c = items[i].word[d];
+    uint32_t j = i;
+    while (j < hi && items[j].word[d] == c) {
+      j++;
+    }
+    void *child = build(a, items, i, j, d + 1);
+    if (child == NULL) {
+      return NULL;
+    }
+    add_child(n, c, child);
+    if (ref_max_count(child) > n->max_count) {
+      n->max_count = ref_max_count(child);
+    }
+    n->num_words += ref_num_words(child);
+    i = j;
+  }
+  return n;
+}
+
+struct WcArt *wc_art_build(const struct WcTable *t, unsigned num_threads) {
+  struct WcArt *a = (struct WcArt *) calloc(1, sizeof(struct WcArt));
+  if (a == NULL) {
+    return NULL;
+  }
+  a->memory = sizeof(struct WcArt);
+
+  struct WcExportItem *items;
+  uint32_t n;
+  if (wc_export_collect(t, &items, &n) != 0) {
+    free(a);
+    return NULL;
+  }
+  if (wc_export_sort_by_word(items, n, num_threads) != 0) {
+    free(items);
+    free(a);
+    return NULL;
+  }
+
+  a->num_words = n;
+  if (n > 0) {
+    a->root = build(a, items, 0, n, 0);
+    if (a->root == NULL) {
+      free(items);
+      wc_art_destroy(a);
+      return NULL;
+    }
+  }
+  free(items);
+  return a;
+}
+
+void wc_art_destroy(struct WcArt *a) {
+  if (a == NULL) {
+    return;
+  }
+  struct WcArtChunk *c = a->chunks;
+  while (c != NULL) {
+    struct WcArtChunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  free(a);
+}
+
+const struct WordEntry *wc_art_lookup(const struct WcArt *a, const unsigned char *word) {
+  const void *ref = a->root;
+
+  while (ref != NULL) {
+    if (is_leaf(ref)) {
+      const struct WordEntry *e = leaf_entry(ref);
+      return wc_str_compare(e->word, word) == 0 ? e : NULL;
+    }
+    const struct WcArtNode *n = (const struct WcArtNode *) ref;
+    for (unsigned i = n->prefix_start; i < n->depth; i++) {
+      if (word[i] != n->path[i]) {
+        return NULL;
+      }
+    }
+    if (word[n->depth] == '\0') {
+      return n->terminal != NULL ? leaf_entry(n->terminal) : NULL;
+    }
+    ref = find_child(n, word[n->depth]);
+  }
+  return NULL;
+}
+
+// Return the root of the subtree holding exactly the words that
+// start with prefix, or NULL if there are none.
+static const void *find_prefix(const struct WcArt *a, const unsigned char *prefix) {
+  size_t len = strlen((const char *) prefix);
+  const void *ref = a->root;
+
+  while (ref != NULL) {
+    if (is_leaf(ref)) {
+      const unsigned char *w = leaf_entry(ref)->word;
+      return strncmp((const char *) w, (const char *) prefix, len) == 0 ? ref : NULL;
+    }
+    const struct WcArtNode *n = (const struct WcArtNode *) ref;
+    for (unsigned i = n->prefix_start; i < n->depth; i++) {
+      if (i == len) {
+        return ref;
+      }
+      if (prefix[i] != n->path[i]) {
+        return NULL;
+      }
+    }
+    if (n->depth == len) {
+      return ref;
+    }
+    ref = find_child(n, prefix[n->depth]);
+  }
+  return NULL;
+}
+
+// The key of a subtree: the leaf's word, or the path of an inner
+// node (a lower bound on every word below it).
+static const unsigned char *ref_key(const void *ref, size_t *len) {
+  if (is_leaf(ref)) {
+    const unsigned char *w = leaf_entry(ref)->word;
+    *len = strlen((const char *) w);
+    return w;
+  }
+  const struct WcArtNode *n = (const struct WcArtNode *) ref;
+  *len = n->depth;
+  return n->path;
+}
+
+// Return 1 if subtree a should be visited before subtree b: higher
+// best count first, then lower key. A leaf is reported once it
+// ranks before every subtree still waiting, so the words come out
+// in wc_table_top_k order.
+static int ref_ranks_before(const void *a, const void *b) {
+  uint32_t ca = ref_max_count(a), cb = ref_max_count(b);
+  if (ca != cb) {
+    return ca > cb;
+  }
+  size_t la, lb;
+  const unsigned char *ka = ref_key(a, &la);
+  const unsigned char *kb = ref_key(b, &lb);
+  int cmp = memcmp(ka, kb, la < lb ? la : lb);
+  return cmp != 0 ? cmp < 0 : la < lb;
+}
+
+struct RefHeap {
+  const void **items;
+  size_t size;
+  size_t cap;
+};
+
+static int heap_push(struct RefHeap *h, const void *ref) {
+  if (h->size == h->cap) {
+    size_t cap = h->cap ? h->cap * 2 : 64;
+    const void **p = (const void **) realloc(h->items, cap * sizeof(const void *));
+    if (p == NULL) {
+      return -1;
+    }
+    h->items = p;
+    h->cap = cap;
+  }
+  size_t i = h->size++;
+  while (i > 0 && ref_ranks_before(ref, h->items[(i - 1) / 2])) {
+    h->items[i] = h->items[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  h->items[i] = ref;
+  return 0;
+}
+
+static const void *heap_pop(struct RefHeap *h) {
+  const void *top = h->items[0];
+  const void *x = h->items[--h->size];
+  size_t i = 0;
+  for (;;) {
+    size_t best = 2 * i + 1;
+    if (best >= h->size) {
+      break;
+    }
+    if (best + 1 < h->size && ref_ranks_before(h->items[best + 1], h->items[best])) {
+      best++;
+    }
+    if (!ref_ranks_before(h->items[best], x)) {
+      break;
+    }
+    h->items[i] = h->items[best];
+    i = best;
+  }
+  if (h->size > 0) {
+    h->items[i] = x;
+  }
+  return top;
+}
+
+// Push every child (and the terminal leaf) of inner node n.
+static int push_children(struct RefHeap *h, const struct WcArtNode *n) {
+  if (n->terminal != NULL && heap_push(h, n->terminal) != 0) {
+    return -1;
+  }
+  switch (n->type) {
+  case WC_ART_NODE4:
+  case WC_ART_NODE16: {
+    void *const *children = n->type == WC_ART_NODE4
+      ? ((const struct WcArtNode4 *) n)->children : ((const struct WcArtNode16 *) n)->children;
+    for (unsigned i = 0; i < n->num_children; i++) {
+      if (heap_push(h, children[i]) != 0) {
+        return -1;
+      }
+    }
+    break;
+  }
+  case WC_ART_NODE48: {
+    const struct WcArtNode48 *n48 = (const struct WcArtNode48 *) n;
+    for (unsigned i = 0; i < n->num_children; i++) {
+      if (heap_push(h, n48->children[i]) != 0) {
+        return -1;
+      }
+    }
+    break;
+  }
+  default: {
+    const struct WcArtNode256 *n256 = (const struct WcArtNode256 *) n;
+    for (unsigned c = 0; c < 256; c++) {
+      if (n256->children[c] != NULL && heap_push(h, n256->children[c]) != 0) {
+        return -1;
+      }
+    }
+    break;
+  }
+  }
+  return 0;
+}
+
+unsigned wc_art_top_k_prefix(const struct WcArt *a, const unsigned char *prefix,
+                             const struct WordEntry **out, unsigned k) {
+  const void *start = find_prefix(a, prefix);
+  if (start == NULL || k == 0) {
+    return 0;
+  }
+
+  // best-first search: the heap holds the subtrees not yet visited,
+  // ordered by the best count they can contain
+  struct RefHeap h = { NULL, 0, 0 };
+  unsigned n = 0;
+  if (heap_push(&h, start) == 0) {
+    while (n < k && h.size > 0) {
+      const void *ref = heap_pop(&h);
+      if (is_leaf(ref)) {
+        out[n++] = leaf_entry(ref);
+      } else if (push_children(&h, (const struct WcArtNode *) ref) != 0) {
+        break;
+      }
+    }
+  }
+  free(h.items);
+  return n;
+}
+
+uint32_t wc_art_count_prefix(const struct WcArt *a, const unsigned char *prefix) {
+  const void *ref = find_prefix(a, prefix);
+  return ref != NULL ? ref_num_words(ref) : 0;
+}
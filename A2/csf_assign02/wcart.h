@@ -0,0 +1,83 @@
+#ifndef WCART_H
+#define WCART_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "wcfuncs.h"
+#include "wctable.h"
+
+// Adaptive radix tree (ART) index over the words of a WcTable, for
+// prefix queries such as "the most frequent words starting with
+// 'pre'".
+//
+// Inner nodes come in four sizes, chosen by the number of children:
+//
+//   Node4, Node16   sorted arrays of key bytes and child pointers
+//   Node48          a 256-entry byte index into 48 child pointers
+//   Node256         256 child pointers, indexed by key byte
+//
+// Chains of single-child nodes are collapsed into a prefix stored
+// in the node they lead to (path compression). Leaves are the
+// table's WordEntry nodes themselves, tagged in the low bit of the
+// child pointer, so the index doesn't copy any words. Every inner
+// node records the highest count in its subtree, which lets a top-K
+// query visit subtrees in order of their best count and stop after
+// K words, rather than scanning every word with the prefix.
+//
+// The tree is built in one pass over the table's words in sorted
+// order, into a bump-allocated arena, so the nodes of a subtree sit
+// close together in memory. It is a snapshot: the table must not
+// be modified, reset or destroyed while the index is in use.
+
+enum {
+  WC_ART_NODE4,
+  WC_ART_NODE16,
+  WC_ART_NODE48,
+  WC_ART_NODE256,
+  WC_ART_NUM_NODE_TYPES
+};
+
+// Header shared by all inner node types. The node's compressed
+// prefix is path[prefix_start..depth), and all words in its subtree
+// begin with path[0..depth); children are selected by the
+// character at offset depth.
+struct WcArtNode {
+  uint8_t type;
+  uint8_t prefix_start;
+  uint8_t depth;
+  uint16_t num_children;
+  uint32_t max_count;          // highest count in the subtree
+  uint32_t num_words;          // number of words in the subtree
+  const unsigned char *path;   // some word in the subtree
+  void *terminal;              // leaf for the word path[0..depth), or NULL
+};
+
+struct WcArt {
+  void *root;
+  uint32_t num_words;
+  uint32_t num_nodes[WC_ART_NUM_NODE_TYPES];
+  size_t memory;               // bytes allocated for the index
+  struct WcArtChunk *chunks;   // arena the nodes are allocated from
+};
+
+// Build an index over the words of t with a nonzero count, sorting
+// them with up to num_threads threads (0 for one per online CPU).
+// Returns NULL if memory could not be allocated.
+struct WcArt *wc_art_build(const struct WcTable *t, unsigned num_threads);
+
+// Free an index (but not the table it refers to).
+void wc_art_destroy(struct WcArt *a);
+
+// Return the table entry for word, or NULL if it isn't indexed.
+const struct WordEntry *wc_art_lookup(const struct WcArt *a, const unsigned char *word);
+
+// Store (at most) the k most frequent words starting with prefix in
+// out, ordered by descending count and then ascending word, as
+// wc_table_top_k does. Returns the number of entries stored.
+unsigned wc_art_top_k_prefix(const struct WcArt *a, const unsigned char *prefix,
+                             const struct WordEntry **out, unsigned k);
+
+// Return the number of indexed words starting with prefix.
+uint32_t wc_art_count_prefix(const struct WcArt *a, const unsigned char *prefix);
+
+#endif // WCART_H
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "wctable.h"
+#include "wcexport.h"
+#include "wcart.h"
+#include "wcutil.h"
+
+// Query benchmark for the ART prefix index.
+//
+// Usage: wcartbench [-k K] [-q queries] file
+//
+// The words of file are counted into a WcTable and indexed with
+// wc_art_build. The build time and the memory used by the index
+// (compared with the table itself) are printed, and then, for
+// prefixes of 1 to 4 characters taken from randomly chosen words,
+// the time per top-K query with the index and with a scan of the
+// whole table. Every index result is checked against the scan.
+
+static int entry_ranks_before(const struct WordEntry *a, const struct WordEntry *b) {
+  if (a->count != b->count) {
+    return a->count > b->count;
+  }
+  return wc_str_compare(a->word, b->word) < 0;
+}
+
+// Top-K by prefix without an index: scan every entry of the table,
+// keeping the best k in out by insertion.
+static unsigned scan_top_k_prefix(const struct WcTable *t, const unsigned char *prefix,
+                                  const struct WordEntry **out, unsigned k) {
+  size_t len = strlen((const char *) prefix);
+  unsigned n = 0;
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    for (const struct WordEntry *p = t->buckets[t->touched[i]]; p != NULL; p = p->next) {
+      if (p->count == 0 || strncmp((const char *) p->word, (const char *) prefix, len) != 0) {
+        continue;
+      }
+      if (n == k && !entry_ranks_before(p, out[k - 1])) {
+        continue;
+      }
+      unsigned j = n < k ? n++ : k - 1;
+      while (j > 0 && entry_ranks_before(p, out[j - 1])) {
+        out[j] = out[j - 1];
+        j--;
+      }
+      out[j] = p;
+    }
+  }
+  return n;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: wcartbench [-k K] [-q queries] file\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  unsigned k = 10;
+  unsigned num_queries = 1000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "k:q:")) != -1) {
+    switch (opt) {
+    case 'k':
+      k = (unsigned) atoi(optarg);
+      break;
+    case 'q':
+      num_queries = (unsigned) atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind != argc - 1 || k < 1 || num_queries < 1) {
+    usage();
+  }
+
+  size_t len;
+  unsigned char *buf = wc_read_file(argv[optind], &len);
+  struct WcTable *t = wc_table_create(0);
+  if (buf == NULL || t == NULL) {
+    fprintf(stderr, "Error: Cannot read file\n");
+    return 1;
+  }
+  wc_table_count_buf(t, buf, len);
+  free(buf);
+
+  double start = wc_now_seconds();
+  struct WcArt *a = wc_art_build(t, 0);
+  double build_time = wc_now_seconds() - start;
+  if (a == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+  size_t table_bytes = wc_table_memory_usage(t);
+  printf("words: %u, build: %.3f s\n", (unsigned int) a->num_words, build_time);
+  printf("memory: table %zu bytes, index %zu bytes (%.1f%% of the table, %.1f bytes/word)\n",
+         table_bytes, a->memory, 100.0 * a->memory / table_bytes,
+         a->num_words ? (double) a->memory / a->num_words : 0.0);
+  printf("nodes: %u Node4, %u Node16, %u Node48, %u Node256\n",
+         a->num_nodes[WC_ART_NODE4], a->num_nodes[WC_ART_NODE16],
+         a->num_nodes[WC_ART_NODE48], a->num_nodes[WC_ART_NODE256]);
+
+  // the query prefixes are taken from randomly chosen words
+  struct WcExportItem *items;
+  uint32_t n;
+  if (wc_export_collect(t, &items, &n) != 0 || n == 0) {
+    fprintf(stderr, "Error: no words to query\n");
+    return 1;
+  }
+  const unsigned char **query_words = (const unsigned char **) malloc(num_queries * sizeof(char *));
+  const struct WordEntry **art_out = (const struct WordEntry **) malloc(k * sizeof(void *));
+  const struct WordEntry **scan_out = (const struct WordEntry **) malloc(k * sizeof(void *));
+  if (query_words == NULL || art_out == NULL || scan_out == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+  srand(12345);
+  for (unsigned i = 0; i < num_queries; i++) {
+    query_words[i] = items[(uint32_t) rand() % n].word;
+  }
+
+  printf("%6s %14s %14s %10s\n", "prefix", "index us/q", "scan us/q", "speedup");
+  for (unsigned plen = 1; plen <= 4; plen++) {
+    unsigned char (*prefixes)[5] = (unsigned char (*)[5]) malloc(num_queries * 5);
+    for (unsigned i = 0; i < num_queries; i++) {
+      strncpy((char *) prefixes[i], (const char *) query_words[i], plen);
+      prefixes[i][plen] = '\0';
+    }
+
+    uint64_t found = 0;
+    start = wc_now_seconds();
+    for (unsigned i = 0; i < num_queries; i++) {
+      found += wc_art_top_k_prefix(a, prefixes[i], art_out, k);
+    }
+    double art_time = wc_now_seconds() - start;
+
+    // the scan is much slower, so it runs on fewer queries
+    unsigned num_scans = num_queries < 100 ? num_queries : 100;
+    start = wc_now_seconds();
+    for (unsigned i = 0; i < num_scans; i++) {
+      unsigned m = scan_top_k_prefix(t, prefixes[i], scan_out, k);
+      if (m != wc_art_top_k_prefix(a, prefixes[i], art_out, k)
+          || memcmp(art_out, scan_out, m * sizeof(void *)) != 0) {
+        fprintf(stderr, "Error: index result differs from scan for prefix %s\n",
+                (const char *) prefixes[i]);
+        return 1;
+      }
+    }
+    double scan_time = wc_now_seconds() - start;
+
+    double art_us = art_time / num_queries * 1e6;
+    double scan_us = scan_time / num_scans * 1e6;
+    printf("%6u %14.2f %14.2f %9.0fx   (%.1f results/query)\n",
+           plen, art_us, scan_us, scan_us / art_us, (double) found / num_queries);
+    free(prefixes);
+  }
+
+  free(query_words);
+  free(art_out);
+  free(scan_out);
+  free(items);
+  wc_art_destroy(a);
+  wc_table_destroy(t);
+  return 0;
+}
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "wctable.h"
+#include "wcconcdict.h"
+#include "wcutil.h"
+
+// Scaling benchmark for the concurrent dictionary.
+//
+// Usage: wcconcbench [-t max_threads] [-r reps] [-H hot] [-g words [-V vocab]] [file]
+//
+// The input (file, or with -g a synthetic corpus of the given number
+// of words drawn from a skewed distribution over vocab distinct
+// words) is split into one chunk per thread at word boundaries and
+// counted two ways, for 1, 2, 4, ... max_threads threads:
+//
+//   shared:     every thread counts into one WcConcDict
+//   per-thread: every thread counts into its own WcTable, then the
+//               tables are merged into the first with wc_table_merge
+//
+// Each run is checked against a single-threaded count, and the best
+// time of reps runs is reported (with the merge time shown
+// separately for the per-thread strategy).
+
+struct Worker {
+  pthread_t thread;
+  const unsigned char *buf;
+  size_t len;
+  struct WcConcThread conc;
+  struct WcTable *table;
+  int failed;
+};
+
+// Generate num_words space-separated words. Word i of the vocabulary
+// is i written in base 26 with the letters a-z; the cube of a uniform
+// random number picks the index, so low-numbered words are very
+// frequent and most of the vocabulary is rare.
+static unsigned char *generate_corpus(uint64_t num_words, uint32_t vocab, size_t *len) {
+  size_t cap = (size_t) num_words * 9 + 1;
+  unsigned char *buf = (unsigned char *) malloc(cap);
+  if (buf == NULL) {
+    return NULL;
+  }
+  uint64_t x = 88172645463325252ULL;
+  size_t n = 0;
+  for (uint64_t i = 0; i < num_words; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    double r = (x >> 11) * (1.0 / 9007199254740992.0);
+    uint32_t index = (uint32_t) (r * r * r * vocab);
+    do {
+      buf[n++] = (unsigned char) ('a' + index % 26);
+      index /= 26;
+    } while (index > 0);
+    buf[n++] = ' ';
+  }
+  *len = n;
+  return buf;
+}
+
+// Split buf into num_workers chunks that don't split words.
+static void split_input(struct Worker *workers, unsigned num_workers,
+                        const unsigned char *buf, size_t len) {
+  size_t start = 0;
+  for (unsigned i = 0; i < num_workers; i++) {
+    size_t end = (i == num_workers - 1) ? len
+      : wc_buf_word_boundary(buf, len, len / num_workers * (i + 1));
+    if (end < start) {
+      end = start;
+    }
+    workers[i].buf = buf + start;
+    workers[i].len = end - start;
+    start = end;
+  }
+}
+
+static void *shared_main(void *arg) {
+  struct Worker *w = (struct Worker *) arg;
+  if (wc_conc_count_buf(&w->conc, w->buf, w->len) != 0) {
+    w->failed = 1;
+  }
+  return NULL;
+}
+
+static void *table_main(void *arg) {
+  struct Worker *w = (struct Worker *) arg;
+  wc_table_count_buf(w->table, w->buf, w->len);
+  return NULL;
+}
+
+// Start a thread per worker running fn, and wait for all of them.
+static int run_workers(struct Worker *workers, unsigned num_workers, void *(*fn)(void *)) {
+  int failed = 0;
+  for (unsigned i = 0; i < num_workers; i++) {
+    if (pthread_create(&workers[i].thread, NULL, fn, &workers[i]) != 0) {
+      fprintf(stderr, "Error: could not create thread\n");
+      exit(1);
+    }
+  }
+  for (unsigned i = 0; i < num_workers; i++) {
+    pthread_join(workers[i].thread, NULL);
+    failed |= workers[i].failed;
+  }
+  return failed ? -1 : 0;
+}
+
+static int same_summary(const struct WcSummary *a, const struct WcSummary *b) {
+  return a->total_words == b->total_words && a->unique_words == b->unique_words
+    && a->best_word_count == b->best_word_count
+    && wc_str_compare(a->best_word, b->best_word) == 0;
+}
+
+// Count buf into a shared dictionary with num_workers threads.
+// Returns the elapsed time, or a negative value on failure.
+static double time_shared(struct Worker *workers, unsigned num_workers,
+                          uint32_t capacity, uint32_t hot, const struct WcSummary *expected) {
+  struct WcConcDict *d = wc_conc_dict_create(capacity, hot);
+  if (d == NULL) {
+    return -1.0;
+  }
+  for (unsigned i = 0; i < num_workers; i++) {
+    wc_conc_thread_init(&workers[i].conc, d, i);
+    workers[i].failed = 0;
+  }
+
+  double start = wc_now_seconds();
+  int rc = run_workers(workers, num_workers, shared_main);
+  double elapsed = wc_now_seconds() - start;
+
+  struct WcSummary s;
+  wc_conc_summarize(d, &s);
+  s.total_words = 0;
+  for (unsigned i = 0; i < num_workers; i++) {
+    s.total_words += workers[i].conc.total_words;
+  }
+  wc_conc_dict_destroy(d);
+  if (rc != 0 || !same_summary(&s, expected)) {
+    return -1.0;
+  }
+  return elapsed;
+}
+
+// Count buf into per-thread tables and merge them. Returns the total
+// elapsed time and stores the merge time in *merge_time, or returns
+// a negative value on failure.
+static double time_per_thread(struct Worker *workers, unsigned num_workers,
+                              const struct WcSummary *expected, double *merge_time) {
+  int ok = 1;
+  for (unsigned i = 0; i < num_workers; i++) {
+    workers[i].table = wc_table_create(0);
+    workers[i].failed = 0;
+    if (workers[i].table == NULL) {
+      ok = 0;
+    }
+  }
+
+  double elapsed = -1.0;
+  if (ok) {
+    double start = wc_now_seconds();
+    run_workers(workers, num_workers, table_main);
+    double merge_start = wc_now_seconds();
+    for (unsigned i = 1; i < num_workers && ok; i++) {
+      ok = wc_table_merge(workers[0].table, workers[i].table) == 0;
+    }
+    double end = wc_now_seconds();
+
+    struct WcSummary s;
+    wc_summary_from_table(&s, workers[0].table);
+    if (ok && same_summary(&s, expected)) {
+      elapsed = end - start;
+      *merge_time = end - merge_start;
+    }
+  }
+
+  for (unsigned i = 0; i < num_workers; i++) {
+    wc_table_destroy(workers[i].table);
+  }
+  return elapsed;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: wcconcbench [-t max_threads] [-r reps] [-H hot] "
+          "[-g words [-V vocab]] [file]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  unsigned max_threads = 64;
+  unsigned reps = 3;
+  uint32_t hot = 1024;
+  uint64_t gen_words = 0;
+  uint32_t vocab = 1000000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:r:H:g:V:")) != -1) {
+    switch (opt) {
+    case 't':
+      max_threads = (unsigned) atoi(optarg);
+      break;
+    case 'r':
+      reps = (unsigned) atoi(optarg);
+      break;
+    case 'H':
+      hot = (uint32_t) strtoul(optarg, NULL, 10);
+      break;
+    case 'g':
+      gen_words = strtoull(optarg, NULL, 10);
+      break;
+    case 'V':
+      vocab = (uint32_t) strtoul(optarg, NULL, 10);
+      break;
+    default:
+      usage();
+    }
+  }
+  if (max_threads < 1 || reps < 1 || vocab < 1
+      || (gen_words == 0 && optind != argc - 1)
+      || (gen_words > 0 && optind != argc)) {
+    usage();
+  }
+
+  size_t len;
+  unsigned char *buf = gen_words > 0 ? generate_corpus(gen_words, vocab, &len)
+    : wc_read_file(argv[optind], &len);
+  if (buf == NULL) {
+    fprintf(stderr, "Error: Cannot read input\n");
+    return 1;
+  }
+
+  // the single-threaded count is the reference result, and tells us
+  // how large the shared dictionary must be
+  struct WcTable *ref = wc_table_create(0);
+  if (ref == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+  double start = wc_now_seconds();
+  wc_table_count_buf(ref, buf, len);
+  double ref_time = wc_now_seconds() - start;
+  struct WcSummary expected;
+  wc_summary_from_table(&expected, ref);
+  wc_table_destroy(ref);
+
+  printf("input: %zu bytes, %llu words, %llu unique; 1 thread, one WcTable: %.3f s\n",
+         len, (unsigned long long) expected.total_words,
+         (unsigned long long) expected.unique_words, ref_time);
+  printf("%7s %10s %12s %10s %10s %12s\n",
+         "threads", "shared s", "Mwords/s", "table s", "merge s", "Mwords/s");
+
+  struct Worker *workers = (struct Worker *) calloc(max_threads, sizeof(struct Worker));
+  if (workers == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+  uint32_t capacity = (uint32_t) expected.unique_words + 1;
+  double mwords = expected.total_words / 1e6;
+
+  for (unsigned n = 1; ; n = (n * 2 > max_threads && n < max_threads) ? max_threads : n * 2) {
+    split_input(workers, n, buf, len);
+
+    double best_shared = -1.0, best_table = -1.0, best_merge = 0.0;
+    for (unsigned r = 0; r < reps; r++) {
+      double merge_time = 0.0;
+      double shared = time_shared(workers, n, capacity, hot, &expected);
+      double table = time_per_thread(workers, n, &expected, &merge_time);
+      if (shared < 0.0 || table < 0.0) {
+        fprintf(stderr, "Error: %u-thread count did not match the single-threaded count\n", n);
+        return 1;
+      }
+      if (best_shared < 0.0 || shared < best_shared) {
+        best_shared = shared;
+      }
+      if (best_table < 0.0 || table < best_table) {
+        best_table = table;
+        best_merge = merge_time;
+      }
+    }
+    printf("%7u %10.3f %12.1f %10.3f %10.3f %12.1f\n", n,
+           best_shared, mwords / best_shared, best_table, best_merge, mwords / best_table);
+
+    if (n >= max_threads) {
+      break;
+    }
+  }
+
+  free(workers);
+  free(buf);
+  return 0;
+}
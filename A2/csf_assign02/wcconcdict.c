@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <string.h>
+#include "wcconcdict.h"
+#include "wcstr.h"
+
+// Number of entries a thread allocates at a time
+#define CHUNK_ENTRIES 1024
+
+// The dictionary refuses inserts once it is this full (in eighths)
+#define MAX_LOAD_EIGHTHS 7
+
+struct WcConcChunk {
+  struct WcConcChunk *next;
+  uint32_t used;
+  struct WcConcEntry entries[CHUNK_ENTRIES];
+};
+
+struct WcConcDict *wc_conc_dict_create(uint32_t capacity, uint32_t hot_threshold) {
+  struct WcConcDict *d = (struct WcConcDict *) malloc(sizeof(struct WcConcDict));
+  if (d == NULL) {
+    return NULL;
+  }
+
+  // size the slot array so that capacity words fill at most
+  // MAX_LOAD_EIGHTHS of it
+  uint64_t slots = 64;
+  while (slots * MAX_LOAD_EIGHTHS / 8 < capacity) {
+    slots *= 2;
+  }
+  if (slots > ((uint64_t) 1 << 31)) {
+    free(d);
+    return NULL;
+  }
+  d->slots = (_Atomic(struct WcConcEntry *) *) calloc((size_t) slots, sizeof(d->slots[0]));
+  if (d->slots == NULL) {
+    free(d);
+    return NULL;
+  }
+  d->mask = (uint32_t) (slots - 1);
+  d->max_entries = (uint32_t) (slots * MAX_LOAD_EIGHTHS / 8);
+  d->hot_threshold = hot_threshold;
+  atomic_init(&d->num_entries, 0);
+  atomic_init(&d->next_id, 0);
+  atomic_init(&d->chunks, NULL);
+  return d;
+}
+
+void wc_conc_dict_destroy(struct WcConcDict *d) {
+  if (d == NULL) {
+    return;
+  }
+  struct WcConcChunk *c = atomic_load(&d->chunks);
+  while (c != NULL) {
+    for (uint32_t i = 0; i < c->used; i++) {
+      free(atomic_load(&c->entries[i].stripes));
+    }
+    struct WcConcChunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  free(d->slots);
+  free(d);
+}
+
+void wc_conc_thread_init(struct WcConcThread *th, struct WcConcDict *d, unsigned thread_num) {
+  th->dict = d;
+  th->stripe = thread_num % WC_CONC_STRIPES;
+  th->chunk = NULL;
+  th->spare = NULL;
+  th->total_words = 0;
+}
+
+// Take a fresh entry from the thread's chunk, allocating a new chunk
+// (and registering it with the dictionary) when the current one is
+// used up.
+static struct WcConcEntry *alloc_entry(struct WcConcThread *th) {
+  if (th->spare != NULL) {
+    struct WcConcEntry *e = th->spare;
+    th->spare = NULL;
+    return e;
+  }
+
+  struct WcConcChunk *c = th->chunk;
+  if (c == NULL || c->used == CHUNK_ENTRIES) {
+    c = (struct WcConcChunk *) malloc(sizeof(struct WcConcChunk));
+    if (c == NULL) {
+      return NULL;
+    }
+    c->used = 0;
+    c->next = atomic_load_explicit(&th->dict->chunks, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak(&th->dict->chunks, &c->next, c)) {
+      // c->next now holds the current list head; try again
+    }
+    th->chunk = c;
+  }
+
+  struct WcConcEntry *e = &c->entries[c->used++];
+  atomic_init(&e->count, 0);
+  atomic_init(&e->stripes, NULL);
+  e->id = atomic_fetch_add_explicit(&th->dict->next_id, 1, memory_order_relaxed);
+  return e;
+}
+
+// Return the first slot to probe for a word with hash h. wc_hash's
+// low bits are poorly distributed for short words, which matters
+// with a power-of-two table, so they are mixed first.
+static uint32_t first_slot(const struct WcConcDict *d, uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35U;
+  h ^= h >> 16;
+  return h & d->mask;
+}
+
+// Return 1 if the published entry e holds the word s with hash h.
+static int entry_matches(const struct WcConcEntry *e, uint32_t h, const unsigned char *s) {
+  return e->hash == h && wc_word_compare(e->word, s) == 0;
+}
+
+struct WcConcEntry *wc_conc_find_or_insert(struct WcConcThread *th, const unsigned char *s) {
+  struct WcConcDict *d = th->dict;
+  uint32_t h = wc_hash(s);
+  struct WcConcEntry *mine = NULL;
+
+  for (uint32_t i = first_slot(d, h), probes = 0; probes <= d->mask; i = (i + 1) & d->mask, probes++) {
+    struct WcConcEntry *e = atomic_load_explicit(&d->slots[i], memory_order_acquire);
+
+    while (e == NULL) {
+      // the word isn't in the table (as far as this probe has seen):
+      // try to claim the empty slot with a new entry
+      if (mine == NULL) {
+        if (atomic_load_explicit(&d->num_entries, memory_order_relaxed) >= d->max_entries) {
+          return NULL;
+        }
+        mine = alloc_entry(th);
+        if (mine == NULL) {
+          return NULL;
+        }
+        mine->hash = h;
+        wc_word_copy(mine->word, s);
+      }
+      if (atomic_compare_exchange_strong_explicit(&d->slots[i], &e, mine,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+        atomic_fetch_add_explicit(&d->num_entries, 1, memory_order_relaxed);
+        return mine;
+      }
+      // another thread filled the slot first; e is now its entry
+    }
+
+    if (entry_matches(e, h, s)) {
+      if (mine != NULL) {
+        th->spare = mine;
+      }
+      return e;
+    }
+  }
+
+  if (mine != NULL) {
+    th->spare = mine;
+  }
+  return NULL;
+}
+
+struct WcConcEntry *wc_conc_lookup(struct WcConcDict *d, const unsigned char *s) {
+  uint32_t h = wc_hash(s);
+
+  for (uint32_t i = first_slot(d, h), probes = 0; probes <= d->mask; i = (i + 1) & d->mask, probes++) {
+    struct WcConcEntry *e = atomic_load_explicit(&d->slots[i], memory_order_acquire);
+    if (e == NULL) {
+      return NULL;
+    }
+    if (entry_matches(e, h, s)) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+void wc_conc_add(struct WcConcThread *th, struct WcConcEntry *e, uint32_t delta) {
+  struct WcConcStripes *stripes = atomic_load_explicit(&e->stripes, memory_order_acquire);
+  if (stripes != NULL) {
+    atomic_fetch_add_explicit(&stripes->stripe[th->stripe].value, delta, memory_order_relaxed);
+    return;
+  }
+
+  uint32_t old = atomic_fetch_add_explicit(&e->count, delta, memory_order_relaxed);
+  uint32_t threshold = th->dict->hot_threshold;
+  if (threshold != 0 && old < threshold && old + delta >= threshold) {
+    // exactly one thread sees the count cross the threshold, and it
+    // installs the stripes
+    struct WcConcStripes *fresh = (struct WcConcStripes *) calloc(1, sizeof(struct WcConcStripes));
+    if (fresh != NULL) {
+      struct WcConcStripes *expected = NULL;
+      if (!atomic_compare_exchange_strong(&e->stripes, &expected, fresh)) {
+        free(fresh);
+      }
+    }
+  }
+}
+
+uint32_t wc_conc_count(const struct WcConcEntry *e) {
+  uint32_t total = atomic_load_explicit(&e->count, memory_order_relaxed);
+  struct WcConcStripes *stripes = atomic_load_explicit(&e->stripes, memory_order_acquire);
+  if (stripes != NULL) {
+    for (unsigned i = 0; i < WC_CONC_STRIPES; i++) {
+      total += atomic_load_explicit(&stripes->stripe[i].value, memory_order_relaxed);
+    }
+  }
+  return total;
+}
+
+int wc_conc_count_word(struct WcConcThread *th, unsigned char *w) {
+  th->total_words++;
+  wc_tolower(w);
+  wc_trim_non_alpha(w);
+
+  struct WcConcEntry *e = wc_conc_find_or_insert(th, w);
+  if (e == NULL) {
+    return -1;
+  }
+  wc_conc_add(th, e, 1);
+  return 0;
+}
+
+int wc_conc_count_buf(struct WcConcThread *th, const unsigned char *buf, size_t len) {
+  unsigned char word[MAX_WORDLEN + 1];
+  size_t pos = 0;
+
+  while (wc_buf_readnext(buf, len, &pos, word)) {
+    if (wc_conc_count_word(th, word) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+struct WcConcEntry *wc_conc_slot(struct WcConcDict *d, uint32_t i) {
+  return atomic_load_explicit(&d->slots[i], memory_order_acquire);
+}
+
+void wc_conc_summarize(struct WcConcDict *d, struct WcSummary *s) {
+  s->unique_words = 0;
+  s->best_word[0] = '\0';
+  s->best_word_count = 0;
+
+  for (uint32_t i = 0; i <= d->mask; i++) {
+    struct WcConcEntry *e = wc_conc_slot(d, i);
+    if (e == NULL) {
+      continue;
+    }
+    uint32_t count = wc_conc_count(e);
+    if (count > 0) {
+      s->unique_words++;
+      wc_summary_consider(s, e->word, count);
+    }
+  }
+}
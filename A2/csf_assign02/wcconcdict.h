@@ -0,0 +1,117 @@
+#ifndef WCCONCDICT_H
+#define WCCONCDICT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "wcfuncs.h"
+#include "wctable.h"
+
+// A word dictionary that many threads can count into at once.
+//
+// The dictionary is an open-addressing array of entry pointers.
+// A thread inserts a word by filling in a private entry and
+// publishing it with a compare-and-swap into the first empty slot of
+// the word's probe sequence; if another thread wins the slot, the
+// probe simply continues, so no locks are taken on any path. Entries
+// are never moved or removed, which keeps lookups safe while other
+// threads insert.
+//
+// Counts are updated with atomic adds. A word whose count passes
+// the "hot" threshold gets an array of cache-line-sized striped
+// counters, and from then on each thread adds to its own stripe, so
+// very frequent words ("the", "of") don't bounce a single cache line
+// between cores.
+//
+// The slot array has a fixed capacity chosen at creation time (the
+// table can't be resized while it is shared); inserting into a full
+// dictionary fails.
+
+// Number of striped counters given to a hot word
+#define WC_CONC_STRIPES 16
+
+struct WcConcStripes {
+  struct {
+    _Atomic uint32_t value;
+    char padding[64 - sizeof(uint32_t)];
+  } stripe[WC_CONC_STRIPES];
+};
+
+struct WcConcEntry {
+  _Atomic uint32_t count;
+  uint32_t hash;
+  uint32_t id;                              // unique, and less than next_id
+  _Atomic(struct WcConcStripes *) stripes;  // NULL until the word is hot
+  unsigned char word[MAX_WORDLEN + 1];
+};
+
+// Block of entries owned by one thread
+struct WcConcChunk;
+
+struct WcConcDict {
+  _Atomic(struct WcConcEntry *) *slots;
+  uint32_t mask;
+  uint32_t max_entries;
+  uint32_t hot_threshold;
+  _Atomic uint32_t num_entries;
+  _Atomic uint32_t next_id;
+  _Atomic(struct WcConcChunk *) chunks;
+};
+
+// Per-thread handle for inserting into a dictionary. Each thread
+// that counts into the dictionary needs its own.
+struct WcConcThread {
+  struct WcConcDict *dict;
+  unsigned stripe;
+  struct WcConcChunk *chunk;
+  struct WcConcEntry *spare;   // entry that lost an insertion race
+  uint64_t total_words;
+};
+
+// Create a dictionary with room for at least capacity words.
+// Words whose count reaches hot_threshold get striped counters
+// (0 to disable striping). Returns NULL if memory could not be
+// allocated.
+struct WcConcDict *wc_conc_dict_create(uint32_t capacity, uint32_t hot_threshold);
+
+// Free a dictionary and all of its entries. No thread may be using
+// it any longer.
+void wc_conc_dict_destroy(struct WcConcDict *d);
+
+// Set up a thread's handle. Handles with different thread numbers
+// add to different stripes of hot words.
+void wc_conc_thread_init(struct WcConcThread *th, struct WcConcDict *d, unsigned thread_num);
+
+// Find or insert the entry for s. A new entry has a count of 0.
+// Returns NULL if the dictionary is full or memory ran out.
+struct WcConcEntry *wc_conc_find_or_insert(struct WcConcThread *th, const unsigned char *s);
+
+// Look up s without inserting it. Returns NULL if s isn't present.
+struct WcConcEntry *wc_conc_lookup(struct WcConcDict *d, const unsigned char *s);
+
+// Add delta to an entry's count.
+void wc_conc_add(struct WcConcThread *th, struct WcConcEntry *e, uint32_t delta);
+
+// Return an entry's count (the sum of its main and striped counters).
+// Exact once all threads have stopped adding to it.
+uint32_t wc_conc_count(const struct WcConcEntry *e);
+
+// Count one occurrence of w, normalized in place with wc_tolower and
+// wc_trim_non_alpha as c_wordcount does.
+// Returns 0 on success, -1 if the word could not be inserted.
+int wc_conc_count_word(struct WcConcThread *th, unsigned char *w);
+
+// Count every word in an in-memory buffer (see wc_buf_readnext).
+// Returns 0 on success, -1 if a word could not be inserted.
+int wc_conc_count_buf(struct WcConcThread *th, const unsigned char *buf, size_t len);
+
+// Return the entry in slot i (0 <= i <= d->mask), or NULL. Used to
+// visit every entry once counting has finished.
+struct WcConcEntry *wc_conc_slot(struct WcConcDict *d, uint32_t i);
+
+// Fill in the unique word count and most frequent word of s from
+// the dictionary. (The total word count is kept per thread, in
+// each handle's total_words.)
+void wc_conc_summarize(struct WcConcDict *d, struct WcSummary *s);
+
+#endif // WCCONCDICT_H
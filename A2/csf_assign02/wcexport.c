@@ -0,0 +1,386 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "wcexport.h"
+
+// Largest number of sorting threads
+#define MAX_SORT_THREADS 64
+
+// Runs shorter than this are sorted by insertion sort
+#define INSERTION_SORT_MAX 16
+
+// Size of the buffer that output records are formatted into
+#define OUT_BUF_SIZE (1 << 16)
+
+int wc_export_collect(const struct WcTable *t, struct WcExportItem **items, uint32_t *n) {
+  struct WcExportItem *a = (struct WcExportItem *)
+    malloc((t->num_entries ? t->num_entries : 1) * sizeof(struct WcExportItem));
+  if (a == NULL) {
+    return -1;
+  }
+
+  uint32_t count = 0;
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    for (const struct WordEntry *p = t->buckets[t->touched[i]]; p != NULL; p = p->next) {
+      if (p->count > 0) {
+        a[count].prefix = wc_export_prefix(p->word);
+        a[count].word = p->word;
+        a[count].count = p->count;
+        count++;
+      }
+    }
+  }
+  *items = a;
+  *n = count;
+  return 0;
+}
+
+uint64_t wc_export_prefix(const unsigned char *word) {
+  uint64_t prefix = 0;
+  unsigned i = 0;
+  for (; i < 8 && word[i] != '\0'; i++) {
+    prefix = (prefix << 8) | word[i];
+  }
+  return prefix << (8 * (8 - i));
+}
+
+// Compare two items' words; the same order as wc_str_compare.
+static int item_word_less(const struct WcExportItem *a, const struct WcExportItem *b) {
+  if (a->prefix != b->prefix) {
+    return a->prefix < b->prefix;
+  }
+  // equal prefixes with a NUL in them mean the words are equal;
+  // otherwise both words are at least 8 characters long
+  if ((a->prefix & 0xFF) == 0) {
+    return 0;
+  }
+  return wc_str_compare(a->word + 8, b->word + 8) < 0;
+}
+
+// Merge the sorted ranges a[0..na) and b[0..nb) into out.
+static void merge_runs(const struct WcExportItem *a, uint32_t na,
+                       const struct WcExportItem *b, uint32_t nb, struct WcExportItem *out) {
+  uint32_t i = 0, j = 0, k = 0;
+  while (i < na && j < nb) {
+    // take from a on ties, which keeps the merge stable
+    if (item_word_less(&b[j], &a[i])) {
+      out[k++] = b[j++];
+    } else {
+      out[k++] = a[i++];
+    }
+  }
+  memcpy(out + k, a + i, (na - i) * sizeof(struct WcExportItem));
+  k += na - i;
+  memcpy(out + k, b + j, (nb - j) * sizeof(struct WcExportItem));
+}
+
+// Sort items[0..n) by word; tmp has room for n items.
+static void merge_sort(struct WcExportItem *items, struct WcExportItem *tmp, uint32_t n) {
+  if (n <= INSERTION_SORT_MAX) {
+    for (uint32_t i = 1; i < n; i++) {
+      struct WcExportItem x = items[i];
+      uint32_t j = i;
+      while (j > 0 && item_word_less(&x, &items[j - 1])) {
+        items[j] = items[j - 1];
+        j--;
+      }
+      items[j] = x;
+    }
+    return;
+  }
+  uint32_t half = n / 2;
+  merge_sort(items, tmp, half);
+  merge_sort(items + half, tmp + half, n - half);
+  merge_runs(items, half, items + half, n - half, tmp);
+  memcpy(items, tmp, n * sizeof(struct WcExportItem));
+}
+
+// One thread's share of a parallel sort: either sort one run, or
+// merge two adjacent sorted runs (items[lo..mid) and items[mid..hi))
+// into tmp.
+struct SortTask {
+  pthread_t thread;
+  struct WcExportItem *items;
+  struct WcExportItem *tmp;
+  uint32_t lo, mid, hi;
+};
+
+static void *sort_run_main(void *arg) {
+  struct SortTask *task = (struct SortTask *) arg;
+  merge_sort(task->items + task->lo, task->tmp + task->lo, task->hi - task->lo);
+  return NULL;
+}
+
+static void *merge_pair_main(void *arg) {
+  struct SortTask *task = (struct SortTask *) arg;
+  merge_runs(task->items + task->lo, task->mid - task->lo,
+             task->items + task->mid, task->hi - task->mid, task->tmp + task->lo);
+  return NULL;
+}
+
+// Run fn on every task, on its own thread. A task whose thread can't
+// be created is run on the calling thread instead.
+static void run_tasks(struct SortTask *tasks, unsigned num_tasks, void *(*fn)(void *)) {
+  int started[MAX_SORT_THREADS];
+  for (unsigned i = 0; i < num_tasks; i++) {
+    started[i] = i > 0 && pthread_create(&tasks[i].thread, NULL, fn, &tasks[i]) == 0;
+  }
+  fn(&tasks[0]);
+  for (unsigned i = 1; i < num_tasks; i++) {
+    if (started[i]) {
+      pthread_join(tasks[i].thread, NULL);
+    } else {
+      fn(&tasks[i]);
+    }
+  }
+}
+
+int wc_export_sort_by_word(struct WcExportItem *items, uint32_t n, unsigned num_threads) {
+  if (num_threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = cpus > 0 ? (unsigned) cpus : 1;
+  }
+  if (num_threads > MAX_SORT_THREADS) {
+    num_threads = MAX_SORT_THREADS;
+  }
+  // at least a few thousand items per run, or threads don't pay off
+  while (num_threads > 1 && n / num_threads < 4096) {
+    num_threads--;
+  }
+
+  struct WcExportItem *tmp = (struct WcExportItem *) malloc((n ? n : 1) * sizeof(struct WcExportItem));
+  if (tmp == NULL) {
+    return -1;
+  }
+
+  // bounds[i] is the start of run i
+  uint32_t bounds[MAX_SORT_THREADS + 1];
+  struct SortTask tasks[MAX_SORT_THREADS];
+  unsigned num_runs = num_threads;
+  for (unsigned i = 0; i <= num_runs; i++) {
+    bounds[i] = (uint32_t) ((uint64_t) n * i / num_runs);
+  }
+  for (unsigned i = 0; i < num_runs; i++) {
+    tasks[i].items = items;
+    tasks[i].tmp = tmp;
+    tasks[i].lo = bounds[i];
+    tasks[i].hi = bounds[i + 1];
+  }
+  run_tasks(tasks, num_runs, sort_run_main);
+
+  // merge pairs of runs until one is left, alternating between
+  // items and tmp as the source
+  struct WcExportItem *src = items, *dst = tmp;
+  while (num_runs > 1) {
+    unsigned num_pairs = num_runs / 2;
+    for (unsigned i = 0; i < num_pairs; i++) {
+      tasks[i].items = src;
+      tasks[i].tmp = dst;
+      tasks[i].lo = bounds[2 * i];
+      tasks[i].mid = bounds[2 * i + 1];
+      tasks[i].hi = bounds[2 * i + 2];
+    }
+    run_tasks(tasks, num_pairs, merge_pair_main);
+
+    // an odd run out is copied across unchanged
+    if (num_runs % 2 == 1) {
+      uint32_t lo = bounds[num_runs - 1];
+      memcpy(dst + lo, src + lo, (n - lo) * sizeof(struct WcExportItem));
+    }
+    unsigned new_runs = 0;
+    for (unsigned i = 0; i < num_runs; i += 2) {
+      bounds[new_runs++] = bounds[i];
+    }
+    bounds[new_runs] = n;
+    num_runs = new_runs;
+
+    struct WcExportItem *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != items) {
+    memcpy(items, src, n * sizeof(struct WcExportItem));
+  }
+  free(tmp);
+  return 0;
+}
+
+int wc_export_sort_by_count(struct WcExportItem *items, uint32_t n) {
+  struct WcExportItem *tmp = (struct WcExportItem *) malloc((n ? n : 1) * sizeof(struct WcExportItem));
+  if (tmp == NULL) {
+    return -1;
+  }
+
+  // sort on ~count so that higher counts come first; one pass
+  // collects the histograms of all four bytes
+  uint32_t hist[4][256];
+  memset(hist, 0, sizeof(hist));
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t key = ~items[i].count;
+    for (unsigned b = 0; b < 4; b++) {
+      hist[b][(key >> (8 * b)) & 0xFF]++;
+    }
+  }
+
+  struct WcExportItem *src = items, *dst = tmp;
+  for (unsigned b = 0; b < 4; b++) {
+    // skip a byte that is the same in every key
+    if (n == 0 || hist[b][(~src[0].count >> (8 * b)) & 0xFF] == n) {
+      continue;
+    }
+    uint32_t offset[256];
+    uint32_t sum = 0;
+    for (unsigned d = 0; d < 256; d++) {
+      offset[d] = sum;
+      sum += hist[b][d];
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      unsigned d = (~src[i].count >> (8 * b)) & 0xFF;
+      dst[offset[d]++] = src[i];
+    }
+    struct WcExportItem *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != items) {
+    memcpy(items, src, n * sizeof(struct WcExportItem));
+  }
+  free(tmp);
+  return 0;
+}
+
+// Output buffer: records are formatted here and written with fwrite
+// a whole buffer at a time.
+struct OutBuf {
+  FILE *out;
+  unsigned char data[OUT_BUF_SIZE];
+  size_t len;
+  int error;
+};
+
+static void out_flush(struct OutBuf *b) {
+  if (b->len > 0 && fwrite(b->data, 1, b->len, b->out) != b->len) {
+    b->error = 1;
+  }
+  b->len = 0;
+}
+
+// Make room for at least n more bytes.
+static unsigned char *out_reserve(struct OutBuf *b, size_t n) {
+  if (b->len + n > OUT_BUF_SIZE) {
+    out_flush(b);
+  }
+  return b->data + b->len;
+}
+
+// Format v in decimal at p, returning the number of digits.
+static unsigned format_u32(unsigned char *p, uint32_t v) {
+  unsigned char digits[10];
+  unsigned n = 0;
+  do {
+    digits[n++] = (unsigned char) ('0' + v % 10);
+    v /= 10;
+  } while (v > 0);
+  for (unsigned i = 0; i < n; i++) {
+    p[i] = digits[n - 1 - i];
+  }
+  return n;
+}
+
+static void write_csv_item(struct OutBuf *b, const struct WcExportItem *item) {
+  // worst case: every character is a doubled quote, plus the
+  // enclosing quotes, a comma, ten digits and a newline
+  unsigned char *p = out_reserve(b, 2 * MAX_WORDLEN + 14);
+  unsigned char *start = p;
+  const unsigned char *w = item->word;
+
+  if (strpbrk((const char *) w, ",\"") != NULL) {
+    *p++ = '"';
+    for (; *w != '\0'; w++) {
+      if (*w == '"') {
+        *p++ = '"';
+      }
+      *p++ = *w;
+    }
+    *p++ = '"';
+  } else {
+    size_t len = strlen((const char *) w);
+    memcpy(p, w, len);
+    p += len;
+  }
+  *p++ = ',';
+  p += format_u32(p, item->count);
+  *p++ = '\n';
+  b->len += (size_t) (p - start);
+}
+
+static void write_binary_item(struct OutBuf *b, const struct WcExportItem *item) {
+  // five varint bytes, a length byte and the word
+  unsigned char *p = out_reserve(b, 6 + MAX_WORDLEN);
+  unsigned char *start = p;
+  uint32_t v = item->count;
+  while (v >= 0x80) {
+    *p++ = (unsigned char) (v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (unsigned char) v;
+  size_t len = strlen((const char *) item->word);
+  *p++ = (unsigned char) len;
+  memcpy(p, item->word, len);
+  p += len;
+  b->len += (size_t) (p - start);
+}
+
+int wc_export_write(FILE *out, const struct WcExportItem *items, uint32_t n,
+                    enum WcExportFormat format) {
+  struct OutBuf *b = (struct OutBuf *) malloc(sizeof(struct OutBuf));
+  if (b == NULL) {
+    return -1;
+  }
+  b->out = out;
+  b->len = 0;
+  b->error = 0;
+
+  if (format == WC_EXPORT_CSV) {
+    memcpy(out_reserve(b, 11), "word,count\n", 11);
+    b->len += 11;
+    for (uint32_t i = 0; i < n; i++) {
+      write_csv_item(b, &items[i]);
+    }
+  } else {
+    unsigned char *p = out_reserve(b, 16);
+    memcpy(p, WC_EXPORT_MAGIC, 8);
+    for (unsigned i = 0; i < 8; i++) {
+      p[8 + i] = (unsigned char) ((uint64_t) n >> (8 * i));
+    }
+    b->len += 16;
+    for (uint32_t i = 0; i < n; i++) {
+      write_binary_item(b, &items[i]);
+    }
+  }
+  out_flush(b);
+
+  int rc = (b->error || fflush(out) != 0) ? -1 : 0;
+  free(b);
+  return rc;
+}
+
+int wc_export_table(FILE *out, const struct WcTable *t, enum WcExportFormat format,
+                    enum WcExportOrder order, unsigned num_threads) {
+  struct WcExportItem *items;
+  uint32_t n;
+
+  if (wc_export_collect(t, &items, &n) != 0) {
+    return -1;
+  }
+  int rc = wc_export_sort_by_word(items, n, num_threads);
+  if (rc == 0 && order == WC_EXPORT_BY_COUNT) {
+    rc = wc_export_sort_by_count(items, n);
+  }
+  if (rc == 0) {
+    rc = wc_export_write(out, items, n, format);
+  }
+  free(items);
+  return rc;
+}
@@ -0,0 +1,77 @@
+#ifndef WCEXPORT_H
+#define WCEXPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "wcfuncs.h"
+#include "wctable.h"
+
+// Export of a complete word-frequency table.
+//
+// The (word, count) pairs of a WcTable are collected into an array
+// and sorted in two steps. The first is a merge sort by word: the
+// array is cut into one run per thread, the runs are sorted in
+// parallel, and pairs of runs are merged in parallel until one is
+// left. Each item carries the first 8 characters of its word as an
+// integer, so most comparisons don't have to follow the word
+// pointer. The second step, for frequency order, is a stable LSD
+// radix sort on the count (descending), which leaves words with
+// equal counts in ascending order.
+//
+// Two output formats are supported:
+//
+//   CSV     a "word,count" header line, then one line per word;
+//           words containing a comma or double quote are quoted
+//           as in RFC 4180
+//   binary  the 8-byte magic WC_EXPORT_MAGIC and the number of
+//           words as a little-endian uint64_t, then for each word
+//           its count as a LEB128 varint, its length as one byte,
+//           and its characters (without a NUL terminator)
+
+#define WC_EXPORT_MAGIC "WCEXPRT1"
+
+enum WcExportFormat {
+  WC_EXPORT_CSV,
+  WC_EXPORT_BINARY
+};
+
+enum WcExportOrder {
+  WC_EXPORT_BY_COUNT,   // count descending, then word ascending
+  WC_EXPORT_BY_WORD     // word ascending
+};
+
+struct WcExportItem {
+  uint64_t prefix;             // first 8 characters of word, big-endian
+  const unsigned char *word;   // points into the table's entries
+  uint32_t count;
+};
+
+// Store an array of the table's entries in *items (to be freed by
+// the caller) and their number in *n. Entries with a zero count are
+// left out. The items point into t, so t must outlive them.
+// Returns 0 on success, -1 if memory could not be allocated.
+int wc_export_collect(const struct WcTable *t, struct WcExportItem **items, uint32_t *n);
+
+// Return the sort prefix of word (see struct WcExportItem).
+uint64_t wc_export_prefix(const unsigned char *word);
+
+// Sort items by word (in wc_str_compare order) using up to
+// num_threads threads (0 for one per online CPU).
+// Returns 0 on success, -1 if memory could not be allocated.
+int wc_export_sort_by_word(struct WcExportItem *items, uint32_t n, unsigned num_threads);
+
+// Stably sort items by descending count.
+// Returns 0 on success, -1 if memory could not be allocated.
+int wc_export_sort_by_count(struct WcExportItem *items, uint32_t n);
+
+// Write items to out in the given format.
+// Returns 0 on success, -1 on a write error.
+int wc_export_write(FILE *out, const struct WcExportItem *items, uint32_t n,
+                    enum WcExportFormat format);
+
+// Collect, sort and write every entry of t.
+// Returns 0 on success, -1 on failure.
+int wc_export_table(FILE *out, const struct WcTable *t, enum WcExportFormat format,
+                    enum WcExportOrder order, unsigned num_threads);
+
+#endif // WCEXPORT_H
@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wcfiles.h"
+#include "wcpipe.h"
+#include "wcutf8.h"
+
+void wc_files_init(struct WcFileList *list) {
+  list->files = NULL;
+  list->num_files = 0;
+  list->capacity = 0;
+}
+
+void wc_files_free(struct WcFileList *list) {
+  for (unsigned i = 0; i < list->num_files; i++) {
+    free(list->files[i].path);
+  }
+  free(list->files);
+  wc_files_init(list);
+}
+
+// Append one file to the list.
+static int add_file(struct WcFileList *list, const char *path, uint64_t size) {
+  if (list->num_files == list->capacity) {
+    unsigned capacity = list->capacity ? list->capacity * 2 : 64;
+    struct WcFile *files = (struct WcFile *) realloc(list->files, capacity * sizeof(struct WcFile));
+    if (files == NULL) {
+      return -1;
+    }
+    list->files = files;
+    list->capacity = capacity;
+  }
+  struct WcFile *f = &list->files[list->num_files];
+  f->path = strdup(path);
+  if (f->path == NULL) {
+    return -1;
+  }
+  f->size = size;
+  f->error = 0;
+  wc_summary_init(&f->summary);
+  list->num_files++;
+  return 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+// Add the regular files below the directory dir, in name order.
+static int add_dir(struct WcFileList *list, const char *dir) {
+  DIR *d = opendir(dir);
+  if (d == NULL) {
+    return -1;
+  }
+  char **names = NULL;
+  unsigned num_names = 0, capacity = 0;
+  int rc = 0;
+  struct dirent *ent;
+  while (rc == 0 && (ent = readdir(d)) != NULL) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+      continue;
+    }
+    if (num_names == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      char **p = (char **) realloc(names, capacity * sizeof(char *));
+      if (p == NULL) {
+        rc = -1;
+        break;
+      }
+      names = p;
+    }
+    names[num_names] = strdup(ent->d_name);
+    if (names[num_names] == NULL) {
+      rc = -1;
+      break;
+    }
+    num_names++;
+  }
+  closedir(d);
+  qsort(names, num_names, sizeof(char *), compare_names);
+
+  size_t dir_len = strlen(dir);
+  for (unsigned i = 0; i < num_names && rc == 0; i++) {
+    char *path = (char *) malloc(dir_len + strlen(names[i]) + 2);
+    if (path == NULL) {
+      rc = -1;
+      break;
+    }
+    sprintf(path, "%s%s%s", dir, dir_len > 0 && dir[dir_len - 1] == '/' ? "" : "/", names[i]);
+
+    // lstat first, so a link to a directory isn't followed (it could
+    // make a cycle), but a link to a file is
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+      rc = add_dir(list, path);
+    } else if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+      rc = add_file(list, path, (uint64_t) st.st_size);
+    }
+    free(path);
+  }
+
+  for (unsigned i = 0; i < num_names; i++) {
+    free(names[i]);
+  }
+  free(names);
+  return rc;
+}
+
+int wc_files_add(struct WcFileList *list, const char *path, int recursive) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    if (strpbrk(path, "*?[") == NULL) {
+      return -1;
+    }
+    glob_t g;
+    if (glob(path, 0, NULL, &g) != 0) {
+      return -1;
+    }
+    int rc = 0;
+    for (size_t i = 0; i < g.gl_pathc && rc == 0; i++) {
+      rc = wc_files_add(list, g.gl_pathv[i], recursive);
+    }
+    globfree(&g);
+    return rc;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    return recursive ? add_dir(list, path) : -1;
+  }
+  // anything else that can be opened (a pipe, /dev/stdin) is read to
+  // its end as one task
+  return add_file(list, path, S_ISREG(st.st_mode) ? (uint64_t) st.st_size : 0);
+}
+
+// A file, or one chunk of a large file
+struct Task {
+  unsigned file;
+  unsigned num_chunks;   // chunks the file was split into (1 if none)
+  uint64_t start, end;   // nominal byte range of the chunk
+};
+
+// A worker's tasks, largest first. The owner takes tasks from the
+// top and thieves take them from the bottom: the owner starts on the
+// big tasks while they're fresh, and a thief, which only runs once
+// its own deque is empty, takes the smallest tasks left, which
+// evens out the finishing times.
+struct Deque {
+  pthread_mutex_t lock;
+  struct Task *tasks;
+  unsigned top, bottom;   // tasks[top..bottom) are waiting
+};
+
+// Per-file state for files split into chunks, when per-file summaries
+// are wanted
+struct ChunkedFile {
+  struct WcTable *table;
+  unsigned chunks_left;
+};
+
+struct Pool;
+
+struct Worker {
+  pthread_t thread;
+  struct Pool *pool;
+  unsigned id;
+  struct Deque deque;
+  struct WcTable *table;     // everything this worker counted
+  struct WcTable *scratch;   // the current task (with per_file)
+  unsigned char *buf;        // for files read with read(2)
+  unsigned num_steals;
+  uint64_t bytes;
+  int failed;                // out of memory
+};
+
+struct Pool {
+  struct WcFileList *list;
+  const struct WcFilesOptions *opts;
+  struct Worker *workers;
+  unsigned num_workers;
+  struct ChunkedFile *chunked;   // per file (with per_file)
+  pthread_mutex_t lock;          // protects chunked and file errors
+};
+
+static void mark_error(struct Pool *pool, struct WcFile *f) {
+  pthread_mutex_lock(&pool->lock);
+  f->error = 1;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void count_range(struct Pool *pool, struct WcTable *t, const unsigned char *buf, size_t len) {
+  if (pool->opts->utf8) {
+    wc_utf8_count_buf(t, buf, len);
+  } else {
+    wc_table_count_buf(t, buf, len);
+  }
+}
+
+// Count a small (or non-regular) file, read a block at a time into
+// the worker's buffer, so a pipe is never buffered whole.
+static int count_whole_file(struct Worker *w, struct WcFile *f, struct WcTable *t) {
+  if (w->buf == NULL) {
+    w->buf = (unsigned char *) malloc(WC_READER_BUF_SIZE);
+    if (w->buf == NULL) {
+      return -1;
+    }
+  }
+  int fd = open(f->path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct WcWordReader reader;
+  unsigned char word[MAX_WORDLEN + 1];
+  int utf8 = w->pool->opts->utf8;
+  int more;
+  wc_reader_init_fd(&reader, fd, w->buf, WC_READER_BUF_SIZE);
+  while ((more = wc_reader_next(&reader, word)) > 0) {
+    if (utf8) {
+      wc_utf8_count_word(t, word);
+    } else {
+      wc_table_count_word(t, word);
+    }
+  }
+  close(fd);
+  w->bytes += reader.bytes_read;
+  return more;
+}
+
+// Map a large file and count one chunk of it.
+static int count_chunk(struct Worker *w, struct WcFile *f, const struct Task *task,
+                       struct WcTable *t) {
+  int fd = open(f->path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  // don't map past the end if the file has shrunk since it was listed
+  struct stat st;
+  size_t size = (size_t) f->size;
+  if (fstat(fd, &st) == 0 && (uint64_t) st.st_size < f->size) {
+    size = (size_t) st.st_size;
+  }
+  if (task->start >= size) {
+    close(fd);
+    return 0;
+  }
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+  const unsigned char *buf = (const unsigned char *) map;
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  // both ends are moved forward to a word boundary, the same way by
+  // the neighbouring chunks, so every word is counted exactly once
+  size_t start = task->start == 0 ? 0 : wc_buf_word_boundary(buf, size, (size_t) task->start);
+  size_t end = task->end >= size ? size : wc_buf_word_boundary(buf, size, (size_t) task->end);
+  if (start < end) {
+    count_range(w->pool, t, buf + start, end - start);
+    w->bytes += end - start;
+  }
+  munmap(map, size);
+  return 0;
+}
+
+static void run_task(struct Worker *w, const struct Task *task) {
+  struct Pool *pool = w->pool;
+  struct WcFile *f = &pool->list->files[task->file];
+  int per_file = pool->opts->per_file;
+  struct WcTable *t = per_file ? w->scratch : w->table;
+
+  int rc = task->num_chunks == 1 ? count_whole_file(w, f, t) : count_chunk(w, f, task, t);
+  if (rc != 0) {
+    mark_error(pool, f);
+  }
+  if (!per_file) {
+    return;
+  }
+
+  if (wc_table_merge(w->table, t) != 0) {
+    w->failed = 1;
+  }
+  if (task->num_chunks == 1) {
+    wc_summary_from_table(&f->summary, t);
+  } else {
+    pthread_mutex_lock(&pool->lock);
+    struct ChunkedFile *c = &pool->chunked[task->file];
+    if (c->table == NULL) {
+      c->table = wc_table_create(0);
+    }
+    if (c->table == NULL || wc_table_merge(c->table, t) != 0) {
+      w->failed = 1;
+    }
+    if (--c->chunks_left == 0 && c->table != NULL) {
+      wc_summary_from_table(&f->summary, c->table);
+      wc_table_destroy(c->table);
+      c->table = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+  wc_table_reset(t);
+}
+
+// Take the next task from the worker's own deque.
+static int pop_own(struct Worker *w, struct Task *task) {
+  struct Deque *d = &w->deque;
+  int found = 0;
+  pthread_mutex_lock(&d->lock);
+  if (d->top < d->bottom) {
+    *task = d->tasks[d->top++];
+    found = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+
+// Take a task from some other worker's deque.
+static int steal(struct Worker *w, struct Task *task) {
+  struct Pool *pool = w->pool;
+  for (unsigned i = 1; i < pool->num_workers; i++) {
+    struct Deque *d = &pool->workers[(w->id + i) % pool->num_workers].deque;
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->top < d->bottom) {
+      *task = d->tasks[--d->bottom];
+      found = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    if (found) {
+      w->num_steals++;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Create the worker's tables.
+static int create_tables(struct Worker *w, const struct WcMemPolicy *p) {
+  const struct WcFilesOptions *opts = w->pool->opts;
+  w->table = wc_table_create_placed(0, p);
+  w->scratch = opts->per_file ? wc_table_create_placed(0, p) : NULL;
+  if (w->table == NULL || (opts->per_file && w->scratch == NULL)) {
+    return -1;
+  }
+  w->table->stop_words = opts->stop_words;
+  if (w->scratch != NULL) {
+    w->scratch->stop_words = opts->stop_words;
+  }
+  return 0;
+}
+
+static void *worker_main(void *arg) {
+  struct Worker *w = (struct Worker *) arg;
+  const struct WcMemPolicy *mem = w->pool->opts->mem;
+  if (mem != NULL && w->table == NULL) {
+    // the first touch of the tables' pages happens on this thread, on
+    // its node (moving the thread there first if it has its own node)
+    struct WcMemPolicy p = wc_mem_policy_for_thread(mem, w->id);
+    if (p.numa != mem->numa) {
+      wc_mem_run_on_node(p.numa);
+    }
+    if (create_tables(w, &p) != 0) {
+      // the other workers steal this one's tasks
+      w->failed = 1;
+      return NULL;
+    }
+  }
+  struct Task task;
+  // tasks are never added once the workers start, so when every deque
+  // is empty the work is done
+  while (pop_own(w, &task) || steal(w, &task)) {
+    run_task(w, &task);
+  }
+  return NULL;
+}
+
+static int compare_tasks(const void *a, const void *b) {
+  const struct Task *x = (const struct Task *) a, *y = (const struct Task *) b;
+  uint64_t x_len = x->end - x->start, y_len = y->end - y->start;
+  if (x_len != y_len) {
+    return x_len > y_len ? -1 : 1;
+  }
+  return x->file != y->file ? (x->file < y->file ? -1 : 1) : (x->start < y->start ? -1 : 1);
+}
+
+int wc_files_count(struct WcFileList *list, const struct WcFilesOptions *opts,
+                   struct WcTable *t, struct WcFilesStats *stats) {
+  size_t chunk_size = opts->chunk_size ? opts->chunk_size : WC_FILES_CHUNK_SIZE;
+  unsigned num_workers = opts->num_threads;
+  if (num_workers == 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = n > 0 ? (unsigned) n : 1;
+  }
+
+  // one task per file, or per chunk of a large file
+  unsigned num_tasks = 0;
+  for (unsigned i = 0; i < list->num_files; i++) {
+    num_tasks += list->files[i].size > chunk_size
+      ? (unsigned) ((list->files[i].size + chunk_size - 1) / chunk_size) : 1;
+  }
+  if (num_workers > num_tasks) {
+    num_workers = num_tasks > 0 ? num_tasks : 1;
+  }
+
+  struct Pool pool;
+  pool.list = list;
+  pool.opts = opts;
+  pool.num_workers = num_workers;
+  pool.workers = (struct Worker *) calloc(num_workers, sizeof(struct Worker));
+  pool.chunked = opts->per_file
+    ? (struct ChunkedFile *) calloc(list->num_files + 1, sizeof(struct ChunkedFile)) : NULL;
+  struct Task *tasks = (struct Task *) malloc((num_tasks + 1) * sizeof(struct Task));
+  int rc = 0;
+  if (pool.workers == NULL || tasks == NULL || (opts->per_file && pool.chunked == NULL)) {
+    free(pool.workers);
+    free(pool.chunked);
+    free(tasks);
+    return -1;
+  }
+  pthread_mutex_init(&pool.lock, NULL);
+
+  unsigned n = 0;
+  for (unsigned i = 0; i < list->num_files; i++) {
+    uint64_t size = list->files[i].size;
+    unsigned num_chunks = size > chunk_size ? (unsigned) ((size + chunk_size - 1) / chunk_size) : 1;
+    for (unsigned c = 0; c < num_chunks; c++) {
+      tasks[n].file = i;
+      tasks[n].num_chunks = num_chunks;
+      tasks[n].start = (uint64_t) c * chunk_size;
+      tasks[n].end = c + 1 == num_chunks ? size : (uint64_t) (c + 1) * chunk_size;
+      n++;
+    }
+    if (opts->per_file) {
+      pool.chunked[i].chunks_left = num_chunks;
+    }
+  }
+
+  // deal the tasks round-robin, largest first, so every worker starts
+  // with about the same amount of work
+  qsort(tasks, num_tasks, sizeof(struct Task), compare_tasks);
+  for (unsigned i = 0; i < num_workers; i++) {
+    struct Worker *w = &pool.workers[i];
+    w->pool = &pool;
+    w->id = i;
+    pthread_mutex_init(&w->deque.lock, NULL);
+    w->deque.tasks = (struct Task *) malloc((num_tasks / num_workers + 1) * sizeof(struct Task));
+    // placed tables are created by their own thread (see worker_main)
+    if (opts->mem == NULL && create_tables(w, NULL) != 0) {
+      rc = -1;
+    }
+    if (w->deque.tasks == NULL) {
+      rc = -1;
+      continue;
+    }
+    for (unsigned j = i; j < num_tasks; j += num_workers) {
+      w->deque.tasks[w->deque.bottom++] = tasks[j];
+    }
+  }
+
+  unsigned num_started = 0;
+  if (rc == 0) {
+    for (; num_started < num_workers; num_started++) {
+      if (pthread_create(&pool.workers[num_started].thread, NULL, worker_main,
+                         &pool.workers[num_started]) != 0) {
+        break;
+      }
+    }
+    // if some threads couldn't be started, this thread does their
+    // work (the running ones may also steal it)
+    for (unsigned i = num_started; i < num_workers; i++) {
+      worker_main(&pool.workers[i]);
+    }
+    for (unsigned i = 0; i < num_started; i++) {
+      pthread_join(pool.workers[i].thread, NULL);
+    }
+  }
+
+  if (stats != NULL) {
+    stats->num_threads = num_workers;
+    stats->num_tasks = num_tasks;
+    stats->num_steals = 0;
+    stats->bytes = 0;
+  }
+  for (unsigned i = 0; i < num_workers; i++) {
+    struct Worker *w = &pool.workers[i];
+    if (rc == 0 && (w->failed || w->table == NULL || wc_table_merge(t, w->table) != 0)) {
+      rc = -1;
+    }
+    if (stats != NULL) {
+      stats->num_steals += w->num_steals;
+      stats->bytes += w->bytes;
+    }
+    wc_table_destroy(w->table);
+    wc_table_destroy(w->scratch);
+    free(w->deque.tasks);
+    free(w->buf);
+    pthread_mutex_destroy(&w->deque.lock);
+  }
+  for (unsigned i = 0; i < list->num_files; i++) {
+    if (list->files[i].error) {
+      rc = -1;
+    }
+    if (pool.chunked != NULL) {
+      wc_table_destroy(pool.chunked[i].table);
+    }
+  }
+  pthread_mutex_destroy(&pool.lock);
+  free(pool.workers);
+  free(pool.chunked);
+  free(tasks);
+  return rc;
+}
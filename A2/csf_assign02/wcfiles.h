@@ -0,0 +1,88 @@
+#ifndef WCFILES_H
+#define WCFILES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "wctable.h"
+
+// Counting many input files in parallel.
+//
+// Input paths are expanded into a list of files: a directory
+// contributes the files below it (when recursive), and a path that
+// doesn't exist but contains glob characters is expanded with
+// glob(3), for patterns quoted past the shell. Files of a directory
+// are listed in name order, so results don't depend on readdir.
+//
+// The files are then counted by a pool of worker threads. Every file
+// becomes one task, except that files larger than the chunk size are
+// split into chunk-sized tasks (at word boundaries, so no word is
+// split). Tasks are dealt to per-worker deques, largest first, and a
+// worker whose deque runs dry steals from the top of another's, so a
+// few huge files and many small ones both keep every worker busy.
+// Each worker counts into its own table; the tables are merged at
+// the end.
+//
+// Small files and non-regular ones (pipes, /dev/stdin) are read with
+// read(2) a block at a time into a per-worker buffer, so memory stays
+// bounded whatever their length; chunked files are mapped with
+// mmap(2), so their chunks share the page cache.
+//
+// With a placement policy, each worker creates its tables itself, so
+// their pages are first touched by the thread using them; with
+// WC_NUMA_SPREAD, worker i also moves to node i's CPUs and binds its
+// tables there.
+
+struct WcFile {
+  char *path;
+  uint64_t size;
+  int error;                  // nonzero if the file couldn't be read
+  struct WcSummary summary;   // the file's own counts (with per_file)
+};
+
+struct WcFileList {
+  struct WcFile *files;
+  unsigned num_files;
+  unsigned capacity;
+};
+
+struct WcFilesOptions {
+  unsigned num_threads;       // worker threads (0 for one per CPU)
+  size_t chunk_size;          // split larger files (0 for the default)
+  int per_file;               // compute each file's summary too
+  int utf8;                   // count with wc_utf8_count_buf
+  const struct WcStopSet *stop_words;  // words not counted, or NULL
+  const struct WcMemPolicy *mem;       // placement of the tables, or NULL
+};
+
+struct WcFilesStats {
+  unsigned num_threads;       // workers used
+  unsigned num_tasks;         // files plus extra chunks
+  unsigned num_steals;        // tasks run by a worker they weren't dealt to
+  uint64_t bytes;             // bytes counted
+};
+
+// Default size above which a file is split into chunks
+#define WC_FILES_CHUNK_SIZE (8 << 20)
+
+// Initialize an empty file list.
+void wc_files_init(struct WcFileList *list);
+
+// Add the file(s) named by path to the list: a regular file, the
+// regular files below a directory (only if recursive is nonzero;
+// symbolic links to directories aren't followed), or the matches of a
+// glob pattern. Returns 0 on success, -1 if path names nothing that
+// can be counted or memory runs out.
+int wc_files_add(struct WcFileList *list, const char *path, int recursive);
+
+// Free the list's paths and array.
+void wc_files_free(struct WcFileList *list);
+
+// Count every file of the list into t (which should be empty), and,
+// with opts->per_file, store each file's summary in its WcFile.
+// Files that can't be read are marked with error and skipped.
+// stats may be NULL. Returns 0 on success, -1 if some file couldn't
+// be read or memory ran out.
+int wc_files_count(struct WcFileList *list, const struct WcFilesOptions *opts,
+                   struct WcTable *t, struct WcFilesStats *stats);
+
+#endif // WCFILES_H
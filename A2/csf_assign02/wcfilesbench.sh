@@ -0,0 +1,54 @@
+#! /usr/bin/env bash
+
+# Measure how counting many files scales with c_wordcount's thread
+# pool (-t), on a directory of many small files and on a few huge
+# ones.
+#
+# Usage: ./wcfilesbench.sh [file [small_files [huge_files [copies]]]]
+#
+# The small-file tree holds small_files pieces of file (default
+# little_dorrit.txt and 2000), spread over 20 subdirectories. The
+# huge files (default 3) each hold copies (default 40) of file, so
+# they are split into chunks. Each run is done warm, after one
+# untimed run to fill the page cache.
+
+set -e
+
+src=${1:-little_dorrit.txt}
+small_files=${2:-2000}
+huge_files=${3:-3}
+copies=${4:-40}
+work=$(mktemp -d "${TMPDIR:-/tmp}/wcfilesbench.XXXXXX")
+trap 'rm -rf "$work"' EXIT
+
+mkdir "$work/small" "$work/huge"
+lines=$(wc -l < "$src")
+per_file=$(( (lines + small_files - 1) / small_files ))
+split -a 4 -l "$per_file" "$src" "$work/small/part_"
+i=0
+for f in "$work"/small/part_*; do
+  sub="$work/small/d$(( i % 20 ))"
+  mkdir -p "$sub"
+  mv "$f" "$sub/"
+  i=$(( i + 1 ))
+done
+for i in $(seq "$huge_files"); do
+  for j in $(seq "$copies"); do
+    cat "$src"
+  done > "$work/huge/big$i.txt"
+done
+
+max_threads=$(nproc)
+[ "$max_threads" -lt 4 ] && max_threads=4
+
+for set in small huge; do
+  echo "$set: $(find "$work/$set" -type f | wc -l) files, $(du -sb "$work/$set" | cut -f1) bytes"
+  ./c_wordcount -R "$work/$set" > /dev/null
+  t=1
+  while [ "$t" -le "$max_threads" ]; do
+    echo -n "  threads $t: "
+    ./c_wordcount -v -R -t "$t" "$work/$set" 2>&1 >/dev/null | tr '\n' ' '
+    echo
+    t=$(( t * 2 ))
+  done
+done
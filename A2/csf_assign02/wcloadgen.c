@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "wcproto.h"
+#include "wcutil.h"
+
+// Load generator for wcserver.
+//
+// Usage: wcloadgen [-c clients] [-n requests] [-k K] [-p] socket_path file
+//
+// Each client thread opens one connection and sends the contents of
+// file as a document n times, waiting for each response before
+// sending the next request. With -k, top-K requests are sent instead
+// of summary requests. With -p, the first response is printed so it
+// can be compared against c_wordcount's output.
+//
+// At the end, the request rate, document throughput and the median
+// and 99th percentile request latency are printed.
+
+struct Client {
+  pthread_t thread;
+  const char *path;
+  const unsigned char *doc;
+  uint32_t doc_len;
+  uint32_t op;
+  uint32_t k;
+  unsigned num_requests;
+  double *latencies;   // seconds, one per request
+  char *first_reply;
+  int failed;
+};
+
+static int connect_to(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void *client_main(void *arg) {
+  struct Client *c = (struct Client *) arg;
+  char *reply = NULL;
+  size_t reply_cap = 0;
+
+  int fd = connect_to(c->path);
+  if (fd < 0) {
+    c->failed = 1;
+    return NULL;
+  }
+
+  for (unsigned i = 0; i < c->num_requests; i++) {
+    double start = wc_now_seconds();
+    unsigned char header[WC_RESPONSE_HEADER_SIZE];
+
+    if (wc_send_request(fd, c->op, c->k, c->doc, c->doc_len) != 0
+        || wc_read_full(fd, header, sizeof(header)) != 1) {
+      c->failed = 1;
+      break;
+    }
+    uint32_t status = wc_get_u32(header);
+    uint32_t len = wc_get_u32(header + 4);
+    if (len + 1 > reply_cap) {
+      char *p = (char *) realloc(reply, len + 1);
+      if (p == NULL) {
+        c->failed = 1;
+        break;
+      }
+      reply = p;
+      reply_cap = len + 1;
+    }
+    if (len > 0 && wc_read_full(fd, reply, len) != 1) {
+      c->failed = 1;
+      break;
+    }
+    reply[len] = '\0';
+    if (status != WC_STATUS_OK) {
+      fprintf(stderr, "Error from server: %s\n", reply);
+      c->failed = 1;
+      break;
+    }
+    c->latencies[i] = wc_now_seconds() - start;
+
+    if (i == 0) {
+      c->first_reply = strdup(reply);
+    }
+  }
+
+  free(reply);
+  close(fd);
+  return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: wcloadgen [-c clients] [-n requests] [-k K] [-p] socket_path file\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  unsigned num_clients = 1;
+  unsigned num_requests = 1000;
+  uint32_t op = WC_OP_SUMMARY;
+  uint32_t k = 0;
+  int print_reply = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "c:n:k:p")) != -1) {
+    switch (opt) {
+    case 'c':
+      num_clients = (unsigned) atoi(optarg);
+      break;
+    case 'n':
+      num_requests = (unsigned) atoi(optarg);
+      break;
+    case 'k':
+      op = WC_OP_TOPK;
+      k = (uint32_t) atoi(optarg);
+      break;
+    case 'p':
+      print_reply = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind != argc - 2 || num_clients < 1 || num_requests < 1) {
+    usage();
+  }
+
+  size_t doc_len;
+  unsigned char *doc = wc_read_file(argv[optind + 1], &doc_len);
+  if (doc == NULL) {
+    fprintf(stderr, "Error: Cannot read file\n");
+    return 1;
+  }
+  if (doc_len > WC_MAX_DOC_SIZE) {
+    fprintf(stderr, "Error: file is larger than the maximum document size\n");
+    return 1;
+  }
+
+  struct Client *clients = (struct Client *) calloc(num_clients, sizeof(struct Client));
+  double *latencies = (double *) calloc((size_t) num_clients * num_requests, sizeof(double));
+  if (clients == NULL || latencies == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+
+  double start = wc_now_seconds();
+  for (unsigned i = 0; i < num_clients; i++) {
+    clients[i].path = argv[optind];
+    clients[i].doc = doc;
+    clients[i].doc_len = (uint32_t) doc_len;
+    clients[i].op = op;
+    clients[i].k = k;
+    clients[i].num_requests = num_requests;
+    clients[i].latencies = latencies + (size_t) i * num_requests;
+    if (pthread_create(&clients[i].thread, NULL, client_main, &clients[i]) != 0) {
+      fprintf(stderr, "Error: could not create client thread\n");
+      return 1;
+    }
+  }
+  int failed = 0;
+  for (unsigned i = 0; i < num_clients; i++) {
+    pthread_join(clients[i].thread, NULL);
+    failed |= clients[i].failed;
+  }
+  double elapsed = wc_now_seconds() - start;
+
+  if (failed) {
+    fprintf(stderr, "Error: one or more clients failed\n");
+    return 1;
+  }
+  if (print_reply) {
+    fputs(clients[0].first_reply, stdout);
+  }
+
+  size_t total = (size_t) num_clients * num_requests;
+  qsort(latencies, total, sizeof(double), compare_doubles);
+  printf("requests: %zu in %.3f s (%.0f req/s, %.1f MB/s)\n",
+         total, elapsed, total / elapsed, total * (double) doc_len / elapsed / 1e6);
+  printf("latency: median %.1f us, p99 %.1f us\n",
+         latencies[total / 2] * 1e6, latencies[(size_t) (total * 0.99)] * 1e6);
+
+  for (unsigned i = 0; i < num_clients; i++) {
+    free(clients[i].first_reply);
+  }
+  free(clients);
+  free(latencies);
+  free(doc);
+  return 0;
+}
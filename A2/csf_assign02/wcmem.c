@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <linux/perf_event.h>
+#include "wcmem.h"
+
+static atomic_uint_fast64_t mapped_bytes;
+static atomic_uint_fast64_t huge_bytes;
+static atomic_uint_fast64_t hugetlb_fallbacks;
+static atomic_uint_fast64_t bind_failures;
+
+// Return the length to map for size bytes, and whether huge pages are
+// worth asking for (not for anything much smaller than one).
+static size_t map_length(size_t size, const struct WcMemPolicy *p, int *huge) {
+  *huge = p->pages != WC_PAGES_DEFAULT && size >= WC_HUGE_PAGE_SIZE / 2;
+  size_t unit = *huge ? WC_HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+  return (size + unit - 1) / unit * unit;
+}
+
+// Map len bytes aligned to a huge page and ask for transparent huge
+// pages.
+static void *map_thp(size_t len) {
+  size_t extra = WC_HUGE_PAGE_SIZE;
+  char *p = (char *) mmap(NULL, len + extra, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  // trim the unaligned head and the tail
+  char *aligned = (char *) (((uintptr_t) p + extra - 1) & ~(uintptr_t) (extra - 1));
+  if (aligned > p) {
+    munmap(p, (size_t) (aligned - p));
+  }
+  size_t tail = (size_t) (p + len + extra - (aligned + len));
+  if (tail > 0) {
+    munmap(aligned + len, tail);
+  }
+  madvise(aligned, len, MADV_HUGEPAGE);
+  return aligned;
+}
+
+void *wc_mem_alloc(size_t size, const struct WcMemPolicy *p) {
+  if (p == NULL) {
+    return calloc(1, size);
+  }
+  int huge;
+  size_t len = map_length(size, p, &huge);
+  void *mem = NULL;
+  if (huge && p->pages == WC_PAGES_HUGETLB) {
+    mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem == MAP_FAILED) {
+      // the pool is empty (or not configured)
+      atomic_fetch_add(&hugetlb_fallbacks, 1);
+      mem = NULL;
+    }
+  }
+  if (mem == NULL && huge) {
+    mem = map_thp(len);
+  } else if (mem == NULL) {
+    mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      mem = NULL;
+    }
+  }
+  if (mem == NULL) {
+    return NULL;
+  }
+
+  // bind before the first touch, which is when the pages are placed
+  if (p->numa >= 0) {
+    unsigned long mask[16] = { 0 };
+    if ((unsigned) p->numa < 8 * sizeof(mask)) {
+      mask[p->numa / (8 * sizeof(unsigned long))] |= 1UL << (p->numa % (8 * sizeof(unsigned long)));
+    }
+    if (syscall(SYS_mbind, mem, len, MPOL_BIND, mask, 8 * sizeof(mask), 0) != 0) {
+      atomic_fetch_add(&bind_failures, 1);
+    }
+  } else if (p->numa == WC_NUMA_LOCAL) {
+    if (syscall(SYS_mbind, mem, len, MPOL_LOCAL, NULL, 0, 0) != 0) {
+      atomic_fetch_add(&bind_failures, 1);
+    }
+  }
+
+  atomic_fetch_add(&mapped_bytes, len);
+  if (huge) {
+    atomic_fetch_add(&huge_bytes, len);
+  }
+  return mem;
+}
+
+void wc_mem_free(void *mem, size_t size, const struct WcMemPolicy *p) {
+  if (p == NULL) {
+    free(mem);
+    return;
+  }
+  if (mem != NULL) {
+    int huge;
+    munmap(mem, map_length(size, p, &huge));
+  }
+}
+
+static unsigned num_nodes;
+static pthread_once_t num_nodes_once = PTHREAD_ONCE_INIT;
+
+// Count the NUMA nodes once, for wc_mem_num_nodes; worker threads
+// placing their tables can ask at the same time.
+static void count_nodes(void) {
+  unsigned n = 0;
+  DIR *d = opendir("/sys/devices/system/node");
+  if (d != NULL) {
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+      if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9') {
+        n++;
+      }
+    }
+    closedir(d);
+  }
+  num_nodes = n > 0 ? n : 1;
+}
+
+unsigned wc_mem_num_nodes(void) {
+  pthread_once(&num_nodes_once, count_nodes);
+  return num_nodes;
+}
+
+struct WcMemPolicy wc_mem_policy_for_thread(const struct WcMemPolicy *p, unsigned thread) {
+  struct WcMemPolicy q = *p;
+  if (q.numa == WC_NUMA_SPREAD) {
+    q.numa = (int) (thread % wc_mem_num_nodes());
+  }
+  return q;
+}
+
+int wc_mem_run_on_node(int node) {
+  if (node < 0) {
+    return 0;
+  }
+  char path[64];
+  sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  // a list of CPUs and ranges, such as "0-3,8-11"
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  unsigned first, last;
+  int n;
+  while ((n = fscanf(f, "%u-%u", &first, &last)) >= 1) {
+    if (n == 1) {
+      last = first;
+    }
+    for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, &cpus);
+    }
+    if (fgetc(f) != ',') {
+      break;
+    }
+  }
+  fclose(f);
+  if (CPU_COUNT(&cpus) == 0) {
+    return -1;
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0 ? 0 : -1;
+}
+
+void wc_mem_get_stats(struct WcMemStats *s) {
+  s->bytes = atomic_load(&mapped_bytes);
+  s->huge_bytes = atomic_load(&huge_bytes);
+  s->hugetlb_fallbacks = atomic_load(&hugetlb_fallbacks);
+  s->bind_failures = atomic_load(&bind_failures);
+}
+
+uint64_t wc_mem_anon_huge_bytes(void) {
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  if (f == NULL) {
+    return 0;
+  }
+  char line[256];
+  unsigned long long kb = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "AnonHugePages: %llu kB", &kb) == 1) {
+      break;
+    }
+  }
+  fclose(f);
+  return (uint64_t) kb << 10;
+}
+
+int wc_dtlb_counter_start(void) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB
+    | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.inherit = 1;           // count the worker threads too
+  attr.exclude_kernel = 1;    // allowed without privileges
+  attr.exclude_hv = 1;
+  int fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  return fd;
+}
+
+int64_t wc_dtlb_counter_stop(int counter) {
+  if (counter < 0) {
+    return -1;
+  }
+  ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+  uint64_t count;
+  ssize_t n = read(counter, &count, sizeof(count));
+  close(counter);
+  return n == (ssize_t) sizeof(count) ? (int64_t) count : -1;
+}
@@ -0,0 +1,89 @@
+#ifndef WCMEM_H
+#define WCMEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory placement for large tables: huge pages and NUMA binding.
+//
+// A table's bucket arrays and nodes are touched at random, so a big
+// vocabulary spreads its lookups over far more 4K pages than the TLB
+// can map, and on a machine with several NUMA nodes half of them may
+// be on the other socket. A placement policy asks for the table's
+// memory to be mapped on its own, with
+//
+//   - transparent huge pages (madvise(MADV_HUGEPAGE) on a 2M-aligned
+//     mapping), or explicit ones from the hugetlbfs pool
+//     (MAP_HUGETLB), falling back to transparent ones if the pool is
+//     empty;
+//   - the pages bound (mbind(2)) to one NUMA node, or to the node of
+//     whichever thread first touches them.
+//
+// Memory placed this way comes from mmap(2), so it's allocated in
+// large regions: nodes come from an arena of slabs that is only freed
+// with the table (see wc_table_create_placed).
+
+// Page sizes
+#define WC_PAGES_DEFAULT 0    // normal pages
+#define WC_PAGES_THP     1    // transparent huge pages
+#define WC_PAGES_HUGETLB 2    // explicit huge pages
+
+// NUMA binding (a node number >= 0 binds to that node)
+#define WC_NUMA_DEFAULT  -1   // the process's policy
+#define WC_NUMA_LOCAL    -2   // the node of the thread touching a page
+#define WC_NUMA_SPREAD   -3   // per-thread tables: thread i on node i
+
+// Size of a huge page, and of a node slab with huge pages
+#define WC_HUGE_PAGE_SIZE (2 << 20)
+
+struct WcMemPolicy {
+  int pages;    // WC_PAGES_*
+  int numa;     // a node, or WC_NUMA_*
+};
+
+// Counts of what was actually mapped, over the whole process.
+struct WcMemStats {
+  uint64_t bytes;           // bytes mapped under some policy
+  uint64_t huge_bytes;      // of those, bytes mapped or advised huge
+  uint64_t hugetlb_fallbacks;  // explicit huge page requests that fell back
+  uint64_t bind_failures;   // mbind calls that failed
+};
+
+// Map size bytes of zeroed memory under the policy (p may be NULL for
+// plain malloc). Returns NULL on failure.
+void *wc_mem_alloc(size_t size, const struct WcMemPolicy *p);
+
+// Release memory from wc_mem_alloc (with the same size and policy).
+void wc_mem_free(void *mem, size_t size, const struct WcMemPolicy *p);
+
+// The node policy's binding for a thread: for WC_NUMA_SPREAD, thread
+// i's tables go on node i modulo the number of nodes; other policies
+// are returned unchanged.
+struct WcMemPolicy wc_mem_policy_for_thread(const struct WcMemPolicy *p, unsigned thread);
+
+// Move the calling thread onto the CPUs of the given node (if it's a
+// node number). Returns 0 on success, -1 if it couldn't be moved.
+int wc_mem_run_on_node(int node);
+
+// Number of NUMA nodes (1 on a machine without NUMA). Safe to call
+// from several threads at once.
+unsigned wc_mem_num_nodes(void);
+
+// Copy the process-wide placement counters into s.
+void wc_mem_get_stats(struct WcMemStats *s);
+
+// Bytes of anonymous memory the kernel currently backs with huge
+// pages, from /proc/self/smaps_rollup (0 if that can't be read).
+uint64_t wc_mem_anon_huge_bytes(void);
+
+// Counting data-TLB misses (of this process and the threads it
+// starts afterwards) with perf_event_open(2).
+//
+// Returns a counter, or -1 if the kernel doesn't allow it
+// (see /proc/sys/kernel/perf_event_paranoid).
+int wc_dtlb_counter_start(void);
+
+// Stop the counter and return the number of dTLB load misses, or -1.
+int64_t wc_dtlb_counter_stop(int counter);
+
+#endif // WCMEM_H
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wcngram.h"
+#include "wctable.h"
+
+#define INITIAL_SLOTS 1024
+
+// Hash an n-gram's word ids.
+static uint32_t ngram_hash(const uint32_t *ids, unsigned n) {
+  uint32_t h = 0x811C9DC5U;
+  for (unsigned i = 0; i < n; i++) {
+    h = (h ^ ids[i]) * 0x9E3779B1U;
+    h ^= h >> 15;
+  }
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+  return h;
+}
+
+// Grow an array of elements of the given size to new_cap elements.
+static int grow_array(void **p, size_t new_cap, size_t elem_size) {
+  void *q = realloc(*p, new_cap * elem_size);
+  if (q == NULL) {
+    return -1;
+  }
+  *p = q;
+  return 0;
+}
+
+struct WcNgramCounter *wc_ngram_create(unsigned n) {
+  if (n < 2 || n > WC_NGRAM_MAX) {
+    return NULL;
+  }
+  struct WcNgramCounter *c = (struct WcNgramCounter *) calloc(1, sizeof(struct WcNgramCounter));
+  if (c == NULL) {
+    return NULL;
+  }
+  c->n = n;
+  c->word_slots = (uint32_t *) calloc(INITIAL_SLOTS, sizeof(uint32_t));
+  c->ngram_slots = (uint32_t *) calloc(INITIAL_SLOTS, sizeof(uint32_t));
+  if (c->word_slots == NULL || c->ngram_slots == NULL) {
+    wc_ngram_destroy(c);
+    return NULL;
+  }
+  c->word_mask = INITIAL_SLOTS - 1;
+  c->ngram_mask = INITIAL_SLOTS - 1;
+  return c;
+}
+
+void wc_ngram_destroy(struct WcNgramCounter *c) {
+  if (c == NULL) {
+    return;
+  }
+  free(c->arena);
+  free(c->word_offsets);
+  free(c->word_slots);
+  free(c->keys);
+  free(c->counts);
+  free(c->hashes);
+  free(c->ngram_slots);
+  free(c);
+}
+
+const unsigned char *wc_ngram_word(const struct WcNgramCounter *c, uint32_t id) {
+  return c->arena + c->word_offsets[id];
+}
+
+const uint32_t *wc_ngram_key(const struct WcNgramCounter *c, uint32_t ngram) {
+  return c->keys + (size_t) ngram * c->n;
+}
+
+// Double the size of a slot array, reinserting every item by hash.
+// hash_of returns the hash of item i.
+static int rehash_slots(uint32_t **slots, uint32_t *mask, uint32_t num_items,
+                        const struct WcNgramCounter *c,
+                        uint32_t (*hash_of)(const struct WcNgramCounter *, uint32_t)) {
+  uint32_t new_mask = *mask * 2 + 1;
+  uint32_t *new_slots = (uint32_t *) calloc((size_t) new_mask + 1, sizeof(uint32_t));
+  if (new_slots == NULL) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < num_items; i++) {
+    uint32_t j = hash_of(c, i) & new_mask;
+    while (new_slots[j] != 0) {
+      j = (j + 1) & new_mask;
+    }
+    new_slots[j] = i + 1;
+  }
+  free(*slots);
+  *slots = new_slots;
+  *mask = new_mask;
+  return 0;
+}
+
+static uint32_t word_hash_of(const struct WcNgramCounter *c, uint32_t id) {
+  return wc_hash(wc_ngram_word(c, id));
+}
+
+static uint32_t ngram_hash_of(const struct WcNgramCounter *c, uint32_t ngram) {
+  return c->hashes[ngram];
+}
+
+// Return the id of the given word, interning it if necessary.
+// Returns -1 if memory could not be allocated.
+static int64_t intern_word(struct WcNgramCounter *c, const unsigned char *w) {
+  uint32_t h = wc_hash(w);
+  uint32_t j = h & c->word_mask;
+
+  for (; c->word_slots[j] != 0; j = (j + 1) & c->word_mask) {
+    uint32_t id = c->word_slots[j] - 1;
+    if (wc_str_compare(wc_ngram_word(c, id), w) == 0) {
+      return id;
+    }
+  }
+
+  size_t len = strlen((const char *) w) + 1;
+  if (c->arena_size + len > c->arena_cap) {
+    size_t cap = c->arena_cap ? c->arena_cap * 2 : 64 * 1024;
+    if (grow_array((void **) &c->arena, cap, 1) != 0) {
+      return -1;
+    }
+    c->arena_cap = cap;
+  }
+  if (c->num_words == c->word_cap) {
+    uint32_t cap = c->word_cap ? c->word_cap * 2 : 1024;
+    if (grow_array((void **) &c->word_offsets, cap, sizeof(uint32_t)) != 0) {
+      return -1;
+    }
+    c->word_cap = cap;
+  }
+
+  uint32_t id = c->num_words++;
+  c->word_offsets[id] = (uint32_t) c->arena_size;
+  memcpy(c->arena + c->arena_size, w, len);
+  c->arena_size += len;
+  c->word_slots[j] = id + 1;
+
+  // keep the index at most half full
+  if (2 * (uint64_t) c->num_words > c->word_mask) {
+    if (rehash_slots(&c->word_slots, &c->word_mask, c->num_words, c, word_hash_of) != 0) {
+      return -1;
+    }
+  }
+  return id;
+}
+
+// Count one occurrence of the n-gram with the given ids.
+static int count_ngram(struct WcNgramCounter *c, const uint32_t *ids) {
+  unsigned n = c->n;
+  uint32_t h = ngram_hash(ids, n);
+  uint32_t j = h & c->ngram_mask;
+
+  c->total_ngrams++;
+  for (; c->ngram_slots[j] != 0; j = (j + 1) & c->ngram_mask) {
+    uint32_t g = c->ngram_slots[j] - 1;
+    if (c->hashes[g] == h && memcmp(wc_ngram_key(c, g), ids, n * sizeof(uint32_t)) == 0) {
+      c->counts[g]++;
+      return 0;
+    }
+  }
+
+  if (c->num_ngrams == c->ngram_cap) {
+    uint32_t cap = c->ngram_cap ? c->ngram_cap * 2 : 1024;
+    if (grow_array((void **) &c->keys, (size_t) cap * n, sizeof(uint32_t)) != 0
+        || grow_array((void **) &c->counts, cap, sizeof(uint32_t)) != 0
+        || grow_array((void **) &c->hashes, cap, sizeof(uint32_t)) != 0) {
+      return -1;
+    }
+    c->ngram_cap = cap;
+  }
+
+  uint32_t g = c->num_ngrams++;
+  memcpy(c->keys + (size_t) g * n, ids, n * sizeof(uint32_t));
+  c->counts[g] = 1;
+  c->hashes[g] = h;
+  c->ngram_slots[j] = g + 1;
+
+  if (2 * (uint64_t) c->num_ngrams > c->ngram_mask) {
+    return rehash_slots(&c->ngram_slots, &c->ngram_mask, c->num_ngrams, c, ngram_hash_of);
+  }
+  return 0;
+}
+
+int wc_ngram_add_word(struct WcNgramCounter *c, unsigned char *w) {
+  wc_tolower(w);
+  wc_trim_non_alpha(w);
+  if (*w == '\0') {
+    return 0;
+  }
+
+  int64_t id = intern_word(c, w);
+  if (id < 0) {
+    return -1;
+  }
+
+  // window holds the previous n-1 ids; append the new one and count
+  // the n-gram once the window is full
+  c->window[c->window_len++] = (uint32_t) id;
+  if (c->window_len < c->n) {
+    return 0;
+  }
+  int rc = count_ngram(c, c->window);
+  memmove(c->window, c->window + 1, (c->n - 1) * sizeof(uint32_t));
+  c->window_len--;
+  return rc;
+}
+
+void wc_ngram_break(struct WcNgramCounter *c) {
+  c->window_len = 0;
+}
+
+// Return 1 if n-gram a should be reported before n-gram b.
+static int ngram_ranks_before(const void *a, const void *b, const void *arg) {
+  const struct WcNgramCounter *c = (const struct WcNgramCounter *) arg;
+  uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+  if (c->counts[x] != c->counts[y]) {
+    return c->counts[x] > c->counts[y];
+  }
+  const uint32_t *kx = wc_ngram_key(c, x);
+  const uint32_t *ky = wc_ngram_key(c, y);
+  for (unsigned i = 0; i < c->n; i++) {
+    if (kx[i] != ky[i]) {
+      return wc_str_compare(wc_ngram_word(c, kx[i]), wc_ngram_word(c, ky[i])) < 0;
+    }
+  }
+  return 0;
+}
+
+unsigned wc_ngram_top_k(const struct WcNgramCounter *c, uint32_t *out, unsigned k) {
+  struct WcTopK h;
+  wc_top_k_init(&h, out, sizeof(*out), k, ngram_ranks_before, c);
+  for (uint32_t g = 0; g < c->num_ngrams && k > 0; g++) {
+    wc_top_k_offer(&h, &g);
+  }
+  return wc_top_k_finish(&h);
+}
+
+void wc_ngram_print(FILE *out, const struct WcNgramCounter *c, uint32_t ngram) {
+  const uint32_t *key = wc_ngram_key(c, ngram);
+  for (unsigned i = 0; i < c->n; i++) {
+    if (i > 0) {
+      fputc(' ', out);
+    }
+    fputs((const char *) wc_ngram_word(c, key[i]), out);
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef WCNGRAM_H
+#define WCNGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "wcfuncs.h"
+
+// Counting of sliding-window n-grams (phrases of n consecutive words).
+//
+// Each distinct normalized word is interned once and given a small
+// integer id; an n-gram is then stored as a tuple of n word ids
+// rather than as a string, so a key costs 4*n bytes and hashing it
+// costs n steps no matter how long the words are. Both the intern
+// table and the n-gram table use open addressing with linear probing
+// and grow by doubling.
+
+// Largest supported n
+#define WC_NGRAM_MAX 8
+
+struct WcNgramCounter {
+  unsigned n;
+
+  // interned words: id -> offset in the arena, and a hash index of ids
+  unsigned char *arena;
+  size_t arena_size, arena_cap;
+  uint32_t *word_offsets;
+  uint32_t num_words, word_cap;
+  uint32_t *word_slots;     // 0 or 1 + word id
+  uint32_t word_mask;
+
+  // n-grams: n ids per key, with a count and hash per key
+  uint32_t *keys;
+  uint32_t *counts;
+  uint32_t *hashes;
+  uint32_t num_ngrams, ngram_cap;
+  uint32_t *ngram_slots;    // 0 or 1 + n-gram number
+  uint32_t ngram_mask;
+
+  // the last n-1 word ids seen
+  uint32_t window[WC_NGRAM_MAX];
+  unsigned window_len;
+
+  uint64_t total_ngrams;
+};
+
+// Create a counter for n-grams of the given length
+// (2 <= n <= WC_NGRAM_MAX). Returns NULL if n is out of range or
+// memory could not be allocated.
+struct WcNgramCounter *wc_ngram_create(unsigned n);
+
+// Free a counter.
+void wc_ngram_destroy(struct WcNgramCounter *c);
+
+// Add the next word of the input. The word is normalized in place
+// with wc_tolower and wc_trim_non_alpha; words that normalize to
+// the empty string (numbers, punctuation) are skipped.
+// Returns 0 on success, -1 if memory could not be allocated.
+int wc_ngram_add_word(struct WcNgramCounter *c, unsigned char *w);
+
+// Forget the current window, so that the next n-gram starts with
+// the next word (e.g., at a document boundary).
+void wc_ngram_break(struct WcNgramCounter *c);
+
+// Return the interned word with the given id.
+const unsigned char *wc_ngram_word(const struct WcNgramCounter *c, uint32_t id);
+
+// Return a pointer to the n word ids of the given n-gram.
+const uint32_t *wc_ngram_key(const struct WcNgramCounter *c, uint32_t ngram);
+
+// Store the numbers of (at most) the k most frequent n-grams in out,
+// ordered by descending count and then by their words. Returns the
+// number of n-grams stored.
+unsigned wc_ngram_top_k(const struct WcNgramCounter *c, uint32_t *out, unsigned k);
+
+// Write the words of an n-gram, separated by spaces, to out.
+void wc_ngram_print(FILE *out, const struct WcNgramCounter *c, uint32_t ngram);
+
+#endif // WCNGRAM_H
@@ -0,0 +1,309 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "wcpipe.h"
+
+// Fill one buffer with read(), stopping when it is full or at end of
+// input. Returns the number of bytes read, and sets *done at end of
+// input or *error on a read error.
+static size_t fill_buffer(int fd, unsigned char *buf, size_t size, int *done, int *error) {
+  size_t n = 0;
+  while (n < size) {
+    ssize_t rc = read(fd, buf + n, size - n);
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *error = 1;
+      break;
+    }
+    if (rc == 0) {
+      *done = 1;
+      break;
+    }
+    n += (size_t) rc;
+  }
+  return n;
+}
+
+static void *reader_main(void *arg) {
+  struct WcPipe *p = (struct WcPipe *) arg;
+
+  for (;;) {
+    pthread_mutex_lock(&p->lock);
+    if (p->filled + p->held == p->num_bufs && !p->stop) {
+      p->reader_waits++;
+      while (p->filled + p->held == p->num_bufs && !p->stop) {
+        pthread_cond_wait(&p->not_full, &p->lock);
+      }
+    }
+    if (p->stop) {
+      pthread_mutex_unlock(&p->lock);
+      return NULL;
+    }
+    unsigned index = p->next_fill;
+    pthread_mutex_unlock(&p->lock);
+
+    // the buffer isn't visible to the consumer until it is counted
+    // in filled, so it can be filled without holding the lock
+    int done = 0, error = 0;
+    size_t n = fill_buffer(p->fd, p->mem + (size_t) index * p->buf_size, p->buf_size, &done, &error);
+
+    pthread_mutex_lock(&p->lock);
+    if (n > 0) {
+      p->lens[index] = n;
+      p->next_fill = (index + 1) % p->num_bufs;
+      p->filled++;
+      p->bytes_read += n;
+    }
+    p->eof = done;
+    p->error = error;
+    pthread_cond_signal(&p->not_empty);
+    pthread_mutex_unlock(&p->lock);
+
+    if (done || error) {
+      return NULL;
+    }
+  }
+}
+
+struct WcPipe *wc_pipe_open(int fd, size_t buf_size, unsigned num_bufs) {
+  if (buf_size == 0) {
+    buf_size = WC_PIPE_BUF_SIZE;
+  }
+  if (num_bufs < 2) {
+    num_bufs = WC_PIPE_NUM_BUFS;
+  }
+
+  struct WcPipe *p = (struct WcPipe *) calloc(1, sizeof(struct WcPipe));
+  if (p == NULL) {
+    return NULL;
+  }
+  p->fd = fd;
+  p->buf_size = buf_size;
+  p->num_bufs = num_bufs;
+  p->mem = (unsigned char *) malloc(buf_size * num_bufs);
+  p->lens = (size_t *) calloc(num_bufs, sizeof(size_t));
+  if (p->mem == NULL || p->lens == NULL) {
+    free(p->mem);
+    free(p->lens);
+    free(p);
+    return NULL;
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->not_empty, NULL);
+  pthread_cond_init(&p->not_full, NULL);
+
+  // only a hint: fails harmlessly for pipes
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  if (pthread_create(&p->reader, NULL, reader_main, p) != 0) {
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->not_empty);
+    pthread_cond_destroy(&p->not_full);
+    free(p->mem);
+    free(p->lens);
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+ssize_t wc_pipe_next(struct WcPipe *p, const unsigned char **data) {
+  pthread_mutex_lock(&p->lock);
+  if (p->held) {
+    // hand the previous buffer back to the reader
+    p->held = 0;
+    pthread_cond_signal(&p->not_full);
+  }
+  if (p->filled == 0 && !p->eof && !p->error) {
+    p->consumer_waits++;
+    while (p->filled == 0 && !p->eof && !p->error) {
+      pthread_cond_wait(&p->not_empty, &p->lock);
+    }
+  }
+
+  ssize_t len;
+  if (p->filled > 0) {
+    unsigned index = p->next_take;
+    p->next_take = (index + 1) % p->num_bufs;
+    p->filled--;
+    p->held = 1;
+    *data = p->mem + (size_t) index * p->buf_size;
+    len = (ssize_t) p->lens[index];
+  } else {
+    *data = NULL;
+    len = p->error ? -1 : 0;
+  }
+  pthread_mutex_unlock(&p->lock);
+  return len;
+}
+
+int wc_pipe_close(struct WcPipe *p) {
+  pthread_mutex_lock(&p->lock);
+  p->stop = 1;
+  pthread_cond_signal(&p->not_full);
+  pthread_mutex_unlock(&p->lock);
+  pthread_join(p->reader, NULL);
+
+  int rc = p->error ? -1 : 0;
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->not_empty);
+  pthread_cond_destroy(&p->not_full);
+  free(p->mem);
+  free(p->lens);
+  free(p);
+  return rc;
+}
+
+int wc_pipe_count_table(struct WcPipe *p, struct WcTable *t) {
+  struct WcSplitter s;
+  unsigned char word[MAX_WORDLEN + 1];
+  const unsigned char *buf;
+  ssize_t len;
+
+  wc_splitter_init(&s);
+  while ((len = wc_pipe_next(p, &buf)) > 0) {
+    size_t pos = 0;
+    while (wc_splitter_next(&s, buf, (size_t) len, &pos, word)) {
+      wc_table_count_word(t, word);
+    }
+  }
+  if (wc_splitter_finish(&s, word)) {
+    wc_table_count_word(t, word);
+  }
+  return len < 0 ? -1 : 0;
+}
+
+void wc_splitter_init(struct WcSplitter *s) {
+  s->partial_len = 0;
+}
+
+int wc_splitter_next(struct WcSplitter *s, const unsigned char *buf, size_t len,
+                     size_t *pos, unsigned char *w) {
+  size_t i = *pos;
+
+  if (s->partial_len > 0) {
+    // finish the word carried over from the previous buffer
+    while (i < len && !wc_isspace(buf[i]) && s->partial_len < MAX_WORDLEN) {
+      s->partial[s->partial_len++] = buf[i++];
+    }
+    if (i == len && s->partial_len < MAX_WORDLEN) {
+      *pos = i;
+      return 0;
+    }
+    memcpy(w, s->partial, s->partial_len);
+    w[s->partial_len] = '\0';
+    s->partial_len = 0;
+    *pos = i;
+    return 1;
+  }
+
+  if (!wc_buf_readnext(buf, len, &i, w)) {
+    *pos = i;
+    return 0;
+  }
+  unsigned n = (unsigned) strlen((const char *) w);
+  if (i == len && n < MAX_WORDLEN) {
+    // the word may continue in the next buffer
+    memcpy(s->partial, w, n);
+    s->partial_len = n;
+    *pos = i;
+    return 0;
+  }
+  *pos = i;
+  return 1;
+}
+
+int wc_splitter_add_char(struct WcSplitter *s, unsigned char c, unsigned char *w) {
+  if (wc_isspace(c)) {
+    return wc_splitter_finish(s, w);
+  }
+  int done = 0;
+  if (s->partial_len == MAX_WORDLEN) {
+    // a full word ends here even though the run goes on
+    done = wc_splitter_finish(s, w);
+  }
+  s->partial[s->partial_len++] = c;
+  return done;
+}
+
+int wc_splitter_finish(struct WcSplitter *s, unsigned char *w) {
+  if (s->partial_len == 0) {
+    return 0;
+  }
+  memcpy(w, s->partial, s->partial_len);
+  w[s->partial_len] = '\0';
+  s->partial_len = 0;
+  return 1;
+}
+
+int wc_reader_init(struct WcWordReader *r, FILE *in) {
+  r->in = in;
+  r->fd = -1;
+  r->buf = (unsigned char *) malloc(WC_READER_BUF_SIZE);
+  r->buf_size = WC_READER_BUF_SIZE;
+  r->owns_buf = 1;
+  r->len = r->pos = 0;
+  r->eof = 0;
+  r->bytes_read = 0;
+  wc_splitter_init(&r->splitter);
+  return r->buf != NULL ? 0 : -1;
+}
+
+int wc_reader_init_fd(struct WcWordReader *r, int fd, unsigned char *buf, size_t buf_size) {
+  r->in = NULL;
+  r->fd = fd;
+  r->buf = buf;
+  r->buf_size = buf_size;
+  r->owns_buf = 0;
+  r->len = r->pos = 0;
+  r->eof = 0;
+  r->bytes_read = 0;
+  wc_splitter_init(&r->splitter);
+  return 0;
+}
+
+// Read the next block into the buffer, setting eof at end of input.
+// Returns 0, or -1 if reading failed.
+static int reader_fill(struct WcWordReader *r) {
+  r->pos = 0;
+  if (r->in != NULL) {
+    r->len = fread(r->buf, 1, r->buf_size, r->in);
+    if (r->len < r->buf_size) {
+      if (ferror(r->in)) {
+        return -1;
+      }
+      r->eof = 1;
+    }
+  } else {
+    int error = 0;
+    r->len = fill_buffer(r->fd, r->buf, r->buf_size, &r->eof, &error);
+    if (error) {
+      return -1;
+    }
+  }
+  r->bytes_read += r->len;
+  return 0;
+}
+
+int wc_reader_next(struct WcWordReader *r, unsigned char *w) {
+  while (!wc_splitter_next(&r->splitter, r->buf, r->len, &r->pos, w)) {
+    if (r->eof) {
+      return wc_splitter_finish(&r->splitter, w);
+    }
+    if (reader_fill(r) != 0) {
+      return -1;
+    }
+  }
+  return 1;
+}
+
+void wc_reader_free(struct WcWordReader *r) {
+  if (r->owns_buf) {
+    free(r->buf);
+  }
+  r->buf = NULL;
+}
@@ -0,0 +1,134 @@
+#ifndef WCPIPE_H
+#define WCPIPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "wcfuncs.h"
+#include "wctable.h"
+
+// Pipelined input for the word counter.
+//
+// A reader thread fills a ring of large buffers with read() while
+// the counting thread tokenizes the buffers it has already filled,
+// so the disk (or the process writing into a pipe) and the CPU are
+// busy at the same time. The pipeline works for any file
+// descriptor: regular files, pipes, and standard input.
+//
+// Buffers are handed over whole, so a word can be split across two
+// buffers; a WcSplitter carries the partial word over to the next
+// buffer.
+
+struct WcPipe {
+  int fd;
+  size_t buf_size;
+  unsigned num_bufs;
+  unsigned char *mem;        // num_bufs buffers of buf_size bytes
+  size_t *lens;              // number of bytes in each filled buffer
+  unsigned next_fill;        // buffer the reader fills next
+  unsigned next_take;        // buffer the consumer takes next
+  unsigned filled;           // buffers filled but not yet taken
+  int held;                  // 1 if the consumer holds a buffer
+  int eof;
+  int error;
+  int stop;
+  pthread_t reader;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  uint64_t bytes_read;
+  uint64_t reader_waits;     // times the reader found every buffer in use
+  uint64_t consumer_waits;   // times the consumer found no buffer ready
+};
+
+// Splits a sequence of buffers into words exactly as wc_buf_readnext
+// would split their concatenation.
+struct WcSplitter {
+  unsigned char partial[MAX_WORDLEN + 1];
+  unsigned partial_len;
+};
+
+// Reads the words of a stdio stream or a file descriptor a block at
+// a time, split by a WcSplitter, for the counting modes that don't
+// use a pipeline. Every mode thus splits words the same way, and
+// only one block is ever buffered, whatever the input.
+struct WcWordReader {
+  FILE *in;                  // NULL when reading fd
+  int fd;
+  unsigned char *buf;
+  size_t buf_size;
+  int owns_buf;              // 1 if buf is freed with the reader
+  size_t len;
+  size_t pos;
+  int eof;
+  uint64_t bytes_read;
+  struct WcSplitter splitter;
+};
+
+// Size of a WcWordReader's buffer
+#define WC_READER_BUF_SIZE (64 << 10)
+
+// Default buffer size and number of buffers in the ring
+#define WC_PIPE_BUF_SIZE (1 << 20)
+#define WC_PIPE_NUM_BUFS 4
+
+// Start a reader thread reading fd into num_bufs buffers of buf_size
+// bytes (0 for the defaults). The caller still owns fd.
+// Returns NULL if memory or the thread could not be allocated.
+struct WcPipe *wc_pipe_open(int fd, size_t buf_size, unsigned num_bufs);
+
+// Take the next filled buffer, waiting for the reader if necessary,
+// and store a pointer to its data in *data. The buffer stays valid
+// until the next call. Returns the number of bytes in the buffer,
+// 0 at end of input, or -1 if reading failed.
+ssize_t wc_pipe_next(struct WcPipe *p, const unsigned char **data);
+
+// Stop the reader thread and free the pipeline.
+// Returns 0, or -1 if a read error occurred.
+int wc_pipe_close(struct WcPipe *p);
+
+// Count every word read through the pipeline into t.
+// Returns 0 on success, -1 if reading failed.
+int wc_pipe_count_table(struct WcPipe *p, struct WcTable *t);
+
+// Set up a splitter with no partial word.
+void wc_splitter_init(struct WcSplitter *s);
+
+// Read the next complete word from buf (len bytes), starting at
+// *pos, into w, and advance *pos past it. Returns 1 if a word was
+// read. Returns 0 once the buffer is used up; a word still running
+// at the end of the buffer is kept in the splitter and completed by
+// the next buffer (or by wc_splitter_finish).
+int wc_splitter_next(struct WcSplitter *s, const unsigned char *buf, size_t len,
+                     size_t *pos, unsigned char *w);
+
+// Add the next character of the input, for input read a character
+// at a time. If it completes a word, store the word in w and return
+// 1; otherwise return 0. A run longer than MAX_WORDLEN is split into
+// words of MAX_WORDLEN characters, as by wc_buf_readnext.
+int wc_splitter_add_char(struct WcSplitter *s, unsigned char c, unsigned char *w);
+
+// At end of input, store the last partial word (if any) in w.
+// Returns 1 if there was one, 0 otherwise.
+int wc_splitter_finish(struct WcSplitter *s, unsigned char *w);
+
+// Set up a reader of the words of in.
+// Returns 0, or -1 if the buffer could not be allocated.
+int wc_reader_init(struct WcWordReader *r, FILE *in);
+
+// Set up a reader of the words of fd, read with read(2) into buf
+// (buf_size bytes), which stays the caller's. The caller still owns
+// fd. Always returns 0.
+int wc_reader_init_fd(struct WcWordReader *r, int fd, unsigned char *buf, size_t buf_size);
+
+// Read the next word into w. Returns 1 if a word was read, 0 at end
+// of input, or -1 if reading failed.
+int wc_reader_next(struct WcWordReader *r, unsigned char *w);
+
+// Free the reader's buffer if it allocated it (but not close its
+// stream or file descriptor).
+void wc_reader_free(struct WcWordReader *r);
+
+#endif // WCPIPE_H
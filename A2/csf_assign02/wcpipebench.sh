@@ -0,0 +1,44 @@
+#! /usr/bin/env bash
+
+# Compare c_wordcount's pipelined reader against the original fgetc
+# loop (-F) on cold-cache and warm-cache input.
+#
+# Usage: ./wcpipebench.sh [file [copies]]
+#
+# The input is file (default little_dorrit.txt) repeated copies
+# times (default 50). The file's pages are evicted from the page
+# cache before each cold run with dd's nocache flag, which works
+# without root for files that aren't dirty.
+
+set -e
+
+src=${1:-little_dorrit.txt}
+copies=${2:-50}
+input=$(mktemp "${TMPDIR:-/tmp}/wcpipebench.XXXXXX")
+trap 'rm -f "$input"' EXIT
+
+for i in $(seq "$copies"); do
+  cat "$src"
+done > "$input"
+sync "$input"
+echo "input: $(stat -c %s "$input") bytes"
+
+evict() {
+  dd if="$input" iflag=nocache count=0 status=none
+}
+
+for mode in "-F" ""; do
+  name=${mode:+fgetc}
+  name=${name:-pipelined}
+
+  evict
+  echo -n "$name, cold: "
+  ./c_wordcount -v $mode "$input" 2>&1 >/dev/null | grep elapsed
+
+  ./c_wordcount $mode "$input" > /dev/null
+  echo -n "$name, warm: "
+  ./c_wordcount -v $mode "$input" 2>&1 >/dev/null | grep elapsed
+
+  echo -n "$name, pipe: "
+  cat "$input" | ./c_wordcount -v $mode 2>&1 >/dev/null | grep elapsed
+done
@@ -0,0 +1,98 @@
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "wcproto.h"
+
+// Store v at p in big-endian byte order.
+void wc_put_u32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char) (v >> 24);
+  p[1] = (unsigned char) (v >> 16);
+  p[2] = (unsigned char) (v >> 8);
+  p[3] = (unsigned char) v;
+}
+
+// Load a big-endian value from p.
+uint32_t wc_get_u32(const unsigned char *p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+    | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+// Read exactly n bytes from fd into buf.
+int wc_read_full(int fd, void *buf, size_t n) {
+  unsigned char *p = (unsigned char *) buf;
+  size_t done = 0;
+
+  while (done < n) {
+    ssize_t rc = read(fd, p + done, n - done);
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (rc == 0) {
+      return done == 0 ? 0 : -1;
+    }
+    done += (size_t) rc;
+  }
+  return 1;
+}
+
+// Write all of the iovecs, retrying after short writes and EINTR.
+// The iovec array is modified.
+static int wc_writev_full(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t rc = writev(fd, iov, iovcnt);
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    size_t left = (size_t) rc;
+    while (iovcnt > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (unsigned char *) iov->iov_base + left;
+      iov->iov_len -= left;
+    }
+  }
+  return 0;
+}
+
+// Write exactly n bytes from buf to fd.
+int wc_write_full(int fd, const void *buf, size_t n) {
+  struct iovec iov = { (void *) buf, n };
+  return wc_writev_full(fd, &iov, 1);
+}
+
+// Send one request (header and document) on fd.
+int wc_send_request(int fd, uint32_t op, uint32_t arg, const void *doc, uint32_t len) {
+  unsigned char header[WC_REQUEST_HEADER_SIZE];
+  wc_put_u32(header, op);
+  wc_put_u32(header + 4, arg);
+  wc_put_u32(header + 8, len);
+
+  struct iovec iov[2] = {
+    { header, sizeof(header) },
+    { (void *) doc, len },
+  };
+  return wc_writev_full(fd, iov, len > 0 ? 2 : 1);
+}
+
+// Send one response (header and text) on fd.
+int wc_send_response(int fd, uint32_t status, const void *text, uint32_t len) {
+  unsigned char header[WC_RESPONSE_HEADER_SIZE];
+  wc_put_u32(header, status);
+  wc_put_u32(header + 4, len);
+
+  struct iovec iov[2] = {
+    { header, sizeof(header) },
+    { (void *) text, len },
+  };
+  return wc_writev_full(fd, iov, len > 0 ? 2 : 1);
+}
@@ -0,0 +1,67 @@
+#ifndef WCPROTO_H
+#define WCPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Framed protocol spoken by wcserver and wcloadgen over a Unix
+// domain stream socket. A connection carries any number of
+// request/response pairs.
+//
+// A request is a 12-byte header followed by the document text:
+//
+//   op   (uint32_t) WC_OP_SUMMARY or WC_OP_TOPK
+//   arg  (uint32_t) for WC_OP_TOPK, the number of words wanted
+//   len  (uint32_t) number of document bytes that follow
+//
+// A response is an 8-byte header followed by len bytes of text:
+//
+//   status (uint32_t) WC_STATUS_OK or WC_STATUS_ERROR
+//   len    (uint32_t) number of text bytes that follow
+//
+// For WC_OP_SUMMARY the text is the same three lines c_wordcount
+// prints. For WC_OP_TOPK it is one "word count" line per word, most
+// frequent first. For WC_STATUS_ERROR it is an error message.
+//
+// All header fields are sent in big-endian (network) byte order.
+
+#define WC_OP_SUMMARY 1
+#define WC_OP_TOPK 2
+
+#define WC_STATUS_OK 0
+#define WC_STATUS_ERROR 1
+
+#define WC_REQUEST_HEADER_SIZE 12
+#define WC_RESPONSE_HEADER_SIZE 8
+
+// Largest document the server will accept in a single request
+#define WC_MAX_DOC_SIZE (64U << 20)
+
+// Largest top-K list the server will produce
+#define WC_MAX_TOPK 100000
+
+// Store v at p in big-endian byte order.
+void wc_put_u32(unsigned char *p, uint32_t v);
+
+// Load a big-endian value from p.
+uint32_t wc_get_u32(const unsigned char *p);
+
+// Read exactly n bytes from fd into buf, retrying after short reads
+// and EINTR. Returns 1 on success, 0 if the peer closed the
+// connection before any byte was read, and -1 on error or if the
+// connection was closed part way through.
+int wc_read_full(int fd, void *buf, size_t n);
+
+// Write exactly n bytes from buf to fd, retrying after short writes
+// and EINTR. Returns 0 on success, -1 on error.
+int wc_write_full(int fd, const void *buf, size_t n);
+
+// Send one request (header and document) on fd.
+// Returns 0 on success, -1 on error.
+int wc_send_request(int fd, uint32_t op, uint32_t arg, const void *doc, uint32_t len);
+
+// Send one response (header and text) on fd.
+// Returns 0 on success, -1 on error.
+int wc_send_response(int fd, uint32_t status, const void *text, uint32_t len);
+
+#endif // WCPROTO_H
@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "wcfuncs.h"
+#include "wctable.h"
+#include "wcproto.h"
+
+// Long-lived word-count server.
+//
+// Usage: wcserver [-t threads] socket_path
+//
+// The main thread accepts connections on a Unix domain socket and
+// polls the idle ones; when a request arrives on a connection, the
+// connection is handed to a fixed pool of worker threads. A worker
+// serves that one request and hands the connection back to be
+// polled, so a client that keeps its connection open doesn't keep a
+// worker from the others. Each worker owns one WcTable and one
+// document buffer, and reuses both for every request it serves:
+// after each request the table is reset in time proportional to the
+// words it counted, so nothing is freed or zeroed wholesale between
+// documents. See wcproto.h for the framing.
+//
+// At most MAX_CONNECTIONS connections are open at once; a client
+// connecting beyond that gets an error response and is disconnected,
+// so the main thread never waits for the workers.
+//
+// SIGINT or SIGTERM stops the server: the main loop is woken through
+// a pipe written by the signal handler, idle connections are closed,
+// and connections still being served are shut down for reading, so
+// workers finish the requests they have already received and then
+// exit.
+
+#define DEFAULT_NUM_WORKERS 4
+#define MAX_NUM_WORKERS 256
+
+// Number of connections that may be open at once
+#define MAX_CONNECTIONS 1024
+
+// Connections with a request waiting for a worker, and connections
+// handed back by the workers to be polled again. A connection is in
+// exactly one place (the poll set, the queue, a worker or the
+// returned list), so neither array can overflow.
+struct ConnQueue {
+  int fds[MAX_CONNECTIONS];
+  unsigned head, count;
+  int returned[MAX_CONNECTIONS];
+  unsigned num_returned;
+  unsigned num_open;        // connections accepted and not yet closed
+  int wake_pipe[2];         // written when a connection is returned
+  int shutdown;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+};
+
+// Per-worker reusable state
+struct Worker {
+  pthread_t thread;
+  struct ConnQueue *queue;
+  int conn_fd;              // connection being served, or -1 (guarded by the queue lock)
+  struct WcTable *table;
+  unsigned char *doc;
+  size_t doc_cap;
+  char *reply;
+  size_t reply_cap;
+  struct WordEntry **top;
+  unsigned top_cap;
+};
+
+// Written by the signal handler to wake the main loop
+static int g_stop_pipe[2] = { -1, -1 };
+
+static void on_stop_signal(int signum) {
+  (void) signum;
+  int saved_errno = errno;
+  char c = 0;
+  if (write(g_stop_pipe[1], &c, 1) < 0) {
+    // the pipe is full, so the loop is woken already
+  }
+  errno = saved_errno;
+}
+
+// Create a pipe whose ends don't block. Returns 0, or -1 on error.
+static int nonblocking_pipe(int fds[2]) {
+  if (pipe(fds) != 0) {
+    return -1;
+  }
+  if (fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0 || fcntl(fds[1], F_SETFL, O_NONBLOCK) != 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  return 0;
+}
+
+static void drain_pipe(int fd) {
+  char buf[64];
+  while (read(fd, buf, sizeof(buf)) > 0) {
+  }
+}
+
+static int queue_init(struct ConnQueue *q) {
+  q->head = 0;
+  q->count = 0;
+  q->num_returned = 0;
+  q->num_open = 0;
+  q->shutdown = 0;
+  if (nonblocking_pipe(q->wake_pipe) != 0) {
+    return -1;
+  }
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_empty, NULL);
+  return 0;
+}
+
+// Count a new connection as open. Returns 0, or -1 if MAX_CONNECTIONS
+// are open already.
+static int queue_admit(struct ConnQueue *q) {
+  int rc = -1;
+  pthread_mutex_lock(&q->lock);
+  if (q->num_open < MAX_CONNECTIONS) {
+    q->num_open++;
+    rc = 0;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return rc;
+}
+
+// Queue a connection whose next request has arrived. Never blocks:
+// every open connection fits in the queue.
+static void queue_push(struct ConnQueue *q, int fd) {
+  pthread_mutex_lock(&q->lock);
+  q->fds[(q->head + q->count) % MAX_CONNECTIONS] = fd;
+  q->count++;
+  pthread_cond_signal(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// Returns the next connection for worker w (recording it in
+// w->conn_fd), or -1 once the queue is shut down and drained. A
+// connection taken after shutdown is shut down for reading at once.
+static int queue_pop(struct ConnQueue *q, struct Worker *w) {
+  int fd = -1;
+
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0 && !q->shutdown) {
+    pthread_cond_wait(&q->not_empty, &q->lock);
+  }
+  if (q->count > 0) {
+    fd = q->fds[q->head];
+    q->head = (q->head + 1) % MAX_CONNECTIONS;
+    q->count--;
+    if (q->shutdown) {
+      shutdown(fd, SHUT_RD);
+    }
+  }
+  w->conn_fd = fd;
+  pthread_mutex_unlock(&q->lock);
+  return fd;
+}
+
+// Finish with worker w's connection: hand it back to be polled for
+// the next request if keep is nonzero (and the server isn't stopping),
+// otherwise close it. This is done under the queue lock, so
+// queue_shutdown never shuts down a descriptor that has been reused.
+static void queue_release(struct ConnQueue *q, struct Worker *w, int keep) {
+  pthread_mutex_lock(&q->lock);
+  if (keep && !q->shutdown) {
+    q->returned[q->num_returned++] = w->conn_fd;
+    char c = 0;
+    if (write(q->wake_pipe[1], &c, 1) < 0) {
+      // the pipe is full, so the main loop is woken already
+    }
+  } else {
+    close(w->conn_fd);
+    q->num_open--;
+  }
+  w->conn_fd = -1;
+  pthread_mutex_unlock(&q->lock);
+}
+
+// Move the connections the workers handed back into fds (which has
+// room for every open connection), starting at index n. Returns the
+// new number of entries.
+static unsigned queue_take_returned(struct ConnQueue *q, struct pollfd *fds, unsigned n) {
+  drain_pipe(q->wake_pipe[0]);
+  pthread_mutex_lock(&q->lock);
+  for (unsigned i = 0; i < q->num_returned; i++) {
+    fds[n].fd = q->returned[i];
+    fds[n].events = POLLIN;
+    fds[n].revents = 0;
+    n++;
+  }
+  q->num_returned = 0;
+  pthread_mutex_unlock(&q->lock);
+  return n;
+}
+
+// Stop handing out connections, close the ones handed back, and shut
+// down the connections the workers are serving for reading: a worker
+// still reading a request then sees end of file, while a request
+// already received still gets its response.
+static void queue_shutdown(struct ConnQueue *q, struct Worker *workers, unsigned num_workers) {
+  pthread_mutex_lock(&q->lock);
+  q->shutdown = 1;
+  for (unsigned i = 0; i < q->num_returned; i++) {
+    close(q->returned[i]);
+  }
+  q->num_returned = 0;
+  for (unsigned i = 0; i < num_workers; i++) {
+    if (workers[i].conn_fd >= 0) {
+      shutdown(workers[i].conn_fd, SHUT_RD);
+    }
+  }
+  pthread_cond_broadcast(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// Make sure the worker's buffer p (of capacity *cap) can hold n bytes.
+// Returns 0 on success, -1 if memory could not be allocated.
+static int ensure_capacity(void **p, size_t *cap, size_t n) {
+  if (n <= *cap) {
+    return 0;
+  }
+  size_t new_cap = *cap ? *cap : 4096;
+  while (new_cap < n) {
+    new_cap *= 2;
+  }
+  void *q = realloc(*p, new_cap);
+  if (q == NULL) {
+    return -1;
+  }
+  *p = q;
+  *cap = new_cap;
+  return 0;
+}
+
+static int send_error(int fd, const char *msg) {
+  return wc_send_response(fd, WC_STATUS_ERROR, msg, (uint32_t) strlen(msg));
+}
+
+// Format the reply for a counted document into the worker's reply
+// buffer. Returns the reply length, or -1 if memory ran out.
+static long format_reply(struct Worker *w, uint32_t op, uint32_t k) {
+  struct WcTable *t = w->table;
+  size_t len = 0;
+
+  if (op == WC_OP_SUMMARY) {
+    if (ensure_capacity((void **) &w->reply, &w->reply_cap, 256) != 0) {
+      return -1;
+    }
+    int n = snprintf(w->reply, w->reply_cap,
+                     "Total words read: %u\n"
+                     "Unique words read: %u\n"
+                     "Most frequent word: %s (%u)\n",
+                     (unsigned int) t->total_words,
+                     (unsigned int) t->unique_words,
+                     (const char *) t->best_word,
+                     (unsigned int) t->best_word_count);
+    return n;
+  }
+
+  if (k > w->top_cap) {
+    void *p = realloc(w->top, k * sizeof(struct WordEntry *));
+    if (p == NULL) {
+      return -1;
+    }
+    w->top = (struct WordEntry **) p;
+    w->top_cap = k;
+  }
+  unsigned n = wc_table_top_k(t, w->top, k);
+
+  // each line is at most MAX_WORDLEN + 1 + 10 + 1 characters
+  if (ensure_capacity((void **) &w->reply, &w->reply_cap, (size_t) n * (MAX_WORDLEN + 13) + 1) != 0) {
+    return -1;
+  }
+  for (unsigned i = 0; i < n; i++) {
+    len += (size_t) sprintf(w->reply + len, "%s %u\n",
+                            (const char *) w->top[i]->word, (unsigned int) w->top[i]->count);
+  }
+  return (long) len;
+}
+
+// Serve one request on a connection. Returns 1 if the connection
+// can carry more requests, 0 if the client disconnected or an error
+// occurred.
+static int serve_request(struct Worker *w, int fd) {
+  unsigned char header[WC_REQUEST_HEADER_SIZE];
+
+  int rc = wc_read_full(fd, header, sizeof(header));
+  if (rc <= 0) {
+    return 0;
+  }
+  uint32_t op = wc_get_u32(header);
+  uint32_t arg = wc_get_u32(header + 4);
+  uint32_t len = wc_get_u32(header + 8);
+
+  if (op != WC_OP_SUMMARY && op != WC_OP_TOPK) {
+    send_error(fd, "unknown operation");
+    return 0;
+  }
+  if (len > WC_MAX_DOC_SIZE) {
+    send_error(fd, "document too large");
+    return 0;
+  }
+  if (op == WC_OP_TOPK && arg > WC_MAX_TOPK) {
+    arg = WC_MAX_TOPK;
+  }
+  if (ensure_capacity((void **) &w->doc, &w->doc_cap, len) != 0) {
+    send_error(fd, "out of memory");
+    return 0;
+  }
+  if (len > 0 && wc_read_full(fd, w->doc, len) != 1) {
+    return 0;
+  }
+
+  // a word dropped for lack of memory would make the counts wrong,
+  // so the request fails instead
+  wc_table_count_buf(w->table, w->doc, len);
+  long reply_len = w->table->num_dropped > 0 ? -1 : format_reply(w, op, arg);
+  wc_table_reset(w->table);
+
+  if (reply_len < 0) {
+    send_error(fd, "out of memory");
+    return 0;
+  }
+  return wc_send_response(fd, WC_STATUS_OK, w->reply, (uint32_t) reply_len) == 0;
+}
+
+static void *worker_main(void *arg) {
+  struct Worker *w = (struct Worker *) arg;
+  int fd;
+
+  while ((fd = queue_pop(w->queue, w)) >= 0) {
+    int keep = serve_request(w, fd);
+    queue_release(w->queue, w, keep);
+  }
+  return NULL;
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: wcserver [-t threads] socket_path\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  unsigned num_workers = DEFAULT_NUM_WORKERS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:")) != -1) {
+    if (opt == 't') {
+      num_workers = (unsigned) atoi(optarg);
+      if (num_workers < 1 || num_workers > MAX_NUM_WORKERS) {
+        fprintf(stderr, "Error: thread count must be between 1 and %d\n", MAX_NUM_WORKERS);
+        return 1;
+      }
+    } else {
+      usage();
+    }
+  }
+  if (optind != argc - 1) {
+    usage();
+  }
+  const char *path = argv[optind];
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Error: socket path is too long\n");
+    return 1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    perror("socket");
+    return 1;
+  }
+  unlink(path);
+  if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    perror("bind");
+    return 1;
+  }
+  if (listen(listen_fd, 128) != 0) {
+    perror("listen");
+    return 1;
+  }
+
+  // a client disconnecting mid-response must not kill the server;
+  // SIGINT/SIGTERM write to the stop pipe, which the main loop
+  // polls along with the socket. The signals are blocked while the
+  // workers are created, so they inherit a mask that leaves them to
+  // this thread.
+  if (nonblocking_pipe(g_stop_pipe) != 0) {
+    perror("pipe");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop_signal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigset_t stop_signals, old_mask;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+
+  static struct ConnQueue queue;
+  if (queue_init(&queue) != 0) {
+    perror("pipe");
+    return 1;
+  }
+
+  struct Worker *workers = (struct Worker *) calloc(num_workers, sizeof(struct Worker));
+  if (workers == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+  for (unsigned i = 0; i < num_workers; i++) {
+    workers[i].queue = &queue;
+    workers[i].conn_fd = -1;
+    workers[i].table = wc_table_create(0);
+    if (workers[i].table == NULL) {
+      fprintf(stderr, "Error: out of memory\n");
+      return 1;
+    }
+    if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+      fprintf(stderr, "Error: could not create worker thread\n");
+      return 1;
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+  // the listening socket, the two pipes, then the idle connections
+  static struct pollfd pfds[3 + MAX_CONNECTIONS];
+  unsigned num_pfds = 3;
+  pfds[0] = (struct pollfd) { listen_fd, POLLIN, 0 };
+  pfds[1] = (struct pollfd) { g_stop_pipe[0], POLLIN, 0 };
+  pfds[2] = (struct pollfd) { queue.wake_pipe[0], POLLIN, 0 };
+  for (;;) {
+    if (poll(pfds, num_pfds, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      break;
+    }
+    if (pfds[1].revents != 0) {
+      break;
+    }
+
+    // connections with a request (or a hangup) go to the workers
+    for (unsigned i = num_pfds; i-- > 3; ) {
+      if (pfds[i].revents != 0) {
+        queue_push(&queue, pfds[i].fd);
+        pfds[i] = pfds[--num_pfds];
+      }
+    }
+    if (pfds[2].revents != 0) {
+      num_pfds = queue_take_returned(&queue, pfds, num_pfds);
+    }
+
+    if (pfds[0].revents == 0) {
+      continue;
+    }
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      perror("accept");
+      break;
+    }
+    if (queue_admit(&queue) != 0) {
+      send_error(fd, "too many connections");
+      close(fd);
+      continue;
+    }
+    pfds[num_pfds++] = (struct pollfd) { fd, POLLIN, 0 };
+  }
+
+  close(listen_fd);
+  unlink(path);
+
+  queue_shutdown(&queue, workers, num_workers);
+  for (unsigned i = 3; i < num_pfds; i++) {
+    close(pfds[i].fd);
+  }
+  for (unsigned i = 0; i < num_workers; i++) {
+    pthread_join(workers[i].thread, NULL);
+    wc_table_destroy(workers[i].table);
+    free(workers[i].doc);
+    free(workers[i].reply);
+    free(workers[i].top);
+  }
+  free(workers);
+  close(g_stop_pipe[0]);
+  close(g_stop_pipe[1]);
+  close(queue.wake_pipe[0]);
+  close(queue.wake_pipe[1]);
+
+  return 0;
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wcfuncs.h"
+#include "wctable.h"
+#include "wcsnapshot.h"
+
+// Build, query and merge word-count snapshots (see wcsnapshot.h).
+//
+// Usage:
+//   wcsnap count [-b base.snap] out.snap [file]
+//       count the words in file (or standard input), adding them to
+//       the counts in base.snap if given, and write out.snap
+//   wcsnap stats in.snap
+//       print the same summary as c_wordcount
+//   wcsnap query in.snap word...
+//       print the count of each word (after the usual normalization)
+//   wcsnap merge out.snap in.snap...
+//       combine the counts of several snapshots
+
+static void usage(void) {
+  fprintf(stderr,
+          "Usage: wcsnap count [-b base.snap] out.snap [file]\n"
+          "       wcsnap stats in.snap\n"
+          "       wcsnap query in.snap word...\n"
+          "       wcsnap merge out.snap in.snap...\n");
+  exit(1);
+}
+
+static int open_snapshot(struct WcSnapshot *snap, const char *filename) {
+  if (wc_snap_open(snap, filename) != 0) {
+    fprintf(stderr, "Error: %s is not a readable snapshot\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+static int do_count(int argc, char **argv) {
+  const char *base_name = NULL;
+  struct WcSnapshot base;
+
+  if (argc >= 2 && strcmp(argv[0], "-b") == 0) {
+    base_name = argv[1];
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc < 1 || argc > 2) {
+    usage();
+  }
+
+  FILE *in_file = stdin;
+  if (argc == 2) {
+    in_file = fopen(argv[1], "r");
+    if (!in_file) {
+      fprintf(stderr, "Error: Cannot open file\n");
+      return 1;
+    }
+  }
+  if (base_name != NULL && open_snapshot(&base, base_name) != 0) {
+    return 1;
+  }
+
+  struct WcTable *t = wc_table_create(0);
+  if (t == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+  unsigned char word[MAX_WORDLEN + 1];
+  while (wc_readnext(in_file, word)) {
+    wc_table_count_word(t, word);
+  }
+
+  int rc = wc_snap_write_table(t, base_name != NULL ? &base : NULL, argv[0]);
+  if (rc != 0) {
+    fprintf(stderr, "Error: could not write %s\n", argv[0]);
+  }
+
+  wc_table_destroy(t);
+  if (base_name != NULL) {
+    wc_snap_close(&base);
+  }
+  if (in_file != stdin) {
+    fclose(in_file);
+  }
+  return rc != 0;
+}
+
+static int do_stats(int argc, char **argv) {
+  struct WcSnapshot snap;
+
+  if (argc != 1) {
+    usage();
+  }
+  if (open_snapshot(&snap, argv[0]) != 0) {
+    return 1;
+  }
+
+  const struct WcSnapHeader *h = snap.header;
+  const unsigned char *best_word = (const unsigned char *) "";
+  uint64_t best_word_count = 0;
+  if (h->best_entry != WC_SNAP_NO_ENTRY) {
+    best_word = wc_snap_word(&snap, &snap.entries[h->best_entry]);
+    best_word_count = snap.entries[h->best_entry].count;
+  }
+  printf("Total words read: %llu\n", (unsigned long long) h->total_words);
+  printf("Unique words read: %u\n", (unsigned int) h->num_words);
+  printf("Most frequent word: %s (%llu)\n", (const char *) best_word, (unsigned long long) best_word_count);
+
+  wc_snap_close(&snap);
+  return 0;
+}
+
+static int do_query(int argc, char **argv) {
+  struct WcSnapshot snap;
+
+  if (argc < 2) {
+    usage();
+  }
+  if (open_snapshot(&snap, argv[0]) != 0) {
+    return 1;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    unsigned char word[MAX_WORDLEN + 1];
+    strncpy((char *) word, argv[i], MAX_WORDLEN);
+    word[MAX_WORDLEN] = '\0';
+    wc_tolower(word);
+    wc_trim_non_alpha(word);
+
+    const struct WcSnapEntry *e = wc_snap_lookup(&snap, word);
+    printf("%s %llu\n", (const char *) word, (unsigned long long) (e != NULL ? e->count : 0));
+  }
+
+  wc_snap_close(&snap);
+  return 0;
+}
+
+static int do_merge(int argc, char **argv) {
+  if (argc < 2) {
+    usage();
+  }
+
+  unsigned n = (unsigned) argc - 1;
+  struct WcSnapshot *inputs = (struct WcSnapshot *) calloc(n, sizeof(struct WcSnapshot));
+  if (inputs == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+
+  int rc = 0;
+  for (unsigned i = 0; i < n && rc == 0; i++) {
+    rc = open_snapshot(&inputs[i], argv[i + 1]);
+  }
+  if (rc == 0) {
+    rc = wc_snap_merge(inputs, n, argv[0]);
+    if (rc != 0) {
+      fprintf(stderr, "Error: could not write %s\n", argv[0]);
+    }
+  }
+
+  for (unsigned i = 0; i < n; i++) {
+    wc_snap_close(&inputs[i]);
+  }
+  free(inputs);
+  return rc != 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    usage();
+  }
+
+  const char *cmd = argv[1];
+  argc -= 2;
+  argv += 2;
+
+  if (strcmp(cmd, "count") == 0) {
+    return do_count(argc, argv);
+  } else if (strcmp(cmd, "stats") == 0) {
+    return do_stats(argc, argv);
+  } else if (strcmp(cmd, "query") == 0) {
+    return do_query(argc, argv);
+  } else if (strcmp(cmd, "merge") == 0) {
+    return do_merge(argc, argv);
+  }
+  usage();
+  return 1;
+}
@@ -0,0 +1,442 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wcsnapshot.h"
+
+// Size of the stdio buffers used when writing a snapshot
+#define SNAP_IO_BUFSIZE (1 << 20)
+
+// A position in one sorted input of a merge: either the entries of
+// a mapped snapshot, or an array of table entries sorted by word.
+struct SnapCursor {
+  const struct WcSnapshot *snap;
+  struct WordEntry **words;
+  uint32_t pos;
+  uint32_t end;
+};
+
+// State of a snapshot being written. Entries go straight to the
+// output file, while words are collected in a temporary file and
+// appended once the number of entries is known.
+struct SnapWriter {
+  FILE *out;
+  FILE *pool;
+  char *tmp_name;
+  uint32_t num_words;
+  uint64_t pool_size;
+  uint32_t *hashes;
+  size_t hashes_cap;
+  uint64_t best_count;
+  uint32_t best_entry;
+};
+
+int wc_snap_open(struct WcSnapshot *snap, const char *filename) {
+  memset(snap, 0, sizeof(*snap));
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct WcSnapHeader)) {
+    close(fd);
+    return -1;
+  }
+  void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+
+  const struct WcSnapHeader *h = (const struct WcSnapHeader *) map;
+  uint64_t size = (uint64_t) st.st_size;
+  uint64_t entries_end = sizeof(struct WcSnapHeader) + (uint64_t) h->num_words * sizeof(struct WcSnapEntry);
+  int valid = memcmp(h->magic, WC_SNAP_MAGIC, sizeof(h->magic)) == 0
+    && h->byte_order == WC_SNAP_BYTE_ORDER
+    && h->pool_offset == entries_end
+    && h->pool_offset + h->pool_size <= size
+    && h->index_offset == h->pool_offset + h->pool_size
+    && h->index_offset % sizeof(uint32_t) == 0
+    && h->index_slots != 0 && (h->index_slots & (h->index_slots - 1)) == 0
+    && h->index_slots > h->num_words
+    && h->index_offset + (uint64_t) h->index_slots * sizeof(uint32_t) <= size
+    && (h->num_words == 0 || (h->pool_size > 0 && h->pool_size <= UINT32_MAX))
+    && (h->best_entry == WC_SNAP_NO_ENTRY || h->best_entry < h->num_words);
+  // every word handed out must end inside the pool
+  if (valid && h->pool_size > 0 && ((const unsigned char *) map)[h->pool_offset + h->pool_size - 1] != '\0') {
+    valid = 0;
+  }
+  if (!valid) {
+    munmap(map, (size_t) st.st_size);
+    return -1;
+  }
+
+  const unsigned char *base = (const unsigned char *) map;
+  snap->map = map;
+  snap->map_size = (size_t) st.st_size;
+  snap->header = h;
+  snap->entries = (const struct WcSnapEntry *) (base + sizeof(struct WcSnapHeader));
+  snap->pool = base + h->pool_offset;
+  snap->index = (const uint32_t *) (base + h->index_offset);
+
+  // merging relies on every word fitting in MAX_WORDLEN and on the
+  // entries being in strictly increasing word order
+  const unsigned char *prev = NULL;
+  for (uint32_t i = 0; i < h->num_words; i++) {
+    uint64_t offset = snap->entries[i].word_offset;
+    const unsigned char *word = snap->pool + offset;
+    uint64_t room = offset < h->pool_size ? h->pool_size - offset : 0;
+    if (room == 0
+        || memchr(word, '\0', room < MAX_WORDLEN + 1 ? (size_t) room : MAX_WORDLEN + 1) == NULL
+        || (prev != NULL && wc_str_compare(prev, word) >= 0)) {
+      wc_snap_close(snap);
+      return -1;
+    }
+    prev = word;
+  }
+  return 0;
+}
+
+void wc_snap_close(struct WcSnapshot *snap) {
+  if (snap->map != NULL) {
+    munmap(snap->map, snap->map_size);
+  }
+  memset(snap, 0, sizeof(*snap));
+}
+
+const unsigned char *wc_snap_word(const struct WcSnapshot *snap, const struct WcSnapEntry *e) {
+  // a corrupt offset yields the empty word rather than reading
+  // outside the pool
+  if (e->word_offset >= snap->header->pool_size) {
+    return (const unsigned char *) "";
+  }
+  return snap->pool + e->word_offset;
+}
+
+const struct WcSnapEntry *wc_snap_lookup(const struct WcSnapshot *snap, const unsigned char *w) {
+  uint32_t hash = wc_hash(w);
+  uint32_t mask = snap->header->index_slots - 1;
+
+  // a valid index always has an empty slot, but a corrupt one may
+  // not, so the probe stops after visiting every slot once
+  uint32_t i = hash & mask;
+  for (uint32_t probes = 0; probes <= mask; probes++, i = (i + 1) & mask) {
+    uint32_t slot = snap->index[i];
+    if (slot == 0 || slot > snap->header->num_words) {
+      return NULL;
+    }
+    const struct WcSnapEntry *e = &snap->entries[slot - 1];
+    if (e->hash == hash && wc_str_compare(wc_snap_word(snap, e), w) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+static const unsigned char *cursor_word(const struct SnapCursor *c) {
+  if (c->snap != NULL) {
+    return wc_snap_word(c->snap, &c->snap->entries[c->pos]);
+  }
+  return c->words[c->pos]->word;
+}
+
+static uint64_t cursor_count(const struct SnapCursor *c) {
+  if (c->snap != NULL) {
+    return c->snap->entries[c->pos].count;
+  }
+  return c->words[c->pos]->count;
+}
+
+static int writer_open(struct SnapWriter *w, const char *filename) {
+  memset(w, 0, sizeof(*w));
+  w->best_entry = WC_SNAP_NO_ENTRY;
+
+  // write to a temporary name and rename at the end, so that a
+  // snapshot can be rewritten while it is still mapped
+  w->tmp_name = (char *) malloc(strlen(filename) + 5);
+  if (w->tmp_name == NULL) {
+    return -1;
+  }
+  sprintf(w->tmp_name, "%s.tmp", filename);
+
+  w->out = fopen(w->tmp_name, "wb");
+  w->pool = tmpfile();
+  if (w->out == NULL || w->pool == NULL) {
+    return -1;
+  }
+  setvbuf(w->out, NULL, _IOFBF, SNAP_IO_BUFSIZE);
+  setvbuf(w->pool, NULL, _IOFBF, SNAP_IO_BUFSIZE);
+
+  struct WcSnapHeader placeholder;
+  memset(&placeholder, 0, sizeof(placeholder));
+  if (fwrite(&placeholder, sizeof(placeholder), 1, w->out) != 1) {
+    return -1;
+  }
+  return 0;
+}
+
+// Append one word. Words must be added in ascending order.
+static int writer_add(struct SnapWriter *w, const unsigned char *word, uint64_t count) {
+  size_t len = strlen((const char *) word);
+
+  if (w->num_words == WC_SNAP_NO_ENTRY || w->pool_size + len + 1 > UINT32_MAX) {
+    return -1;
+  }
+  if (w->num_words == w->hashes_cap) {
+    size_t cap = w->hashes_cap ? w->hashes_cap * 2 : 1024;
+    uint32_t *p = (uint32_t *) realloc(w->hashes, cap * sizeof(uint32_t));
+    if (p == NULL) {
+      return -1;
+    }
+    w->hashes = p;
+    w->hashes_cap = cap;
+  }
+
+  struct WcSnapEntry e;
+  e.count = count;
+  e.word_offset = (uint32_t) w->pool_size;
+  e.hash = wc_hash(word);
+  if (fwrite(&e, sizeof(e), 1, w->out) != 1 || fwrite(word, 1, len + 1, w->pool) != len + 1) {
+    return -1;
+  }
+
+  // since words arrive in ascending order, a tie never replaces
+  // the current best word
+  if (w->best_entry == WC_SNAP_NO_ENTRY || count > w->best_count) {
+    w->best_count = count;
+    w->best_entry = w->num_words;
+  }
+  w->hashes[w->num_words++] = e.hash;
+  w->pool_size += len + 1;
+  return 0;
+}
+
+// Append the pool and the hash index, fill in the header and move
+// the file into place.
+static int writer_finish(struct SnapWriter *w, uint64_t total_words, const char *filename) {
+  static const unsigned char padding[8];
+  unsigned char *buf = NULL;
+  uint32_t *index = NULL;
+  int rc = -1;
+
+  // copy the pool, padded so that the index is aligned
+  size_t pad = (size_t) ((8 - w->pool_size % 8) % 8);
+  if (fwrite(padding, 1, pad, w->pool) != pad || fflush(w->pool) != 0 || fseek(w->pool, 0, SEEK_SET) != 0) {
+    goto done;
+  }
+  buf = (unsigned char *) malloc(SNAP_IO_BUFSIZE);
+  if (buf == NULL) {
+    goto done;
+  }
+  size_t n;
+  while ((n = fread(buf, 1, SNAP_IO_BUFSIZE, w->pool)) > 0) {
+    if (fwrite(buf, 1, n, w->out) != n) {
+      goto done;
+    }
+  }
+  if (ferror(w->pool)) {
+    goto done;
+  }
+
+  // the index is kept at most half full
+  uint32_t slots = 16;
+  while (slots < 2 * (uint64_t) w->num_words) {
+    slots *= 2;
+  }
+  index = (uint32_t *) calloc(slots, sizeof(uint32_t));
+  if (index == NULL) {
+    goto done;
+  }
+  for (uint32_t i = 0; i < w->num_words; i++) {
+    uint32_t j = w->hashes[i] & (slots - 1);
+    while (index[j] != 0) {
+      j = (j + 1) & (slots - 1);
+    }
+    index[j] = i + 1;
+  }
+  if (fwrite(index, sizeof(uint32_t), slots, w->out) != slots) {
+    goto done;
+  }
+
+  struct WcSnapHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, WC_SNAP_MAGIC, sizeof(h.magic));
+  h.byte_order = WC_SNAP_BYTE_ORDER;
+  h.num_words = w->num_words;
+  h.total_words = total_words;
+  h.pool_offset = sizeof(struct WcSnapHeader) + (uint64_t) w->num_words * sizeof(struct WcSnapEntry);
+  h.pool_size = w->pool_size + pad;
+  h.index_offset = h.pool_offset + h.pool_size;
+  h.index_slots = slots;
+  h.best_entry = w->best_entry;
+  if (fseek(w->out, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, w->out) != 1) {
+    goto done;
+  }
+
+  int close_rc = fclose(w->out);
+  w->out = NULL;
+  if (close_rc != 0 || rename(w->tmp_name, filename) != 0) {
+    goto done;
+  }
+  rc = 0;
+
+done:
+  free(buf);
+  free(index);
+  return rc;
+}
+
+static void writer_cleanup(struct SnapWriter *w) {
+  if (w->out != NULL) {
+    fclose(w->out);
+  }
+  if (w->pool != NULL) {
+    fclose(w->pool);
+  }
+  if (w->tmp_name != NULL) {
+    unlink(w->tmp_name);  // no-op once the file has been renamed
+    free(w->tmp_name);
+  }
+  free(w->hashes);
+}
+
+// Min-heap of cursor numbers ordered by each cursor's current word.
+static void cursor_sift_down(struct SnapCursor *cur, unsigned *heap, unsigned n, unsigned i) {
+  for (;;) {
+    unsigned least = i;
+    unsigned left = 2 * i + 1;
+    unsigned right = 2 * i + 2;
+    if (left < n && wc_str_compare(cursor_word(&cur[heap[left]]), cursor_word(&cur[heap[least]])) < 0) {
+      least = left;
+    }
+    if (right < n && wc_str_compare(cursor_word(&cur[heap[right]]), cursor_word(&cur[heap[least]])) < 0) {
+      least = right;
+    }
+    if (least == i) {
+      return;
+    }
+    unsigned tmp = heap[i];
+    heap[i] = heap[least];
+    heap[least] = tmp;
+    i = least;
+  }
+}
+
+// Merge n sorted cursors into a new snapshot file.
+static int merge_cursors(struct SnapCursor *cur, unsigned n, uint64_t total_words, const char *filename) {
+  struct SnapWriter w;
+  unsigned *heap = (unsigned *) malloc((n ? n : 1) * sizeof(unsigned));
+  unsigned heap_size = 0;
+  int rc = -1;
+
+  memset(&w, 0, sizeof(w));
+  if (heap == NULL || writer_open(&w, filename) != 0) {
+    goto done;
+  }
+
+  for (unsigned i = 0; i < n; i++) {
+    if (cur[i].pos < cur[i].end) {
+      heap[heap_size++] = i;
+    }
+  }
+  for (unsigned i = heap_size / 2; i-- > 0; ) {
+    cursor_sift_down(cur, heap, heap_size, i);
+  }
+
+  while (heap_size > 0) {
+    // take the smallest word, and the same word from every other
+    // input that has it
+    const unsigned char *word = cursor_word(&cur[heap[0]]);
+    uint64_t count = 0;
+    unsigned char copy[MAX_WORDLEN + 1];
+    size_t len = strlen((const char *) word);
+    if (len > MAX_WORDLEN) {
+      len = MAX_WORDLEN;
+    }
+    memcpy(copy, word, len);
+    copy[len] = '\0';
+
+    // compared in full, so every cursor on the word moves past it
+    // (the words stay put while the cursors advance)
+    while (heap_size > 0 && wc_str_compare(cursor_word(&cur[heap[0]]), word) == 0) {
+      struct SnapCursor *c = &cur[heap[0]];
+      count += cursor_count(c);
+      c->pos++;
+      if (c->pos == c->end) {
+        heap[0] = heap[--heap_size];
+      }
+      cursor_sift_down(cur, heap, heap_size, 0);
+    }
+    if (writer_add(&w, copy, count) != 0) {
+      goto done;
+    }
+  }
+
+  rc = writer_finish(&w, total_words, filename);
+
+done:
+  writer_cleanup(&w);
+  free(heap);
+  return rc;
+}
+
+static int compare_entry_words(const void *a, const void *b) {
+  const struct WordEntry *x = *(struct WordEntry * const *) a;
+  const struct WordEntry *y = *(struct WordEntry * const *) b;
+  return wc_str_compare(x->word, y->word);
+}
+
+int wc_snap_write_table(const struct WcTable *t, const struct WcSnapshot *base, const char *filename) {
+  struct WordEntry **words = (struct WordEntry **) malloc((t->num_entries ? t->num_entries : 1) * sizeof(struct WordEntry *));
+  if (words == NULL) {
+    return -1;
+  }
+  uint32_t n = 0;
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    for (struct WordEntry *p = t->buckets[t->touched[i]]; p != NULL; p = p->next) {
+      words[n++] = p;
+    }
+  }
+  qsort(words, n, sizeof(struct WordEntry *), compare_entry_words);
+
+  struct SnapCursor cur[2];
+  unsigned num_cursors = 0;
+  uint64_t total_words = t->total_words;
+
+  memset(cur, 0, sizeof(cur));
+  cur[num_cursors].words = words;
+  cur[num_cursors].end = n;
+  num_cursors++;
+  if (base != NULL) {
+    cur[num_cursors].snap = base;
+    cur[num_cursors].end = base->header->num_words;
+    num_cursors++;
+    total_words += base->header->total_words;
+  }
+
+  int rc = merge_cursors(cur, num_cursors, total_words, filename);
+  free(words);
+  return rc;
+}
+
+int wc_snap_merge(const struct WcSnapshot *inputs, unsigned n, const char *filename) {
+  struct SnapCursor *cur = (struct SnapCursor *) calloc(n ? n : 1, sizeof(struct SnapCursor));
+  uint64_t total_words = 0;
+
+  if (cur == NULL) {
+    return -1;
+  }
+  for (unsigned i = 0; i < n; i++) {
+    cur[i].snap = &inputs[i];
+    cur[i].end = inputs[i].header->num_words;
+    total_words += inputs[i].header->total_words;
+  }
+
+  int rc = merge_cursors(cur, n, total_words, filename);
+  free(cur);
+  return rc;
+}
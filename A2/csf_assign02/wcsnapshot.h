@@ -0,0 +1,93 @@
+#ifndef WCSNAPSHOT_H
+#define WCSNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "wcfuncs.h"
+#include "wctable.h"
+
+// On-disk snapshot of a word-count dictionary.
+//
+// A snapshot file is laid out so that it can be mmap'ed and queried
+// directly, without any parsing step:
+//
+//   header   struct WcSnapHeader (64 bytes)
+//   entries  num_words x struct WcSnapEntry, sorted by word
+//            (in wc_str_compare order)
+//   pool     the words, NUL-terminated and in the same order as
+//            the entries, padded to a multiple of 8 bytes
+//   index    index_slots x uint32_t open-addressing hash index;
+//            each slot is 0 (empty) or 1 + an entry number, and
+//            entries are placed by wc_hash(word) with linear probing
+//
+// All values are stored in the byte order of the machine that wrote
+// the file; byte_order lets a reader detect a mismatch. Counts are
+// 64 bits wide so that many snapshots can be merged without overflow.
+
+#define WC_SNAP_MAGIC "WCSNAP01"
+#define WC_SNAP_BYTE_ORDER 0x01020304U
+
+// No most-frequent word (the snapshot is empty)
+#define WC_SNAP_NO_ENTRY 0xFFFFFFFFU
+
+struct WcSnapHeader {
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t num_words;
+  uint64_t total_words;
+  uint64_t pool_offset;
+  uint64_t pool_size;
+  uint64_t index_offset;
+  uint32_t index_slots;   // always a power of 2
+  uint32_t best_entry;    // entry number of the most frequent word
+  uint64_t reserved;
+};
+
+struct WcSnapEntry {
+  uint64_t count;
+  uint32_t word_offset;   // offset of the word in the pool
+  uint32_t hash;          // wc_hash of the word
+};
+
+// A snapshot file mapped into memory.
+struct WcSnapshot {
+  void *map;
+  size_t map_size;
+  const struct WcSnapHeader *header;
+  const struct WcSnapEntry *entries;
+  const unsigned char *pool;
+  const uint32_t *index;
+};
+
+// Map the snapshot file with the given name and check that its
+// header is consistent with the file size, that the index has more
+// slots than there are words, that the pool ends in a NUL, and that
+// every entry's word starts inside the pool, is at most MAX_WORDLEN
+// bytes long and sorts strictly after the previous entry's (in
+// wc_str_compare order). Returns 0 on success, -1 if the file can't
+// be opened or isn't a valid snapshot.
+int wc_snap_open(struct WcSnapshot *snap, const char *filename);
+
+// Unmap a snapshot opened with wc_snap_open.
+void wc_snap_close(struct WcSnapshot *snap);
+
+// Return the word stored for the given entry.
+const unsigned char *wc_snap_word(const struct WcSnapshot *snap, const struct WcSnapEntry *e);
+
+// Look up a word using the hash index. Returns a pointer to its
+// entry, or NULL if the word isn't in the snapshot.
+const struct WcSnapEntry *wc_snap_lookup(const struct WcSnapshot *snap, const unsigned char *w);
+
+// Write the contents of a table as a snapshot. If base is not NULL,
+// its counts (and total) are added to the table's, so a run can
+// extend a stored snapshot with the words it has just counted.
+// Returns 0 on success, -1 on error.
+int wc_snap_write_table(const struct WcTable *t, const struct WcSnapshot *base, const char *filename);
+
+// Combine n snapshots into one, adding the counts of words that
+// appear in more than one input. The inputs are read in a single
+// streaming k-way pass over their sorted entries.
+// Returns 0 on success, -1 on error.
+int wc_snap_merge(const struct WcSnapshot *inputs, unsigned n, const char *filename);
+
+#endif // WCSNAPSHOT_H
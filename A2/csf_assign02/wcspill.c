@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "wcspill.h"
+#include "wcstop.h"
+#include "wcpipe.h"
+
+#define DEFAULT_NUM_PARTITIONS 64
+
+// Partitions that still don't fit are split again at most this
+// many times; past that the budget is exceeded rather than failing
+#define MAX_SPILL_DEPTH 4
+
+// Bounds on the initial size of the counting table's bucket array
+#define MIN_SPILL_BUCKETS 61
+#define DEFAULT_SPILL_BUCKETS 13249
+
+// Bounds on the stdio buffer given to each partition file
+#define MIN_SPILL_BUFSIZE (16 << 10)
+#define MAX_SPILL_BUFSIZE (1 << 20)
+
+// One level of partition files
+struct Spiller {
+  FILE **parts;
+  unsigned num_parts;
+  unsigned level;
+};
+
+// Shared state of one wc_spill_count call
+struct SpillContext {
+  const struct WcSpillOptions *opts;
+  const char *tmp_dir;
+  size_t bufsize;
+  struct WcTable *table;
+  struct WcSummary *summary;
+  struct WcSpillStats *stats;
+};
+
+// Choose a partition for a word at a given level. Each level mixes
+// the hash differently so that a partition which is split again
+// spreads over all of its sub-partitions.
+static unsigned spill_partition(const unsigned char *word, unsigned level, unsigned num_parts) {
+  uint32_t h = wc_hash(word) ^ (level * 0x9E3779B9U);
+  h ^= h >> 16;
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35U;
+  h ^= h >> 16;
+  return h % num_parts;
+}
+
+// Return 1 if the table has used up the budget and would need to
+// allocate to insert another word.
+static int table_is_full(const struct SpillContext *ctx) {
+  return ctx->table->free_nodes == NULL
+    && ctx->table->num_entries > 0
+    && wc_table_memory_usage(ctx->table) >= ctx->opts->memory_budget;
+}
+
+// Create an anonymous read/write temporary file in the spill directory.
+static FILE *spill_tmpfile(const struct SpillContext *ctx) {
+  size_t len = strlen(ctx->tmp_dir);
+  char *name = (char *) malloc(len + 20);
+  if (name == NULL) {
+    return NULL;
+  }
+  sprintf(name, "%s/wcspillXXXXXX", ctx->tmp_dir);
+  int fd = mkstemp(name);
+  if (fd < 0) {
+    free(name);
+    return NULL;
+  }
+  unlink(name);
+  free(name);
+
+  FILE *f = fdopen(fd, "w+b");
+  if (f == NULL) {
+    close(fd);
+    return NULL;
+  }
+  setvbuf(f, NULL, _IOFBF, ctx->bufsize);
+  return f;
+}
+
+static void spiller_close(struct Spiller *sp) {
+  if (sp->parts != NULL) {
+    for (unsigned i = 0; i < sp->num_parts; i++) {
+      if (sp->parts[i] != NULL) {
+        fclose(sp->parts[i]);
+      }
+    }
+    free(sp->parts);
+  }
+  sp->parts = NULL;
+}
+
+static int spiller_open(struct Spiller *sp, const struct SpillContext *ctx, unsigned level) {
+  sp->num_parts = ctx->opts->num_partitions ? ctx->opts->num_partitions : DEFAULT_NUM_PARTITIONS;
+  sp->level = level;
+  sp->parts = (FILE **) calloc(sp->num_parts, sizeof(FILE *));
+  if (sp->parts == NULL) {
+    return -1;
+  }
+  for (unsigned i = 0; i < sp->num_parts; i++) {
+    sp->parts[i] = spill_tmpfile(ctx);
+    if (sp->parts[i] == NULL) {
+      spiller_close(sp);
+      return -1;
+    }
+  }
+  if (ctx->stats != NULL && level > ctx->stats->max_depth) {
+    ctx->stats->max_depth = level;
+  }
+  return 0;
+}
+
+// Write one (word, count) record: a length byte, the word's
+// characters, and the count as a base-128 varint.
+static int write_record(FILE *f, const unsigned char *word, uint64_t count, uint64_t *bytes) {
+  unsigned char buf[1 + MAX_WORDLEN + 10];
+  size_t len = strlen((const char *) word);
+  size_t n = 0;
+
+  buf[n++] = (unsigned char) len;
+  memcpy(buf + n, word, len);
+  n += len;
+  do {
+    unsigned char b = count & 0x7F;
+    count >>= 7;
+    buf[n++] = b | (count ? 0x80 : 0);
+  } while (count);
+
+  *bytes += n;
+  return fwrite(buf, 1, n, f) == n ? 0 : -1;
+}
+
+// Read one record. Returns 1 if a record was read, 0 at end of file,
+// and -1 if the file is truncated or corrupt.
+static int read_record(FILE *f, unsigned char *word, uint64_t *count) {
+  int len = getc(f);
+  if (len == EOF) {
+    return 0;
+  }
+  if (len > MAX_WORDLEN || fread(word, 1, (size_t) len, f) != (size_t) len) {
+    return -1;
+  }
+  word[len] = '\0';
+
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int b = getc(f);
+    if (b == EOF) {
+      return -1;
+    }
+    value |= (uint64_t) (b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *count = value;
+      return 1;
+    }
+  }
+  return -1;
+}
+
+// Write every entry of the table to its partition and empty the table.
+static int spill_table(struct Spiller *sp, struct SpillContext *ctx) {
+  struct WcTable *t = ctx->table;
+  uint64_t bytes = 0;
+
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    for (struct WordEntry *p = t->buckets[t->touched[i]]; p != NULL; p = p->next) {
+      FILE *f = sp->parts[spill_partition(p->word, sp->level, sp->num_parts)];
+      if (write_record(f, p->word, p->count, &bytes) != 0) {
+        return -1;
+      }
+    }
+  }
+  if (ctx->stats != NULL) {
+    ctx->stats->num_spills++;
+    ctx->stats->bytes_spilled += bytes;
+  }
+  wc_table_reset(t);
+  return 0;
+}
+
+// Add the table's entries, whose counts are final, to the summary,
+// and empty the table.
+static void summarize_table(struct SpillContext *ctx) {
+  struct WcTable *t = ctx->table;
+
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    for (struct WordEntry *p = t->buckets[t->touched[i]]; p != NULL; p = p->next) {
+      ctx->summary->unique_words++;
+      wc_summary_consider(ctx->summary, p->word, p->count);
+    }
+  }
+  wc_table_reset(t);
+}
+
+// Add count to the entry's count, clamping it at UINT32_MAX (the
+// widest count a WordEntry holds) and noting the clamp in the stats.
+static void add_count(struct SpillContext *ctx, struct WordEntry *e, uint64_t count) {
+  if (count > UINT32_MAX - e->count) {
+    e->count = UINT32_MAX;
+    if (ctx->stats != NULL) {
+      ctx->stats->num_clamped++;
+    }
+  } else {
+    e->count += (uint32_t) count;
+  }
+}
+
+static int count_partition(FILE *f, unsigned level, struct SpillContext *ctx);
+
+// Finish counting once all input has been read into the table
+// (and possibly into the spiller's partitions).
+static int finish_level(struct Spiller *sp, struct SpillContext *ctx) {
+  if (sp->parts == NULL) {
+    summarize_table(ctx);
+    return 0;
+  }
+
+  int rc = spill_table(sp, ctx);
+  for (unsigned i = 0; i < sp->num_parts && rc == 0; i++) {
+    if (fflush(sp->parts[i]) != 0 || fseek(sp->parts[i], 0, SEEK_SET) != 0) {
+      rc = -1;
+    } else {
+      rc = count_partition(sp->parts[i], sp->level + 1, ctx);
+    }
+    // release each partition's disk space as soon as it is counted
+    fclose(sp->parts[i]);
+    sp->parts[i] = NULL;
+  }
+  spiller_close(sp);
+  return rc;
+}
+
+// Count the records of one partition file, splitting it again if
+// its words don't fit in the budget.
+static int count_partition(FILE *f, unsigned level, struct SpillContext *ctx) {
+  struct Spiller sub = { NULL, 0, 0 };
+  unsigned char word[MAX_WORDLEN + 1];
+  uint64_t count;
+  int rc;
+
+  while ((rc = read_record(f, word, &count)) == 1) {
+    if (table_is_full(ctx) && level < MAX_SPILL_DEPTH) {
+      if ((sub.parts == NULL && spiller_open(&sub, ctx, level) != 0) || spill_table(&sub, ctx) != 0) {
+        spiller_close(&sub);
+        return -1;
+      }
+    }
+    struct WordEntry *e = wc_table_find_or_insert(ctx->table, word);
+    if (e == NULL) {
+      spiller_close(&sub);
+      return -1;
+    }
+    add_count(ctx, e, count);
+  }
+  if (rc < 0) {
+    spiller_close(&sub);
+    return -1;
+  }
+  return finish_level(&sub, ctx);
+}
+
+int wc_spill_count(FILE *in, const struct WcSpillOptions *opts,
+                   struct WcSummary *summary, struct WcSpillStats *stats) {
+  struct SpillContext ctx;
+  struct Spiller top = { NULL, 0, 0 };
+  unsigned char word[MAX_WORDLEN + 1];
+
+  ctx.opts = opts;
+  ctx.tmp_dir = opts->tmp_dir;
+  if (ctx.tmp_dir == NULL) {
+    ctx.tmp_dir = getenv("TMPDIR");
+  }
+  if (ctx.tmp_dir == NULL || *ctx.tmp_dir == '\0') {
+    ctx.tmp_dir = "/tmp";
+  }
+
+  // give the partition buffers about a quarter of the budget
+  unsigned num_parts = opts->num_partitions ? opts->num_partitions : DEFAULT_NUM_PARTITIONS;
+  ctx.bufsize = opts->memory_budget / 4 / num_parts;
+  if (ctx.bufsize < MIN_SPILL_BUFSIZE) {
+    ctx.bufsize = MIN_SPILL_BUFSIZE;
+  } else if (ctx.bufsize > MAX_SPILL_BUFSIZE) {
+    ctx.bufsize = MAX_SPILL_BUFSIZE;
+  }
+
+  ctx.summary = summary;
+  ctx.stats = stats;
+  wc_summary_init(summary);
+  if (stats != NULL) {
+    memset(stats, 0, sizeof(*stats));
+  }
+  // start with a bucket array that takes at most an eighth of the
+  // budget, so that small budgets still leave room for words
+  size_t num_buckets = opts->memory_budget / 8 / (sizeof(struct WordEntry *) + sizeof(unsigned));
+  if (num_buckets < MIN_SPILL_BUCKETS) {
+    num_buckets = MIN_SPILL_BUCKETS;
+  } else if (num_buckets > DEFAULT_SPILL_BUCKETS) {
+    num_buckets = DEFAULT_SPILL_BUCKETS;
+  }
+  struct WcWordReader reader;
+  ctx.table = wc_table_create((unsigned) num_buckets);
+  if (ctx.table == NULL || wc_reader_init(&reader, in) != 0) {
+    wc_table_destroy(ctx.table);
+    return -1;
+  }
+
+  int rc = 0, more;
+  while (rc == 0 && (more = wc_reader_next(&reader, word)) != 0) {
+    if (more < 0) {
+      rc = -1;
+      break;
+    }
+    wc_tolower(word);
+    wc_trim_non_alpha(word);
+    if (opts->stop_words != NULL && wc_stop_contains(opts->stop_words, word)) {
+      continue;
+    }
+    summary->total_words++;
+
+    if (table_is_full(&ctx)) {
+      if ((top.parts == NULL && spiller_open(&top, &ctx, 0) != 0) || spill_table(&top, &ctx) != 0) {
+        rc = -1;
+        break;
+      }
+    }
+    struct WordEntry *e = wc_table_find_or_insert(ctx.table, word);
+    if (e == NULL) {
+      rc = -1;
+      break;
+    }
+    add_count(&ctx, e, 1);
+  }
+
+  if (rc == 0) {
+    rc = finish_level(&top, &ctx);
+  }
+  spiller_close(&top);
+  wc_table_destroy(ctx.table);
+  wc_reader_free(&reader);
+  return rc;
+}
@@ -0,0 +1,49 @@
+#ifndef WCSPILL_H
+#define WCSPILL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "wctable.h"
+
+// External-memory word counting for vocabularies that don't fit
+// in memory.
+//
+// Words are counted in a WcTable as usual until the table reaches
+// the memory budget. The table is then written out as (word, count)
+// records to one of several partition files chosen by the word's
+// hash, emptied, and reused. At the end each partition is counted
+// on its own; since a word always lands in the same partition, the
+// partitions' unique words and most frequent words combine into
+// the exact result of an in-memory run. A partition that still
+// doesn't fit is split again with a different hash, up to a fixed
+// depth.
+//
+// All spill I/O goes through large stdio buffers, so reads and
+// writes are sequential.
+
+struct WcSpillOptions {
+  size_t memory_budget;     // bytes the table may use before spilling
+  unsigned num_partitions;  // partition files per spill level (0 for default)
+  const char *tmp_dir;      // directory for spill files (NULL for $TMPDIR or /tmp)
+  const struct WcStopSet *stop_words;  // words not counted, or NULL
+};
+
+struct WcSpillStats {
+  unsigned num_spills;      // times a full table was written out
+  uint64_t bytes_spilled;   // total bytes written to partition files
+  unsigned max_depth;       // deepest partitioning level used
+  uint64_t num_clamped;     // times a word's count was clamped at UINT32_MAX
+};
+
+// Count the words read from in (with a WcWordReader, normalized as
+// c_wordcount does) within the given memory budget, storing the
+// result in summary. stats may be NULL. A word's count is kept in a
+// WordEntry, so a count beyond UINT32_MAX is clamped there (and
+// counted in num_clamped).
+// Returns 0 on success, -1 if the input or a spill file could not be
+// read, or a spill file could not be created or written.
+int wc_spill_count(FILE *in, const struct WcSpillOptions *opts,
+                   struct WcSummary *summary, struct WcSpillStats *stats);
+
+#endif // WCSPILL_H
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wcpipe.h"
+#include "wcstop.h"
+
+// Largest displacement tried for a bucket before giving up on a seed
+#define MAX_DISP 0xFFFF
+
+// Number of seeds tried before giving up on building a set
+#define MAX_SEEDS 64
+
+// Compare word pointers for sorting.
+static int compare_words(const void *a, const void *b) {
+  return wc_str_compare(*(const unsigned char *const *) a, *(const unsigned char *const *) b);
+}
+
+// Per-word data while a set is being built
+struct BuildKey {
+  uint64_t hash;
+  uint32_t len;
+  uint32_t offset;
+};
+
+// Try to place every key with the given seed, filling in disp and
+// slots. bucket_order and bucket_start must have room for
+// num_buckets and num_buckets + 1 entries. Returns 0 on success,
+// -1 if some bucket couldn't be placed.
+static int try_seed(struct WcStopSet *s, uint16_t *disp, struct WcStopSlot *slots,
+                    struct BuildKey *keys, uint32_t *key_order,
+                    uint32_t *bucket_order, uint32_t *bucket_start,
+                    const unsigned char *const *words) {
+  uint32_t n = s->num_words;
+  uint32_t nb = s->num_buckets;
+
+  for (uint32_t i = 0; i < n; i++) {
+    size_t len;
+    keys[i].hash = wc_stop_hash(s->seed, words[i], &len);
+  }
+
+  // group the keys by bucket (a counting sort)
+  memset(bucket_start, 0, (nb + 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; i++) {
+    bucket_start[wc_stop_bucket(s, keys[i].hash) + 1]++;
+  }
+  for (uint32_t b = 0; b < nb; b++) {
+    bucket_start[b + 1] += bucket_start[b];
+  }
+  uint32_t *fill = bucket_order;   // borrowed as scratch for now
+  memcpy(fill, bucket_start, nb * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; i++) {
+    key_order[fill[wc_stop_bucket(s, keys[i].hash)]++] = i;
+  }
+
+  // place the largest buckets first, while most slots are free
+  for (uint32_t b = 0; b < nb; b++) {
+    bucket_order[b] = b;
+  }
+  for (uint32_t i = 1; i < nb; i++) {
+    uint32_t b = bucket_order[i];
+    uint32_t size = bucket_start[b + 1] - bucket_start[b];
+    uint32_t j = i;
+    while (j > 0 && bucket_start[bucket_order[j - 1] + 1] - bucket_start[bucket_order[j - 1]] < size) {
+      bucket_order[j] = bucket_order[j - 1];
+      j--;
+    }
+    bucket_order[j] = b;
+  }
+
+  for (uint32_t i = 0; i < s->num_slots; i++) {
+    slots[i].len = WC_STOP_EMPTY;
+  }
+  for (uint32_t i = 0; i < nb; i++) {
+    uint32_t b = bucket_order[i];
+    uint32_t lo = bucket_start[b], hi = bucket_start[b + 1];
+    disp[b] = 0;
+    if (lo == hi) {
+      continue;
+    }
+
+    uint32_t d;
+    for (d = 0; d <= MAX_DISP; d++) {
+      uint32_t j;
+      for (j = lo; j < hi; j++) {
+        uint32_t slot = wc_stop_slot(s, keys[key_order[j]].hash, d);
+        if (slots[slot].len != WC_STOP_EMPTY) {
+          break;
+        }
+        // claim the slot now, so that two keys of this bucket can't
+        // share it
+        slots[slot].len = 0;
+      }
+      if (j == hi) {
+        break;
+      }
+      // undo the partial placement
+      for (uint32_t k = lo; k < j; k++) {
+        slots[wc_stop_slot(s, keys[key_order[k]].hash, d)].len = WC_STOP_EMPTY;
+      }
+    }
+    if (d > MAX_DISP) {
+      return -1;
+    }
+
+    disp[b] = (uint16_t) d;
+    for (uint32_t j = lo; j < hi; j++) {
+      const struct BuildKey *key = &keys[key_order[j]];
+      struct WcStopSlot *slot = &slots[wc_stop_slot(s, key->hash, d)];
+      slot->hash = (uint32_t) (key->hash >> 32);
+      slot->offset = key->offset;
+      slot->len = (uint8_t) key->len;
+    }
+  }
+  return 0;
+}
+
+struct WcStopSet *wc_stop_build(const unsigned char *const *words, uint32_t n) {
+  // sort a copy of the list so duplicates are adjacent
+  const unsigned char **unique = (const unsigned char **) malloc((n ? n : 1) * sizeof(unsigned char *));
+  if (unique == NULL) {
+    return NULL;
+  }
+  memcpy(unique, words, n * sizeof(unsigned char *));
+  qsort(unique, n, sizeof(unsigned char *), compare_words);
+  uint32_t num_unique = 0;
+  size_t pool_size = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (num_unique == 0 || wc_str_compare(unique[num_unique - 1], unique[i]) != 0) {
+      unique[num_unique++] = unique[i];
+      pool_size += strlen((const char *) unique[i]) + 1;
+    }
+  }
+
+  // about three words per bucket and a fifth of the slots empty
+  uint32_t num_buckets = num_unique / 3 + 1;
+  uint32_t num_slots = num_unique + num_unique / 4 + 1;
+
+  // the set and its arrays are a single allocation
+  size_t disp_offset = sizeof(struct WcStopSet);
+  size_t slots_offset = (disp_offset + num_buckets * sizeof(uint16_t) + 7) & ~(size_t) 7;
+  size_t pool_offset = slots_offset + num_slots * sizeof(struct WcStopSlot);
+  unsigned char *block = (unsigned char *) malloc(pool_offset + pool_size + 1);
+  struct BuildKey *keys = (struct BuildKey *) malloc((num_unique + 1) * sizeof(struct BuildKey));
+  uint32_t *scratch = (uint32_t *) malloc((num_unique + 2 * num_buckets + 2) * sizeof(uint32_t));
+  if (block == NULL || keys == NULL || scratch == NULL) {
+    free(block);
+    free(keys);
+    free(scratch);
+    free(unique);
+    return NULL;
+  }
+
+  struct WcStopSet *s = (struct WcStopSet *) block;
+  uint16_t *disp = (uint16_t *) (block + disp_offset);
+  struct WcStopSlot *slots = (struct WcStopSlot *) (block + slots_offset);
+  char *pool = (char *) (block + pool_offset);
+  s->num_words = num_unique;
+  s->num_buckets = num_buckets;
+  s->num_slots = num_slots;
+  s->max_len = 0;
+  s->disp = disp;
+  s->slots = slots;
+  s->pool = pool;
+
+  size_t offset = 0;
+  for (uint32_t i = 0; i < num_unique; i++) {
+    size_t len = strlen((const char *) unique[i]);
+    memcpy(pool + offset, unique[i], len + 1);
+    keys[i].len = (uint32_t) len;
+    keys[i].offset = (uint32_t) offset;
+    offset += len + 1;
+    if (len > s->max_len) {
+      s->max_len = (uint32_t) len;
+    }
+  }
+  pool[offset] = '\0';
+
+  int rc = -1;
+  for (uint64_t seed = 0; seed < MAX_SEEDS && rc != 0; seed++) {
+    s->seed = seed * 0x9E3779B97F4A7C15ULL;
+    rc = try_seed(s, disp, slots, keys, scratch, scratch + num_unique,
+                  scratch + num_unique + num_buckets, unique);
+  }
+
+  free(keys);
+  free(scratch);
+  free(unique);
+  if (rc != 0) {
+    free(block);
+    return NULL;
+  }
+  return s;
+}
+
+// Read the next word of a word list into w with the splitter,
+// skipping comment lines. *line_start tracks whether the next
+// character begins a line. Returns 0 at the end of the list.
+static int next_list_word(FILE *in, struct WcSplitter *s, int *line_start, unsigned char *w) {
+  int c;
+  while ((c = getc(in)) != EOF) {
+    if (*line_start && c == '#') {
+      // a comment runs to the end of its line, however long
+      do {
+        c = getc(in);
+      } while (c != EOF && c != '\n');
+      continue;
+    }
+    *line_start = c == '\n';
+    if (wc_splitter_add_char(s, (unsigned char) c, w)) {
+      return 1;
+    }
+  }
+  return wc_splitter_finish(s, w);
+}
+
+struct WcStopSet *wc_stop_load(const char *filename) {
+  FILE *in = fopen(filename, "r");
+  if (!in) {
+    return NULL;
+  }
+
+  unsigned char **words = NULL;
+  uint32_t n = 0, cap = 0;
+  struct WcSplitter splitter;
+  unsigned char word[MAX_WORDLEN + 1];
+  int line_start = 1;
+  int ok = 1;
+  wc_splitter_init(&splitter);
+  while (ok && next_list_word(in, &splitter, &line_start, word)) {
+    wc_tolower(word);
+    wc_trim_non_alpha(word);
+    if (word[0] == '\0') {
+      continue;
+    }
+    if (n == cap) {
+      cap = cap ? cap * 2 : 256;
+      unsigned char **p = (unsigned char **) realloc(words, cap * sizeof(unsigned char *));
+      if (p == NULL) {
+        ok = 0;
+        break;
+      }
+      words = p;
+    }
+    words[n] = (unsigned char *) strdup((const char *) word);
+    if (words[n] == NULL) {
+      ok = 0;
+      break;
+    }
+    n++;
+  }
+  if (ferror(in)) {
+    ok = 0;
+  }
+  fclose(in);
+
+  struct WcStopSet *s = ok ? wc_stop_build((const unsigned char *const *) words, n) : NULL;
+  for (uint32_t i = 0; i < n; i++) {
+    free(words[i]);
+  }
+  free(words);
+  return s;
+}
+
+void wc_stop_free(struct WcStopSet *s) {
+  free(s);
+}
@@ -0,0 +1,106 @@
+#ifndef WCSTOP_H
+#define WCSTOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "wcfuncs.h"
+
+// Stop-word filter based on a perfect hash.
+//
+// Every word in the set hashes to its own slot, so a lookup costs
+// one hash of the word, two table reads and (only when the stored
+// hash matches) one memcmp. The hash is a two-level scheme ("hash
+// and displace"): the word's 64-bit hash picks a bucket, and the
+// bucket's displacement value, found when the set is built, moves
+// all of the bucket's words to slots no other word uses.
+//
+// The built-in set, wc_stop_builtin, is generated at build time by
+// wcstopgen from a word list (stopwords.txt unless the STOPWORDS make
+// variable names another). wc_stop_load builds a set from a list
+// at runtime with the same algorithm.
+//
+// Words in a list are separated by whitespace; a line starting with
+// '#' is a comment. Lines may be of any length; a run of more than
+// MAX_WORDLEN characters is split into words as the word reader
+// splits it (see wcpipe.h). Each word is normalized with wc_tolower
+// and wc_trim_non_alpha, as counted words are, and words that
+// normalize to nothing are ignored.
+
+// Marks an empty slot (no word is this long)
+#define WC_STOP_EMPTY 0xFF
+
+struct WcStopSlot {
+  uint32_t hash;     // high half of the word's hash
+  uint32_t offset;   // offset of the word in the pool
+  uint8_t len;       // length of the word, or WC_STOP_EMPTY
+};
+
+struct WcStopSet {
+  uint64_t seed;
+  uint32_t num_words;
+  uint32_t num_buckets;
+  uint32_t num_slots;
+  uint32_t max_len;
+  const uint16_t *disp;            // displacement of each bucket
+  const struct WcStopSlot *slots;
+  const char *pool;                // the words, NUL-terminated
+};
+
+// The set generated from the build-time word list
+extern const struct WcStopSet wc_stop_builtin;
+
+// Hash the word w with the given seed, storing its length in *len.
+static inline uint64_t wc_stop_hash(uint64_t seed, const unsigned char *w, size_t *len) {
+  uint64_t h = 0xCBF29CE484222325ULL ^ seed;
+  size_t n = 0;
+  for (; w[n] != '\0'; n++) {
+    h = (h ^ w[n]) * 0x100000001B3ULL;
+  }
+  h ^= h >> 29;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 32;
+  *len = n;
+  return h;
+}
+
+// Return the bucket of a word with hash h.
+static inline uint32_t wc_stop_bucket(const struct WcStopSet *s, uint64_t h) {
+  return (uint32_t) (((h & 0xFFFFFFFFU) * s->num_buckets) >> 32);
+}
+
+// Return the slot of a word with hash h in a bucket with
+// displacement d.
+static inline uint32_t wc_stop_slot(const struct WcStopSet *s, uint64_t h, uint32_t d) {
+  uint32_t x = (uint32_t) (h >> 32) ^ (d * 0x9E3779B1U);
+  x ^= x >> 16;
+  x *= 0x85EBCA6BU;
+  x ^= x >> 13;
+  return (uint32_t) (((uint64_t) x * s->num_slots) >> 32);
+}
+
+// Return 1 if the (normalized) word w is in the set, 0 otherwise.
+static inline int wc_stop_contains(const struct WcStopSet *s, const unsigned char *w) {
+  if (s->num_words == 0) {
+    return 0;
+  }
+  size_t len;
+  uint64_t h = wc_stop_hash(s->seed, w, &len);
+  const struct WcStopSlot *slot = &s->slots[wc_stop_slot(s, h, s->disp[wc_stop_bucket(s, h)])];
+  return slot->hash == (uint32_t) (h >> 32) && slot->len == len
+    && memcmp(s->pool + slot->offset, w, len) == 0;
+}
+
+// Build a set from n words (which must already be normalized and
+// non-empty; duplicates are allowed).
+// Returns NULL if memory could not be allocated.
+struct WcStopSet *wc_stop_build(const unsigned char *const *words, uint32_t n);
+
+// Read a word list from a file and build a set from it.
+// Returns NULL if the file can't be read or memory runs out.
+struct WcStopSet *wc_stop_load(const char *filename);
+
+// Free a set returned by wc_stop_build or wc_stop_load.
+void wc_stop_free(struct WcStopSet *s);
+
+#endif // WCSTOP_H
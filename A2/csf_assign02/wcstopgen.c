@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "wcstop.h"
+
+// Build-time generator for the built-in stop-word set.
+//
+// Usage: wcstopgen wordlist out.c
+//
+// Builds the perfect hash for the words in wordlist (see wcstop.h)
+// and writes it to out.c as constant tables defining wc_stop_builtin,
+// so the program that links it needs no setup at startup.
+
+static void write_set(FILE *out, const struct WcStopSet *s, const char *list_name) {
+  fprintf(out, "// Generated by wcstopgen from %s; do not edit.\n", list_name);
+  fprintf(out, "#include \"wcstop.h\"\n\n");
+
+  fprintf(out, "static const uint16_t disp[%u] = {", (unsigned) s->num_buckets);
+  for (uint32_t i = 0; i < s->num_buckets; i++) {
+    fprintf(out, "%s%u,", i % 12 == 0 ? "\n  " : " ", (unsigned) s->disp[i]);
+  }
+  fprintf(out, "\n};\n\n");
+
+  fprintf(out, "static const struct WcStopSlot slots[%u] = {", (unsigned) s->num_slots);
+  for (uint32_t i = 0; i < s->num_slots; i++) {
+    const struct WcStopSlot *slot = &s->slots[i];
+    if (slot->len == WC_STOP_EMPTY) {
+      fprintf(out, "\n  { 0, 0, WC_STOP_EMPTY },");
+    } else {
+      fprintf(out, "\n  { 0x%08XU, %u, %u },  // %s", (unsigned) slot->hash,
+              (unsigned) slot->offset, (unsigned) slot->len, s->pool + slot->offset);
+    }
+  }
+  fprintf(out, "\n};\n\n");
+
+  // the pool is written as one string literal per word, so each
+  // word's NUL terminator comes from its literal
+  fprintf(out, "static const char pool[] =");
+  size_t offset = 0;
+  for (uint32_t i = 0; i < s->num_words; i++) {
+    fprintf(out, "\n  \"");
+    for (; s->pool[offset] != '\0'; offset++) {
+      unsigned char c = (unsigned char) s->pool[offset];
+      if (c == '"' || c == '\\') {
+        fprintf(out, "\\%c", c);
+      } else if (c < 0x20 || c >= 0x7F) {
+        fprintf(out, "\\%03o", c);
+      } else {
+        fputc(c, out);
+      }
+    }
+    fprintf(out, "\\0\"");
+    offset++;
+  }
+  fprintf(out, "%s;\n\n", s->num_words == 0 ? " \"\"" : "");
+
+  fprintf(out, "const struct WcStopSet wc_stop_builtin = {\n");
+  fprintf(out, "  0x%016llXULL, %u, %u, %u, %u, disp, slots, pool\n};\n",
+          (unsigned long long) s->seed, (unsigned) s->num_words, (unsigned) s->num_buckets,
+          (unsigned) s->num_slots, (unsigned) s->max_len);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: wcstopgen wordlist out.c\n");
+    return 1;
+  }
+
+  struct WcStopSet *s = wc_stop_load(argv[1]);
+  if (s == NULL) {
+    fprintf(stderr, "Error: Cannot build stop-word set from %s\n", argv[1]);
+    return 1;
+  }
+  FILE *out = fopen(argv[2], "w");
+  if (!out) {
+    fprintf(stderr, "Error: Cannot open output file\n");
+    return 1;
+  }
+  write_set(out, s, argv[1]);
+  if (fclose(out) != 0) {
+    fprintf(stderr, "Error: could not write output file\n");
+    return 1;
+  }
+  wc_stop_free(s);
+  return 0;
+}
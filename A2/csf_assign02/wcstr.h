@@ -0,0 +1,153 @@
+#ifndef WCSTR_H
+#define WCSTR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "wcfuncs.h"
+
+// Word compare, copy and length, a block of bytes at a time.
+//
+// These have the semantics of wc_str_compare, wc_str_copy and strlen
+// for words (of at most MAX_WORDLEN characters), but look at 32 bytes
+// per step with AVX2, 16 with SSE2, or 8 otherwise: one load of each
+// string, a byte-wise compare, and a bit mask of the bytes where the
+// strings differ or the first one ends.
+//
+// A block may extend past the end of a string. Reading it is safe as
+// long as it doesn't reach into the next page, which might not be
+// mapped; a block that could is handled a byte at a time instead.
+// wc_word_copy also writes whole blocks, so its destination must be a
+// buffer of MAX_WORDLEN + 1 bytes (such as WordEntry.word), whose
+// bytes after the terminator may change.
+
+#define WC_STR_PAGE_SIZE 4096
+
+#if defined(__AVX2__)
+#define WC_STR_BLOCK 32
+#elif defined(__SSE2__)
+#define WC_STR_BLOCK 16
+#else
+#define WC_STR_BLOCK 8
+#endif
+
+// Return 1 if a block read at p could reach the next page.
+static inline int wc_str_near_page_end(const unsigned char *p) {
+  return ((uintptr_t) p & (WC_STR_PAGE_SIZE - 1)) > WC_STR_PAGE_SIZE - WC_STR_BLOCK;
+}
+
+// Mask of the bytes of the blocks at a and b where they differ or a
+// has a NUL (only the lowest set bit is exact); wc_str_first turns
+// its lowest set bit into a byte offset.
+static inline uint64_t wc_str_stop_mask(const unsigned char *a, const unsigned char *b) {
+#if defined(__AVX2__)
+  __m256i x = _mm256_loadu_si256((const __m256i *) a);
+  __m256i y = _mm256_loadu_si256((const __m256i *) b);
+  unsigned diff = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+  unsigned nul = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_setzero_si256()));
+  return diff | nul;
+#elif defined(__SSE2__)
+  __m128i x = _mm_loadu_si128((const __m128i *) a);
+  __m128i y = _mm_loadu_si128((const __m128i *) b);
+  unsigned diff = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFFU;
+  unsigned nul = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128()));
+  return diff | nul;
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  // the high bit of each byte that differs or is a NUL; a borrow can
+  // flag bytes after the first NUL, which doesn't matter
+  uint64_t x, y;
+  memcpy(&x, a, sizeof(x));
+  memcpy(&y, b, sizeof(y));
+  uint64_t diff = x ^ y;
+  diff |= (diff & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL;
+  uint64_t nul = (x - 0x0101010101010101ULL) & ~x;
+  return (diff | nul) & 0x8080808080808080ULL;
+#else
+  uint64_t mask = 0;
+  for (unsigned i = 0; i < WC_STR_BLOCK; i++) {
+    if (a[i] != b[i] || a[i] == '\0') {
+      mask |= 1ULL << i;
+    }
+  }
+  return mask;
+#endif
+}
+
+// Offset of the byte flagged by the lowest set bit of a nonzero mask.
+static inline unsigned wc_str_first(uint64_t mask) {
+#if !defined(__SSE2__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return (unsigned) __builtin_ctzll(mask) / 8;
+#else
+  return (unsigned) __builtin_ctzll(mask);
+#endif
+}
+
+// Compare two words like wc_str_compare.
+static inline int wc_word_compare(const unsigned char *lhs, const unsigned char *rhs) {
+  for (;;) {
+    if (wc_str_near_page_end(lhs) || wc_str_near_page_end(rhs)) {
+      for (unsigned i = 0; i < WC_STR_BLOCK; i++) {
+        if (lhs[i] != rhs[i] || lhs[i] == '\0') {
+          return (lhs[i] > rhs[i]) - (lhs[i] < rhs[i]);
+        }
+      }
+    } else {
+      uint64_t mask = wc_str_stop_mask(lhs, rhs);
+      if (mask != 0) {
+        unsigned i = wc_str_first(mask);
+        return (lhs[i] > rhs[i]) - (lhs[i] < rhs[i]);
+      }
+    }
+    lhs += WC_STR_BLOCK;
+    rhs += WC_STR_BLOCK;
+  }
+}
+
+// Return the length of a word (of at most MAX_WORDLEN characters).
+static inline size_t wc_word_length(const unsigned char *w) {
+  for (size_t off = 0; ; off += WC_STR_BLOCK) {
+    if (wc_str_near_page_end(w + off)) {
+      size_t i = off;
+      while (w[i] != '\0') {
+        i++;
+      }
+      return i;
+    }
+    // a block compared with itself differs nowhere, so the mask is
+    // just its NULs
+    uint64_t mask = wc_str_stop_mask(w + off, w + off);
+    if (mask != 0) {
+      return off + wc_str_first(mask);
+    }
+  }
+}
+
+// Copy a word (of at most MAX_WORDLEN characters) to dest, which must
+// have room for MAX_WORDLEN + 1 bytes, like wc_str_copy. Returns the
+// word's length.
+static inline size_t wc_word_copy(unsigned char *dest, const unsigned char *source) {
+  for (size_t off = 0; ; off += WC_STR_BLOCK) {
+    if (wc_str_near_page_end(source + off)) {
+      size_t i = off;
+      while ((dest[i] = source[i]) != '\0') {
+        i++;
+      }
+      return i;
+    }
+    uint64_t mask = wc_str_stop_mask(source + off, source + off);
+    // the block is stored whole (within dest, since the terminator is
+    // at most MAX_WORDLEN bytes in)
+    memcpy(dest + off, source + off, WC_STR_BLOCK);
+    if (mask != 0) {
+      return off + wc_str_first(mask);
+    }
+  }
+}
+
+#endif // WCSTR_H
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "wcfuncs.h"
+#include "wcstr.h"
+#include "wcutil.h"
+
+// Micro-benchmark for the block-at-a-time word functions.
+//
+// Usage: wcstrbench [-n rounds]
+//
+// For every word length from 1 to MAX_WORDLEN, a set of WordEntry
+// nodes is filled with random words of that length, and the time per
+// call is measured for
+//
+//   - comparing each word with an equal copy (the chain-walk hit,
+//     which reads both words to the end),
+//   - comparing it with a word differing only in its last character,
+//   - copying it into another node,
+//
+// with wc_str_compare/wc_str_copy and wc_word_compare/wc_word_copy.
+// Every result is checked against the byte-at-a-time function.
+
+#define NUM_WORDS 1024
+
+// Calls through these aren't inlined, so both versions pay for a call
+// as they do in the library.
+__attribute__((noinline)) static int block_compare(const unsigned char *a, const unsigned char *b) {
+  return wc_word_compare(a, b);
+}
+
+__attribute__((noinline)) static void block_copy(unsigned char *dest, const unsigned char *source) {
+  wc_word_copy(dest, source);
+}
+
+static struct WordEntry words[NUM_WORDS], equal[NUM_WORDS], differ[NUM_WORDS], copies[NUM_WORDS];
+
+// Time rounds passes of compare over words and others, in ns per call.
+static double time_compare(int (*compare)(const unsigned char *, const unsigned char *),
+                           const struct WordEntry *others, unsigned rounds, long *sum) {
+  double start = wc_now_seconds();
+  for (unsigned r = 0; r < rounds; r++) {
+    for (unsigned i = 0; i < NUM_WORDS; i++) {
+      *sum += compare(words[i].word, others[i].word);
+    }
+  }
+  return (wc_now_seconds() - start) * 1e9 / ((double) rounds * NUM_WORDS);
+}
+
+static double time_copy(void (*copy)(unsigned char *, const unsigned char *), unsigned rounds,
+                        long *sum) {
+  double start = wc_now_seconds();
+  for (unsigned r = 0; r < rounds; r++) {
+    for (unsigned i = 0; i < NUM_WORDS; i++) {
+      copy(copies[i].word, words[i].word);
+    }
+    *sum += copies[r % NUM_WORDS].word[0];
+  }
+  return (wc_now_seconds() - start) * 1e9 / ((double) rounds * NUM_WORDS);
+}
+
+int main(int argc, char **argv) {
+  unsigned rounds = 2000;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+    case 'n':
+      rounds = (unsigned) atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: wcstrbench [-n rounds]\n");
+      return 1;
+    }
+  }
+  if (rounds < 1) {
+    fprintf(stderr, "Error: invalid number of rounds\n");
+    return 1;
+  }
+
+  printf("block size: %d bytes\n", WC_STR_BLOCK);
+  printf("%4s %10s %10s %10s %10s %10s %10s\n", "len", "eq byte", "eq block",
+         "ne byte", "ne block", "cpy byte", "cpy block");
+  srand(1);
+  long sum = 0;
+  for (unsigned len = 1; len <= MAX_WORDLEN; len++) {
+    for (unsigned i = 0; i < NUM_WORDS; i++) {
+      for (unsigned j = 0; j < len; j++) {
+        words[i].word[j] = (unsigned char) ('a' + rand() % 26);
+      }
+      words[i].word[len] = '\0';
+      memcpy(equal[i].word, words[i].word, len + 1);
+      memcpy(differ[i].word, words[i].word, len + 1);
+      differ[i].word[len - 1] ^= 1;
+    }
+    for (unsigned i = 0; i < NUM_WORDS; i++) {
+      block_copy(copies[i].word, words[i].word);
+      if (wc_word_compare(words[i].word, equal[i].word) != wc_str_compare(words[i].word, equal[i].word)
+          || wc_word_compare(words[i].word, differ[i].word) != wc_str_compare(words[i].word, differ[i].word)
+          || wc_str_compare(copies[i].word, words[i].word) != 0) {
+        fprintf(stderr, "Error: results differ for length %u\n", len);
+        return 1;
+      }
+    }
+
+    double eq_byte = time_compare(wc_str_compare, equal, rounds, &sum);
+    double eq_block = time_compare(block_compare, equal, rounds, &sum);
+    double ne_byte = time_compare(wc_str_compare, differ, rounds, &sum);
+    double ne_block = time_compare(block_compare, differ, rounds, &sum);
+    double cpy_byte = time_copy(wc_str_copy, rounds, &sum);
+    double cpy_block = time_copy(block_copy, rounds, &sum);
+    printf("%4u %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", len, eq_byte, eq_block,
+           ne_byte, ne_block, cpy_byte, cpy_block);
+  }
+  // keep the calls from being optimized away
+  if (sum == 42) {
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,499 @@
+#include <stdlib.h>
+#include <string.h>
+#include "wctable.h"
+#include "wcstop.h"
+#include "wcstr.h"
+
+// Default number of buckets (same as c_wordcount's hash table)
+#define WC_TABLE_DEFAULT_BUCKETS 13249
+
+// Grow the bucket array once the average chain is this long
+#define WC_TABLE_MAX_LOAD 4
+
+// A slab of nodes for a placed table.
+struct WcTableSlab {
+  struct WcTableSlab *next;
+  size_t size;
+};
+
+// Size of a node slab when not using huge pages
+#define WC_TABLE_SLAB_SIZE (256 << 10)
+
+static const struct WcMemPolicy *table_policy(const struct WcTable *t) {
+  return t->placed ? &t->placement : NULL;
+}
+
+// Allocate an empty table with the given number of buckets.
+struct WcTable *wc_table_create(unsigned num_buckets) {
+  return wc_table_create_placed(num_buckets, NULL);
+}
+
+// Allocate an empty table with its memory placed under a policy.
+struct WcTable *wc_table_create_placed(unsigned num_buckets, const struct WcMemPolicy *p) {
+  if (num_buckets == 0) {
+    num_buckets = WC_TABLE_DEFAULT_BUCKETS;
+  }
+
+  struct WcTable *t = (struct WcTable *) malloc(sizeof(struct WcTable));
+  if (t == NULL) {
+    return NULL;
+  }
+  t->placed = p != NULL;
+  if (p != NULL) {
+    t->placement = *p;
+  }
+  t->buckets = (struct WordEntry **) wc_mem_alloc(num_buckets * sizeof(struct WordEntry *), p);
+  t->touched = (unsigned *) wc_mem_alloc(num_buckets * sizeof(unsigned), p);
+  if (t->buckets == NULL || t->touched == NULL) {
+    wc_mem_free(t->buckets, num_buckets * sizeof(struct WordEntry *), p);
+    wc_mem_free(t->touched, num_buckets * sizeof(unsigned), p);
+    free(t);
+    return NULL;
+  }
+  t->num_buckets = num_buckets;
+  t->num_touched = 0;
+  t->free_nodes = NULL;
+  t->num_entries = 0;
+  t->num_nodes = 0;
+  t->total_words = 0;
+  t->unique_words = 0;
+  t->best_word[0] = '\0';
+  t->best_word_count = 0;
+  t->num_dropped = 0;
+  t->stop_words = NULL;
+  t->slabs = NULL;
+  t->slab_next = NULL;
+  t->slab_end = NULL;
+  return t;
+}
+
+// Free a table and all of its nodes (including recycled ones).
+void wc_table_destroy(struct WcTable *t) {
+  if (t == NULL) {
+    return;
+  }
+  const struct WcMemPolicy *p = table_policy(t);
+  if (p == NULL) {
+    for (unsigned i = 0; i < t->num_touched; i++) {
+      wc_free_chain(t->buckets[t->touched[i]]);
+    }
+    wc_free_chain(t->free_nodes);
+  }
+  while (t->slabs != NULL) {
+    struct WcTableSlab *next = t->slabs->next;
+    wc_mem_free(t->slabs, t->slabs->size, p);
+    t->slabs = next;
+  }
+  wc_mem_free(t->buckets, t->num_buckets * sizeof(struct WordEntry *), p);
+  wc_mem_free(t->touched, t->num_buckets * sizeof(unsigned), p);
+  free(t);
+}
+
+// Allocate a new node (from malloc, or the newest slab of a placed
+// table).
+static struct WordEntry *wc_table_new_node(struct WcTable *t) {
+  if (!t->placed) {
+    return (struct WordEntry *) malloc(sizeof(struct WordEntry));
+  }
+  if (t->slab_end - t->slab_next < (ptrdiff_t) sizeof(struct WordEntry)) {
+    size_t size = t->placement.pages != WC_PAGES_DEFAULT ? WC_HUGE_PAGE_SIZE : WC_TABLE_SLAB_SIZE;
+    struct WcTableSlab *slab = (struct WcTableSlab *) wc_mem_alloc(size, &t->placement);
+    if (slab == NULL) {
+      return NULL;
+    }
+    slab->next = t->slabs;
+    slab->size = size;
+    t->slabs = slab;
+    t->slab_next = (char *) slab + 64;    // nodes start on a cache line
+    t->slab_end = (char *) slab + size;
+  }
+  struct WordEntry *node = (struct WordEntry *) t->slab_next;
+  t->slab_next += sizeof(struct WordEntry);
+  return node;
+}
+
+// Rehash every entry into a bucket array roughly twice as large.
+// If the new arrays can't be allocated, the table keeps its current
+// size (lookups stay correct, just slower).
+static void wc_table_grow(struct WcTable *t) {
+  const struct WcMemPolicy *p = table_policy(t);
+  unsigned new_size = t->num_buckets * 2 + 1;
+  struct WordEntry **new_buckets = (struct WordEntry **) wc_mem_alloc(new_size * sizeof(struct WordEntry *), p);
+  unsigned *new_touched = (unsigned *) wc_mem_alloc(new_size * sizeof(unsigned), p);
+  if (new_buckets == NULL || new_touched == NULL) {
+    wc_mem_free(new_buckets, new_size * sizeof(struct WordEntry *), p);
+    wc_mem_free(new_touched, new_size * sizeof(unsigned), p);
+    return;
+  }
+
+  unsigned new_num_touched = 0;
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    struct WordEntry *p = t->buckets[t->touched[i]];
+    while (p != NULL) {
+      struct WordEntry *next = p->next;
+      unsigned index = wc_hash(p->word) % new_size;
+      if (new_buckets[index] == NULL) {
+        new_touched[new_num_touched++] = index;
+      }
+      p->next = new_buckets[index];
+      new_buckets[index] = p;
+      p = next;
+    }
+  }
+
+  wc_mem_free(t->buckets, t->num_buckets * sizeof(struct WordEntry *), p);
+  wc_mem_free(t->touched, t->num_buckets * sizeof(unsigned), p);
+  t->buckets = new_buckets;
+  t->touched = new_touched;
+  t->num_buckets = new_size;
+  t->num_touched = new_num_touched;
+}
+
+// Find or insert the WordEntry for s.
+struct WordEntry *wc_table_find_or_insert(struct WcTable *t, const unsigned char *s) {
+  unsigned index = wc_hash(s) % t->num_buckets;
+
+  for (struct WordEntry *p = t->buckets[index]; p != NULL; p = p->next) {
+    if (wc_word_compare(p->word, s) == 0) {
+      return p;
+    }
+  }
+
+  struct WordEntry *node = t->free_nodes;
+  if (node != NULL) {
+    t->free_nodes = node->next;
+  } else {
+    node = wc_table_new_node(t);
+    if (node == NULL) {
+      return NULL;
+    }
+    t->num_nodes++;
+  }
+  wc_word_copy(node->word, s);
+  node->count = 0;
+
+  if (t->buckets[index] == NULL) {
+    t->touched[t->num_touched++] = index;
+  }
+  node->next = t->buckets[index];
+  t->buckets[index] = node;
+  t->num_entries++;
+
+  if (t->num_entries > WC_TABLE_MAX_LOAD * t->num_buckets) {
+    wc_table_grow(t);
+  }
+  return node;
+}
+
+// Return the number of bytes of memory held by the table.
+size_t wc_table_memory_usage(const struct WcTable *t) {
+  return (size_t) t->num_buckets * (sizeof(struct WordEntry *) + sizeof(unsigned))
+    + (size_t) t->num_nodes * sizeof(struct WordEntry);
+}
+
+// Count one occurrence of the word in w, updating the summary statistics.
+void wc_table_count_word(struct WcTable *t, unsigned char *w) {
+  wc_tolower(w);
+  wc_trim_non_alpha(w);
+  wc_table_count_normalized(t, w);
+}
+
+// Count one occurrence of an already-normalized word.
+void wc_table_count_normalized(struct WcTable *t, const unsigned char *w) {
+  if (t->stop_words != NULL && wc_stop_contains(t->stop_words, w)) {
+    return;
+  }
+  struct WordEntry *current = wc_table_find_or_insert(t, w);
+  if (current == NULL) {
+    t->num_dropped++;
+    return;
+  }
+  t->total_words++;
+  current->count++;
+  if (current->count == 1) {
+    t->unique_words++;
+  }
+
+  // the best word has the highest count, and among words with
+  // equal counts, the one that compares lowest
+  if (current->count > t->best_word_count) {
+    t->best_word_count = current->count;
+    wc_word_copy(t->best_word, current->word);
+  } else if (current->count == t->best_word_count
+             && wc_word_compare(current->word, t->best_word) < 0) {
+    wc_word_copy(t->best_word, current->word);
+  }
+}
+
+// Count every word in the given in-memory buffer.
+void wc_table_count_buf(struct WcTable *t, const unsigned char *buf, size_t len) {
+  unsigned char word[MAX_WORDLEN + 1];
+  size_t pos = 0;
+
+  while (wc_buf_readnext(buf, len, &pos, word)) {
+    wc_table_count_word(t, word);
+  }
+}
+
+// Add every entry of src to dst.
+int wc_table_merge(struct WcTable *dst, const struct WcTable *src) {
+  for (unsigned i = 0; i < src->num_touched; i++) {
+    for (struct WordEntry *p = src->buckets[src->touched[i]]; p != NULL; p = p->next) {
+      struct WordEntry *q = wc_table_find_or_insert(dst, p->word);
+      if (q == NULL) {
+        return -1;
+      }
+      if (q->count == 0 && p->count > 0) {
+        dst->unique_words++;
+      }
+      q->count += p->count;
+
+      // counts only grow, so checking the updated entries is enough
+      // to keep the best word current
+      if (q->count > dst->best_word_count
+          || (q->count == dst->best_word_count && wc_word_compare(q->word, dst->best_word) < 0)) {
+        dst->best_word_count = q->count;
+        wc_word_copy(dst->best_word, q->word);
+      }
+    }
+  }
+  dst->total_words += src->total_words;
+  return 0;
+}
+
+// Return the WordEntry for s, or NULL if s isn't in the table.
+static struct WordEntry *wc_table_find(const struct WcTable *t, const unsigned char *s) {
+  for (struct WordEntry *p = t->buckets[wc_hash(s) % t->num_buckets]; p != NULL; p = p->next) {
+    if (wc_word_compare(p->word, s) == 0) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+// Subtract every entry of src from dst.
+int wc_table_subtract(struct WcTable *dst, const struct WcTable *src) {
+  for (unsigned i = 0; i < src->num_touched; i++) {
+    for (struct WordEntry *p = src->buckets[src->touched[i]]; p != NULL; p = p->next) {
+      if (p->count == 0) {
+        continue;
+      }
+      struct WordEntry *q = wc_table_find(dst, p->word);
+      if (q == NULL || q->count < p->count) {
+        return -1;
+      }
+      q->count -= p->count;
+      if (q->count == 0) {
+        dst->unique_words--;
+      }
+    }
+  }
+  dst->total_words -= src->total_words;
+  return 0;
+}
+
+// Remove the entries whose count is zero.
+void wc_table_compact(struct WcTable *t) {
+  unsigned num_touched = 0;
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    unsigned index = t->touched[i];
+    struct WordEntry **link = &t->buckets[index];
+    while (*link != NULL) {
+      struct WordEntry *p = *link;
+      if (p->count == 0) {
+        *link = p->next;
+        p->next = t->free_nodes;
+        t->free_nodes = p;
+        t->num_entries--;
+      } else {
+        link = &p->next;
+      }
+    }
+    // buckets left empty are dropped from the touched list, so
+    // wc_table_find_or_insert can add them again
+    if (t->buckets[index] != NULL) {
+      t->touched[num_touched++] = index;
+    }
+  }
+  t->num_touched = num_touched;
+}
+
+// Empty the table so it can be reused.
+void wc_table_reset(struct WcTable *t) {
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    unsigned index = t->touched[i];
+    struct WordEntry *p = t->buckets[index];
+    while (p != NULL) {
+      struct WordEntry *next = p->next;
+      p->next = t->free_nodes;
+      t->free_nodes = p;
+      p = next;
+    }
+    t->buckets[index] = NULL;
+  }
+  t->num_touched = 0;
+  t->num_entries = 0;
+  t->total_words = 0;
+  t->unique_words = 0;
+  t->best_word[0] = '\0';
+  t->best_word_count = 0;
+  t->num_dropped = 0;
+}
+
+// Return 1 if entry a should be reported before entry b.
+static int wc_entry_ranks_before(const void *a, const void *b, const void *arg) {
+  const struct WordEntry *x = *(const struct WordEntry *const *) a;
+  const struct WordEntry *y = *(const struct WordEntry *const *) b;
+  (void) arg;
+  if (x->count != y->count) {
+    return x->count > y->count;
+  }
+  return wc_word_compare(x->word, y->word) < 0;
+}
+
+static void wc_top_k_swap(struct WcTopK *h, unsigned i, unsigned j) {
+  unsigned char *a = h->items + i * h->item_size;
+  unsigned char *b = h->items + j * h->item_size;
+  for (size_t m = 0; m < h->item_size; m++) {
+    unsigned char tmp = a[m];
+    a[m] = b[m];
+    b[m] = tmp;
+  }
+}
+
+// Restore the heap property of the first n items, whose root is the
+// lowest-ranked item, starting from index i.
+static void wc_top_k_sift_down(struct WcTopK *h, unsigned n, unsigned i) {
+  for (;;) {
+    unsigned worst = i;
+    unsigned left = 2 * i + 1;
+    unsigned right = 2 * i + 2;
+    if (left < n && h->ranks_before(h->items + worst * h->item_size,
+                                    h->items + left * h->item_size, h->arg)) {
+      worst = left;
+    }
+    if (right < n && h->ranks_before(h->items + worst * h->item_size,
+                                     h->items + right * h->item_size, h->arg)) {
+      worst = right;
+    }
+    if (worst == i) {
+      return;
+    }
+    wc_top_k_swap(h, i, worst);
+    i = worst;
+  }
+}
+
+void wc_top_k_init(struct WcTopK *h, void *out, size_t item_size, unsigned k,
+                   int (*ranks_before)(const void *a, const void *b, const void *arg),
+                   const void *arg) {
+  h->items = (unsigned char *) out;
+  h->item_size = item_size;
+  h->k = k;
+  h->n = 0;
+  h->ranks_before = ranks_before;
+  h->arg = arg;
+}
+
+void wc_top_k_offer(struct WcTopK *h, const void *item) {
+  if (h->n < h->k) {
+    memcpy(h->items + h->n * h->item_size, item, h->item_size);
+    if (++h->n == h->k) {
+      for (unsigned j = h->k / 2; j-- > 0; ) {
+        wc_top_k_sift_down(h, h->n, j);
+      }
+    }
+  } else if (h->k > 0 && h->ranks_before(item, h->items, h->arg)) {
+    memcpy(h->items, item, h->item_size);
+    wc_top_k_sift_down(h, h->n, 0);
+  }
+}
+
+unsigned wc_top_k_finish(struct WcTopK *h) {
+  if (h->n < h->k) {
+    for (unsigned j = h->n / 2; j-- > 0; ) {
+      wc_top_k_sift_down(h, h->n, j);
+    }
+  }
+  // repeatedly move the lowest-ranked item to the end
+  for (unsigned end = h->n; end > 1; end--) {
+    wc_top_k_swap(h, 0, end - 1);
+    wc_top_k_sift_down(h, end - 1, 0);
+  }
+  return h->n;
+}
+
+// Store pointers to (at most) the k highest-ranked entries in out.
+unsigned wc_table_top_k(const struct WcTable *t, struct WordEntry **out, unsigned k) {
+  struct WcTopK h;
+  wc_top_k_init(&h, out, sizeof(*out), k, wc_entry_ranks_before, NULL);
+  for (unsigned i = 0; i < t->num_touched && k > 0; i++) {
+    for (struct WordEntry *p = t->buckets[t->touched[i]]; p != NULL; p = p->next) {
+      wc_top_k_offer(&h, &p);
+    }
+  }
+  return wc_top_k_finish(&h);
+}
+
+// Set s to the empty summary.
+void wc_summary_init(struct WcSummary *s) {
+  s->total_words = 0;
+  s->unique_words = 0;
+  s->best_word[0] = '\0';
+  s->best_word_count = 0;
+}
+
+// Copy the summary statistics of a table into s.
+void wc_summary_from_table(struct WcSummary *s, const struct WcTable *t) {
+  s->total_words = t->total_words;
+  s->unique_words = t->unique_words;
+  wc_word_copy(s->best_word, t->best_word);
+  s->best_word_count = t->best_word_count;
+}
+
+// Consider (word, count) as the summary's most frequent word.
+void wc_summary_consider(struct WcSummary *s, const unsigned char *word, uint64_t count) {
+  if (count > s->best_word_count
+      || (count == s->best_word_count && wc_word_compare(word, s->best_word) < 0)) {
+    s->best_word_count = count;
+    wc_word_copy(s->best_word, word);
+  }
+}
+
+// Print the summary in c_wordcount's three-line format.
+void wc_summary_print(FILE *out, const struct WcSummary *s) {
+  fprintf(out, "Total words read: %llu\n", (unsigned long long) s->total_words);
+  fprintf(out, "Unique words read: %llu\n", (unsigned long long) s->unique_words);
+  fprintf(out, "Most frequent word: %s (%llu)\n", (const char *) s->best_word,
+          (unsigned long long) s->best_word_count);
+}
+
+// Read the next word from an in-memory buffer.
+int wc_buf_readnext(const unsigned char *buf, size_t len, size_t *pos, unsigned char *w) {
+  size_t i = *pos;
+
+  while (i < len && wc_isspace(buf[i])) {
+    i++;
+  }
+  if (i == len) {
+    *pos = i;
+    *w = '\0';
+    return 0;
+  }
+
+  unsigned n = 0;
+  while (i < len && !wc_isspace(buf[i]) && n < MAX_WORDLEN) {
+    w[n++] = buf[i++];
+  }
+  w[n] = '\0';
+  *pos = i;
+  return 1;
+}
+
+// Return the first word boundary at or after pos.
+size_t wc_buf_word_boundary(const unsigned char *buf, size_t len, size_t pos) {
+  while (pos < len && !wc_isspace(buf[pos])) {
+    pos++;
+  }
+  return pos;
+}
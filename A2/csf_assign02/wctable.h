@@ -0,0 +1,183 @@
+#ifndef WCTABLE_H
+#define WCTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "wcfuncs.h"
+#include "wcmem.h"
+
+// A reusable word-count table built on the same chained buckets
+// as wc_dict_find_or_insert.
+//
+// Unlike a plain array of bucket heads, the table remembers which
+// buckets have become non-empty since the last reset, so clearing it
+// costs time proportional to the number of distinct words counted
+// rather than the number of buckets. Nodes are recycled through a
+// free list instead of being handed back to free, so a warm table
+// can count a new document without calling malloc.
+//
+// The table also keeps the same summary statistics that c_wordcount
+// prints: total words, unique words, and the most frequent word
+// (ties broken in favor of the lexicographically smaller word).
+//
+// Setting stop_words (NULL after wc_table_create) makes
+// wc_table_count_word skip the words in that set (see wcstop.h).
+//
+// A table made by wc_table_create_placed maps its bucket arrays and
+// nodes under a placement policy (see wcmem.h) instead of using
+// malloc; its nodes are carved from slabs freed with the table.
+struct WcTable {
+  struct WordEntry **buckets;
+  unsigned num_buckets;
+  unsigned *touched;      // indices of non-empty buckets
+  unsigned num_touched;
+  struct WordEntry *free_nodes;
+  uint32_t num_entries;   // number of WordEntry nodes in the buckets
+  uint32_t num_nodes;     // nodes allocated, including recycled ones
+  uint32_t total_words;
+  uint32_t unique_words;
+  unsigned char best_word[MAX_WORDLEN + 1];
+  uint32_t best_word_count;
+  uint32_t num_dropped;   // words lost because memory ran out
+  const struct WcStopSet *stop_words;   // words not counted, or NULL
+  int placed;             // memory is mapped under placement
+  struct WcMemPolicy placement;
+  struct WcTableSlab *slabs;            // node slabs (if placed)
+  char *slab_next;        // free space in the newest slab
+  char *slab_end;
+};
+
+// Summary statistics of a counting run, with counters wide enough
+// for runs whose results are combined from several tables.
+struct WcSummary {
+  uint64_t total_words;
+  uint64_t unique_words;
+  unsigned char best_word[MAX_WORDLEN + 1];
+  uint64_t best_word_count;
+};
+
+// Allocate an empty table with the given number of buckets.
+// If num_buckets is 0, a default size is used. The bucket array
+// grows automatically when the chains get long.
+// Returns NULL if memory could not be allocated.
+struct WcTable *wc_table_create(unsigned num_buckets);
+
+// Allocate an empty table like wc_table_create, with its memory placed
+// under the policy p (NULL for malloc). With a NUMA policy that
+// follows the first touch, create the table from the thread using it.
+struct WcTable *wc_table_create_placed(unsigned num_buckets, const struct WcMemPolicy *p);
+
+// Free a table and all of its nodes (including recycled ones).
+void wc_table_destroy(struct WcTable *t);
+
+// Find or insert the WordEntry for s. A newly-inserted entry
+// has its count set to 0; it is the caller's job to update it.
+// Returns NULL only if a new node could not be allocated.
+struct WordEntry *wc_table_find_or_insert(struct WcTable *t, const unsigned char *s);
+
+// Return the number of bytes of memory held by the table: the bucket
+// arrays plus every node allocated so far, including recycled ones.
+size_t wc_table_memory_usage(const struct WcTable *t);
+
+// Count one occurrence of the word in w, updating the summary
+// statistics. The word is normalized in place with wc_tolower and
+// wc_trim_non_alpha first, exactly as c_wordcount does. If the table
+// has a stop-word set, a normalized word in the set is skipped and
+// doesn't count towards the total either. A word that can't be
+// added because memory ran out is counted in num_dropped instead.
+void wc_table_count_word(struct WcTable *t, unsigned char *w);
+
+// Count one occurrence of a word that has already been normalized
+// (used by tokenizers with their own normalization, such as
+// wc_utf8_count_word).
+void wc_table_count_normalized(struct WcTable *t, const unsigned char *w);
+
+// Count every word in the given in-memory buffer.
+void wc_table_count_buf(struct WcTable *t, const unsigned char *buf, size_t len);
+
+// Add every entry of src (and its total word count) to dst,
+// updating dst's summary statistics.
+// Returns 0 on success, -1 if memory could not be allocated.
+int wc_table_merge(struct WcTable *dst, const struct WcTable *src);
+
+// Subtract every entry of src (and its total word count) from dst,
+// undoing an earlier wc_table_merge of src into dst. Runs in time
+// proportional to the number of entries in src. Entries that drop to
+// zero stay in dst (with a zero count) until wc_table_compact, and
+// dst's best word isn't updated, so use wc_table_top_k afterwards.
+// Returns 0 on success, -1 if some word of src has a lower count in
+// dst (dst is then partly updated).
+int wc_table_subtract(struct WcTable *dst, const struct WcTable *src);
+
+// Remove the entries whose count is zero, recycling their nodes.
+// Runs in time proportional to the number of touched buckets.
+void wc_table_compact(struct WcTable *t);
+
+// Empty the table so it can be reused. Runs in time proportional
+// to the number of buckets touched since the previous reset.
+void wc_table_reset(struct WcTable *t);
+
+// Store pointers to (at most) the k entries with the highest counts
+// in out, ordered by descending count and then ascending word.
+// Returns the number of entries stored.
+unsigned wc_table_top_k(const struct WcTable *t, struct WordEntry **out, unsigned k);
+
+// Selection of the k highest-ranked items of a stream, for the
+// top-K queries over any kind of item. The items (of item_size bytes
+// each, such as pointers or ids) are kept in a caller-provided array
+// of k as a heap whose root is the lowest-ranked of them, so each
+// offered item costs at most O(log k) comparisons.
+struct WcTopK {
+  unsigned char *items;
+  size_t item_size;
+  unsigned k;
+  unsigned n;
+  // 1 if the item at a should be reported before the one at b
+  int (*ranks_before)(const void *a, const void *b, const void *arg);
+  const void *arg;
+};
+
+// Start a selection of at most k items into out.
+void wc_top_k_init(struct WcTopK *h, void *out, size_t item_size, unsigned k,
+                   int (*ranks_before)(const void *a, const void *b, const void *arg),
+                   const void *arg);
+
+// Consider the item at item.
+void wc_top_k_offer(struct WcTopK *h, const void *item);
+
+// Sort the selected items, highest-ranked first, and return how many
+// there are.
+unsigned wc_top_k_finish(struct WcTopK *h);
+
+// Set s to the empty summary.
+void wc_summary_init(struct WcSummary *s);
+
+// Copy the summary statistics of a table into s.
+void wc_summary_from_table(struct WcSummary *s, const struct WcTable *t);
+
+// Make (word, count) the summary's most frequent word if count is
+// higher than the current best, or equal to it and word compares
+// lower. Used when a word's final count is known.
+void wc_summary_consider(struct WcSummary *s, const unsigned char *word, uint64_t count);
+
+// Print the summary in c_wordcount's three-line format.
+void wc_summary_print(FILE *out, const struct WcSummary *s);
+
+// Read the next word from the buffer buf of len bytes, starting at
+// the offset pointed-to by pos, and advance *pos past it. The word is
+// stored in w (which must have room for MAX_WORDLEN+1 characters).
+// Returns 1 if a word was read, 0 if the buffer has no more words.
+//
+// Words are delimited by wc_isspace characters, as for wc_readnext.
+// A run of more than MAX_WORDLEN non-whitespace characters is
+// returned as several consecutive words of at most MAX_WORDLEN
+// characters each.
+int wc_buf_readnext(const unsigned char *buf, size_t len, size_t *pos, unsigned char *w);
+
+// Return the first offset at or after pos that is either len or the
+// offset of a whitespace character. Splitting a buffer at such
+// offsets never splits a word, so the pieces can be tokenized
+// independently with wc_buf_readnext.
+size_t wc_buf_word_boundary(const unsigned char *buf, size_t len, size_t pos);
+
+#endif // WCTABLE_H
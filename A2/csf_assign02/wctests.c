@@ -1,7 +1,27 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "tctest.h"
 #include "wcfuncs.h"
+#include "wctable.h"
+#include "wcsnapshot.h"
+#include "wcspill.h"
+#include "wcngram.h"
+#include "wcconcdict.h"
+#include "wcpipe.h"
+#include "wcexport.h"
+#include "wcart.h"
+#include "wcstop.h"
+#include "wcutf8.h"
+#include "wcwindow.h"
+#include "wcfiles.h"
+#include "wctfidf.h"
+#include "wcmem.h"
+#include "wcstr.h"
 
 // Test fixture object type
 typedef struct {
@@ -21,6 +41,7 @@ void cleanup(TestObjs *objs);
 
 // Helper functions for tests
 FILE *create_input_file(const unsigned char *text);
+void make_temp_name(char *name);
 
 // Prototypes of test functions
 void test_hash(TestObjs *objs);
@@ -34,12 +55,51 @@ void test_trim_non_alpha(TestObjs *objs);
 void test_find_or_insert(TestObjs *objs);
 void test_dict_find_or_insert(TestObjs *objs);
 void test_free_chain(TestObjs *objs);
+void test_buf_readnext(TestObjs *objs);
+void test_table_find_or_insert(TestObjs *objs);
+void test_table_count_buf(TestObjs *objs);
+void test_table_reset(TestObjs *objs);
+void test_table_top_k(TestObjs *objs);
+void test_snap_write_and_lookup(TestObjs *objs);
+void test_snap_merge(TestObjs *objs);
+void test_spill_count(TestObjs *objs);
+void test_ngram_count(TestObjs *objs);
+void test_ngram_top_k(TestObjs *objs);
+void test_table_merge(TestObjs *objs);
+void test_conc_dict(TestObjs *objs);
+void test_conc_dict_threads(TestObjs *objs);
+void test_splitter(TestObjs *objs);
+void test_pipe_count(TestObjs *objs);
+void test_long_words(TestObjs *objs);
+void test_export_sort(TestObjs *objs);
+void test_export_write(TestObjs *objs);
+void test_art_lookup(TestObjs *objs);
+void test_art_top_k_prefix(TestObjs *objs);
+void test_stop_set(TestObjs *objs);
+void test_stop_filter_count(TestObjs *objs);
+void test_utf8_decode(TestObjs *objs);
+void test_utf8_normalize(TestObjs *objs);
+void test_utf8_count(TestObjs *objs);
+void test_table_subtract(TestObjs *objs);
+void test_window(TestObjs *objs);
+void test_files_count(TestObjs *objs);
+void test_tfidf(TestObjs *objs);
+void test_table_placed(TestObjs *objs);
+void test_word_functions(TestObjs *objs);
+void test_no_alloc(TestObjs *objs);
+
+// Prototypes of benchmark functions
+void bench_hash(TestObjs *objs, uint64_t iters);
+void bench_str_compare(TestObjs *objs, uint64_t iters);
+void bench_dict_find_or_insert(TestObjs *objs, uint64_t iters, long num_words);
+void bench_table_count_buf(TestObjs *objs, uint64_t iters);
 
 int main(int argc, char **argv) {
   // If a command line argument is provided, use it as the
-  // name of the test function to run
-  if (argc > 1) {
-    tctest_testname_to_execute = argv[1];
+  // name of the test function to run (see tctest_parse_args
+  // for the options)
+  if (tctest_parse_args(argc, argv) != 0) {
+    return 1;
   }
 
   TEST_INIT();
@@ -55,6 +115,43 @@ int main(int argc, char **argv) {
   TEST(test_find_or_insert);
   TEST(test_dict_find_or_insert);
   TEST(test_free_chain);
+  TEST(test_buf_readnext);
+  TEST(test_table_find_or_insert);
+  TEST(test_table_count_buf);
+  TEST(test_table_reset);
+  TEST(test_table_top_k);
+  TEST(test_snap_write_and_lookup);
+  TEST(test_snap_merge);
+  TEST(test_spill_count);
+  TEST(test_ngram_count);
+  TEST(test_ngram_top_k);
+  TEST(test_table_merge);
+  TEST(test_conc_dict);
+  TEST(test_conc_dict_threads);
+  TEST(test_splitter);
+  TEST(test_pipe_count);
+  TEST(test_long_words);
+  TEST(test_export_sort);
+  TEST(test_export_write);
+  TEST(test_art_lookup);
+  TEST(test_art_top_k_prefix);
+  TEST(test_stop_set);
+  TEST(test_stop_filter_count);
+  TEST(test_utf8_decode);
+  TEST(test_utf8_normalize);
+  TEST(test_utf8_count);
+  TEST(test_table_subtract);
+  TEST(test_window);
+  TEST(test_files_count);
+  TEST(test_tfidf);
+  TEST(test_table_placed);
+  TEST(test_word_functions);
+  TEST(test_no_alloc);
+
+  BENCH(bench_hash);
+  BENCH(bench_str_compare);
+  BENCH_ARGS(bench_dict_find_or_insert, 100, 10000);
+  BENCH(bench_table_count_buf);
 
   TEST_FINI();
 }
@@ -110,6 +207,18 @@ FILE *create_input_file(const unsigned char *text) {
   return out;
 }
 
+// Generate a unique file name (which must hold at least 32 characters)
+// for tests that need a named file rather than a FILE *.
+void make_temp_name(char *name) {
+  strcpy(name, "/tmp/wctestsXXXXXX");
+  int fd = mkstemp(name);
+  if (fd < 0) {
+    fprintf(stderr, "mkstemp failed\n");
+    exit(1);
+  }
+  close(fd);
+}
+
 void test_hash(TestObjs *objs) {
   uint32_t hash;
 
@@ -450,3 +559,1744 @@ void test_free_chain(TestObjs *objs) {
 
   wc_free_chain(p);
 }
+
+void test_buf_readnext(TestObjs *objs) {
+  unsigned char buf[MAX_WORDLEN + 1];
+  size_t len = strlen((const char *) objs->words_1);
+  size_t pos = 0;
+
+  ASSERT(1 == wc_buf_readnext(objs->words_1, len, &pos, buf));
+  ASSERT(0 == strcmp("A", (const char *) buf));
+  ASSERT(1 == wc_buf_readnext(objs->words_1, len, &pos, buf));
+  ASSERT(0 == strcmp("strong", (const char *) buf));
+  ASSERT(1 == wc_buf_readnext(objs->words_1, len, &pos, buf));
+  ASSERT(1 == wc_buf_readnext(objs->words_1, len, &pos, buf));
+  ASSERT(1 == wc_buf_readnext(objs->words_1, len, &pos, buf));
+  ASSERT(1 == wc_buf_readnext(objs->words_1, len, &pos, buf));
+  ASSERT(0 == strcmp("prevails", (const char *) buf));
+  ASSERT(1 == wc_buf_readnext(objs->words_1, len, &pos, buf));
+  ASSERT(0 == strcmp("throughout.", (const char *) buf));
+  ASSERT(0 == wc_buf_readnext(objs->words_1, len, &pos, buf));
+  ASSERT(pos == len);
+
+  // the buffer need not be NUL-terminated
+  pos = 0;
+  ASSERT(1 == wc_buf_readnext((const unsigned char *) "  hello, world", 7, &pos, buf));
+  ASSERT(0 == strcmp("hello", (const char *) buf));
+  ASSERT(0 == wc_buf_readnext((const unsigned char *) "  hello, world", 7, &pos, buf));
+
+  pos = 0;
+  ASSERT(0 == wc_buf_readnext((const unsigned char *) " \t\n ", 4, &pos, buf));
+
+  // long runs are split into MAX_WORDLEN-character words
+  unsigned char long_run[MAX_WORDLEN + 10];
+  memset(long_run, 'x', sizeof(long_run));
+  pos = 0;
+  ASSERT(1 == wc_buf_readnext(long_run, sizeof(long_run), &pos, buf));
+  ASSERT(MAX_WORDLEN == strlen((const char *) buf));
+  ASSERT(1 == wc_buf_readnext(long_run, sizeof(long_run), &pos, buf));
+  ASSERT(10 == strlen((const char *) buf));
+  ASSERT(0 == wc_buf_readnext(long_run, sizeof(long_run), &pos, buf));
+}
+
+void test_table_find_or_insert(TestObjs *objs) {
+  (void) objs;
+
+  struct WcTable *t = wc_table_create(5);
+  struct WordEntry *p, *q;
+
+  p = wc_table_find_or_insert(t, (const unsigned char *) "avis");
+  ASSERT(p != NULL);
+  ASSERT(0 == strcmp("avis", (const char *) p->word));
+  ASSERT(0 == p->count);
+  ++p->count;
+
+  // "avis" and "ax's" share a bucket
+  q = wc_table_find_or_insert(t, (const unsigned char *) "ax's");
+  ASSERT(q != NULL && q != p);
+  ASSERT(0 == q->count);
+  ASSERT(1 == t->num_touched);
+
+  ASSERT(p == wc_table_find_or_insert(t, (const unsigned char *) "avis"));
+  ASSERT(1 == p->count);
+  ASSERT(2 == t->num_entries);
+
+  // inserting many words grows the bucket array, and every
+  // word can still be found afterwards
+  unsigned char word[16];
+  for (unsigned i = 0; i < 1000; i++) {
+    sprintf((char *) word, "w%u", i);
+    wc_table_find_or_insert(t, word)->count = i;
+  }
+  ASSERT(t->num_buckets > 5);
+  for (unsigned i = 0; i < 1000; i++) {
+    sprintf((char *) word, "w%u", i);
+    ASSERT(i == wc_table_find_or_insert(t, word)->count);
+  }
+  ASSERT(1002 == t->num_entries);
+  ASSERT(p == wc_table_find_or_insert(t, (const unsigned char *) "avis"));
+
+  wc_table_destroy(t);
+}
+
+void test_table_count_buf(TestObjs *objs) {
+  (void) objs;
+
+  struct WcTable *t = wc_table_create(0);
+  const char *text = "The cat saw THE dog; the dog saw a cat. 1234";
+
+  wc_table_count_buf(t, (const unsigned char *) text, strlen(text));
+  ASSERT(11 == t->total_words);
+  // "1234" trims down to the empty word, which is counted too
+  ASSERT(6 == t->unique_words);
+  ASSERT(0 == strcmp("the", (const char *) t->best_word));
+  ASSERT(3 == t->best_word_count);
+
+  // ties go to the word that compares lowest
+  wc_table_count_buf(t, (const unsigned char *) "cat dog", 7);
+  ASSERT(3 == t->best_word_count);
+  ASSERT(0 == strcmp("cat", (const char *) t->best_word));
+
+  wc_table_destroy(t);
+}
+
+void test_table_reset(TestObjs *objs) {
+  struct WcTable *t = wc_table_create(0);
+
+  wc_table_count_buf(t, objs->words_1, strlen((const char *) objs->words_1));
+  ASSERT(7 == t->total_words);
+  ASSERT(7 == t->num_touched);
+  struct WordEntry *smell = wc_table_find_or_insert(t, (const unsigned char *) "smell");
+  ASSERT(1 == smell->count);
+
+  wc_table_reset(t);
+  ASSERT(0 == t->num_touched);
+  ASSERT(0 == t->num_entries);
+  ASSERT(0 == t->total_words);
+  ASSERT(0 == t->unique_words);
+  ASSERT(0 == t->best_word_count);
+  ASSERT(0 == strcmp("", (const char *) t->best_word));
+  for (unsigned i = 0; i < t->num_buckets; i++) {
+    ASSERT(t->buckets[i] == NULL);
+  }
+
+  // recycled nodes are reused and start from a zero count
+  struct WordEntry *p = wc_table_find_or_insert(t, (const unsigned char *) "petroleum");
+  ASSERT(0 == p->count);
+  ASSERT(t->free_nodes != NULL);
+
+  wc_table_count_buf(t, (const unsigned char *) "smell smell", 11);
+  ASSERT(2 == t->total_words);
+  ASSERT(1 == t->unique_words);
+  ASSERT(2 == wc_table_find_or_insert(t, (const unsigned char *) "smell")->count);
+
+  wc_table_destroy(t);
+}
+
+void test_table_top_k(TestObjs *objs) {
+  (void) objs;
+
+  struct WcTable *t = wc_table_create(3);
+  struct WordEntry *top[8];
+  const char *text = "b a c b d c b e c a";
+
+  ASSERT(0 == wc_table_top_k(t, top, 4));
+
+  wc_table_count_buf(t, (const unsigned char *) text, strlen(text));
+
+  // b and c both occur 3 times, so the tie is broken alphabetically
+  ASSERT(3 == wc_table_top_k(t, top, 3));
+  ASSERT(0 == strcmp("b", (const char *) top[0]->word));
+  ASSERT(0 == strcmp("c", (const char *) top[1]->word));
+  ASSERT(0 == strcmp("a", (const char *) top[2]->word));
+  ASSERT(3 == top[0]->count);
+  ASSERT(2 == top[2]->count);
+
+  ASSERT(5 == wc_table_top_k(t, top, 8));
+  ASSERT(0 == strcmp("b", (const char *) top[0]->word));
+  ASSERT(0 == strcmp("c", (const char *) top[1]->word));
+  ASSERT(0 == strcmp("a", (const char *) top[2]->word));
+  ASSERT(0 == strcmp("d", (const char *) top[3]->word));
+  ASSERT(0 == strcmp("e", (const char *) top[4]->word));
+
+  ASSERT(0 == wc_table_top_k(t, top, 0));
+
+  wc_table_destroy(t);
+}
+
+void test_snap_write_and_lookup(TestObjs *objs) {
+  (void) objs;
+
+  char name[32];
+  struct WcTable *t = wc_table_create(0);
+  struct WcSnapshot snap;
+  const char *text = "the cat and the hat and THE bat";
+
+  make_temp_name(name);
+  wc_table_count_buf(t, (const unsigned char *) text, strlen(text));
+  ASSERT(0 == wc_snap_write_table(t, NULL, name));
+  ASSERT(0 == wc_snap_open(&snap, name));
+
+  ASSERT(8 == snap.header->total_words);
+  ASSERT(5 == snap.header->num_words);
+  ASSERT(0 == strcmp("the", (const char *) wc_snap_word(&snap, &snap.entries[snap.header->best_entry])));
+
+  // entries are sorted by word
+  ASSERT(0 == strcmp("and", (const char *) wc_snap_word(&snap, &snap.entries[0])));
+  ASSERT(0 == strcmp("bat", (const char *) wc_snap_word(&snap, &snap.entries[1])));
+  ASSERT(0 == strcmp("the", (const char *) wc_snap_word(&snap, &snap.entries[4])));
+
+  const struct WcSnapEntry *e = wc_snap_lookup(&snap, (const unsigned char *) "the");
+  ASSERT(e != NULL);
+  ASSERT(3 == e->count);
+  e = wc_snap_lookup(&snap, (const unsigned char *) "hat");
+  ASSERT(e != NULL);
+  ASSERT(1 == e->count);
+  ASSERT(NULL == wc_snap_lookup(&snap, (const unsigned char *) "dog"));
+  ASSERT(NULL == wc_snap_lookup(&snap, (const unsigned char *) ""));
+
+  // a later run can add its counts to the stored snapshot, even
+  // when writing over the file it was loaded from
+  wc_table_reset(t);
+  wc_table_count_buf(t, (const unsigned char *) "dog hat hat", 11);
+  ASSERT(0 == wc_snap_write_table(t, &snap, name));
+  wc_snap_close(&snap);
+  ASSERT(0 == wc_snap_open(&snap, name));
+  ASSERT(11 == snap.header->total_words);
+  ASSERT(6 == snap.header->num_words);
+  ASSERT(3 == wc_snap_lookup(&snap, (const unsigned char *) "hat")->count);
+  ASSERT(1 == wc_snap_lookup(&snap, (const unsigned char *) "dog")->count);
+  ASSERT(3 == wc_snap_lookup(&snap, (const unsigned char *) "the")->count);
+
+  // ties for the most frequent word go to the lower word
+  ASSERT(0 == strcmp("hat", (const char *) wc_snap_word(&snap, &snap.entries[snap.header->best_entry])));
+
+  struct WcSnapHeader h = *snap.header;
+  wc_snap_close(&snap);
+  wc_table_destroy(t);
+
+  // an index with no empty slot doesn't make a lookup spin
+  FILE *f = fopen(name, "r+b");
+  uint32_t first = 1;
+  fseek(f, (long) h.index_offset, SEEK_SET);
+  for (uint32_t i = 0; i < h.index_slots; i++) {
+    fwrite(&first, sizeof(first), 1, f);
+  }
+  fclose(f);
+  ASSERT(0 == wc_snap_open(&snap, name));
+  ASSERT(NULL == wc_snap_lookup(&snap, (const unsigned char *) "dog"));
+  wc_snap_close(&snap);
+
+  // nor is a pool whose last word runs off its end accepted
+  f = fopen(name, "r+b");
+  fseek(f, (long) (h.pool_offset + h.pool_size - 1), SEEK_SET);
+  fputc('x', f);
+  fclose(f);
+  ASSERT(-1 == wc_snap_open(&snap, name));
+
+  // or an index without room for every word
+  f = fopen(name, "r+b");
+  fseek(f, (long) (h.pool_offset + h.pool_size - 1), SEEK_SET);
+  fputc('\0', f);
+  h.index_slots = 4;
+  fseek(f, 0, SEEK_SET);
+  fwrite(&h, sizeof(h), 1, f);
+  fclose(f);
+  ASSERT(-1 == wc_snap_open(&snap, name));
+  unlink(name);
+
+  // files that aren't snapshots are rejected
+  make_temp_name(name);
+  f = fopen(name, "w");
+  for (int i = 0; i < 100; i++) {
+    fputs("not a snapshot\n", f);
+  }
+  fclose(f);
+  ASSERT(-1 == wc_snap_open(&snap, name));
+  unlink(name);
+}
+
+void test_snap_merge(TestObjs *objs) {
+  (void) objs;
+
+  char names[4][32];
+  const char *texts[3] = { "b d f b", "a b c", "" };
+  struct WcSnapshot snaps[3], merged;
+  struct WcTable *t = wc_table_create(0);
+
+  for (int i = 0; i < 3; i++) {
+    make_temp_name(names[i]);
+    wc_table_reset(t);
+    wc_table_count_buf(t, (const unsigned char *) texts[i], strlen(texts[i]));
+    ASSERT(0 == wc_snap_write_table(t, NULL, names[i]));
+    ASSERT(0 == wc_snap_open(&snaps[i], names[i]));
+  }
+  ASSERT(0 == snaps[2].header->num_words);
+  ASSERT(WC_SNAP_NO_ENTRY == snaps[2].header->best_entry);
+
+  make_temp_name(names[3]);
+  ASSERT(0 == wc_snap_merge(snaps, 3, names[3]));
+  ASSERT(0 == wc_snap_open(&merged, names[3]));
+
+  const char *expected_words[5] = { "a", "b", "c", "d", "f" };
+  uint64_t expected_counts[5] = { 1, 3, 1, 1, 1 };
+  ASSERT(7 == merged.header->total_words);
+  ASSERT(5 == merged.header->num_words);
+  for (int i = 0; i < 5; i++) {
+    ASSERT(0 == strcmp(expected_words[i], (const char *) wc_snap_word(&merged, &merged.entries[i])));
+    ASSERT(expected_counts[i] == merged.entries[i].count);
+    ASSERT(&merged.entries[i] == wc_snap_lookup(&merged, (const unsigned char *) expected_words[i]));
+  }
+  ASSERT(1 == merged.header->best_entry);
+
+  wc_snap_close(&merged);
+  for (int i = 0; i < 3; i++) {
+    wc_snap_close(&snaps[i]);
+  }
+
+  // the merge relies on words of at most MAX_WORDLEN in sorted
+  // order, so snapshots breaking either rule aren't opened: joining
+  // a MAX_WORDLEN word to the next gives a word that's too long, and
+  // swapping the two entries puts them out of order
+  unsigned char long_word[MAX_WORDLEN + 3];
+  memset(long_word, 'a', MAX_WORDLEN);
+  strcpy((char *) long_word + MAX_WORDLEN, " b");
+  wc_table_reset(t);
+  wc_table_count_buf(t, long_word, strlen((const char *) long_word));
+  ASSERT(0 == wc_snap_write_table(t, NULL, names[3]));
+  ASSERT(0 == wc_snap_open(&merged, names[3]));
+  struct WcSnapHeader h = *merged.header;
+  struct WcSnapEntry entries[2] = { merged.entries[0], merged.entries[1] };
+  wc_snap_close(&merged);
+
+  FILE *f = fopen(names[3], "r+b");
+  fseek(f, (long) (h.pool_offset + MAX_WORDLEN), SEEK_SET);
+  fputc('a', f);
+  fclose(f);
+  ASSERT(-1 == wc_snap_open(&merged, names[3]));
+
+  f = fopen(names[3], "r+b");
+  fseek(f, (long) (h.pool_offset + MAX_WORDLEN), SEEK_SET);
+  fputc('\0', f);
+  fseek(f, (long) sizeof(struct WcSnapHeader), SEEK_SET);
+  fwrite(&entries[1], sizeof(struct WcSnapEntry), 1, f);
+  fwrite(&entries[0], sizeof(struct WcSnapEntry), 1, f);
+  fclose(f);
+  ASSERT(-1 == wc_snap_open(&merged, names[3]));
+  for (int i = 0; i < 4; i++) {
+    unlink(names[i]);
+  }
+  wc_table_destroy(t);
+}
+
+void test_spill_count(TestObjs *objs) {
+  (void) objs;
+
+  // build a text with a large vocabulary and a skewed distribution
+  size_t cap = 1 << 20;
+  unsigned char *text = malloc(cap);
+  size_t len = 0;
+  for (unsigned i = 0; i < 30000; i++) {
+    // words end in a letter so that they aren't trimmed together
+    unsigned v = i % 7919;
+    len += sprintf((char *) text + len, "Word%c%c%c, w%c. ",
+                   'a' + v % 26, 'a' + v / 26 % 26, 'a' + v / 676, 'a' + i % 13);
+  }
+
+  struct WcTable *t = wc_table_create(0);
+  struct WcSummary expected, actual;
+  wc_table_count_buf(t, text, len);
+  wc_summary_from_table(&expected, t);
+  wc_table_destroy(t);
+
+  // a budget well below the table's size forces several levels of spilling
+  struct WcSpillOptions opts = { 64 << 10, 8, NULL, NULL };
+  struct WcSpillStats stats;
+  FILE *in = create_input_file(text);
+  ASSERT(0 == wc_spill_count(in, &opts, &actual, &stats));
+  fclose(in);
+
+  ASSERT(stats.num_spills > 0);
+  ASSERT(stats.max_depth > 0);
+  ASSERT(expected.total_words == actual.total_words);
+  ASSERT(expected.unique_words == actual.unique_words);
+  ASSERT(expected.best_word_count == actual.best_word_count);
+  ASSERT(0 == strcmp((const char *) expected.best_word, (const char *) actual.best_word));
+
+  // a budget that is never reached doesn't spill
+  opts.memory_budget = 64 << 20;
+  in = create_input_file(text);
+  ASSERT(0 == wc_spill_count(in, &opts, &actual, &stats));
+  fclose(in);
+  ASSERT(0 == stats.num_spills);
+  ASSERT(expected.unique_words == actual.unique_words);
+  ASSERT(0 == strcmp((const char *) expected.best_word, (const char *) actual.best_word));
+
+  free(text);
+}
+
+// Feed every word of text to an n-gram counter.
+static void add_ngram_text(struct WcNgramCounter *c, const char *text) {
+  unsigned char word[MAX_WORDLEN + 1];
+  size_t pos = 0;
+  while (wc_buf_readnext((const unsigned char *) text, strlen(text), &pos, word)) {
+    ASSERT(0 == wc_ngram_add_word(c, word));
+  }
+}
+
+void test_ngram_count(TestObjs *objs) {
+  (void) objs;
+
+  ASSERT(NULL == wc_ngram_create(1));
+  ASSERT(NULL == wc_ngram_create(WC_NGRAM_MAX + 1));
+
+  struct WcNgramCounter *c = wc_ngram_create(2);
+  ASSERT(c != NULL);
+
+  // words are normalized as usual, and words that normalize to
+  // nothing don't take part in n-grams
+  add_ngram_text(c, "Of the, 42 of THE people -- of the");
+  ASSERT(6 == c->total_ngrams);
+  ASSERT(4 == c->num_ngrams);
+  ASSERT(3 == c->num_words);
+  ASSERT(0 == strcmp("of", (const char *) wc_ngram_word(c, 0)));
+  ASSERT(0 == strcmp("the", (const char *) wc_ngram_word(c, 1)));
+
+  // the first n-gram is "of the", stored as word ids
+  ASSERT(0 == wc_ngram_key(c, 0)[0]);
+  ASSERT(1 == wc_ngram_key(c, 0)[1]);
+  ASSERT(3 == c->counts[0]);
+
+  // a break starts a new window
+  wc_ngram_break(c);
+  add_ngram_text(c, "people");
+  ASSERT(6 == c->total_ngrams);
+  add_ngram_text(c, "of");
+  ASSERT(7 == c->total_ngrams);
+
+  wc_ngram_destroy(c);
+
+  // many distinct n-grams force both tables to grow
+  c = wc_ngram_create(3);
+  unsigned char word[16];
+  for (unsigned i = 0; i < 5000; i++) {
+    sprintf((char *) word, "w%c%c%c", 'a' + i % 26, 'a' + i / 26 % 26, 'a' + i / 676);
+    ASSERT(0 == wc_ngram_add_word(c, word));
+  }
+  ASSERT(5000 == c->num_words);
+  ASSERT(4998 == c->num_ngrams);
+  ASSERT(4998 == c->total_ngrams);
+  for (uint32_t g = 0; g < c->num_ngrams; g++) {
+    ASSERT(1 == c->counts[g]);
+    ASSERT(g == wc_ngram_key(c, g)[0]);
+    ASSERT(g + 2 == wc_ngram_key(c, g)[2]);
+  }
+  wc_ngram_destroy(c);
+}
+
+void test_ngram_top_k(TestObjs *objs) {
+  (void) objs;
+
+  struct WcNgramCounter *c = wc_ngram_create(2);
+  uint32_t top[8];
+
+  ASSERT(0 == wc_ngram_top_k(c, top, 3));
+
+  add_ngram_text(c, "b a b a c d c d x y");
+  // "b a" and "c d" occur twice, the other five bigrams once
+  ASSERT(3 == wc_ngram_top_k(c, top, 3));
+  ASSERT(2 == c->counts[top[0]]);
+  ASSERT(0 == strcmp("b", (const char *) wc_ngram_word(c, wc_ngram_key(c, top[0])[0])));
+  ASSERT(2 == c->counts[top[1]]);
+  ASSERT(0 == strcmp("c", (const char *) wc_ngram_word(c, wc_ngram_key(c, top[1])[0])));
+  ASSERT(1 == c->counts[top[2]]);
+  ASSERT(0 == strcmp("a", (const char *) wc_ngram_word(c, wc_ngram_key(c, top[2])[0])));
+  ASSERT(0 == strcmp("b", (const char *) wc_ngram_word(c, wc_ngram_key(c, top[2])[1])));
+
+  ASSERT(7 == wc_ngram_top_k(c, top, 8));
+
+  wc_ngram_destroy(c);
+}
+
+void test_table_merge(TestObjs *objs) {
+  (void) objs;
+
+  const char *text = "the cat saw the dog and the dog saw a cat";
+  size_t len = strlen(text);
+  const unsigned char *buf = (const unsigned char *) text;
+
+  // boundaries never fall inside a word
+  ASSERT(3 == wc_buf_word_boundary(buf, len, 0));
+  ASSERT(3 == wc_buf_word_boundary(buf, len, 1));
+  ASSERT(3 == wc_buf_word_boundary(buf, len, 3));
+  ASSERT(len == wc_buf_word_boundary(buf, len, len - 1));
+  ASSERT(len == wc_buf_word_boundary(buf, len, len));
+
+  size_t mid = wc_buf_word_boundary(buf, len, len / 2);
+  struct WcTable *a = wc_table_create(0);
+  struct WcTable *b = wc_table_create(0);
+  struct WcTable *whole = wc_table_create(0);
+  wc_table_count_buf(a, buf, mid);
+  wc_table_count_buf(b, buf + mid, len - mid);
+  wc_table_count_buf(whole, buf, len);
+
+  ASSERT(0 == wc_table_merge(a, b));
+  ASSERT(whole->total_words == a->total_words);
+  ASSERT(whole->unique_words == a->unique_words);
+  ASSERT(whole->best_word_count == a->best_word_count);
+  ASSERT(0 == strcmp((const char *) whole->best_word, (const char *) a->best_word));
+  ASSERT(2 == wc_table_find_or_insert(a, (const unsigned char *) "dog")->count);
+
+  wc_table_destroy(a);
+  wc_table_destroy(b);
+  wc_table_destroy(whole);
+}
+
+void test_conc_dict(TestObjs *objs) {
+  struct WcConcDict *d = wc_conc_dict_create(100, 4);
+  struct WcConcThread th;
+  wc_conc_thread_init(&th, d, 0);
+
+  ASSERT(NULL == wc_conc_lookup(d, (const unsigned char *) "hello"));
+  struct WcConcEntry *e = wc_conc_find_or_insert(&th, (const unsigned char *) "hello");
+  ASSERT(e != NULL);
+  ASSERT(0 == wc_conc_count(e));
+  ASSERT(e == wc_conc_lookup(d, (const unsigned char *) "hello"));
+  ASSERT(e == wc_conc_find_or_insert(&th, (const unsigned char *) "hello"));
+
+  // once the count reaches the hot threshold, increments go to
+  // the stripes, but the total is unchanged
+  for (int i = 0; i < 10; i++) {
+    wc_conc_add(&th, e, 1);
+  }
+  ASSERT(e->stripes != NULL);
+  ASSERT(10 == wc_conc_count(e));
+
+  ASSERT(0 == wc_conc_count_buf(&th, objs->words_1, strlen((const char *) objs->words_1)));
+  struct WcSummary s;
+  wc_conc_summarize(d, &s);
+  ASSERT(7 == th.total_words);
+  ASSERT(8 == s.unique_words);
+  ASSERT(0 == strcmp("hello", (const char *) s.best_word));
+  ASSERT(10 == s.best_word_count);
+
+  wc_conc_dict_destroy(d);
+
+  // a full dictionary refuses new words but still finds old ones
+  d = wc_conc_dict_create(1, 0);
+  wc_conc_thread_init(&th, d, 0);
+  unsigned char word[8];
+  uint32_t inserted = 0;
+  for (uint32_t i = 0; i < 100; i++) {
+    sprintf((char *) word, "w%u", i);
+    if (wc_conc_find_or_insert(&th, word) != NULL) {
+      inserted++;
+    }
+  }
+  ASSERT(inserted == d->max_entries);
+  ASSERT(inserted < 100);
+  ASSERT(NULL != wc_conc_find_or_insert(&th, (const unsigned char *) "w0"));
+  wc_conc_dict_destroy(d);
+}
+
+struct ConcTestWorker {
+  pthread_t thread;
+  struct WcConcThread th;
+  const unsigned char *buf;
+  size_t len;
+  int rc;
+};
+
+static void *conc_test_main(void *arg) {
+  struct ConcTestWorker *w = (struct ConcTestWorker *) arg;
+  w->rc = wc_conc_count_buf(&w->th, w->buf, w->len);
+  return NULL;
+}
+
+void test_conc_dict_threads(TestObjs *objs) {
+  (void) objs;
+
+  // many threads counting the same small vocabulary makes the
+  // insertion races and the hot-word stripes likely
+  size_t len = 0;
+  unsigned char *buf = (unsigned char *) malloc(200000);
+  for (int i = 0; i < 20000; i++) {
+    len += sprintf((char *) buf + len, "%c%c ", 'a' + i % 26, 'a' + i % 7);
+  }
+
+  struct WcTable *ref = wc_table_create(0);
+  wc_table_count_buf(ref, buf, len);
+
+  enum { NUM_THREADS = 8 };
+  struct WcConcDict *d = wc_conc_dict_create(1000, 16);
+  struct ConcTestWorker workers[NUM_THREADS];
+  size_t start = 0;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    size_t end = (i == NUM_THREADS - 1) ? len
+      : wc_buf_word_boundary(buf, len, len / NUM_THREADS * (i + 1));
+    wc_conc_thread_init(&workers[i].th, d, i);
+    workers[i].buf = buf + start;
+    workers[i].len = end - start;
+    start = end;
+    ASSERT(0 == pthread_create(&workers[i].thread, NULL, conc_test_main, &workers[i]));
+  }
+  uint64_t total = 0;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_join(workers[i].thread, NULL);
+    ASSERT(0 == workers[i].rc);
+    total += workers[i].th.total_words;
+  }
+
+  struct WcSummary s;
+  wc_conc_summarize(d, &s);
+  ASSERT(ref->total_words == total);
+  ASSERT(ref->unique_words == s.unique_words);
+  ASSERT(ref->best_word_count == s.best_word_count);
+  ASSERT(0 == strcmp((const char *) ref->best_word, (const char *) s.best_word));
+
+  // every entry's count matches the reference table
+  for (uint32_t i = 0; i <= d->mask; i++) {
+    struct WcConcEntry *e = wc_conc_slot(d, i);
+    if (e != NULL) {
+      ASSERT(wc_table_find_or_insert(ref, e->word)->count == wc_conc_count(e));
+    }
+  }
+
+  wc_conc_dict_destroy(d);
+  wc_table_destroy(ref);
+  free(buf);
+}
+
+void test_splitter(TestObjs *objs) {
+  (void) objs;
+
+  // a 70-character word is split into 63 and 7 characters, as by
+  // wc_buf_readnext
+  unsigned char text[128];
+  memset(text, 'x', 70);
+  strcpy((char *) text + 70, " ab  cd\te");
+  size_t len = strlen((const char *) text);
+
+  unsigned char expected[8][MAX_WORDLEN + 1];
+  unsigned num_expected = 0;
+  size_t pos = 0;
+  while (wc_buf_readnext(text, len, &pos, expected[num_expected])) {
+    num_expected++;
+  }
+  ASSERT(5 == num_expected);
+
+  // feeding the text in pieces of every size gives the same words
+  for (size_t piece = 1; piece <= len; piece++) {
+    struct WcSplitter s;
+    unsigned char w[MAX_WORDLEN + 1];
+    unsigned n = 0;
+    wc_splitter_init(&s);
+    for (size_t start = 0; start < len; start += piece) {
+      size_t piece_len = (start + piece > len) ? len - start : piece;
+      size_t p = 0;
+      while (wc_splitter_next(&s, text + start, piece_len, &p, w)) {
+        ASSERT(n < num_expected);
+        ASSERT(0 == strcmp((const char *) expected[n], (const char *) w));
+        n++;
+      }
+      ASSERT(piece_len == p);
+    }
+    if (wc_splitter_finish(&s, w)) {
+      ASSERT(0 == strcmp((const char *) expected[n], (const char *) w));
+      n++;
+    }
+    ASSERT(num_expected == n);
+  }
+}
+
+void test_pipe_count(TestObjs *objs) {
+  (void) objs;
+
+  const char *text = "The cat saw THE dog; the dog saw a cat.";
+  struct WcTable *expected = wc_table_create(0);
+  wc_table_count_buf(expected, (const unsigned char *) text, strlen(text));
+
+  // tiny buffers, so words are split across them and the reader
+  // has to wait for the counter
+  FILE *in = create_input_file((const unsigned char *) text);
+  struct WcTable *t = wc_table_create(0);
+  struct WcPipe *p = wc_pipe_open(fileno(in), 5, 2);
+  ASSERT(0 == wc_pipe_count_table(p, t));
+  ASSERT(strlen(text) == p->bytes_read);
+  ASSERT(0 == wc_pipe_close(p));
+  fclose(in);
+  ASSERT(expected->total_words == t->total_words);
+  ASSERT(expected->unique_words == t->unique_words);
+  ASSERT(0 == strcmp((const char *) expected->best_word, (const char *) t->best_word));
+  ASSERT(expected->best_word_count == t->best_word_count);
+
+  // the same through a pipe
+  int fds[2];
+  ASSERT(0 == pipe(fds));
+  ASSERT((ssize_t) strlen(text) == write(fds[1], text, strlen(text)));
+  close(fds[1]);
+  wc_table_reset(t);
+  p = wc_pipe_open(fds[0], 0, 0);
+  ASSERT(0 == wc_pipe_count_table(p, t));
+  ASSERT(0 == wc_pipe_close(p));
+  close(fds[0]);
+  ASSERT(expected->total_words == t->total_words);
+  ASSERT(expected->unique_words == t->unique_words);
+
+  // an empty input has no words, and end of input is sticky
+  FILE *empty = create_input_file((const unsigned char *) "");
+  const unsigned char *data;
+  p = wc_pipe_open(fileno(empty), 0, 0);
+  ASSERT(0 == wc_pipe_next(p, &data));
+  ASSERT(0 == wc_pipe_next(p, &data));
+  ASSERT(0 == wc_pipe_close(p));
+  fclose(empty);
+
+  wc_table_destroy(t);
+  wc_table_destroy(expected);
+}
+
+void test_long_words(TestObjs *objs) {
+  (void) objs;
+
+  // runs of 70, 100 and exactly MAX_WORDLEN non-whitespace characters,
+  // repeated so that the input spans several reader blocks
+  enum { REPEATS = 600 };
+  char b[71], c[101], d[MAX_WORDLEN + 1];
+  memset(b, 'b', 70);
+  b[70] = '\0';
+  memset(c, 'c', 100);
+  c[100] = '\0';
+  memset(d, 'd', MAX_WORDLEN);
+  d[MAX_WORDLEN] = '\0';
+  char *text = malloc(REPEATS * 256);
+  size_t len = 0;
+  for (unsigned i = 0; i < REPEATS; i++) {
+    len += sprintf(text + len, "x %s end %s %s tail bbbbbbb%c\n", b, c, d, 'a' + i % 26);
+  }
+
+  // the rule every mode follows: a long run is split into words of
+  // MAX_WORDLEN characters, and a word of exactly MAX_WORDLEN counts
+  struct WcTable *expected = wc_table_create(0);
+  wc_table_count_buf(expected, (const unsigned char *) text, len);
+  ASSERT(REPEATS * 9 == expected->total_words);
+  ASSERT(0 == strcmp("bbbbbbb", (const char *) expected->best_word));
+
+  // the default (pipelined) path, with buffers small enough to split
+  // the runs
+  FILE *in = create_input_file((const unsigned char *) text);
+  struct WcTable *t = wc_table_create(0);
+  struct WcPipe *p = wc_pipe_open(fileno(in), 7, 3);
+  ASSERT(0 == wc_pipe_count_table(p, t));
+  ASSERT(0 == wc_pipe_close(p));
+  fclose(in);
+  ASSERT(expected->total_words == t->total_words);
+  ASSERT(expected->unique_words == t->unique_words);
+  ASSERT(0 == strcmp((const char *) expected->best_word, (const char *) t->best_word));
+  ASSERT(expected->best_word_count == t->best_word_count);
+
+  // -F: a character at a time
+  unsigned char word[MAX_WORDLEN + 1];
+  struct WcSplitter s;
+  wc_table_reset(t);
+  wc_splitter_init(&s);
+  for (size_t i = 0; i < len; i++) {
+    if (wc_splitter_add_char(&s, (unsigned char) text[i], word)) {
+      wc_table_count_word(t, word);
+    }
+  }
+  if (wc_splitter_finish(&s, word)) {
+    wc_table_count_word(t, word);
+  }
+  ASSERT(expected->total_words == t->total_words);
+  ASSERT(expected->unique_words == t->unique_words);
+  ASSERT(0 == strcmp((const char *) expected->best_word, (const char *) t->best_word));
+  ASSERT(expected->best_word_count == t->best_word_count);
+
+  // -m: counting within a memory budget
+  struct WcSpillOptions spill_opts = { 16 << 10, 4, NULL, NULL };
+  struct WcSummary summary;
+  in = create_input_file((const unsigned char *) text);
+  ASSERT(0 == wc_spill_count(in, &spill_opts, &summary, NULL));
+  fclose(in);
+  ASSERT(expected->total_words == summary.total_words);
+  ASSERT(expected->unique_words == summary.unique_words);
+  ASSERT(0 == strcmp((const char *) expected->best_word, (const char *) summary.best_word));
+  ASSERT(expected->best_word_count == summary.best_word_count);
+
+  // -n: every word here survives normalization, so there is one
+  // bigram per word but the first
+  struct WcNgramCounter *ngrams = wc_ngram_create(2);
+  struct WcWordReader reader;
+  int more;
+  in = create_input_file((const unsigned char *) text);
+  ASSERT(0 == wc_reader_init(&reader, in));
+  while ((more = wc_reader_next(&reader, word)) > 0) {
+    ASSERT(0 == wc_ngram_add_word(ngrams, word));
+  }
+  ASSERT(0 == more);
+  wc_reader_free(&reader);
+  fclose(in);
+  ASSERT(expected->total_words - 1 == ngrams->total_ngrams);
+  ASSERT(expected->unique_words == ngrams->num_words);
+
+  wc_ngram_destroy(ngrams);
+  wc_table_destroy(t);
+  wc_table_destroy(expected);
+  free(text);
+}
+
+void test_export_sort(TestObjs *objs) {
+  (void) objs;
+
+  // enough words that the sort uses several runs per thread count
+  enum { NUM_WORDS = 50000 };
+  struct WcTable *t = wc_table_create(0);
+  unsigned char word[24];
+  for (uint32_t i = 0; i < NUM_WORDS; i++) {
+    // many words share their first 8 characters
+    sprintf((char *) word, "%s%c%u", i % 3 ? "wordword" : "w", 'a' + (i * 7) % 26,
+            (i * 2654435761U) % 100003);
+    struct WordEntry *e = wc_table_find_or_insert(t, word);
+    e->count += 1 + (i % 300) * (i % 5);
+  }
+
+  struct WcExportItem *items;
+  uint32_t n;
+  ASSERT(0 == wc_export_collect(t, &items, &n));
+  ASSERT(t->num_entries == n);
+
+  // the prefix order agrees with wc_str_compare
+  ASSERT(wc_export_prefix((const unsigned char *) "ab") < wc_export_prefix((const unsigned char *) "abc"));
+  ASSERT(wc_export_prefix((const unsigned char *) "abcdefgh") == wc_export_prefix((const unsigned char *) "abcdefghij"));
+  ASSERT(0 == wc_export_prefix((const unsigned char *) ""));
+
+  for (unsigned threads = 1; threads <= 5; threads += 2) {
+    ASSERT(0 == wc_export_sort_by_word(items, n, threads));
+    for (uint32_t i = 1; i < n; i++) {
+      ASSERT(wc_str_compare(items[i - 1].word, items[i].word) < 0);
+    }
+  }
+
+  ASSERT(0 == wc_export_sort_by_count(items, n));
+  for (uint32_t i = 1; i < n; i++) {
+    ASSERT(items[i - 1].count >= items[i].count);
+    if (items[i - 1].count == items[i].count) {
+      ASSERT(wc_str_compare(items[i - 1].word, items[i].word) < 0);
+    }
+  }
+
+  // every entry is still present exactly once
+  uint64_t sum = 0, expected_sum = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    sum += items[i].count;
+    ASSERT(items[i].count == wc_table_find_or_insert(t, items[i].word)->count);
+  }
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    for (struct WordEntry *p = t->buckets[t->touched[i]]; p != NULL; p = p->next) {
+      expected_sum += p->count;
+    }
+  }
+  ASSERT(expected_sum == sum);
+
+  free(items);
+  wc_table_destroy(t);
+}
+
+void test_export_write(TestObjs *objs) {
+  (void) objs;
+
+  struct WcTable *t = wc_table_create(0);
+  const char *text = "b b a c c say,\"hi\" say,\"hi\" c";
+  wc_table_count_buf(t, (const unsigned char *) text, strlen(text));
+
+  char buf[256];
+  FILE *out = tmpfile();
+  ASSERT(0 == wc_export_table(out, t, WC_EXPORT_CSV, WC_EXPORT_BY_COUNT, 2));
+  rewind(out);
+  size_t len = fread(buf, 1, sizeof(buf) - 1, out);
+  buf[len] = '\0';
+  ASSERT(0 == strcmp("word,count\nc,3\nb,2\n\"say,\"\"hi\",2\na,1\n", buf));
+  fclose(out);
+
+  out = tmpfile();
+  ASSERT(0 == wc_export_table(out, t, WC_EXPORT_CSV, WC_EXPORT_BY_WORD, 0));
+  rewind(out);
+  len = fread(buf, 1, sizeof(buf) - 1, out);
+  buf[len] = '\0';
+  ASSERT(0 == strcmp("word,count\na,1\nb,2\nc,3\n\"say,\"\"hi\",2\n", buf));
+  fclose(out);
+
+  // binary: magic, little-endian word count, then varint count,
+  // length byte and characters for each word
+  struct WcExportItem items[2] = {
+    { 0, (const unsigned char *) "xyz", 300 },
+    { 0, (const unsigned char *) "q", 5 },
+  };
+  const unsigned char expected[] = {
+    'W', 'C', 'E', 'X', 'P', 'R', 'T', '1', 2, 0, 0, 0, 0, 0, 0, 0,
+    0xAC, 0x02, 3, 'x', 'y', 'z',
+    5, 1, 'q',
+  };
+  out = tmpfile();
+  ASSERT(0 == wc_export_write(out, items, 2, WC_EXPORT_BINARY));
+  rewind(out);
+  len = fread(buf, 1, sizeof(buf), out);
+  ASSERT(sizeof(expected) == len);
+  ASSERT(0 == memcmp(expected, buf, len));
+  fclose(out);
+
+  wc_table_destroy(t);
+}
+
+void test_art_lookup(TestObjs *objs) {
+  (void) objs;
+
+  struct WcTable *t = wc_table_create(0);
+  struct WcArt *a = wc_art_build(t, 1);
+  ASSERT(0 == a->num_words);
+  ASSERT(NULL == wc_art_lookup(a, (const unsigned char *) "a"));
+  wc_art_destroy(a);
+
+  // words that are prefixes of each other, long shared prefixes,
+  // and a node with more than 48 children
+  const char *text = "a an and android ant antelope antelopes b "
+    "internationalization internationalize";
+  wc_table_count_buf(t, (const unsigned char *) text, strlen(text));
+  unsigned char word[3] = "z";
+  for (unsigned c = 0; c < 60; c++) {
+    word[1] = (unsigned char) (0x80 + c);
+    wc_table_find_or_insert(t, word)->count = 1;
+  }
+
+  a = wc_art_build(t, 2);
+  ASSERT(t->num_entries == a->num_words);
+  ASSERT(1 == a->num_nodes[WC_ART_NODE256]);
+  for (unsigned i = 0; i < t->num_touched; i++) {
+    for (struct WordEntry *p = t->buckets[t->touched[i]]; p != NULL; p = p->next) {
+      ASSERT(p == wc_art_lookup(a, p->word));
+    }
+  }
+  ASSERT(NULL == wc_art_lookup(a, (const unsigned char *) "antelop"));
+  ASSERT(NULL == wc_art_lookup(a, (const unsigned char *) "internationalizations"));
+  ASSERT(NULL == wc_art_lookup(a, (const unsigned char *) "international"));
+  ASSERT(NULL == wc_art_lookup(a, (const unsigned char *) "c"));
+  ASSERT(NULL == wc_art_lookup(a, (const unsigned char *) ""));
+
+  ASSERT(6 == wc_art_count_prefix(a, (const unsigned char *) "an"));
+  ASSERT(3 == wc_art_count_prefix(a, (const unsigned char *) "ant"));
+  ASSERT(2 == wc_art_count_prefix(a, (const unsigned char *) "inter"));
+  ASSERT(60 == wc_art_count_prefix(a, (const unsigned char *) "z"));
+  ASSERT(0 == wc_art_count_prefix(a, (const unsigned char *) "q"));
+  ASSERT(a->num_words == wc_art_count_prefix(a, (const unsigned char *) ""));
+
+  wc_art_destroy(a);
+  wc_table_destroy(t);
+}
+
+void test_art_top_k_prefix(TestObjs *objs) {
+  (void) objs;
+
+  struct WcTable *t = wc_table_create(0);
+  const char *text = "pre prefix prefix prefix press press present "
+    "preach preach preach pry other other other other other";
+  wc_table_count_buf(t, (const unsigned char *) text, strlen(text));
+  struct WcArt *a = wc_art_build(t, 0);
+  const struct WordEntry *top[8];
+
+  // ties are broken by word, as by wc_table_top_k
+  ASSERT(4 == wc_art_top_k_prefix(a, (const unsigned char *) "pre", top, 4));
+  ASSERT(0 == strcmp("preach", (const char *) top[0]->word));
+  ASSERT(3 == top[0]->count);
+  ASSERT(0 == strcmp("prefix", (const char *) top[1]->word));
+  ASSERT(0 == strcmp("press", (const char *) top[2]->word));
+  ASSERT(0 == strcmp("pre", (const char *) top[3]->word));
+
+  ASSERT(6 == wc_art_top_k_prefix(a, (const unsigned char *) "pr", top, 8));
+  ASSERT(0 == strcmp("pry", (const char *) top[5]->word));
+  ASSERT(1 == wc_art_top_k_prefix(a, (const unsigned char *) "prefix", top, 8));
+  ASSERT(0 == wc_art_top_k_prefix(a, (const unsigned char *) "prefixes", top, 8));
+  ASSERT(0 == wc_art_top_k_prefix(a, (const unsigned char *) "x", top, 8));
+
+  // an empty prefix gives the same answer as the whole table
+  struct WordEntry *expected[3];
+  ASSERT(3 == wc_table_top_k(t, expected, 3));
+  ASSERT(3 == wc_art_top_k_prefix(a, (const unsigned char *) "", top, 3));
+  for (unsigned i = 0; i < 3; i++) {
+    ASSERT(expected[i] == top[i]);
+  }
+
+  wc_art_destroy(a);
+  wc_table_destroy(t);
+}
+
+void test_stop_set(TestObjs *objs) {
+  (void) objs;
+
+  // a set built from generated words contains exactly those words
+  // (duplicates are allowed in the list)
+  enum { N = 1000 };
+  static unsigned char words[N + 1][8];
+  const unsigned char *list[N + 1];
+  for (unsigned i = 0; i < N; i++) {
+    sprintf((char *) words[i], "w%ux", i);
+    list[i] = words[i];
+  }
+  list[N] = words[7];
+  struct WcStopSet *s = wc_stop_build(list, N + 1);
+  ASSERT(s != NULL);
+  ASSERT(N == s->num_words);
+  unsigned char w[16];
+  for (unsigned i = 0; i < N; i++) {
+    ASSERT(wc_stop_contains(s, words[i]));
+    sprintf((char *) w, "w%uy", i);
+    ASSERT(!wc_stop_contains(s, w));
+  }
+  ASSERT(!wc_stop_contains(s, (const unsigned char *) ""));
+  ASSERT(!wc_stop_contains(s, (const unsigned char *) "w1"));
+  ASSERT(!wc_stop_contains(s, (const unsigned char *) "w1xx"));
+  wc_stop_free(s);
+
+  // an empty set contains nothing
+  s = wc_stop_build(list, 0);
+  ASSERT(s != NULL);
+  ASSERT(!wc_stop_contains(s, (const unsigned char *) "the"));
+  wc_stop_free(s);
+
+  ASSERT(wc_stop_contains(&wc_stop_builtin, (const unsigned char *) "the"));
+  ASSERT(wc_stop_contains(&wc_stop_builtin, (const unsigned char *) "wouldn't"));
+  ASSERT(!wc_stop_contains(&wc_stop_builtin, (const unsigned char *) "dorrit"));
+  ASSERT(!wc_stop_contains(&wc_stop_builtin, (const unsigned char *) "The"));
+
+  // words in a list file are normalized, and comment lines ignored
+  char name[32];
+  make_temp_name(name);
+  FILE *f = fopen(name, "w");
+  fputs("# not a word\nThe  AND,\n\tof-- 42\n", f);
+  fclose(f);
+  s = wc_stop_load(name);
+  ASSERT(s != NULL);
+  ASSERT(3 == s->num_words);
+  ASSERT(wc_stop_contains(s, (const unsigned char *) "the"));
+  ASSERT(wc_stop_contains(s, (const unsigned char *) "and"));
+  ASSERT(wc_stop_contains(s, (const unsigned char *) "of"));
+  ASSERT(!wc_stop_contains(s, (const unsigned char *) "not"));
+  wc_stop_free(s);
+
+  // long lines aren't split: neither a word that straddles 1024
+  // bytes nor the tail of a long comment
+  f = fopen(name, "w");
+  fputc('#', f);
+  for (int i = 0; i < 1100; i++) {
+    fputc(' ', f);
+  }
+  fputs("tail\n", f);
+  for (int i = 0; i < 1020; i++) {
+    fputc(' ', f);
+  }
+  fputs("straddle\n", f);
+  fclose(f);
+  s = wc_stop_load(name);
+  ASSERT(s != NULL);
+  ASSERT(1 == s->num_words);
+  ASSERT(wc_stop_contains(s, (const unsigned char *) "straddle"));
+  ASSERT(!wc_stop_contains(s, (const unsigned char *) "tail"));
+  wc_stop_free(s);
+  unlink(name);
+  ASSERT(NULL == wc_stop_load(name));
+}
+
+void test_stop_filter_count(TestObjs *objs) {
+  (void) objs;
+
+  // counting with a stop-word set gives the same result as counting
+  // the input with the stop words removed beforehand
+  const char *text = "The cat and THE dog. Of mice and men, the end; cat? cat!";
+  const char *filtered = "cat dog. mice men, end; cat? cat!";
+  struct WcTable *t = wc_table_create(0);
+  struct WcTable *expected = wc_table_create(0);
+  t->stop_words = &wc_stop_builtin;
+  wc_table_count_buf(t, (const unsigned char *) text, strlen(text));
+  wc_table_count_buf(expected, (const unsigned char *) filtered, strlen(filtered));
+
+  ASSERT(7 == t->total_words);
+  ASSERT(expected->total_words == t->total_words);
+  ASSERT(expected->unique_words == t->unique_words);
+  ASSERT(0 == strcmp((const char *) expected->best_word, (const char *) t->best_word));
+  ASSERT(expected->best_word_count == t->best_word_count);
+  ASSERT(expected->num_entries == t->num_entries);
+
+  // the spilling counter filters the same way
+  FILE *in = create_input_file((const unsigned char *) text);
+  struct WcSpillOptions opts = { 64 << 10, 8, NULL, &wc_stop_builtin };
+  struct WcSummary summary;
+  struct WcSpillStats stats;
+  ASSERT(0 == wc_spill_count(in, &opts, &summary, &stats));
+  ASSERT(7 == summary.total_words);
+  ASSERT(expected->unique_words == summary.unique_words);
+  ASSERT(0 == strcmp("cat", (const char *) summary.best_word));
+  fclose(in);
+
+  wc_table_destroy(t);
+  wc_table_destroy(expected);
+}
+
+void test_utf8_decode(TestObjs *objs) {
+  (void) objs;
+  unsigned n;
+
+  ASSERT('a' == wc_utf8_decode((const unsigned char *) "a", 1, &n));
+  ASSERT(1 == n);
+  ASSERT(0xE9 == wc_utf8_decode((const unsigned char *) "\xC3\xA9", 2, &n));
+  ASSERT(2 == n);
+  ASSERT(0x20AC == wc_utf8_decode((const unsigned char *) "\xE2\x82\xAC", 3, &n));
+  ASSERT(3 == n);
+  ASSERT(0x1F600 == wc_utf8_decode((const unsigned char *) "\xF0\x9F\x98\x80", 4, &n));
+  ASSERT(4 == n);
+
+  // overlong, surrogate, too large, truncated, stray continuation
+  ASSERT(WC_UTF8_INVALID == wc_utf8_decode((const unsigned char *) "\xC0\xAF", 2, &n));
+  ASSERT(1 == n);
+  ASSERT(WC_UTF8_INVALID == wc_utf8_decode((const unsigned char *) "\xE0\x80\xAF", 3, &n));
+  ASSERT(WC_UTF8_INVALID == wc_utf8_decode((const unsigned char *) "\xED\xA0\x80", 3, &n));
+  ASSERT(WC_UTF8_INVALID == wc_utf8_decode((const unsigned char *) "\xF4\x90\x80\x80", 4, &n));
+  ASSERT(WC_UTF8_INVALID == wc_utf8_decode((const unsigned char *) "\xE2\x82\xAC", 2, &n));
+  ASSERT(WC_UTF8_INVALID == wc_utf8_decode((const unsigned char *) "\x80", 1, &n));
+
+  // the ASCII scan and validation find the first non-ASCII (or
+  // invalid) byte wherever it is relative to the 16- and 32-byte steps
+  unsigned char buf[100];
+  for (unsigned pos = 0; pos < 90; pos++) {
+    memset(buf, 'x', sizeof(buf));
+    buf[pos] = 0xC3;
+    buf[pos + 1] = 0xA9;
+    ASSERT(pos == wc_utf8_ascii_prefix(buf, sizeof(buf)));
+    ASSERT(sizeof(buf) == wc_utf8_validate(buf, sizeof(buf)));
+    ASSERT(pos == wc_utf8_validate(buf, pos + 1));   // truncated
+    buf[pos + 1] = 'x';
+    ASSERT(pos == wc_utf8_validate(buf, sizeof(buf)));
+  }
+  ASSERT(7 == wc_utf8_ascii_prefix(buf, 7));
+}
+
+void test_utf8_normalize(TestObjs *objs) {
+  (void) objs;
+  unsigned char out[MAX_WORDLEN + 1];
+
+  ASSERT(wc_utf8_isletter(0xE9));
+  ASSERT(wc_utf8_isletter(0x3C3));
+  ASSERT(wc_utf8_isletter(0x301));     // combining acute accent
+  ASSERT(!wc_utf8_isletter(0x201D));   // right double quotation mark
+  ASSERT(wc_utf8_isspace(0xA0));
+  ASSERT(!wc_utf8_isspace(0xE9));
+  ASSERT(0xE9 == wc_utf8_fold(0xC9));
+  ASSERT(0x3C3 == wc_utf8_fold(0x3A3));
+  ASSERT(0x3C3 == wc_utf8_fold(0x3C2));   // final sigma
+  ASSERT(0xDF == wc_utf8_fold(0x1E9E));   // capital sharp s
+  ASSERT(0x4E2D == wc_utf8_fold(0x4E2D));
+
+  const char *w = "\xC3\x89L\xC3\x89PHANT,\xE2\x80\x9D";   // ÉLÉPHANT,"
+  wc_utf8_normalize((const unsigned char *) w, strlen(w), out);
+  ASSERT(0 == strcmp("\xC3\xA9l\xC3\xA9phant", (const char *) out));
+  w = "caf\xC3\x89!";
+  wc_utf8_normalize((const unsigned char *) w, strlen(w), out);
+  ASSERT(0 == strcmp("caf\xC3\xA9", (const char *) out));
+
+  // invalid bytes are kept, but trimmed like punctuation
+  w = "a\xFF" "b\xFF";
+  wc_utf8_normalize((const unsigned char *) w, strlen(w), out);
+  ASSERT(0 == strcmp("a\xFF" "b", (const char *) out));
+
+  // growing past MAX_WORDLEN cuts at a code point boundary (U+023A
+  // is two bytes, its folding three)
+  char big[MAX_WORDLEN + 1];
+  for (unsigned i = 0; i < 31; i++) {
+    memcpy(big + 2 * i, "\xC8\xBA", 2);
+  }
+  big[62] = '\0';
+  wc_utf8_normalize((const unsigned char *) big, 62, out);
+  ASSERT(63 == strlen((const char *) out));
+  ASSERT(0 == memcmp("\xE2\xB1\xA5", out + 60, 3));
+}
+
+void test_utf8_count(TestObjs *objs) {
+  // pure ASCII text counts exactly as in the byte path
+  struct WcTable *t = wc_table_create(0);
+  struct WcTable *expected = wc_table_create(0);
+  const unsigned char *ascii = objs->words_1;
+  wc_utf8_count_buf(t, ascii, strlen((const char *) ascii));
+  wc_table_count_buf(expected, ascii, strlen((const char *) ascii));
+  ASSERT(expected->total_words == t->total_words);
+  ASSERT(expected->unique_words == t->unique_words);
+  ASSERT(0 == strcmp((const char *) expected->best_word, (const char *) t->best_word));
+  wc_table_reset(t);
+
+  // case variants fold together, and a no-break space splits words
+  const char *text = "\xC3\x89t\xC3\xA9 \xC3\xA9T\xC3\x89, \xC3\xA9t\xC3\xA9\xC2\xA0" "caf\xC3\xA9 Caf\xC3\x89";
+  wc_utf8_count_buf(t, (const unsigned char *) text, strlen(text));
+  ASSERT(5 == t->total_words);
+  ASSERT(2 == t->unique_words);
+  ASSERT(0 == strcmp("\xC3\xA9t\xC3\xA9", (const char *) t->best_word));
+  ASSERT(3 == t->best_word_count);
+
+  // a word split across pipe buffers is decoded as a whole
+  char name[32];
+  make_temp_name(name);
+  FILE *f = fopen(name, "w");
+  for (unsigned i = 0; i < 5000; i++) {
+    fputs(text, f);
+    fputc(' ', f);
+  }
+  fclose(f);
+  FILE *in = fopen(name, "r");
+  struct WcPipe *p = wc_pipe_open(fileno(in), 4099, 3);
+  wc_table_reset(t);
+  ASSERT(0 == wc_utf8_count_pipe(p, t));
+  ASSERT(0 == wc_pipe_close(p));
+  fclose(in);
+  unlink(name);
+  ASSERT(25000 == t->total_words);
+  ASSERT(2 == t->unique_words);
+  ASSERT(15000 == t->best_word_count);
+
+  wc_table_destroy(t);
+  wc_table_destroy(expected);
+}
+
+void test_table_subtract(TestObjs *objs) {
+  (void) objs;
+
+  struct WcTable *t = wc_table_create(3);
+  struct WcTable *a = wc_table_create(0);
+  struct WcTable *b = wc_table_create(0);
+  const char *text_a = "one two two three three three";
+  const char *text_b = "three four four";
+  wc_table_count_buf(a, (const unsigned char *) text_a, strlen(text_a));
+  wc_table_count_buf(b, (const unsigned char *) text_b, strlen(text_b));
+  ASSERT(0 == wc_table_merge(t, a));
+  ASSERT(0 == wc_table_merge(t, b));
+  ASSERT(9 == t->total_words);
+  ASSERT(4 == t->unique_words);
+
+  ASSERT(0 == wc_table_subtract(t, a));
+  ASSERT(3 == t->total_words);
+  ASSERT(2 == t->unique_words);
+  ASSERT(4 == t->num_entries);   // zero counts stay until compacted
+  struct WordEntry *top[4];
+  ASSERT(4 == wc_table_top_k(t, top, 4));
+  ASSERT(0 == strcmp("four", (const char *) top[0]->word));
+  ASSERT(2 == top[0]->count);
+  ASSERT(0 == top[3]->count);
+
+  wc_table_compact(t);
+  ASSERT(2 == t->num_entries);
+  ASSERT(2 == wc_table_top_k(t, top, 4));
+  ASSERT(0 == strcmp("three", (const char *) top[1]->word));
+
+  // the compacted table keeps working, reusing the recycled nodes
+  ASSERT(0 == wc_table_merge(t, a));
+  ASSERT(9 == t->total_words);
+  ASSERT(4 == t->num_entries);
+  ASSERT(4 == t->unique_words);
+
+  // subtracting words that aren't there fails
+  wc_table_reset(t);
+  ASSERT(-1 == wc_table_subtract(t, b));
+
+  wc_table_destroy(t);
+  wc_table_destroy(a);
+  wc_table_destroy(b);
+}
+
+// Count text into the current interval of w.
+static void count_window_text(struct WcWindow *w, const char *text) {
+  wc_table_count_buf(wc_window_current(w), (const unsigned char *) text, strlen(text));
+}
+
+void test_window(TestObjs *objs) {
+  (void) objs;
+
+  struct WcWindow *w = wc_window_create(2, NULL);
+  struct WordEntry *top[4];
+
+  count_window_text(w, "a a b");
+  ASSERT(0 == wc_window_top_k(w, top, 4));   // nothing complete yet
+  ASSERT(0 == wc_window_close_interval(w));
+  count_window_text(w, "b c");
+  ASSERT(0 == wc_window_close_interval(w));
+  ASSERT(5 == w->total->total_words);
+  ASSERT(3 == wc_window_top_k(w, top, 4));
+  ASSERT(0 == strcmp("a", (const char *) top[0]->word));
+  ASSERT(0 == strcmp("b", (const char *) top[1]->word));
+
+  // the third interval pushes the first out of the window
+  count_window_text(w, "c c");
+  ASSERT(0 == wc_window_close_interval(w));
+  ASSERT(4 == w->total->total_words);
+  ASSERT(2 == w->total->unique_words);
+  ASSERT(2 == wc_window_top_k(w, top, 4));
+  ASSERT(0 == strcmp("c", (const char *) top[0]->word));
+  ASSERT(3 == top[0]->count);
+  ASSERT(0 == strcmp("b", (const char *) top[1]->word));
+
+  // empty intervals expire everything
+  ASSERT(0 == wc_window_close_interval(w));
+  ASSERT(0 == wc_window_close_interval(w));
+  ASSERT(0 == w->total->total_words);
+  ASSERT(0 == w->total->unique_words);
+  ASSERT(0 == wc_window_top_k(w, top, 4));
+  ASSERT(0 == w->total->num_entries);   // compacted
+  wc_window_destroy(w);
+
+  // an expired count that isn't in the total is reported
+  w = wc_window_create(1, NULL);
+  count_window_text(w, "a a");
+  ASSERT(0 == wc_window_close_interval(w));
+  wc_table_find_or_insert(w->total, (const unsigned char *) "a")->count = 1;
+  ASSERT(-1 == wc_window_close_interval(w));
+  wc_window_destroy(w);
+}
+
+struct PipeWriter {
+  pthread_t thread;
+  int fd;
+  const char *data;
+  size_t len;
+};
+
+static void *pipe_writer_main(void *arg) {
+  struct PipeWriter *pw = (struct PipeWriter *) arg;
+  size_t done = 0;
+  while (done < pw->len) {
+    ssize_t n = write(pw->fd, pw->data + done, pw->len - done);
+    if (n <= 0) {
+      break;
+    }
+    done += (size_t) n;
+  }
+  close(pw->fd);
+  return NULL;
+}
+
+void test_files_count(TestObjs *objs) {
+  (void) objs;
+
+  // a directory with a subdirectory, some small files and one file
+  // big enough to be split into chunks
+  char dir[32];
+  strcpy(dir, "/tmp/wctestsXXXXXX");
+  ASSERT(mkdtemp(dir) != NULL);
+  char path[64];
+  sprintf(path, "%s/sub", dir);
+  ASSERT(0 == mkdir(path, 0700));
+
+  const char *small[] = { "alpha beta\n", "beta gamma gamma\n", "" };
+  const char *names[] = { "a.txt", "sub/b.txt", "sub/c.txt" };
+  struct WcTable *expected = wc_table_create(0);
+  for (unsigned i = 0; i < 3; i++) {
+    sprintf(path, "%s/%s", dir, names[i]);
+    FILE *f = fopen(path, "w");
+    fputs(small[i], f);
+    fclose(f);
+    wc_table_count_buf(expected, (const unsigned char *) small[i], strlen(small[i]));
+  }
+  sprintf(path, "%s/big.txt", dir);
+  FILE *f = fopen(path, "w");
+  for (unsigned i = 0; i < 3000; i++) {
+    char line[64];
+    sprintf(line, "word%u delta delta epsilon%u\n", i % 7, i % 113);
+    fputs(line, f);
+    wc_table_count_buf(expected, (const unsigned char *) line, strlen(line));
+  }
+  fclose(f);
+
+  struct WcFileList list;
+  wc_files_init(&list);
+  ASSERT(-1 == wc_files_add(&list, dir, 0));   // a directory needs recursive
+  ASSERT(0 == wc_files_add(&list, dir, 1));
+  ASSERT(4 == list.num_files);
+  sprintf(path, "%s/a.txt", dir);
+  ASSERT(0 == strcmp(path, list.files[0].path));   // in name order
+
+  // the chunk size splits big.txt into a dozen chunks
+  struct WcFilesOptions opts = { 3, 6000, 1, 0, NULL, NULL };
+  struct WcFilesStats stats;
+  struct WcTable *t = wc_table_create(0);
+  ASSERT(0 == wc_files_count(&list, &opts, t, &stats));
+  ASSERT(stats.num_tasks > 10);
+  ASSERT(expected->total_words == t->total_words);
+  ASSERT(expected->unique_words == t->unique_words);
+  ASSERT(0 == strcmp((const char *) expected->best_word, (const char *) t->best_word));
+  ASSERT(expected->best_word_count == t->best_word_count);
+
+  ASSERT(2 == list.files[0].summary.total_words);
+  ASSERT(12000 == list.files[1].summary.total_words);
+  ASSERT(0 == strcmp("delta", (const char *) list.files[1].summary.best_word));
+  ASSERT(6000 == list.files[1].summary.best_word_count);
+  ASSERT(0 == strcmp("gamma", (const char *) list.files[2].summary.best_word));
+  ASSERT(0 == list.files[3].summary.total_words);
+
+  // a glob pattern, and a file that disappears before it's counted
+  wc_files_free(&list);
+  wc_table_reset(t);
+  sprintf(path, "%s/sub/*.txt", dir);
+  ASSERT(0 == wc_files_add(&list, path, 0));
+  ASSERT(2 == list.num_files);
+  unlink(list.files[1].path);
+  opts.per_file = 0;
+  ASSERT(-1 == wc_files_count(&list, &opts, t, NULL));
+  ASSERT(0 == list.files[0].error);
+  ASSERT(1 == list.files[1].error);
+  ASSERT(3 == t->total_words);
+
+  // a pipe (listed with size 0) is read a block at a time, however
+  // long it is
+  size_t text_len = 0;
+  char *text = (char *) malloc(400000);
+  wc_table_reset(expected);
+  for (unsigned i = 0; i < 10000; i++) {
+    size_t n = sprintf(text + text_len, "pipe%u zeta zeta eta%u\n", i % 11, i % 97);
+    wc_table_count_buf(expected, (const unsigned char *) text + text_len, n);
+    text_len += n;
+  }
+  ASSERT(text_len > 3 * WC_READER_BUF_SIZE);
+  int fds[2];
+  ASSERT(0 == pipe(fds));
+  struct PipeWriter pw = { 0, fds[1], text, text_len };
+  ASSERT(0 == pthread_create(&pw.thread, NULL, pipe_writer_main, &pw));
+  wc_files_free(&list);
+  wc_table_reset(t);
+  sprintf(path, "/dev/fd/%d", fds[0]);
+  ASSERT(0 == wc_files_add(&list, path, 0));
+  ASSERT(0 == list.files[0].size);
+  ASSERT(0 == wc_files_count(&list, &opts, t, &stats));
+  pthread_join(pw.thread, NULL);
+  close(fds[0]);
+  ASSERT(1 == stats.num_tasks);
+  ASSERT(text_len == stats.bytes);
+  ASSERT(expected->total_words == t->total_words);
+  ASSERT(expected->unique_words == t->unique_words);
+  ASSERT(0 == strcmp((const char *) expected->best_word, (const char *) t->best_word));
+  ASSERT(expected->best_word_count == t->best_word_count);
+  free(text);
+
+  sprintf(path, "%s/sub/b.txt", dir);
+  unlink(path);
+  sprintf(path, "%s/sub", dir);
+  rmdir(path);
+  sprintf(path, "%s/a.txt", dir);
+  unlink(path);
+  sprintf(path, "%s/big.txt", dir);
+  unlink(path);
+  rmdir(dir);
+  wc_files_free(&list);
+  wc_table_destroy(t);
+  wc_table_destroy(expected);
+}
+
+void test_tfidf(TestObjs *objs) {
+  (void) objs;
+
+  // four documents, one of them empty and one with a large vocabulary,
+  // repeated so that the document spans more than one read block
+  char dir[32];
+  strcpy(dir, "/tmp/wctestsXXXXXX");
+  ASSERT(mkdtemp(dir) != NULL);
+  char path[64];
+  sprintf(path, "%s/0.txt", dir);
+  FILE *f = fopen(path, "w");
+  fputs("The cat sat. The cat!\n", f);
+  fclose(f);
+  sprintf(path, "%s/1.txt", dir);
+  f = fopen(path, "w");
+  fputs("a dog sat -- 123\n", f);
+  fclose(f);
+  sprintf(path, "%s/2.txt", dir);
+  f = fopen(path, "w");
+  fclose(f);
+  sprintf(path, "%s/3.txt", dir);
+  f = fopen(path, "w");
+  for (unsigned i = 0; i < 18000; i++) {
+    unsigned j = i % 3000;
+    fprintf(f, "z%c%c%c ", 'a' + j / 676, 'a' + j / 26 % 26, 'a' + j % 26);
+  }
+  fputs("sat\n", f);
+  fclose(f);
+
+  struct WcFileList list;
+  wc_files_init(&list);
+  ASSERT(0 == wc_files_add(&list, dir, 1));
+  ASSERT(4 == list.num_files);
+
+  FILE *out = tmpfile();
+  struct WcTfidfOptions opts = { 2, NULL, NULL };
+  struct WcTfidfStats stats;
+  ASSERT(0 == wc_tfidf_run(&list, &opts, out, &stats));
+  ASSERT(4 == stats.num_docs);
+  ASSERT(3005 == stats.num_terms);
+  ASSERT(3007 == stats.num_weights);
+  ASSERT(18009 == stats.num_tokens);   // "--" and "123" aren't terms
+
+  rewind(out);
+  uint32_t num_docs, num_terms;
+  ASSERT(0 == wc_tfidf_read_header(out, &num_docs, &num_terms));
+  ASSERT(4 == num_docs);
+  ASSERT(3005 == num_terms);
+  // the vocabulary is in word order
+  const char *words[] = { "a", "cat", "dog", "sat", "the" };
+  const uint32_t dfs[] = { 1, 1, 1, 3, 1 };
+  struct WcTfidfTerm term;
+  for (unsigned i = 0; i < num_terms; i++) {
+    ASSERT(0 == wc_tfidf_read_term(out, &term));
+    if (i < 5) {
+      ASSERT(0 == strcmp(words[i], (const char *) term.word));
+      ASSERT(dfs[i] == term.df);
+    } else {
+      ASSERT(1 == term.df);
+    }
+  }
+
+  uint32_t *ids = NULL;
+  float *weights = NULL;
+  uint32_t capacity = 0, nnz;
+  double idf1 = log(5.0 / 2.0) + 1.0, idf3 = log(5.0 / 4.0) + 1.0;
+
+  // "the" and "cat" twice, "sat" once
+  ASSERT(0 == wc_tfidf_read_doc(out, &ids, &weights, &capacity, &nnz));
+  ASSERT(3 == nnz);
+  double norm = sqrt(8 * idf1 * idf1 + idf3 * idf3);
+  ASSERT(1 == ids[0] && 3 == ids[1] && 4 == ids[2]);
+  ASSERT(fabs(weights[0] - 2 * idf1 / norm) < 1e-6);
+  ASSERT(fabs(weights[1] - idf3 / norm) < 1e-6);
+  ASSERT(fabs(weights[2] - 2 * idf1 / norm) < 1e-6);
+
+  ASSERT(0 == wc_tfidf_read_doc(out, &ids, &weights, &capacity, &nnz));
+  ASSERT(3 == nnz);
+  norm = sqrt(2 * idf1 * idf1 + idf3 * idf3);
+  ASSERT(0 == ids[0] && 2 == ids[1] && 3 == ids[2]);
+  ASSERT(fabs(weights[0] - idf1 / norm) < 1e-6);
+  ASSERT(fabs(weights[2] - idf3 / norm) < 1e-6);
+
+  ASSERT(0 == wc_tfidf_read_doc(out, &ids, &weights, &capacity, &nnz));
+  ASSERT(0 == nnz);
+
+  ASSERT(0 == wc_tfidf_read_doc(out, &ids, &weights, &capacity, &nnz));
+  ASSERT(3001 == nnz);
+  double sum = 0.0;
+  for (uint32_t i = 0; i < nnz; i++) {
+    ASSERT(i == 0 || ids[i] > ids[i - 1]);
+    sum += weights[i] * weights[i];
+  }
+  ASSERT(fabs(sum - 1.0) < 1e-5);
+  ASSERT(EOF == getc(out));
+
+  // stop words aren't terms
+  rewind(out);
+  opts.stop_words = &wc_stop_builtin;
+  ASSERT(0 == wc_tfidf_run(&list, &opts, out, &stats));
+  ASSERT(3003 == stats.num_terms);   // without "a" and "the"
+  fclose(out);
+
+  for (unsigned i = 0; i < list.num_files; i++) {
+    unlink(list.files[i].path);
+  }
+  rmdir(dir);
+  wc_files_free(&list);
+  free(ids);
+  free(weights);
+}
+
+void test_table_placed(TestObjs *objs) {
+  (void) objs;
+
+  // placed tables count exactly like malloc'd ones, through bucket
+  // growth, resets (recycling slab nodes) and merges
+  struct WcMemPolicy policies[] = {
+    { WC_PAGES_DEFAULT, WC_NUMA_LOCAL },
+    { WC_PAGES_THP, WC_NUMA_DEFAULT },
+    { WC_PAGES_HUGETLB, 0 },    // falls back if there's no pool
+  };
+  struct WcTable *expected = wc_table_create(101);
+  char line[64];
+  for (unsigned i = 0; i < 20000; i++) {
+    sprintf(line, "w%c%c%c%c x ", 'a' + i % 26, 'a' + i / 26 % 26, 'a' + i / 676 % 26, 'a' + i / 17576);
+    wc_table_count_buf(expected, (const unsigned char *) line, strlen(line));
+  }
+  for (unsigned k = 0; k < 3; k++) {
+    struct WcTable *t = wc_table_create_placed(101, &policies[k]);
+    ASSERT(t != NULL);
+    for (int round = 0; round < 2; round++) {
+      wc_table_reset(t);
+      for (unsigned i = 0; i < 20000; i++) {
+        sprintf(line, "w%c%c%c%c x ", 'a' + i % 26, 'a' + i / 26 % 26, 'a' + i / 676 % 26, 'a' + i / 17576);
+        wc_table_count_buf(t, (const unsigned char *) line, strlen(line));
+      }
+    }
+    ASSERT(t->num_buckets > 101);
+    ASSERT(20001 == t->num_nodes);    // the second round reused them
+    ASSERT(expected->total_words == t->total_words);
+    ASSERT(expected->unique_words == t->unique_words);
+    ASSERT(0 == strcmp("x", (const char *) t->best_word));
+    ASSERT(20000 == t->best_word_count);
+
+    struct WcTable *merged = wc_table_create_placed(0, &policies[k]);
+    ASSERT(0 == wc_table_merge(merged, t));
+    ASSERT(expected->unique_words == merged->unique_words);
+    wc_table_destroy(merged);
+    wc_table_destroy(t);
+  }
+  wc_table_destroy(expected);
+
+  struct WcMemStats stats;
+  wc_mem_get_stats(&stats);
+  ASSERT(stats.bytes > 0);
+  ASSERT(stats.huge_bytes > 0);
+
+  // spreading over the nodes, thread by thread
+  struct WcMemPolicy spread = { WC_PAGES_DEFAULT, WC_NUMA_SPREAD };
+  unsigned num_nodes = wc_mem_num_nodes();
+  ASSERT(num_nodes >= 1);
+  for (unsigned i = 0; i < 4; i++) {
+    ASSERT((int) (i % num_nodes) == wc_mem_policy_for_thread(&spread, i).numa);
+  }
+  ASSERT(0 == wc_mem_policy_for_thread(&policies[2], 3).numa);
+  ASSERT(0 == wc_mem_run_on_node(WC_NUMA_DEFAULT));
+}
+
+void test_word_functions(TestObjs *objs) {
+  // every length, with the strings differing at every position
+  struct WordEntry a, b, c;
+  for (unsigned len = 0; len <= MAX_WORDLEN; len++) {
+    for (unsigned i = 0; i < len; i++) {
+      a.word[i] = (unsigned char) ('a' + i % 26);
+    }
+    a.word[len] = '\0';
+    ASSERT(len == wc_word_length(a.word));
+    memset(c.word, 'x', sizeof(c.word));
+    ASSERT(len == wc_word_copy(c.word, a.word));
+    ASSERT(0 == wc_str_compare(c.word, a.word));
+    ASSERT(0 == wc_word_compare(a.word, c.word));
+
+    for (unsigned pos = 0; pos <= len && len < MAX_WORDLEN; pos++) {
+      wc_str_copy(b.word, a.word);
+      b.word[pos] = pos < len ? (unsigned char) (a.word[pos] + 1) : 'z';
+      b.word[pos < len ? len : len + 1] = '\0';
+      ASSERT(wc_str_compare(a.word, b.word) == wc_word_compare(a.word, b.word));
+      ASSERT(wc_str_compare(b.word, a.word) == wc_word_compare(b.word, a.word));
+      ASSERT(wc_word_compare(a.word, b.word) < 0);
+    }
+  }
+  // bytes above 0x7F compare as unsigned
+  ASSERT(wc_word_compare((const unsigned char *) "caf\xc3\xa9", (const unsigned char *) "cafe") > 0);
+  ASSERT(wc_str_compare(objs->test_str_1, objs->test_str_2) == wc_word_compare(objs->test_str_1, objs->test_str_2));
+
+  // words ending just before an unmapped page
+  long page = sysconf(_SC_PAGESIZE);
+  unsigned char *mem = (unsigned char *) mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+                                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT(mem != MAP_FAILED);
+  ASSERT(0 == mprotect(mem + page, page, PROT_NONE));
+  for (unsigned len = 0; len <= MAX_WORDLEN; len++) {
+    unsigned char *w = mem + page - len - 1;
+    memset(w, 'q', len);
+    w[len] = '\0';
+    ASSERT(len == wc_word_length(w));
+    ASSERT(len == wc_word_copy(c.word, w));
+    ASSERT(0 == wc_word_compare(c.word, w));
+    ASSERT(0 == wc_word_compare(w, c.word));
+    c.word[len] = 'q';
+    c.word[len + 1] = '\0';
+    ASSERT(wc_word_compare(w, c.word) < 0);
+    ASSERT(wc_word_compare(c.word, w) > 0);
+  }
+  munmap(mem, 2 * page);
+}
+
+// Words already in a dictionary or table are counted without
+// allocating.
+void test_no_alloc(TestObjs *objs) {
+  struct WordEntry *dict[5] = { NULL, NULL, NULL, NULL, NULL };
+  struct WordEntry *p = NULL;
+
+  wc_dict_find_or_insert(dict, 5, (const unsigned char *) "avis");
+  wc_dict_find_or_insert(dict, 5, (const unsigned char *) "lemur");
+  ASSERT_NO_ALLOC(p = wc_dict_find_or_insert(dict, 5, (const unsigned char *) "avis"));
+  ASSERT(wc_str_compare(p->word, (const unsigned char *) "avis") == 0);
+  ASSERT_NO_ALLOC(p = wc_dict_find_or_insert(dict, 5, (const unsigned char *) "lemur"));
+  ASSERT(wc_str_compare(p->word, (const unsigned char *) "lemur") == 0);
+  for (unsigned i = 0; i < 5; i++) {
+    wc_free_chain(dict[i]);
+  }
+
+  struct WcTable *t = wc_table_create(0);
+  ASSERT(t != NULL);
+  size_t len = strlen((const char *) objs->words_1);
+  wc_table_count_buf(t, objs->words_1, len);
+  uint32_t total = t->total_words;
+  ASSERT_NO_ALLOC(wc_table_count_buf(t, objs->words_1, len));
+  ASSERT(t->total_words == 2 * total);
+  wc_table_destroy(t);
+}
+
+void bench_hash(TestObjs *objs, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    uint32_t hash = wc_hash(objs->words_1);
+    TCTEST_KEEP(hash);
+  }
+}
+
+void bench_str_compare(TestObjs *objs, uint64_t iters) {
+  for (uint64_t i = 0; i < iters; i++) {
+    int cmp = wc_str_compare(objs->test_str_4, objs->test_str_1);
+    TCTEST_KEEP(cmp);
+  }
+}
+
+#define BENCH_DICT_BUCKETS 13249
+
+// Look up words in a dictionary of num_words distinct words (every
+// lookup finds its word)
+void bench_dict_find_or_insert(TestObjs *objs, uint64_t iters, long num_words) {
+  (void) objs;
+  tctest_bench_pause();
+  struct WordEntry *buckets[BENCH_DICT_BUCKETS] = { NULL };
+  unsigned char (*words)[16] = malloc(num_words * sizeof(*words));
+  ASSERT(words != NULL);
+  for (long i = 0; i < num_words; i++) {
+    sprintf((char *) words[i], "w%c%c%c%c", (int) ('a' + i % 26), (int) ('a' + i / 26 % 26),
+            (int) ('a' + i / 676 % 26), (int) ('a' + i / 17576 % 26));
+    wc_dict_find_or_insert(buckets, BENCH_DICT_BUCKETS, words[i]);
+  }
+  tctest_bench_resume();
+
+  long j = 0;
+  for (uint64_t i = 0; i < iters; i++) {
+    struct WordEntry *e = wc_dict_find_or_insert(buckets, BENCH_DICT_BUCKETS, words[j]);
+    TCTEST_KEEP(e);
+    if (++j == num_words) {
+      j = 0;
+    }
+  }
+
+  tctest_bench_pause();
+  for (unsigned i = 0; i < BENCH_DICT_BUCKETS; i++) {
+    wc_free_chain(buckets[i]);
+  }
+  free(words);
+}
+
+void bench_table_count_buf(TestObjs *objs, uint64_t iters) {
+  tctest_bench_pause();
+  struct WcTable *t = wc_table_create(0);
+  ASSERT(t != NULL);
+  size_t len = strlen((const char *) objs->words_1);
+  tctest_bench_resume();
+
+  for (uint64_t i = 0; i < iters; i++) {
+    wc_table_count_buf(t, objs->words_1, len);
+    wc_table_reset(t);
+  }
+
+  tctest_bench_pause();
+  wc_table_destroy(t);
+}
@@ -0,0 +1,633 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "wctfidf.h"
+#include "wcstop.h"
+#include "wctable.h"
+#include "wcpipe.h"
+#include "wcstr.h"
+
+// A term of a worker's dictionary.
+struct Term {
+  unsigned char word[MAX_WORDLEN + 1];
+  uint32_t id;          // local id: position in the worker's term blocks
+  uint32_t df;          // documents (of this worker) containing the term
+  uint32_t last_doc;    // 1 + index of the last document it was seen in
+  uint32_t doc_count;   // occurrences in that document
+  struct Term *next;
+};
+
+// Terms are allocated in blocks, so they never move.
+#define TERM_BLOCK_SHIFT 10
+#define TERM_BLOCK_SIZE (1U << TERM_BLOCK_SHIFT)
+
+// Where a document's (term, count) pairs were spilled.
+struct DocRef {
+  unsigned worker;
+  uint32_t nnz;
+  uint64_t offset;
+};
+
+struct Run {
+  struct WcFileList *docs;
+  const struct WcTfidfOptions *opts;
+  const char *tmp_dir;
+  struct DocRef *refs;
+  unsigned next_doc;      // next document to take (updated atomically)
+  pthread_mutex_t lock;   // protects document errors
+};
+
+struct Worker {
+  struct Run *run;
+  unsigned id;
+  pthread_t thread;
+  int failed;
+
+  struct Term **buckets;
+  unsigned num_buckets;
+  struct Term **blocks;
+  unsigned num_blocks;
+  uint32_t num_terms;
+
+  uint32_t *pairs;        // the current document's (id, count) pairs
+  uint32_t pairs_capacity;
+  unsigned char *buf;     // the block of the current document being read
+
+  FILE *spill;
+  uint64_t spill_bytes;
+  uint64_t tokens;
+  uint32_t *global_ids;   // local id to term id, after the merge
+};
+
+static inline struct Term *term_by_id(const struct Worker *w, uint32_t id) {
+  return &w->blocks[id >> TERM_BLOCK_SHIFT][id & (TERM_BLOCK_SIZE - 1)];
+}
+
+static int grow_buckets(struct Worker *w) {
+  unsigned size = w->num_buckets * 2 + 1;
+  struct Term **buckets = (struct Term **) calloc(size, sizeof(struct Term *));
+  if (buckets == NULL) {
+    return -1;
+  }
+  for (unsigned i = 0; i < w->num_buckets; i++) {
+    struct Term *p = w->buckets[i];
+    while (p != NULL) {
+      struct Term *next = p->next;
+      unsigned index = wc_hash(p->word) % size;
+      p->next = buckets[index];
+      buckets[index] = p;
+      p = next;
+    }
+  }
+  free(w->buckets);
+  w->buckets = buckets;
+  w->num_buckets = size;
+  return 0;
+}
+
+// Find the term for the normalized word, adding it if it's new.
+static struct Term *find_or_insert(struct Worker *w, const unsigned char *word) {
+  unsigned index = wc_hash(word) % w->num_buckets;
+  for (struct Term *p = w->buckets[index]; p != NULL; p = p->next) {
+    if (wc_word_compare(p->word, word) == 0) {
+      return p;
+    }
+  }
+
+  if (w->num_terms == (uint32_t) w->num_blocks << TERM_BLOCK_SHIFT) {
+    struct Term **blocks = (struct Term **) realloc(w->blocks, (w->num_blocks + 1) * sizeof(struct Term *));
+    if (blocks == NULL) {
+      return NULL;
+    }
+    w->blocks = blocks;
+    w->blocks[w->num_blocks] = (struct Term *) malloc(TERM_BLOCK_SIZE * sizeof(struct Term));
+    if (w->blocks[w->num_blocks] == NULL) {
+      return NULL;
+    }
+    w->num_blocks++;
+  }
+  if (w->num_terms > 4 * w->num_buckets) {
+    if (grow_buckets(w) != 0) {
+      return NULL;
+    }
+    index = wc_hash(word) % w->num_buckets;
+  }
+
+  struct Term *p = term_by_id(w, w->num_terms);
+  wc_word_copy(p->word, word);
+  p->id = w->num_terms++;
+  p->df = 0;
+  p->last_doc = 0;
+  p->doc_count = 0;
+  p->next = w->buckets[index];
+  w->buckets[index] = p;
+  return p;
+}
+
+static void free_terms(struct Worker *w) {
+  for (unsigned i = 0; i < w->num_blocks; i++) {
+    free(w->blocks[i]);
+  }
+  free(w->blocks);
+  free(w->buckets);
+  w->blocks = NULL;
+  w->buckets = NULL;
+  w->num_blocks = 0;
+}
+
+static void doc_error(struct Run *run, struct WcFile *f) {
+  pthread_mutex_lock(&run->lock);
+  f->error = 1;
+  pthread_mutex_unlock(&run->lock);
+}
+
+// Count document d, read a block at a time, and spill its (term,
+// count) pairs.
+static void count_doc(struct Worker *w, unsigned d) {
+  struct Run *run = w->run;
+  struct WcFile *f = &run->docs->files[d];
+  struct DocRef *ref = &run->refs[d];
+  ref->worker = w->id;
+  ref->nnz = 0;
+  ref->offset = w->spill_bytes;
+
+  int fd = open(f->path, O_RDONLY);
+  if (fd < 0) {
+    doc_error(run, f);
+    return;
+  }
+  struct WcWordReader reader;
+  wc_reader_init_fd(&reader, fd, w->buf, WC_READER_BUF_SIZE);
+
+  // the pairs buffer first collects the ids of the document's terms,
+  // in order of first occurrence
+  const struct WcStopSet *stop_words = run->opts->stop_words;
+  uint32_t stamp = d + 1;
+  uint32_t nnz = 0;
+  unsigned char word[MAX_WORDLEN + 1];
+  int more;
+  while ((more = wc_reader_next(&reader, word)) > 0) {
+    wc_tolower(word);
+    wc_trim_non_alpha(word);
+    if (word[0] == '\0' || (stop_words != NULL && wc_stop_contains(stop_words, word))) {
+      continue;
+    }
+    struct Term *t = find_or_insert(w, word);
+    if (t == NULL) {
+      w->failed = 1;
+      break;
+    }
+    w->tokens++;
+    if (t->last_doc != stamp) {
+      if (2 * nnz == w->pairs_capacity) {
+        uint32_t capacity = w->pairs_capacity ? w->pairs_capacity * 2 : 2048;
+        uint32_t *pairs = (uint32_t *) realloc(w->pairs, capacity * sizeof(uint32_t));
+        if (pairs == NULL) {
+          w->failed = 1;
+          break;
+        }
+        w->pairs = pairs;
+        w->pairs_capacity = capacity;
+      }
+      t->last_doc = stamp;
+      t->doc_count = 0;
+      t->df++;
+      w->pairs[nnz++] = t->id;
+    }
+    t->doc_count++;
+  }
+  close(fd);
+  if (w->failed) {
+    return;
+  }
+  // a read error still spills the terms counted so far, which are
+  // already in the document frequencies
+  if (more < 0) {
+    doc_error(run, f);
+  }
+
+  // expand the ids into (id, count) pairs in place, from the end
+  for (uint32_t i = nnz; i-- > 0; ) {
+    uint32_t id = w->pairs[i];
+    w->pairs[2 * i] = id;
+    w->pairs[2 * i + 1] = term_by_id(w, id)->doc_count;
+  }
+  if (nnz > 0 && fwrite(w->pairs, 2 * sizeof(uint32_t), nnz, w->spill) != nnz) {
+    w->failed = 1;
+    return;
+  }
+  ref->nnz = nnz;
+  w->spill_bytes += (uint64_t) nnz * 2 * sizeof(uint32_t);
+}
+
+static void *worker_main(void *arg) {
+  struct Worker *w = (struct Worker *) arg;
+  struct Run *run = w->run;
+  while (!w->failed) {
+    unsigned d = __atomic_fetch_add(&run->next_doc, 1, __ATOMIC_RELAXED);
+    if (d >= run->docs->num_files) {
+      break;
+    }
+    count_doc(w, d);
+  }
+  return NULL;
+}
+
+// Create an anonymous read/write temporary file.
+static FILE *tfidf_tmpfile(const char *tmp_dir) {
+  char *name = (char *) malloc(strlen(tmp_dir) + 20);
+  if (name == NULL) {
+    return NULL;
+  }
+  sprintf(name, "%s/wctfidfXXXXXX", tmp_dir);
+  int fd = mkstemp(name);
+  if (fd < 0) {
+    free(name);
+    return NULL;
+  }
+  unlink(name);
+  free(name);
+
+  FILE *f = fdopen(fd, "w+b");
+  if (f == NULL) {
+    close(fd);
+    return NULL;
+  }
+  return f;
+}
+
+// Output encoding
+
+static void put_u32(FILE *out, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    putc((int) ((v >> (8 * i)) & 0xFF), out);
+  }
+}
+
+static void put_varint(FILE *out, uint32_t v) {
+  while (v >= 0x80) {
+    putc((int) ((v & 0x7F) | 0x80), out);
+    v >>= 7;
+  }
+  putc((int) v, out);
+}
+
+static void put_f32(FILE *out, float f) {
+  uint32_t v;
+  memcpy(&v, &f, sizeof(v));
+  put_u32(out, v);
+}
+
+// A term of some worker, for merging the vocabularies.
+struct VocabRef {
+  const struct Term *term;
+  unsigned worker;
+};
+
+static int compare_vocab(const void *a, const void *b) {
+  return wc_word_compare(((const struct VocabRef *) a)->term->word,
+                        ((const struct VocabRef *) b)->term->word);
+}
+
+// A weight of the vector being written.
+struct Weight {
+  uint32_t id;
+  double weight;
+};
+
+static int compare_weights(const void *a, const void *b) {
+  uint32_t x = ((const struct Weight *) a)->id, y = ((const struct Weight *) b)->id;
+  return x < y ? -1 : x > y;
+}
+
+// Merge the workers' dictionaries, write the header and vocabulary,
+// and fill in idf and every worker's global_ids. Frees the
+// dictionaries. Returns the number of terms, or -1 on failure.
+static int64_t write_vocabulary(struct Worker *workers, unsigned num_workers, uint32_t num_docs,
+                                FILE *out, double **idf_out) {
+  size_t total = 0;
+  for (unsigned i = 0; i < num_workers; i++) {
+    total += workers[i].num_terms;
+  }
+  struct VocabRef *refs = (struct VocabRef *) malloc((total + 1) * sizeof(struct VocabRef));
+  uint32_t *dfs = (uint32_t *) malloc((total + 1) * sizeof(uint32_t));
+  if (refs == NULL || dfs == NULL) {
+    free(refs);
+    free(dfs);
+    return -1;
+  }
+  size_t n = 0;
+  for (unsigned i = 0; i < num_workers; i++) {
+    struct Worker *w = &workers[i];
+    w->global_ids = (uint32_t *) malloc((w->num_terms + 1) * sizeof(uint32_t));
+    if (w->global_ids == NULL) {
+      free(refs);
+      free(dfs);
+      return -1;
+    }
+    for (uint32_t id = 0; id < w->num_terms; id++) {
+      refs[n].term = term_by_id(w, id);
+      refs[n].worker = i;
+      n++;
+    }
+  }
+  qsort(refs, total, sizeof(struct VocabRef), compare_vocab);
+
+  // a term's id is its position in word order; the same word counted
+  // by several workers is one term, with the sum of their frequencies
+  uint32_t num_terms = 0;
+  for (size_t i = 0; i < total; i++) {
+    if (i == 0 || wc_word_compare(refs[i].term->word, refs[i - 1].term->word) != 0) {
+      dfs[num_terms++] = 0;
+    }
+    dfs[num_terms - 1] += refs[i].term->df;
+    workers[refs[i].worker].global_ids[refs[i].term->id] = num_terms - 1;
+  }
+
+  double *idf = (double *) malloc((num_terms + 1) * sizeof(double));
+  if (idf == NULL) {
+    free(refs);
+    free(dfs);
+    return -1;
+  }
+  fwrite("WCTFIDF1", 1, 8, out);
+  put_u32(out, num_docs);
+  put_u32(out, num_terms);
+  uint32_t t = 0;
+  for (size_t i = 0; i < total; i++) {
+    if (i > 0 && wc_word_compare(refs[i].term->word, refs[i - 1].term->word) == 0) {
+      continue;
+    }
+    const unsigned char *word = refs[i].term->word;
+    size_t len = strlen((const char *) word);
+    put_varint(out, dfs[t]);
+    putc((int) len, out);
+    fwrite(word, 1, len, out);
+    idf[t] = log((1.0 + num_docs) / (1.0 + dfs[t])) + 1.0;
+    t++;
+  }
+
+  free(refs);
+  free(dfs);
+  for (unsigned i = 0; i < num_workers; i++) {
+    free_terms(&workers[i]);
+  }
+  *idf_out = idf;
+  return num_terms;
+}
+
+// Read back each document's pairs and write its vector.
+static int write_vectors(struct Run *run, struct Worker *workers, const double *idf,
+                         FILE *out, uint64_t *num_weights) {
+  uint32_t capacity = 0;
+  uint32_t *pairs = NULL;
+  struct Weight *weights = NULL;
+  int rc = 0;
+  for (unsigned d = 0; d < run->docs->num_files && rc == 0; d++) {
+    const struct DocRef *ref = &run->refs[d];
+    struct Worker *w = &workers[ref->worker];
+    uint32_t nnz = ref->nnz;
+    if (nnz > capacity) {
+      capacity = nnz;
+      free(pairs);
+      free(weights);
+      pairs = (uint32_t *) malloc(2 * (size_t) capacity * sizeof(uint32_t));
+      weights = (struct Weight *) malloc(capacity * sizeof(struct Weight));
+      if (pairs == NULL || weights == NULL) {
+        rc = -1;
+        break;
+      }
+    }
+    // each worker took its documents in increasing order, so these
+    // reads go through every temporary file sequentially
+    if (nnz > 0 && (fseeko(w->spill, (off_t) ref->offset, SEEK_SET) != 0
+                    || fread(pairs, 2 * sizeof(uint32_t), nnz, w->spill) != nnz)) {
+      rc = -1;
+      break;
+    }
+
+    double sum = 0.0;
+    for (uint32_t i = 0; i < nnz; i++) {
+      uint32_t id = w->global_ids[pairs[2 * i]];
+      double x = pairs[2 * i + 1] * idf[id];
+      weights[i].id = id;
+      weights[i].weight = x;
+      sum += x * x;
+    }
+    qsort(weights, nnz, sizeof(struct Weight), compare_weights);
+    double scale = sum > 0.0 ? 1.0 / sqrt(sum) : 0.0;
+
+    put_varint(out, nnz);
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < nnz; i++) {
+      put_varint(out, weights[i].id - prev);
+      put_f32(out, (float) (weights[i].weight * scale));
+      prev = weights[i].id;
+    }
+    *num_weights += nnz;
+  }
+  free(pairs);
+  free(weights);
+  return rc;
+}
+
+int wc_tfidf_run(struct WcFileList *docs, const struct WcTfidfOptions *opts,
+                 FILE *out, struct WcTfidfStats *stats) {
+  unsigned num_workers = opts->num_threads;
+  if (num_workers == 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = n > 0 ? (unsigned) n : 1;
+  }
+  if (num_workers > docs->num_files) {
+    num_workers = docs->num_files > 0 ? docs->num_files : 1;
+  }
+
+  struct Run run;
+  run.docs = docs;
+  run.opts = opts;
+  run.tmp_dir = opts->tmp_dir;
+  if (run.tmp_dir == NULL) {
+    run.tmp_dir = getenv("TMPDIR");
+  }
+  if (run.tmp_dir == NULL || run.tmp_dir[0] == '\0') {
+    run.tmp_dir = "/tmp";
+  }
+  run.next_doc = 0;
+  run.refs = (struct DocRef *) calloc(docs->num_files + 1, sizeof(struct DocRef));
+  struct Worker *workers = (struct Worker *) calloc(num_workers, sizeof(struct Worker));
+  if (run.refs == NULL || workers == NULL) {
+    free(run.refs);
+    free(workers);
+    return -1;
+  }
+  pthread_mutex_init(&run.lock, NULL);
+
+  int rc = 0;
+  for (unsigned i = 0; i < num_workers; i++) {
+    struct Worker *w = &workers[i];
+    w->run = &run;
+    w->id = i;
+    w->num_buckets = 1021;
+    w->buckets = (struct Term **) calloc(w->num_buckets, sizeof(struct Term *));
+    w->buf = (unsigned char *) malloc(WC_READER_BUF_SIZE);
+    w->spill = tfidf_tmpfile(run.tmp_dir);
+    if (w->buckets == NULL || w->buf == NULL || w->spill == NULL) {
+      rc = -1;
+    }
+  }
+
+  if (rc == 0) {
+    unsigned num_started = 0;
+    for (; num_started < num_workers; num_started++) {
+      if (pthread_create(&workers[num_started].thread, NULL, worker_main,
+                         &workers[num_started]) != 0) {
+        break;
+      }
+    }
+    // if some threads couldn't be started, this thread does their work
+    for (unsigned i = num_started; i < num_workers; i++) {
+      worker_main(&workers[i]);
+    }
+    for (unsigned i = 0; i < num_started; i++) {
+      pthread_join(workers[i].thread, NULL);
+    }
+  }
+
+  uint64_t tokens = 0, tmp_bytes = 0;
+  for (unsigned i = 0; i < num_workers && rc == 0; i++) {
+    struct Worker *w = &workers[i];
+    if (w->failed || fflush(w->spill) != 0) {
+      rc = -1;
+    }
+    tokens += w->tokens;
+    tmp_bytes += w->spill_bytes;
+  }
+
+  double *idf = NULL;
+  int64_t num_terms = 0;
+  uint64_t num_weights = 0;
+  if (rc == 0) {
+    num_terms = write_vocabulary(workers, num_workers, docs->num_files, out, &idf);
+    if (num_terms < 0) {
+      rc = -1;
+    }
+  }
+  if (rc == 0) {
+    rc = write_vectors(&run, workers, idf, out, &num_weights);
+  }
+  if (rc == 0 && (fflush(out) != 0 || ferror(out))) {
+    rc = -1;
+  }
+
+  for (unsigned i = 0; i < docs->num_files && rc == 0; i++) {
+    if (docs->files[i].error) {
+      rc = -1;
+    }
+  }
+  if (stats != NULL) {
+    stats->num_docs = docs->num_files;
+    stats->num_terms = num_terms > 0 ? (uint32_t) num_terms : 0;
+    stats->num_weights = num_weights;
+    stats->num_tokens = tokens;
+    stats->tmp_bytes = tmp_bytes;
+  }
+
+  for (unsigned i = 0; i < num_workers; i++) {
+    struct Worker *w = &workers[i];
+    free_terms(w);
+    free(w->pairs);
+    free(w->buf);
+    free(w->global_ids);
+    if (w->spill != NULL) {
+      fclose(w->spill);
+    }
+  }
+  free(workers);
+  free(idf);
+  free(run.refs);
+  pthread_mutex_destroy(&run.lock);
+  return rc;
+}
+
+// Reading the output back
+
+static int get_u32(FILE *in, uint32_t *v) {
+  unsigned char b[4];
+  if (fread(b, 1, 4, in) != 4) {
+    return -1;
+  }
+  *v = (uint32_t) b[0] | (uint32_t) b[1] << 8 | (uint32_t) b[2] << 16 | (uint32_t) b[3] << 24;
+  return 0;
+}
+
+static int get_varint(FILE *in, uint32_t *v) {
+  uint32_t x = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int c = getc(in);
+    if (c == EOF) {
+      return -1;
+    }
+    x |= (uint32_t) (c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      *v = x;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int wc_tfidf_read_header(FILE *in, uint32_t *num_docs, uint32_t *num_terms) {
+  char magic[8];
+  if (fread(magic, 1, 8, in) != 8 || memcmp(magic, "WCTFIDF1", 8) != 0) {
+    return -1;
+  }
+  return get_u32(in, num_docs) != 0 || get_u32(in, num_terms) != 0 ? -1 : 0;
+}
+
+int wc_tfidf_read_term(FILE *in, struct WcTfidfTerm *term) {
+  int len;
+  if (get_varint(in, &term->df) != 0 || (len = getc(in)) == EOF || len > MAX_WORDLEN
+      || fread(term->word, 1, (size_t) len, in) != (size_t) len) {
+    return -1;
+  }
+  term->word[len] = '\0';
+  return 0;
+}
+
+int wc_tfidf_read_doc(FILE *in, uint32_t **ids, float **weights, uint32_t *capacity,
+                      uint32_t *nnz) {
+  uint32_t n;
+  if (get_varint(in, &n) != 0) {
+    return -1;
+  }
+  if (n > *capacity) {
+    uint32_t *new_ids = (uint32_t *) realloc(*ids, n * sizeof(uint32_t));
+    if (new_ids != NULL) {
+      *ids = new_ids;
+    }
+    float *new_weights = (float *) realloc(*weights, n * sizeof(float));
+    if (new_weights != NULL) {
+      *weights = new_weights;
+    }
+    if (new_ids == NULL || new_weights == NULL) {
+      return -1;
+    }
+    *capacity = n;
+  }
+  uint32_t id = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t delta, bits;
+    if (get_varint(in, &delta) != 0 || get_u32(in, &bits) != 0) {
+      return -1;
+    }
+    id += delta;
+    (*ids)[i] = id;
+    memcpy(&(*weights)[i], &bits, sizeof(float));
+  }
+  *nnz = n;
+  return 0;
+}
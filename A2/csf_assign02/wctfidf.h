@@ -0,0 +1,86 @@
+#ifndef WCTFIDF_H
+#define WCTFIDF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "wcfuncs.h"
+#include "wcfiles.h"
+
+// Document frequencies and TF-IDF vectors over a collection of
+// documents (one per file).
+//
+// Documents are counted in parallel, each worker thread taking the
+// next document in turn and keeping its own term dictionary. Each
+// term stores the (1-based) index of the last document it was seen
+// in; the first time a term turns up in a document, the stamp is
+// updated, the term's document frequency incremented and the term
+// appended to the document's term list, so a document's distinct
+// terms are found without a per-document hash set. Documents are read
+// a block at a time, and when one ends, its (term, count) pairs are
+// appended to the worker's temporary file, so only the dictionaries
+// stay in memory, however long the documents are.
+//
+// Once every document is counted, the dictionaries are merged into
+// the global vocabulary (sorted by word, which gives the term ids)
+// and the documents are written out in input order, reading their
+// pairs back from the temporary files. The weight of a term t in
+// document d is
+//
+//   count(t, d) * (ln((1 + N) / (1 + df(t))) + 1)
+//
+// for N documents, and every vector is scaled to unit (L2) length.
+// Tokens that normalize to the empty word are not terms.
+//
+// Output format (integers little-endian; "varint" is LEB128):
+//
+//   "WCTFIDF1"                   magic
+//   u32 num_docs, u32 num_terms
+//   num_terms times:             the vocabulary, by term id
+//     varint df, u8 len, len bytes of the word
+//   num_docs times:              the vectors, in input order
+//     varint nnz
+//     nnz times: varint id delta (from the previous id, or from 0
+//                for the first), f32 weight
+
+struct WcTfidfOptions {
+  unsigned num_threads;                // 0 for one per CPU
+  const struct WcStopSet *stop_words;  // words that aren't terms, or NULL
+  const char *tmp_dir;                 // NULL for $TMPDIR or /tmp
+};
+
+struct WcTfidfStats {
+  uint32_t num_docs;
+  uint32_t num_terms;
+  uint64_t num_weights;   // nonzero entries over all vectors
+  uint64_t num_tokens;    // term occurrences counted
+  uint64_t tmp_bytes;     // bytes written to temporary files
+};
+
+// Compute the TF-IDF vectors of the documents in docs and write them
+// to out. Documents that can't be read are marked with error and
+// written as empty vectors. stats may be NULL. Returns 0 on success,
+// -1 if a document couldn't be read, memory ran out, or a temporary
+// file or the output couldn't be written.
+int wc_tfidf_run(struct WcFileList *docs, const struct WcTfidfOptions *opts,
+                 FILE *out, struct WcTfidfStats *stats);
+
+// Reading the output back.
+
+struct WcTfidfTerm {
+  unsigned char word[MAX_WORDLEN + 1];
+  uint32_t df;
+};
+
+// Read the header. Returns 0 on success, -1 on a bad or short file.
+int wc_tfidf_read_header(FILE *in, uint32_t *num_docs, uint32_t *num_terms);
+
+// Read the next vocabulary entry. Returns 0 on success, -1 on error.
+int wc_tfidf_read_term(FILE *in, struct WcTfidfTerm *term);
+
+// Read the next document's vector into *ids and *weights (arrays of
+// *capacity elements, grown with realloc as needed), storing its
+// length in *nnz. Returns 0 on success, -1 on error.
+int wc_tfidf_read_doc(FILE *in, uint32_t **ids, float **weights, uint32_t *capacity,
+                      uint32_t *nnz);
+
+#endif // WCTFIDF_H
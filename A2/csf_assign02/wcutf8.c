@@ -0,0 +1,248 @@
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "wcutf8.h"
+
+size_t wc_utf8_ascii_prefix(const unsigned char *buf, size_t len) {
+  size_t i = 0;
+#ifdef __SSE2__
+  // 32 bytes per step: a byte is non-ASCII iff its top bit is set, so
+  // one movemask of the OR of two vectors checks them all
+  for (; i + 32 <= len; i += 32) {
+    __m128i a = _mm_loadu_si128((const __m128i *) (buf + i));
+    __m128i b = _mm_loadu_si128((const __m128i *) (buf + i + 16));
+    if (_mm_movemask_epi8(_mm_or_si128(a, b)) != 0) {
+      break;
+    }
+  }
+  if (i + 16 <= len) {
+    int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (buf + i)));
+    if (mask != 0) {
+      return i + (size_t) __builtin_ctz((unsigned) mask);
+    }
+    i += 16;
+  }
+#else
+  for (; i + 8 <= len; i += 8) {
+    uint64_t x;
+    memcpy(&x, buf + i, sizeof(x));
+    if ((x & 0x8080808080808080ULL) != 0) {
+      break;
+    }
+  }
+#endif
+  while (i < len && buf[i] < 0x80) {
+    i++;
+  }
+  return i;
+}
+
+uint32_t wc_utf8_decode(const unsigned char *s, size_t len, unsigned *n) {
+  unsigned char c = s[0];
+  unsigned need;
+  uint32_t cp, min;
+
+  *n = 1;
+  if (c < 0x80) {
+    return c;
+  } else if (c >= 0xC2 && c <= 0xDF) {
+    need = 1;
+    cp = c & 0x1F;
+    min = 0x80;
+  } else if ((c & 0xF0) == 0xE0) {
+    need = 2;
+    cp = c & 0x0F;
+    min = 0x800;
+  } else if (c >= 0xF0 && c <= 0xF4) {
+    need = 3;
+    cp = c & 0x07;
+    min = 0x10000;
+  } else {
+    return WC_UTF8_INVALID;
+  }
+
+  if (len <= need) {
+    return WC_UTF8_INVALID;
+  }
+  for (unsigned i = 1; i <= need; i++) {
+    if ((s[i] & 0xC0) != 0x80) {
+      return WC_UTF8_INVALID;
+    }
+    cp = (cp << 6) | (s[i] & 0x3F);
+  }
+  // reject overlong forms, surrogates and code points past U+10FFFF
+  if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+    return WC_UTF8_INVALID;
+  }
+  *n = need + 1;
+  return cp;
+}
+
+size_t wc_utf8_validate(const unsigned char *buf, size_t len) {
+  size_t i = 0;
+  for (;;) {
+    i += wc_utf8_ascii_prefix(buf + i, len - i);
+    if (i == len) {
+      return len;
+    }
+    unsigned n;
+    if (wc_utf8_decode(buf + i, len - i, &n) == WC_UTF8_INVALID) {
+      return i;
+    }
+    i += n;
+  }
+}
+
+// Encode the code point cp into out, returning the number of bytes.
+static unsigned encode(uint32_t cp, unsigned char *out) {
+  if (cp < 0x80) {
+    out[0] = (unsigned char) cp;
+    return 1;
+  } else if (cp < 0x800) {
+    out[0] = (unsigned char) (0xC0 | (cp >> 6));
+    out[1] = (unsigned char) (0x80 | (cp & 0x3F));
+    return 2;
+  } else if (cp < 0x10000) {
+    out[0] = (unsigned char) (0xE0 | (cp >> 12));
+    out[1] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (unsigned char) (0x80 | (cp & 0x3F));
+    return 3;
+  }
+  out[0] = (unsigned char) (0xF0 | (cp >> 18));
+  out[1] = (unsigned char) (0x80 | ((cp >> 12) & 0x3F));
+  out[2] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+  out[3] = (unsigned char) (0x80 | (cp & 0x3F));
+  return 4;
+}
+
+void wc_utf8_normalize(const unsigned char *w, size_t len, unsigned char *out) {
+  size_t n_out = 0;
+  size_t keep = 0;   // length of out up to and including its last letter
+  size_t i = 0;
+
+  while (i < len) {
+    unsigned n;
+    uint32_t cp = wc_utf8_decode(w + i, len - i, &n);
+    unsigned char enc[4];
+    unsigned m;
+    int letter;
+
+    if (cp == WC_UTF8_INVALID) {
+      enc[0] = w[i];
+      m = 1;
+      letter = 0;
+    } else if (cp < 0x80) {
+      enc[0] = (cp >= 'A' && cp <= 'Z') ? (unsigned char) (cp + ('a' - 'A')) : (unsigned char) cp;
+      m = 1;
+      letter = wc_isalpha(enc[0]);
+    } else {
+      cp = wc_utf8_fold(cp);
+      m = encode(cp, enc);
+      letter = wc_utf8_isletter(cp);
+    }
+
+    if (n_out + m > MAX_WORDLEN) {
+      break;
+    }
+    memcpy(out + n_out, enc, m);
+    n_out += m;
+    if (letter) {
+      keep = n_out;
+    }
+    i += n;
+  }
+  out[keep] = '\0';
+}
+
+// Count the parts of the non-ASCII word w (of length len) between
+// Unicode white space.
+static void count_parts(struct WcTable *t, const unsigned char *w, size_t len) {
+  unsigned char out[MAX_WORDLEN + 1];
+  size_t start = 0;
+  size_t i = 0;
+
+  while (i < len) {
+    unsigned n;
+    uint32_t cp = wc_utf8_decode(w + i, len - i, &n);
+    if (cp != WC_UTF8_INVALID && cp >= 0x80 && wc_utf8_isspace(cp)) {
+      if (i > start) {
+        wc_utf8_normalize(w + start, i - start, out);
+        wc_table_count_normalized(t, out);
+      }
+      start = i + n;
+    }
+    i += n;
+  }
+  if (len > start) {
+    wc_utf8_normalize(w + start, len - start, out);
+    wc_table_count_normalized(t, out);
+  }
+}
+
+void wc_utf8_count_word(struct WcTable *t, unsigned char *w) {
+  size_t len = 0;
+  unsigned char bits = 0;
+  for (; w[len] != '\0'; len++) {
+    bits |= w[len];
+  }
+  if (bits < 0x80) {
+    wc_table_count_word(t, w);
+  } else {
+    count_parts(t, w, len);
+  }
+}
+
+// In both counting loops below, next_non_ascii is the position of
+// the first non-ASCII byte at or after the start of the current word,
+// so a word ending at or before it is pure ASCII and takes the byte
+// path without being looked at again. The buffer is only rescanned
+// after a word that (probably) wasn't ASCII.
+
+void wc_utf8_count_buf(struct WcTable *t, const unsigned char *buf, size_t len) {
+  unsigned char word[MAX_WORDLEN + 1];
+  size_t pos = 0;
+  size_t next_non_ascii = wc_utf8_ascii_prefix(buf, len);
+
+  while (wc_buf_readnext(buf, len, &pos, word)) {
+    if (pos <= next_non_ascii) {
+      wc_table_count_word(t, word);
+    } else {
+      wc_utf8_count_word(t, word);
+      next_non_ascii = pos + wc_utf8_ascii_prefix(buf + pos, len - pos);
+    }
+  }
+}
+
+int wc_utf8_count_pipe(struct WcPipe *p, struct WcTable *t) {
+  struct WcSplitter s;
+  unsigned char word[MAX_WORDLEN + 1];
+  const unsigned char *buf;
+  ssize_t len;
+
+  wc_splitter_init(&s);
+  while ((len = wc_pipe_next(p, &buf)) > 0) {
+    size_t pos = 0;
+    size_t next_non_ascii = wc_utf8_ascii_prefix(buf, (size_t) len);
+    for (;;) {
+      // a word carried over from the previous buffer starts with
+      // bytes this buffer's scan hasn't seen
+      int carried = s.partial_len > 0;
+      if (!wc_splitter_next(&s, buf, (size_t) len, &pos, word)) {
+        break;
+      }
+      if (pos <= next_non_ascii && !carried) {
+        wc_table_count_word(t, word);
+      } else {
+        wc_utf8_count_word(t, word);
+        if (pos > next_non_ascii) {
+          next_non_ascii = pos + wc_utf8_ascii_prefix(buf + pos, (size_t) len - pos);
+        }
+      }
+    }
+  }
+  if (wc_splitter_finish(&s, word)) {
+    wc_utf8_count_word(t, word);
+  }
+  return len < 0 ? -1 : 0;
+}
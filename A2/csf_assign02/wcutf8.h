@@ -0,0 +1,110 @@
+#ifndef WCUTF8_H
+#define WCUTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "wcfuncs.h"
+#include "wctable.h"
+#include "wcpipe.h"
+
+// UTF-8 aware word normalization.
+//
+// wc_tolower and wc_trim_non_alpha only know ASCII letters, so the É
+// of "Éléphant" stays capital and "café" is trimmed to "caf" (the
+// bytes of é aren't ASCII letters). In UTF-8 mode a word is decoded
+// into code points, every code point is case folded, trailing code
+// points that aren't letters (or combining marks) are trimmed, and
+// Unicode white space (no-break space, em space, ...) splits words
+// just as ASCII white space does.
+//
+// Words are still found by splitting the input on ASCII white space
+// (wc_buf_readnext, WcSplitter), so buffer and chunk boundaries work
+// as they do in the byte path, and words made only of ASCII are
+// handed straight to wc_table_count_word. The check for non-ASCII
+// bytes is done on the buffer rather than on each word, 32 bytes at
+// a time, so pure-ASCII input costs one vector scan on top of the
+// byte path.
+//
+// Bytes that aren't valid UTF-8 (overlong forms, surrogates, code
+// points past U+10FFFF, truncated sequences) are kept as they are and
+// treated as non-letters.
+//
+// The Unicode tables live in wcutf8tables.c, generated by
+// wcutf8gen.py.
+
+// Returned by wc_utf8_decode for a byte that doesn't start a valid
+// sequence
+#define WC_UTF8_INVALID 0xFFFFFFFFU
+
+// Shape of the generated tables (checked by wcutf8tables.c)
+#define WC_UTF8_LETTER_SHIFT 8
+#define WC_UTF8_FOLD_SHIFT 5
+#define WC_UTF8_FOLD_LIMIT 0x1E940
+
+extern const uint8_t wc_utf8_letter_index[0x110000 >> WC_UTF8_LETTER_SHIFT];
+extern const uint32_t wc_utf8_letter_bits[][1 << WC_UTF8_LETTER_SHIFT >> 5];
+extern const uint8_t wc_utf8_fold_index[WC_UTF8_FOLD_LIMIT >> WC_UTF8_FOLD_SHIFT];
+extern const int32_t wc_utf8_fold_delta[][1 << WC_UTF8_FOLD_SHIFT];
+
+// Return 1 if the code point cp is a letter or a combining mark.
+static inline int wc_utf8_isletter(uint32_t cp) {
+  if (cp >= 0x110000) {
+    return 0;
+  }
+  const uint32_t *bits = wc_utf8_letter_bits[wc_utf8_letter_index[cp >> WC_UTF8_LETTER_SHIFT]];
+  uint32_t i = cp & ((1U << WC_UTF8_LETTER_SHIFT) - 1);
+  return (bits[i >> 5] >> (i & 31)) & 1;
+}
+
+// Return 1 if the code point cp is (ASCII or Unicode) white space.
+static inline int wc_utf8_isspace(uint32_t cp) {
+  if (cp < 0x80) {
+    return wc_isspace((unsigned char) cp);
+  }
+  return cp == 0x85 || cp == 0xA0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200A)
+    || cp == 0x2028 || cp == 0x2029 || cp == 0x202F || cp == 0x205F || cp == 0x3000;
+}
+
+// Return the simple case folding of the code point cp.
+static inline uint32_t wc_utf8_fold(uint32_t cp) {
+  if (cp >= WC_UTF8_FOLD_LIMIT) {
+    return cp;
+  }
+  return cp + (uint32_t) wc_utf8_fold_delta[wc_utf8_fold_index[cp >> WC_UTF8_FOLD_SHIFT]]
+                                           [cp & ((1U << WC_UTF8_FOLD_SHIFT) - 1)];
+}
+
+// Return the length of the run of ASCII bytes at the start of buf.
+size_t wc_utf8_ascii_prefix(const unsigned char *buf, size_t len);
+
+// Decode the code point starting at s (of the len bytes available),
+// storing the number of bytes it uses in *n. Returns WC_UTF8_INVALID
+// (with *n set to 1) if s doesn't start a valid sequence.
+uint32_t wc_utf8_decode(const unsigned char *s, size_t len, unsigned *n);
+
+// Return the length of the longest prefix of buf that is valid UTF-8
+// (len if all of it is).
+size_t wc_utf8_validate(const unsigned char *buf, size_t len);
+
+// Normalize the first len bytes of w into out (which must hold
+// MAX_WORDLEN + 1 bytes): case fold every code point and trim
+// trailing non-letters. A word that would grow past MAX_WORDLEN
+// bytes is cut at a code point boundary.
+void wc_utf8_normalize(const unsigned char *w, size_t len, unsigned char *out);
+
+// Count the word w (as found by splitting on ASCII white space) in
+// UTF-8 mode: split it on Unicode white space, then normalize and
+// count each part. A pure-ASCII word is counted by
+// wc_table_count_word, exactly as in the byte path. w may be
+// modified.
+void wc_utf8_count_word(struct WcTable *t, unsigned char *w);
+
+// Count every word in the given in-memory buffer in UTF-8 mode.
+void wc_utf8_count_buf(struct WcTable *t, const unsigned char *buf, size_t len);
+
+// Count every word read from the pipe in UTF-8 mode (the UTF-8
+// version of wc_pipe_count_table). Returns 0 on success, -1 on a
+// read error.
+int wc_utf8_count_pipe(struct WcPipe *p, struct WcTable *t);
+
+#endif // WCUTF8_H
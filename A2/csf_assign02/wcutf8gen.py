@@ -0,0 +1,109 @@
+#! /usr/bin/env python3
+
+# Generate wcutf8tables.c, the Unicode tables used by wcutf8.c,
+# from the Unicode database of the running Python.
+#
+# Usage: ./wcutf8gen.py > wcutf8tables.c
+#
+# Two tables are written, both two-stage (an index of blocks, then
+# the deduplicated blocks):
+#
+#   - word characters: a bit per code point, set for letters (L*)
+#     and combining marks (M*), in blocks of 256 code points
+#   - simple case folding: a delta to add to each code point, in
+#     blocks of 32 code points, up to the last code point that folds
+#
+# The folding of a character is its case fold if that is a single
+# character, otherwise its lowercase if that is a single character,
+# otherwise the character itself, which approximates Unicode's
+# simple case folding (the C and S mappings of CaseFolding.txt).
+
+import sys
+import unicodedata
+
+LETTER_SHIFT = 8
+FOLD_SHIFT = 5
+
+
+def is_word_char(cp):
+    return unicodedata.category(chr(cp))[0] in 'LM'
+
+
+def fold(cp):
+    c = chr(cp)
+    f = c.casefold()
+    if len(f) == 1 and f != c:
+        return ord(f)
+    f = c.lower()
+    if len(f) == 1 and f != c:
+        return ord(f)
+    return cp
+
+
+def two_stage(num_blocks, block_of):
+    blocks = {}
+    index = []
+    for b in range(num_blocks):
+        block = block_of(b)
+        index.append(blocks.setdefault(block, len(blocks)))
+    return index, sorted(blocks, key=blocks.get)
+
+
+def write_array(out, decl, values, per_line, fmt):
+    out.write('%s = {' % decl)
+    for i, v in enumerate(values):
+        out.write(('\n  ' if i % per_line == 0 else ' ') + fmt % v + ',')
+    out.write('\n};\n\n')
+
+
+def main():
+    out = sys.stdout
+
+    def letter_block(b):
+        words = []
+        for w in range(1 << LETTER_SHIFT >> 5):
+            bits = 0
+            for i in range(32):
+                if is_word_char((b << LETTER_SHIFT) + w * 32 + i):
+                    bits |= 1 << i
+            words.append(bits)
+        return tuple(words)
+
+    letter_index, letter_blocks = two_stage(0x110000 >> LETTER_SHIFT, letter_block)
+
+    fold_limit = max(cp for cp in range(0x80, 0x110000) if fold(cp) != cp) + 1
+    fold_limit = (fold_limit + (1 << FOLD_SHIFT) - 1) >> FOLD_SHIFT << FOLD_SHIFT
+
+    def fold_block(b):
+        first = b << FOLD_SHIFT
+        return tuple(fold(cp) - cp for cp in range(first, first + (1 << FOLD_SHIFT)))
+
+    fold_index, fold_blocks = two_stage(fold_limit >> FOLD_SHIFT, fold_block)
+    assert len(letter_blocks) <= 256 and len(fold_blocks) <= 256
+
+    out.write('// Generated by wcutf8gen.py from Unicode %s; do not edit.\n'
+              % unicodedata.unidata_version)
+    out.write('#include "wcutf8.h"\n\n')
+    out.write('#if WC_UTF8_LETTER_SHIFT != %d || WC_UTF8_FOLD_SHIFT != %d '
+              '|| WC_UTF8_FOLD_LIMIT != 0x%X\n' % (LETTER_SHIFT, FOLD_SHIFT, fold_limit))
+    out.write('#error "wcutf8.h does not match the generated tables"\n#endif\n\n')
+
+    write_array(out, 'const uint8_t wc_utf8_letter_index[%d]' % len(letter_index),
+                letter_index, 16, '%d')
+    out.write('const uint32_t wc_utf8_letter_bits[%d][%d] = {\n'
+              % (len(letter_blocks), 1 << LETTER_SHIFT >> 5))
+    for block in letter_blocks:
+        out.write('  { ' + ', '.join('0x%08X' % w for w in block) + ' },\n')
+    out.write('};\n\n')
+
+    write_array(out, 'const uint8_t wc_utf8_fold_index[%d]' % len(fold_index),
+                fold_index, 16, '%d')
+    out.write('const int32_t wc_utf8_fold_delta[%d][%d] = {\n'
+              % (len(fold_blocks), 1 << FOLD_SHIFT))
+    for block in fold_blocks:
+        out.write('  { ' + ', '.join('%d' % d for d in block) + ' },\n')
+    out.write('};\n')
+
+
+if __name__ == '__main__':
+    main()
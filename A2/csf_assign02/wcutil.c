@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "wcutil.h"
+
+double wc_now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned char *wc_read_file(const char *filename, size_t *len) {
+  FILE *in = fopen(filename, "rb");
+  if (!in) {
+    return NULL;
+  }
+  size_t cap = 1 << 16;
+  size_t n = 0;
+  unsigned char *buf = (unsigned char *) malloc(cap);
+  size_t rc;
+  while (buf != NULL && (rc = fread(buf + n, 1, cap - n, in)) > 0) {
+    n += rc;
+    if (n == cap) {
+      cap *= 2;
+      unsigned char *p = (unsigned char *) realloc(buf, cap);
+      if (p == NULL) {
+        free(buf);
+      }
+      buf = p;
+    }
+  }
+  if (buf != NULL && ferror(in)) {
+    free(buf);
+    buf = NULL;
+  }
+  fclose(in);
+  *len = n;
+  return buf;
+}
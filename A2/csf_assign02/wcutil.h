@@ -0,0 +1,16 @@
+#ifndef WCUTIL_H
+#define WCUTIL_H
+
+#include <stddef.h>
+
+// Small helpers shared by c_wordcount and the benchmark programs.
+
+// The time in seconds on a monotonic clock, for measuring intervals.
+double wc_now_seconds(void);
+
+// Read an entire file into a buffer allocated with malloc, storing
+// its length in *len. Returns NULL if the file can't be opened or
+// read, or memory runs out.
+unsigned char *wc_read_file(const char *filename, size_t *len);
+
+#endif // WCUTIL_H
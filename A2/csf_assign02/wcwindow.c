@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include "wcwindow.h"
+
+struct WcWindow *wc_window_create(unsigned num_intervals, const struct WcStopSet *stop_words) {
+  if (num_intervals < 1) {
+    num_intervals = 1;
+  }
+  struct WcWindow *w = (struct WcWindow *) calloc(1, sizeof(struct WcWindow));
+  if (w == NULL) {
+    return NULL;
+  }
+  w->num_intervals = num_intervals;
+  w->intervals = (struct WcTable **) calloc(num_intervals + 1, sizeof(struct WcTable *));
+  w->total = wc_table_create(0);
+  if (w->intervals == NULL || w->total == NULL) {
+    wc_window_destroy(w);
+    return NULL;
+  }
+  w->total->stop_words = stop_words;
+  for (unsigned i = 0; i <= num_intervals; i++) {
+    w->intervals[i] = wc_table_create(0);
+    if (w->intervals[i] == NULL) {
+      wc_window_destroy(w);
+      return NULL;
+    }
+    w->intervals[i]->stop_words = stop_words;
+  }
+  return w;
+}
+
+void wc_window_destroy(struct WcWindow *w) {
+  if (w == NULL) {
+    return;
+  }
+  if (w->intervals != NULL) {
+    for (unsigned i = 0; i <= w->num_intervals; i++) {
+      wc_table_destroy(w->intervals[i]);
+    }
+  }
+  free(w->intervals);
+  wc_table_destroy(w->total);
+  free(w);
+}
+
+int wc_window_close_interval(struct WcWindow *w) {
+  if (wc_table_merge(w->total, wc_window_current(w)) != 0) {
+    return -1;
+  }
+
+  // the slot after the current one holds the oldest complete
+  // interval (or an empty table while the window is filling up)
+  w->current = (w->current + 1) % (w->num_intervals + 1);
+  struct WcTable *expired = wc_window_current(w);
+  if (w->num_closed < w->num_intervals) {
+    w->num_closed++;
+  } else {
+    int rc = wc_table_subtract(w->total, expired);
+    w->num_expired += expired->num_entries;
+    if (rc != 0) {
+      // the total no longer matches its intervals
+      wc_table_reset(expired);
+      return -1;
+    }
+  }
+  wc_table_reset(expired);
+
+  if (w->total->num_entries - w->total->unique_words > w->total->unique_words) {
+    wc_table_compact(w->total);
+  }
+  return 0;
+}
+
+unsigned wc_window_top_k(const struct WcWindow *w, struct WordEntry **out, unsigned k) {
+  unsigned n = wc_table_top_k(w->total, out, k);
+  // zero counts sort last, so they can only be at the end
+  while (n > 0 && out[n - 1]->count == 0) {
+    n--;
+  }
+  return n;
+}
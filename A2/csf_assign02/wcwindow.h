@@ -0,0 +1,58 @@
+#ifndef WCWINDOW_H
+#define WCWINDOW_H
+
+#include <stdint.h>
+#include "wctable.h"
+
+// Word counts over a sliding window of time.
+//
+// The window is divided into num_intervals intervals of equal
+// length, each counted in its own WcTable. Words are counted into the
+// current interval's table (wc_window_current); closing the interval
+// adds it to the window's running total and subtracts the interval
+// that has just fallen out of the window. Both steps take time
+// proportional to the number of distinct words in those intervals,
+// not to the size of the whole vocabulary, and the expired table is
+// reset and reused as the next current interval.
+//
+// The total covers the complete intervals only, so it changes once
+// per interval. Words whose count drops to zero are dropped from the
+// total once they make up half of its entries, which keeps its size
+// proportional to the vocabulary of the window at an amortized cost
+// of O(1) per expired entry.
+
+struct WcWindow {
+  struct WcTable **intervals;  // ring of num_intervals + 1 tables
+  unsigned num_intervals;      // complete intervals in a full window
+  unsigned current;            // index of the interval being counted
+  unsigned num_closed;         // complete intervals in the total so far
+  struct WcTable *total;       // counts over the complete intervals
+  uint64_t num_expired;        // entries subtracted from the total
+};
+
+// Create an empty window of num_intervals (at least 1) intervals.
+// Every table counts with the given stop-word set (which may be NULL).
+// Returns NULL if memory could not be allocated.
+struct WcWindow *wc_window_create(unsigned num_intervals, const struct WcStopSet *stop_words);
+
+// Free a window and all of its tables.
+void wc_window_destroy(struct WcWindow *w);
+
+// Return the table of the interval being counted.
+static inline struct WcTable *wc_window_current(struct WcWindow *w) {
+  return w->intervals[w->current];
+}
+
+// Close the current interval: add it to the total, expire the oldest
+// interval if the window is full, and start a new, empty interval.
+// Returns 0 on success, -1 if memory could not be allocated or the
+// total lacks some of the expired interval's counts (as when a count
+// in the total overflowed); the window's counts are then unreliable.
+int wc_window_close_interval(struct WcWindow *w);
+
+// Store pointers to (at most) the k most frequent words of the total
+// in out, as wc_table_top_k does, leaving out words whose count has
+// dropped to zero. Returns the number of entries stored.
+unsigned wc_window_top_k(const struct WcWindow *w, struct WordEntry **out, unsigned k);
+
+#endif // WCWINDOW_H